@@ -0,0 +1,159 @@
+/*
+ * Per-thread bump allocator for search scratch space
+ */
+
+#include "config.h"
+#include "arena.h"
+
+#include <glib.h>
+#include <string.h>
+
+#define ARENA_ALIGN 16
+#define ARENA_CHUNK_SIZE (256 * 1024)
+
+typedef struct _arenachunk {
+  struct _arenachunk *pacNext;
+  size_t cb;  /* usable bytes after the header */
+  size_t cbUsed;
+} arenachunk;
+
+struct _arena {
+  arenachunk *pacFirst;
+  arenachunk *pacCurrent;
+  size_t cbInUse;
+  size_t cbPeak;
+  /* counts since the last reset, folded into asTotal by ArenaReset */
+  unsigned long long cAllocs;
+  unsigned long long cbAllocated;
+  unsigned long long cChunkAllocs;
+};
+
+static GMutex mtxStats;
+static arenastats asTotal;
+
+#define CHUNK_HEADER                                                           \
+  ((sizeof(arenachunk) + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1))
+#define CHUNK_DATA(pac) ((char *)(pac) + CHUNK_HEADER)
+
+static void ArenaFree(gpointer p) {
+  arena *pa = (arena *)p;
+  arenachunk *pac, *pacNext;
+
+  g_mutex_lock(&mtxStats);
+  for (pac = pa->pacFirst; pac; pac = pac->pacNext) {
+    asTotal.cChunks--;
+    asTotal.cbReserved -= pac->cb;
+  }
+  asTotal.cArenas--;
+  g_mutex_unlock(&mtxStats);
+
+  for (pac = pa->pacFirst; pac; pac = pacNext) {
+    pacNext = pac->pacNext;
+    g_free(pac);
+  }
+  g_free(pa);
+}
+
+static GPrivate privArena = G_PRIVATE_INIT(ArenaFree);
+
+extern arena *ArenaGet(void) {
+  arena *pa = (arena *)g_private_get(&privArena);
+
+  if (!pa) {
+    pa = g_new0(arena, 1);
+    g_private_set(&privArena, pa);
+    g_mutex_lock(&mtxStats);
+    asTotal.cArenas++;
+    g_mutex_unlock(&mtxStats);
+  }
+  return pa;
+}
+
+static arenachunk *NewChunk(arena *pa, size_t cbMin) {
+  size_t cb = MAX(cbMin, (size_t)ARENA_CHUNK_SIZE);
+  arenachunk *pac = (arenachunk *)g_malloc(CHUNK_HEADER + cb);
+
+  pac->pacNext = NULL;
+  pac->cb = cb;
+  pac->cbUsed = 0;
+  pa->cChunkAllocs++;
+
+  g_mutex_lock(&mtxStats);
+  asTotal.cChunks++;
+  asTotal.cbReserved += cb;
+  g_mutex_unlock(&mtxStats);
+
+  return pac;
+}
+
+extern void *ArenaAlloc(arena *pa, size_t cb) {
+  arenachunk *pac;
+  void *p;
+
+  cb = (cb + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+
+  if (!pa->pacCurrent && pa->pacFirst) {
+    pa->pacCurrent = pa->pacFirst;
+    pa->pacCurrent->cbUsed = 0;
+  }
+  pac = pa->pacCurrent;
+
+  /* Reuse the chunks kept from earlier calls in order, then append. */
+  while (!pac || pac->cb - pac->cbUsed < cb) {
+    if (pac && pac->pacNext) {
+      pac = pac->pacNext;
+      pac->cbUsed = 0;
+    } else if (pac)
+      pac = pac->pacNext = NewChunk(pa, cb);
+    else
+      pac = pa->pacFirst = NewChunk(pa, cb);
+  }
+  pa->pacCurrent = pac;
+
+  p = CHUNK_DATA(pac) + pac->cbUsed;
+  pac->cbUsed += cb;
+  pa->cbInUse += cb;
+  if (pa->cbInUse > pa->cbPeak)
+    pa->cbPeak = pa->cbInUse;
+  pa->cAllocs++;
+  pa->cbAllocated += cb;
+
+  return p;
+}
+
+extern void ArenaReset(arena *pa) {
+  g_mutex_lock(&mtxStats);
+  asTotal.cAllocs += pa->cAllocs;
+  asTotal.cbAllocated += pa->cbAllocated;
+  asTotal.cChunkAllocs += pa->cChunkAllocs;
+  asTotal.cResets++;
+  if (pa->cbPeak > asTotal.cbPeak)
+    asTotal.cbPeak = pa->cbPeak;
+  g_mutex_unlock(&mtxStats);
+
+  pa->cAllocs = pa->cbAllocated = pa->cChunkAllocs = 0;
+  pa->cbInUse = pa->cbPeak = 0;
+  pa->pacCurrent = NULL;
+}
+
+extern void ArenaMark(arena *pa, arenamark *pam) {
+  pam->pac = pa->pacCurrent;
+  pam->cbUsed = pa->pacCurrent ? pa->pacCurrent->cbUsed : 0;
+  pam->cbInUse = pa->cbInUse;
+}
+
+extern void ArenaRelease(arena *pa, const arenamark *pam) {
+  if (!pam->pac) {
+    ArenaReset(pa);
+    return;
+  }
+  pa->pacCurrent = pam->pac;
+  pa->pacCurrent->cbUsed = pam->cbUsed;
+  pa->cbInUse = pam->cbInUse;
+}
+
+extern void ArenaGetStats(arenastats *pas) {
+  g_mutex_lock(&mtxStats);
+  memcpy(pas, &asTotal, sizeof(arenastats));
+  g_mutex_unlock(&mtxStats);
+}
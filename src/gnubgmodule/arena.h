@@ -0,0 +1,64 @@
+/*
+ * Per-thread bump allocator for search scratch space
+ *
+ * Each thread that calls ArenaGet() owns one arena. Allocations are carved
+ * out of large chunks and are never freed individually; ArenaReset() drops
+ * everything at once and keeps the chunks for the next top-level call.
+ */
+
+#ifndef SRC_GNUBGMODULE_ARENA_H_
+#define SRC_GNUBGMODULE_ARENA_H_
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct _arena arena;
+
+typedef struct {
+  unsigned long long cArenas;      /* threads that have used an arena */
+  unsigned long long cChunks;      /* chunks currently held */
+  unsigned long long cbReserved;   /* bytes held in chunks */
+  unsigned long long cbPeak;       /* most bytes in use between two resets */
+  unsigned long long cAllocs;      /* ArenaAlloc calls */
+  unsigned long long cbAllocated;  /* bytes handed out by ArenaAlloc */
+  unsigned long long cResets;      /* ArenaReset calls */
+  unsigned long long cChunkAllocs; /* chunks obtained from the heap */
+} arenastats;
+
+/* The calling thread's arena, created on first use. */
+extern arena *ArenaGet(void);
+
+/* cb bytes, 16-byte aligned, valid until the next ArenaReset(pa). */
+extern void *ArenaAlloc(arena *pa, size_t cb);
+
+/* Release everything allocated from pa and publish its statistics. */
+extern void ArenaReset(arena *pa);
+
+/* A point to roll an arena back to. */
+typedef struct {
+  struct _arenachunk *pac; /* current chunk, NULL if the arena was reset */
+  size_t cbUsed;
+  size_t cbInUse;
+} arenamark;
+
+/* Remember the state of pa in *pam. */
+extern void ArenaMark(arena *pa, arenamark *pam);
+
+/*
+ * Release what was allocated from pa since *pam was taken and keep what
+ * was allocated before, so that calls can nest; a mark taken on a reset
+ * arena resets it. Marks are released in the reverse order of taking.
+ */
+extern void ArenaRelease(arena *pa, const arenamark *pam);
+
+/* Totals over all arenas, as of their last reset. */
+extern void ArenaGetStats(arenastats *pas);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // SRC_GNUBGMODULE_ARENA_H_
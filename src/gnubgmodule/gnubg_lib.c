@@ -4400,6 +4400,197 @@ void gnubg_lib_set_pkg_datadir(const char *path) {
   }
 }
 
+/* Worker threads to start with: the CPUs this process may run on, further
+ * limited by a cgroup v2 CPU quota so that containers are not
+ * oversubscribed. */
+static unsigned int DefaultThreadCount(void) {
+  unsigned int n = g_get_num_processors();
+#if defined(__linux__)
+  char *sz = NULL;
+  long nQuota, nPeriod;
+
+  if (g_file_get_contents("/sys/fs/cgroup/cpu.max", &sz, NULL, NULL)) {
+    if (sscanf(sz, "%ld %ld", &nQuota, &nPeriod) == 2 && nQuota > 0 &&
+        nPeriod > 0)
+      n = MIN(n, (unsigned int)((nQuota + nPeriod - 1) / nPeriod));
+    g_free(sz);
+  }
+#endif
+  return MAX(1u, MIN(n, (unsigned int)MAX_NUMTHREADS));
+}
+
+/* The match state of a new session, taken once initialisation is done. */
+static matchstate msInitial;
+
+/*
+ * The state of one Python session (gnubg.Engine): the match with its games
+ * and the settings that commands change. The engine works on the globals,
+ * so a session is swapped with them while one of its calls runs.
+ */
+struct sessionstate {
+  matchstate ms;
+  matchinfo mi;
+  listOLD lMatch;
+  listOLD *plGame, *plLastMove;
+  /* set cube use, set jacoby, set crawford, set beavers, set matchlength */
+  int fCubeUse, fJacoby, fAutoCrawford;
+  unsigned int nBeavers, nDefaultLength;
+  /* set matchequitytable, set invert matchequitytable */
+  float aafMET[MAXSCORE][MAXSCORE];
+  float aafMETPostCrawford[2][MAXSCORE];
+  metinfo miCurrent;
+  int fInvertMET;
+  /* set rng, set seed */
+  rng rngCurrent;
+  rngcontext *rngctxCurrent;
+  /* set player */
+  player ap[2];
+  rolloutcontext rcRollout;
+  evalsetup esEvalChequer, esEvalCube, esAnalysisChequer, esAnalysisCube;
+  movefilter aamfEval[MAX_FILTER_PLIES][MAX_FILTER_PLIES];
+  movefilter aamfAnalysis[MAX_FILTER_PLIES][MAX_FILTER_PLIES];
+  /* set analysis ... */
+  int fAnalyseCube, fAnalyseDice, fAnalyseMove, afAnalysePlayers[2];
+  evalcontext ecLuck;
+  float arSkillLevel[G_N_ELEMENTS(arSkillLevel)];
+  float arLuckLevel[G_N_ELEMENTS(arLuckLevel)];
+};
+
+/* A session with no match and a copy of the current settings. Its dice
+ * come from a new generator of the current kind, seeded afresh. */
+sessionstate *gnubg_lib_session_new(void) {
+  sessionstate *pss = g_new0(sessionstate, 1);
+
+  pss->ms = msInitial;
+  ListCreate(&pss->lMatch);
+  pss->fCubeUse = fCubeUse;
+  pss->fJacoby = fJacoby;
+  pss->fAutoCrawford = fAutoCrawford;
+  pss->nBeavers = nBeavers;
+  pss->nDefaultLength = nDefaultLength;
+  memcpy(pss->aafMET, aafMET, sizeof(aafMET));
+  memcpy(pss->aafMETPostCrawford, aafMETPostCrawford,
+         sizeof(aafMETPostCrawford));
+  pss->miCurrent = miCurrent;
+  pss->miCurrent.szName = g_strdup(miCurrent.szName);
+  pss->miCurrent.szFileName = g_strdup(miCurrent.szFileName);
+  pss->miCurrent.szDescription = g_strdup(miCurrent.szDescription);
+  pss->fInvertMET = fInvertMET;
+  pss->rngCurrent = rngCurrent;
+  if (!(pss->rngctxCurrent = InitRNG(NULL, NULL, TRUE, pss->rngCurrent))) {
+    pss->rngCurrent = RNG_MERSENNE;
+    pss->rngctxCurrent = InitRNG(NULL, NULL, TRUE, pss->rngCurrent);
+  }
+  memcpy(pss->ap, ap, sizeof(ap));
+  pss->rcRollout = rcRollout;
+  pss->esEvalChequer = esEvalChequer;
+  pss->esEvalCube = esEvalCube;
+  pss->esAnalysisChequer = esAnalysisChequer;
+  pss->esAnalysisCube = esAnalysisCube;
+  memcpy(pss->aamfEval, aamfEval, sizeof(aamfEval));
+  memcpy(pss->aamfAnalysis, aamfAnalysis, sizeof(aamfAnalysis));
+  pss->fAnalyseCube = fAnalyseCube;
+  pss->fAnalyseDice = fAnalyseDice;
+  pss->fAnalyseMove = fAnalyseMove;
+  memcpy(pss->afAnalysePlayers, afAnalysePlayers, sizeof(afAnalysePlayers));
+  pss->ecLuck = ecLuck;
+  memcpy(pss->arSkillLevel, arSkillLevel, sizeof(arSkillLevel));
+  memcpy(pss->arLuckLevel, arLuckLevel, sizeof(arLuckLevel));
+  return pss;
+}
+
+#define SWAP_VALUE(type, a, b)                                                 \
+  do {                                                                         \
+    type t_ = (a);                                                             \
+    (a) = (b);                                                                 \
+    (b) = t_;                                                                  \
+  } while (0)
+
+/* Exchange two arrays of the same type and size. */
+#define SWAP_ARRAY(a, b)                                                       \
+  do {                                                                         \
+    G_STATIC_ASSERT(sizeof(a) == sizeof(b));                                   \
+    SwapBytes((a), (b), sizeof(a));                                            \
+  } while (0)
+
+static void SwapBytes(void *pa, void *pb, size_t cb) {
+  unsigned char *a = pa, *b = pb;
+  unsigned char ab[256];
+
+  while (cb > 0) {
+    size_t n = MIN(cb, sizeof(ab));
+
+    memcpy(ab, a, n);
+    memcpy(a, b, n);
+    memcpy(b, ab, n);
+    a += n;
+    b += n;
+    cb -= n;
+  }
+}
+
+/* After list head pl has been moved from plOld, point its neighbours (or
+ * itself, if the list is empty) at the new address. */
+static void RelinkList(listOLD *pl, listOLD *plOld) {
+  if (pl->plNext == plOld) {
+    pl->plNext = pl->plPrev = pl;
+  } else {
+    pl->plNext->plPrev = pl;
+    pl->plPrev->plNext = pl;
+  }
+}
+
+/* Exchange pss with the globals. Calling it twice restores both. */
+void gnubg_lib_session_swap(sessionstate *pss) {
+  SWAP_VALUE(matchstate, ms, pss->ms);
+  SWAP_VALUE(matchinfo, mi, pss->mi);
+  SWAP_VALUE(listOLD, lMatch, pss->lMatch);
+  RelinkList(&lMatch, &pss->lMatch);
+  RelinkList(&pss->lMatch, &lMatch);
+  SWAP_VALUE(listOLD *, plGame, pss->plGame);
+  SWAP_VALUE(listOLD *, plLastMove, pss->plLastMove);
+  SWAP_VALUE(int, fCubeUse, pss->fCubeUse);
+  SWAP_VALUE(int, fJacoby, pss->fJacoby);
+  SWAP_VALUE(int, fAutoCrawford, pss->fAutoCrawford);
+  SWAP_VALUE(unsigned int, nBeavers, pss->nBeavers);
+  SWAP_VALUE(unsigned int, nDefaultLength, pss->nDefaultLength);
+  SWAP_ARRAY(aafMET, pss->aafMET);
+  SWAP_ARRAY(aafMETPostCrawford, pss->aafMETPostCrawford);
+  SWAP_VALUE(metinfo, miCurrent, pss->miCurrent);
+  SWAP_VALUE(int, fInvertMET, pss->fInvertMET);
+  SWAP_VALUE(rng, rngCurrent, pss->rngCurrent);
+  SWAP_VALUE(rngcontext *, rngctxCurrent, pss->rngctxCurrent);
+  SWAP_ARRAY(ap, pss->ap);
+  SWAP_VALUE(rolloutcontext, rcRollout, pss->rcRollout);
+  SWAP_VALUE(evalsetup, esEvalChequer, pss->esEvalChequer);
+  SWAP_VALUE(evalsetup, esEvalCube, pss->esEvalCube);
+  SWAP_VALUE(evalsetup, esAnalysisChequer, pss->esAnalysisChequer);
+  SWAP_VALUE(evalsetup, esAnalysisCube, pss->esAnalysisCube);
+  SWAP_ARRAY(aamfEval, pss->aamfEval);
+  SWAP_ARRAY(aamfAnalysis, pss->aamfAnalysis);
+  SWAP_VALUE(int, fAnalyseCube, pss->fAnalyseCube);
+  SWAP_VALUE(int, fAnalyseDice, pss->fAnalyseDice);
+  SWAP_VALUE(int, fAnalyseMove, pss->fAnalyseMove);
+  SWAP_ARRAY(afAnalysePlayers, pss->afAnalysePlayers);
+  SWAP_VALUE(evalcontext, ecLuck, pss->ecLuck);
+  SWAP_ARRAY(arSkillLevel, pss->arSkillLevel);
+  SWAP_ARRAY(arLuckLevel, pss->arLuckLevel);
+}
+
+/* Free pss and its match. Like gnubg_lib_session_swap, it uses the globals,
+ * so no other session may be swapped in. */
+void gnubg_lib_session_free(sessionstate *pss) {
+  gnubg_lib_session_swap(pss);
+  FreeMatch();
+  ClearMatch();
+  gnubg_lib_session_swap(pss);
+  free_rngctx(pss->rngctxCurrent);
+  g_free(pss->miCurrent.szName);
+  g_free(pss->miCurrent.szFileName);
+  g_free(pss->miCurrent.szDescription);
+  g_free(pss);
+}
+
 /* Minimal init for standalone Python module use (e.g. REST API).
  * Ensures neural nets and match equity are loaded so evaluate/findbestmove work. */
 void gnubg_lib_init_for_python(void) {
@@ -4424,6 +4615,8 @@ void gnubg_lib_init_for_python(void) {
   init_nets(0);
   glib_ext_init();
   MT_InitThreads();
+  MT_SetNumThreads(DefaultThreadCount());
+  msInitial = ms;
 }
 
 extern int GetManualDice(unsigned int anDice[2]) {
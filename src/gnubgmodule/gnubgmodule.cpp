@@ -1,14 +1,24 @@
 #define PY_SSIZE_T_CLEAN
 #include <Python.h>
 #include <algorithm>
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
 #include <cstring>
+#include <functional>
+#include <list>
+#include <mutex>
+#include <set>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 // Include glib and Windows headers before extern "C" so C++/template code in
 // them is not parsed with C linkage (fixes MinGW build: template with C
 // linkage, mmintrin.h __m64 errors).
 #include <glib.h>
+#include <glib/gstdio.h>  // g_unlink (for export_files)
 #if defined(_WIN32) || defined(WIN32) || defined(__MINGW32__)
 #include <windows.h>
 #include <winsock2.h>
@@ -16,29 +26,452 @@
 
 // Include GNUBG headers; wrap in extern "C" so C symbols link correctly.
 extern "C" {
+#include "config.h"  // MAX_NUMTHREADS
+#include "arena.h"  // ArenaGet, ArenaAlloc, ArenaMark, ArenaRelease
 #include "backgammon.h"  // Defines 'ms' (matchstate), 'msBoard', 'GAME_NONE', GetMatchStateCubeInfo
 #include "dice.h"       // RollDice, rngCurrent, rngctxCurrent
 #include "drawboard.h"  // FormatMove, ParseMove
 #include "eval.h"  // Evaluation functions, eq2mwc, mwc2eq, se_eq2mwc, se_mwc2eq
+#include "export.h"  // exsExport (for export_files)
 #include "gnubgmodule.h"
+#include "import.h"  // ImportMat, ImportSGG, ... (for import_bytes)
+#include "sgfparse.h"  // SGFParseSetInput (for import_bytes)
 #include "lib/gnubg-types.h"  // Defines 'TanBoard'
 #include "matchequity.h"      // aafMET, aafMETPostCrawford, MAXSCORE
 #include "matchid.h"      // posinfo, cubeinfo, MatchID, MatchIDFromMatchState
 #include "multithread.h"  // MT_SafeGet, MT_SafeSet (for command)
 #include "output.h"       // foutput_to_mem, szMemOutput (for show)
 #include "positionid.h"  // Position ID functions, PositionBearoff, PositionFromBearoff, Combination
+#include "rollout.h"  // RolloutGeneral, rolloutstat
+#include "trialrollout.h"  // TrialRollout, trialshard (sharded rollouts)
 }
 #include <cstdlib>  // std::getenv, setenv (POSIX)
 #include <cerrno>   // errno
 #include <climits>  // INT_MIN (for navigate)
 #include <csignal>  // SIGINT (for command)
+#include <cstdio>   // fmemopen, tmpfile (for import_bytes)
 #if defined(__linux__) || defined(__APPLE__) || defined(__FreeBSD__)
 #include <dlfcn.h>
 #endif
+#if defined(__linux__)
+#include <sched.h>  // sched_setaffinity (for set_threads)
+#endif
 #if defined(_WIN32) || defined(WIN32) || defined(__MINGW32__)
 #include <stdlib.h>  // _putenv_s
 #endif
 
+/* -------------------------------------------------------------------------
+ * Sessions
+ * ------------------------------------------------------------------------- */
+
+/*
+ * gnubg.Engine: a session of its own (match, games and the settings that
+ * commands change) plus the evalcontext and movefilters used by calls that
+ * are not given one. Calls made inside "with engine:" use it instead of the
+ * process-wide session.
+ */
+typedef struct {
+  PyObject_HEAD
+  sessionstate *pss;
+  evalcontext ec;
+  movefilter aamf[MAX_FILTER_PLIES][MAX_FILTER_PLIES];
+  unsigned long nMatchGeneration; /* see SessionMatchChanged */
+} EngineObject;
+
+/* Engines entered on this thread, innermost last. */
+static thread_local std::vector<EngineObject *> apengActive;
+
+/* The engine works on one set of globals, so calls that use session state
+ * take turns through mtxSession. */
+static GMutex mtxSession;
+static thread_local int cSessionDepth;
+static thread_local EngineObject *pengSession; /* swapped in by this thread */
+
+/* Sessions of deallocated engines, freed once no session is swapped in.
+ * Guarded by the GIL. */
+static std::vector<sessionstate *> apssRetired;
+
+/* Set while this thread runs a Python callback for a call in progress,
+ * such as analyse_match's or rollout's progress. The thread that made that call holds mtxSession
+ * and mtxEngineTasks until it ends, so calls that need either would wait
+ * for ever (or change the match under it); they raise RuntimeError instead.
+ */
+static thread_local int fInEngineCallback;
+
+/* TRUE, with RuntimeError set, inside an engine callback. */
+static int RefuseInEngineCallback(void) {
+  if (!fInEngineCallback)
+    return FALSE;
+  PyErr_SetString(PyExc_RuntimeError,
+                  "gnubg calls that use the session or the thread pool "
+                  "cannot be made from a callback of another gnubg call");
+  return TRUE;
+}
+
+/*
+ * Held for the duration of a call that reads or changes session state:
+ * waits for other threads' calls (with the GIL released) and swaps in the
+ * innermost engine entered on this thread, if any. Nested locks on one
+ * thread are no-ops. Inside an engine callback the lock is refused: Held()
+ * is FALSE, RuntimeError is set, and the caller must return at once.
+ */
+class SessionLock {
+ public:
+  SessionLock() : fHeld_(!RefuseInEngineCallback()) {
+    if (!fHeld_ || cSessionDepth++ > 0)
+      return;
+    if (!g_mutex_trylock(&mtxSession)) {
+      Py_BEGIN_ALLOW_THREADS
+      g_mutex_lock(&mtxSession);
+      Py_END_ALLOW_THREADS
+    }
+    if (!apengActive.empty()) {
+      pengSession = apengActive.back();
+      Py_INCREF(pengSession);
+      gnubg_lib_session_swap(pengSession->pss);
+    }
+  }
+
+  ~SessionLock() {
+    EngineObject *peng = pengSession;
+
+    if (!fHeld_ || --cSessionDepth > 0)
+      return;
+    if (peng)
+      gnubg_lib_session_swap(peng->pss);
+    pengSession = NULL;
+    for (sessionstate *pss : apssRetired)
+      gnubg_lib_session_free(pss);
+    apssRetired.clear();
+    g_mutex_unlock(&mtxSession);
+    Py_XDECREF(peng);
+  }
+
+  int Held() const { return fHeld_; }
+
+  SessionLock(const SessionLock &) = delete;
+  SessionLock &operator=(const SessionLock &) = delete;
+
+ private:
+  int fHeld_;
+};
+
+/* Defaults for calls given no evalcontext or movefilters; only valid while
+ * a SessionLock is held. */
+static const evalcontext *SessionEvalContext(void) {
+  return pengSession ? &pengSession->ec : &ecBasic;
+}
+
+static const movefilter *SessionMoveFilters(void) {
+  return pengSession ? &pengSession->aamf[0][0] : &defaultFilters[0][0];
+}
+
+/* Match generation of the process-wide session; engines keep their own. */
+static unsigned long nMatchGeneration;
+
+/* Bumped through SessionMatchChanged by every call that may change the
+ * records of the session's match, so that iter_records notices. Only valid
+ * while a SessionLock is held. */
+static unsigned long SessionMatchGeneration(void) {
+  return pengSession ? pengSession->nMatchGeneration : nMatchGeneration;
+}
+
+static void SessionMatchChanged(void) {
+  if (pengSession)
+    pengSession->nMatchGeneration++;
+  else
+    nMatchGeneration++;
+}
+
+/* -------------------------------------------------------------------------
+ * Cancellation
+ * ------------------------------------------------------------------------- */
+
+/* Results of CancelState. */
+#define CANCEL_REQUESTED 1
+#define CANCEL_DEADLINE 2
+
+/* Microseconds between checks of an InterruptWatch. */
+#define CANCEL_POLL 20000
+
+/*
+ * gnubg.CancelToken: cancelled by cancel() or once its deadline passes.
+ * Calls made inside "with token:" stop early when it is.
+ */
+typedef struct {
+  PyObject_HEAD
+  gint fCancelled;  /* set with g_atomic_int_set from any thread */
+  gint64 tDeadline; /* g_get_monotonic_time(), or 0 for none */
+} CancelTokenObject;
+
+typedef std::vector<CancelTokenObject *> canceltokens;
+
+/* Tokens entered on this thread. A call checks all of them, on whatever
+ * thread its work runs. */
+static thread_local canceltokens apctActive;
+
+static PyObject *pyCancelledError;
+
+/* 0 while work under the tokens act may go on, else CANCEL_REQUESTED or
+ * CANCEL_DEADLINE. */
+static int CancelState(const canceltokens &act) {
+  gint64 t = 0;
+
+  for (CancelTokenObject *pct : act) {
+    if (g_atomic_int_get(&pct->fCancelled))
+      return CANCEL_REQUESTED;
+    if (pct->tDeadline) {
+      if (!t)
+        t = g_get_monotonic_time();
+      if (t >= pct->tDeadline)
+        return CANCEL_DEADLINE;
+    }
+  }
+  return 0;
+}
+
+static void SetCancelError(int nState) {
+  if (nState == CANCEL_DEADLINE)
+    PyErr_SetString(PyExc_TimeoutError, "deadline passed");
+  else
+    PyErr_SetString(pyCancelledError, "cancelled");
+}
+
+/*
+ * Engine code stops on fInterrupt, which is process-wide: raised for one
+ * call, it makes every other call running engine code fail too. So a call
+ * that may raise it (for a token, or to stop on its progress callback)
+ * holds rwlInterrupt for writing, and every other call holds it for
+ * reading while it runs engine code (RunEngineTaskList). A SIGINT still
+ * reaches every call. Nested locks on one thread are no-ops; the lock is
+ * taken after the session lock and before mtxEngineTasks.
+ */
+static GRWLock rwlInterrupt;
+static thread_local int cInterruptDepth;
+
+class InterruptLock {
+ public:
+  /* Called with the GIL held. */
+  explicit InterruptLock(int fWrite) : fWrite_(fWrite), fHeld_(FALSE) {
+    if (cInterruptDepth++ > 0)
+      return;
+    if (!(fWrite_ ? g_rw_lock_writer_trylock(&rwlInterrupt)
+                  : g_rw_lock_reader_trylock(&rwlInterrupt))) {
+      Py_BEGIN_ALLOW_THREADS
+      if (fWrite_)
+        g_rw_lock_writer_lock(&rwlInterrupt);
+      else
+        g_rw_lock_reader_lock(&rwlInterrupt);
+      Py_END_ALLOW_THREADS
+    }
+    fHeld_ = TRUE;
+  }
+
+  ~InterruptLock() { Release(); }
+
+  void Release() {
+    if (fWrite_ < 0)
+      return;
+    cInterruptDepth--;
+    if (fHeld_) {
+      if (fWrite_)
+        g_rw_lock_writer_unlock(&rwlInterrupt);
+      else
+        g_rw_lock_reader_unlock(&rwlInterrupt);
+    }
+    fWrite_ = -1;
+  }
+
+  InterruptLock(const InterruptLock &) = delete;
+  InterruptLock &operator=(const InterruptLock &) = delete;
+
+ private:
+  int fWrite_, fHeld_;
+};
+
+/* SIGINTs seen by HandleCommandInterrupt, the handler gnubg.command
+ * installs. */
+static volatile sig_atomic_t nSigInt;
+
+static void HandleCommandInterrupt(int idSignal) {
+  nSigInt = nSigInt + 1;
+  HandleInterrupt(idSignal);
+}
+
+/*
+ * Engine code that stops on fInterrupt knows nothing about tokens. While an
+ * InterruptWatch is alive, a helper thread sets fInterrupt as soon as one of
+ * the calling thread's tokens is cancelled. It holds rwlInterrupt for
+ * writing if the call has tokens or fMayInterrupt says it raises fInterrupt
+ * itself, for reading otherwise. Finish() stops the watch and returns the
+ * CancelState that fired it (0 if none). If the watch set fInterrupt,
+ * Finish() clears it again, unless it was already set when the watch
+ * fired; a SIGINT that came in meanwhile is passed on to Python as
+ * KeyboardInterrupt rather than lost under the cancellation error.
+ */
+class InterruptWatch {
+ public:
+  explicit InterruptWatch(int fMayInterrupt = FALSE)
+      : act_(apctActive), lock_(!act_.empty() || fMayInterrupt),
+        pThread_(NULL), fStop_(FALSE), nState_(0), fWasSet_(FALSE),
+        nSigInt_(nSigInt) {
+    if (act_.empty())
+      return;
+    g_mutex_init(&mtx_);
+    g_cond_init(&cond_);
+    pThread_ = g_thread_new("gnubg-cancel", Watch, this);
+  }
+
+  ~InterruptWatch() { Finish(); }
+
+  int Finish() {
+    if (pThread_) {
+      g_mutex_lock(&mtx_);
+      fStop_ = TRUE;
+      g_cond_signal(&cond_);
+      g_mutex_unlock(&mtx_);
+      g_thread_join(pThread_);
+      pThread_ = NULL;
+      g_cond_clear(&cond_);
+      g_mutex_clear(&mtx_);
+      if (nState_ && nSigInt != nSigInt_) {
+        MT_SafeSet(&fInterrupt, FALSE);
+        PyErr_SetInterrupt();
+      } else if (nState_ && !fWasSet_)
+        MT_SafeSet(&fInterrupt, FALSE);
+    }
+    lock_.Release();
+    return nState_;
+  }
+
+  InterruptWatch(const InterruptWatch &) = delete;
+  InterruptWatch &operator=(const InterruptWatch &) = delete;
+
+ private:
+  static gpointer Watch(gpointer p) {
+    InterruptWatch *piw = (InterruptWatch *)p;
+
+    g_mutex_lock(&piw->mtx_);
+    while (!piw->fStop_) {
+      if ((piw->nState_ = CancelState(piw->act_)) != 0) {
+        piw->fWasSet_ = MT_SafeGet(&fInterrupt);
+        MT_SafeSet(&fInterrupt, TRUE);
+        break;
+      }
+      g_cond_wait_until(&piw->cond_, &piw->mtx_,
+                        g_get_monotonic_time() + CANCEL_POLL);
+    }
+    g_mutex_unlock(&piw->mtx_);
+    return NULL;
+  }
+
+  canceltokens act_;
+  InterruptLock lock_;
+  GMutex mtx_;
+  GCond cond_;
+  GThread *pThread_;
+  int fStop_, nState_, fWasSet_;
+  sig_atomic_t nSigInt_;
+};
+
+/*
+ * Exposed as: gnubg.CancelToken(timeout=None)
+ * A token that is cancelled by cancel() or, with timeout, that many seconds
+ * after it is made.
+ */
+static PyObject *CancelTokenNew(PyTypeObject *type, PyObject *args,
+                                PyObject *keywds) {
+  static const char *kwlist[] = {"timeout", NULL};
+  PyObject *pyTimeout = Py_None;
+  double rTimeout = 0.0;
+  CancelTokenObject *pct;
+
+  if (!PyArg_ParseTupleAndKeywords(args, keywds, "|O:CancelToken",
+                                   (char **)kwlist, &pyTimeout))
+    return NULL;
+  if (pyTimeout != Py_None) {
+    rTimeout = PyFloat_AsDouble(pyTimeout);
+    if (rTimeout == -1.0 && PyErr_Occurred())
+      return NULL;
+    if (!(rTimeout >= 0.0)) {
+      PyErr_SetString(PyExc_ValueError, "timeout must not be negative");
+      return NULL;
+    }
+  }
+  if (!(pct = (CancelTokenObject *)type->tp_alloc(type, 0)))
+    return NULL;
+  pct->fCancelled = FALSE;
+  pct->tDeadline = 0;
+  if (pyTimeout != Py_None)
+    pct->tDeadline =
+        g_get_monotonic_time() + MAX(1, (gint64)(rTimeout * 1e6));
+  return (PyObject *)pct;
+}
+
+static PyObject *CancelTokenCancel(PyObject *self, PyObject *args) {
+  (void)args;
+  g_atomic_int_set(&((CancelTokenObject *)self)->fCancelled, TRUE);
+  Py_RETURN_NONE;
+}
+
+static PyObject *CancelTokenCancelled(PyObject *self, PyObject *args) {
+  canceltokens act(1, (CancelTokenObject *)self);
+
+  (void)args;
+  return PyBool_FromLong(CancelState(act) != 0);
+}
+
+static PyObject *CancelTokenEnter(PyObject *self, PyObject *args) {
+  (void)args;
+  Py_INCREF(self);
+  apctActive.push_back((CancelTokenObject *)self);
+  Py_INCREF(self);
+  return self;
+}
+
+static PyObject *CancelTokenExit(PyObject *self, PyObject *args) {
+  (void)args;
+  if (apctActive.empty() || apctActive.back() != (CancelTokenObject *)self) {
+    PyErr_SetString(PyExc_RuntimeError,
+                    "token is not the innermost one entered on this thread");
+    return NULL;
+  }
+  apctActive.pop_back();
+  Py_DECREF(self);
+  Py_RETURN_FALSE;
+}
+
+static PyMethodDef CancelTokenMethods[] = {
+    {"cancel", CancelTokenCancel, METH_NOARGS,
+     "Cancel the calls made under this token, from any thread"},
+    {"cancelled", CancelTokenCancelled, METH_NOARGS,
+     "True once cancelled or past the deadline"},
+    {"__enter__", CancelTokenEnter, METH_NOARGS,
+     "Make gnubg calls on this thread stop when the token is cancelled"},
+    {"__exit__", CancelTokenExit, METH_VARARGS, "Stop using the token"},
+    {NULL, NULL, 0, NULL}};
+
+static PyTypeObject CancelTokenType = {PyVarObject_HEAD_INIT(NULL, 0)};
+
+/* Fill in CancelTokenType and make CancelledError; called once from module
+ * init. */
+static int InitCancelTokenType(void) {
+  CancelTokenType.tp_name = "gnubg.CancelToken";
+  CancelTokenType.tp_basicsize = sizeof(CancelTokenObject);
+  CancelTokenType.tp_flags = Py_TPFLAGS_DEFAULT;
+  CancelTokenType.tp_doc =
+      "CancelToken(timeout=None)\n"
+      "Inside 'with token:' gnubg calls on this thread stop early once the\n"
+      "token is cancelled, raising gnubg.CancelledError, or once timeout\n"
+      "seconds have passed, raising TimeoutError.";
+  CancelTokenType.tp_new = CancelTokenNew;
+  CancelTokenType.tp_methods = CancelTokenMethods;
+  if (!(pyCancelledError =
+            PyErr_NewException("gnubg.CancelledError", NULL, NULL)))
+    return -1;
+  return PyType_Ready(&CancelTokenType);
+}
+
 /* -------------------------------------------------------------------------
  * Helper Functions
  * ------------------------------------------------------------------------- */
@@ -64,6 +497,12 @@ static PyObject *BoardToPy(const TanBoard anBoard) {
   return b;
 }
 
+/* Helper: set dict key and decref value (steal reference) */
+static void DictSetItemSteal(PyObject *dict, const char *key, PyObject *val) {
+  if (PyDict_SetItemString(dict, key, val) == 0)
+    Py_DECREF(val);
+}
+
 /*
  * Ported from gnubgmodule.c: Board1ToPy
  * Converts a single board (25 points) to a Python tuple.
@@ -653,6 +1092,237 @@ PyToMoveFilters(PyObject *p,
   return 0;
 }
 
+/* -------------------------------------------------------------------------
+ * Result cache
+ * ------------------------------------------------------------------------- */
+
+/*
+ * Identifies one search: the position, the dice (unordered) and a hash of
+ * everything else the result depends on (cubeinfo, evalcontext,
+ * movefilters, top-k and, in match play, the match equity table). The
+ * variation and gammon prices are part of the cubeinfo; the networks and
+ * bearoff databases are loaded once.
+ */
+struct ResultCacheKey {
+  unsigned char auch[10];
+  unsigned char anDice[2];
+  uint64_t nContext;
+
+  bool operator==(const ResultCacheKey &o) const {
+    return memcmp(auch, o.auch, sizeof(auch)) == 0 &&
+           anDice[0] == o.anDice[0] && anDice[1] == o.anDice[1] &&
+           nContext == o.nContext;
+  }
+};
+
+/* 64-bit FNV-1a. */
+static uint64_t HashBytes(uint64_t h, const void *p, size_t cb) {
+  const unsigned char *pch = (const unsigned char *)p;
+
+  for (size_t i = 0; i < cb; ++i) {
+    h ^= pch[i];
+    h *= 0x100000001b3ULL;
+  }
+  return h;
+}
+
+struct ResultCacheKeyHash {
+  size_t operator()(const ResultCacheKey &k) const {
+    uint64_t h = HashBytes(0xcbf29ce484222325ULL, k.auch, sizeof(k.auch));
+    h = HashBytes(h, k.anDice, sizeof(k.anDice));
+    return (size_t)HashBytes(h, &k.nContext, sizeof(k.nContext));
+  }
+};
+
+/* Settings are hashed field by field; the structs have padding and
+ * bitfields. */
+static uint64_t HashCubeInfo(uint64_t h, const cubeinfo *pci) {
+  const int an[] = {pci->nCube,      pci->fCubeOwner, pci->fMove,
+                    pci->nMatchTo,   pci->anScore[0], pci->anScore[1],
+                    pci->fCrawford,  pci->fJacoby,    pci->fBeavers,
+                    (int)pci->bgv};
+
+  h = HashBytes(h, an, sizeof(an));
+  return HashBytes(h, pci->arGammonPrice, sizeof(pci->arGammonPrice));
+}
+
+/* The part of the match equity table a match to pci->nMatchTo can reach.
+ * It is hashed rather than versioned, as "set matchequitytable", "set
+ * invert matchequitytable" and Engine switches all replace it in place. */
+static uint64_t HashMET(uint64_t h, const cubeinfo *pci) {
+  const int n = MIN(pci->nMatchTo, MAXSCORE);
+
+  for (int i = 0; i < n; ++i)
+    h = HashBytes(h, aafMET[i], (size_t)n * sizeof(float));
+  for (int i = 0; i < 2 && n > 0; ++i)
+    h = HashBytes(h, aafMETPostCrawford[i], (size_t)n * sizeof(float));
+  return h;
+}
+
+static uint64_t HashEvalContext(uint64_t h, const evalcontext *pec) {
+  const int an[] = {(int)pec->fCubeful, (int)pec->nPlies,
+                    (int)pec->fUsePrune, (int)pec->fDeterministic};
+
+  h = HashBytes(h, an, sizeof(an));
+  return HashBytes(h, &pec->rNoise, sizeof(pec->rNoise));
+}
+
+static uint64_t
+HashMoveFilters(uint64_t h,
+                const movefilter aamf[MAX_FILTER_PLIES][MAX_FILTER_PLIES]) {
+  for (int i = 0; i < MAX_FILTER_PLIES; ++i)
+    for (int j = 0; j < MAX_FILTER_PLIES; ++j) {
+      const int an[] = {aamf[i][j].Accept, aamf[i][j].Extra};
+      h = HashBytes(h, an, sizeof(an));
+      h = HashBytes(h, &aamf[i][j].Threshold, sizeof(aamf[i][j].Threshold));
+    }
+  return h;
+}
+
+/*
+ * Build the cache key for a search. aamf may be NULL for plain
+ * evaluations and anDice NULL when no dice are involved. Returns FALSE if
+ * the result must not be cached (evaluation noise is drawn per call).
+ */
+static int MakeResultCacheKey(
+    ConstTanBoard anBoard, const int *anDice, const cubeinfo *pci,
+    const evalcontext *pec,
+    const movefilter (*aamf)[MAX_FILTER_PLIES], unsigned int k,
+    ResultCacheKey *pkey) {
+  oldpositionkey key;
+  uint64_t h = 0xcbf29ce484222325ULL;
+
+  if (pec->rNoise > 0.0f && !pec->fDeterministic)
+    return FALSE;
+
+  oldPositionKey(anBoard, &key);
+  memcpy(pkey->auch, key.auch, sizeof(pkey->auch));
+  pkey->anDice[0] = (unsigned char)(anDice ? MAX(anDice[0], anDice[1]) : 0);
+  pkey->anDice[1] = (unsigned char)(anDice ? MIN(anDice[0], anDice[1]) : 0);
+  h = HashCubeInfo(h, pci);
+  h = HashMET(h, pci);
+  h = HashEvalContext(h, pec);
+  if (aamf)
+    h = HashMoveFilters(h, aamf);
+  pkey->nContext = HashBytes(h, &k, sizeof(k));
+  return TRUE;
+}
+
+/*
+ * Bounded LRU map from ResultCacheKey to V. Capacity 0 disables it. The
+ * lock makes it safe to use from several threads.
+ */
+template <typename V> class ResultCache {
+public:
+  explicit ResultCache(size_t cCapacity) : cCapacity(cCapacity) {}
+
+  bool Lookup(const ResultCacheKey &key, V *pv) {
+    std::lock_guard<std::mutex> lock(mtx);
+    auto it = map.find(key);
+
+    if (it == map.end()) {
+      cMisses++;
+      return false;
+    }
+    lru.splice(lru.begin(), lru, it->second);
+    *pv = it->second->second;
+    cHits++;
+    return true;
+  }
+
+  void Insert(const ResultCacheKey &key, const V &v) {
+    std::lock_guard<std::mutex> lock(mtx);
+    auto it = map.find(key);
+
+    if (!cCapacity)
+      return;
+    if (it != map.end()) {
+      it->second->second = v;
+      lru.splice(lru.begin(), lru, it->second);
+      return;
+    }
+    lru.emplace_front(key, v);
+    map[key] = lru.begin();
+    Trim();
+  }
+
+  void SetCapacity(size_t n) {
+    std::lock_guard<std::mutex> lock(mtx);
+
+    cCapacity = n;
+    Trim();
+  }
+
+  void Clear() {
+    std::lock_guard<std::mutex> lock(mtx);
+
+    lru.clear();
+    map.clear();
+  }
+
+  /* {"size": i, "capacity": i, "hits": i, "misses": i, "evictions": i} */
+  PyObject *StatsToPy() {
+    std::lock_guard<std::mutex> lock(mtx);
+
+    return Py_BuildValue("{s:n,s:n,s:K,s:K,s:K}", "size", (Py_ssize_t)lru.size(),
+                         "capacity", (Py_ssize_t)cCapacity, "hits",
+                         (unsigned long long)cHits, "misses",
+                         (unsigned long long)cMisses, "evictions",
+                         (unsigned long long)cEvictions);
+  }
+
+private:
+  typedef std::list<std::pair<ResultCacheKey, V>> entrylist;
+
+  void Trim() {
+    while (lru.size() > cCapacity) {
+      map.erase(lru.back().first);
+      lru.pop_back();
+      cEvictions++;
+    }
+  }
+
+  std::mutex mtx;
+  entrylist lru;
+  std::unordered_map<ResultCacheKey, typename entrylist::iterator,
+                     ResultCacheKeyHash>
+      map;
+  size_t cCapacity;
+  uint64_t cHits = 0, cMisses = 0, cEvictions = 0;
+};
+
+#define RESULT_CACHE_DEFAULT_SIZE 256
+
+/* Sorted move lists from FindnSaveBestMoves (and the top-k search). */
+static ResultCache<std::vector<move>> rcMoves(RESULT_CACHE_DEFAULT_SIZE);
+/* GeneralEvaluationE outputs. */
+static ResultCache<std::array<float, NUM_ROLLOUT_OUTPUTS>>
+    rcEvals(RESULT_CACHE_DEFAULT_SIZE);
+
+/*
+ * Scratch space on this thread's arena for the rest of a block. Scopes nest:
+ * the outermost one resets the arena and inner ones (e.g. an engine task
+ * run inline on the calling thread) only release their own allocations.
+ */
+class ArenaScope {
+ public:
+  ArenaScope() : pa_(ArenaGet()) { ArenaMark(pa_, &am_); }
+
+  ~ArenaScope() { ArenaRelease(pa_, &am_); }
+
+  /* Uninitialised room for n objects of a trivially copyable type. */
+  template <typename T> T *Alloc(size_t n) {
+    return (T *)ArenaAlloc(pa_, MAX(n, (size_t)1) * sizeof(T));
+  }
+
+  ArenaScope(const ArenaScope &) = delete;
+  ArenaScope &operator=(const ArenaScope &) = delete;
+
+ private:
+  arena *pa_;
+  arenamark am_;
+};
+
 /* -------------------------------------------------------------------------
  * Python Exposed Functions
  * ------------------------------------------------------------------------- */
@@ -662,6 +1332,9 @@ PyToMoveFilters(PyObject *p,
  * Exposed as: gnubg.board()
  */
 static PyObject *PythonBoard(PyObject *self, PyObject *args) {
+  SessionLock session;
+  if (!session.Held())
+    return NULL;
   // :board indicates no arguments are expected
   if (!PyArg_ParseTuple(args, ":board"))
     return NULL;
@@ -682,6 +1355,9 @@ static PyObject *PythonBoard(PyObject *self, PyObject *args) {
  * Returns position ID string from board.
  */
 static PyObject *PythonPositionID(PyObject *self, PyObject *args) {
+  SessionLock session;
+  if (!session.Held())
+    return NULL;
   PyObject *pyBoard = NULL;
   TanBoard anBoard;
 
@@ -704,6 +1380,9 @@ static PyObject *PythonPositionID(PyObject *self, PyObject *args) {
  * Returns board from position ID string.
  */
 static PyObject *PythonPositionFromID(PyObject *self, PyObject *args) {
+  SessionLock session;
+  if (!session.Held())
+    return NULL;
   char *sz = NULL;
   TanBoard anBoard;
 
@@ -729,6 +1408,9 @@ static PyObject *PythonPositionFromID(PyObject *self, PyObject *args) {
  * Returns position key as tuple of 10 ints.
  */
 static PyObject *PythonPositionKey(PyObject *self, PyObject *args) {
+  SessionLock session;
+  if (!session.Held())
+    return NULL;
   PyObject *pyBoard = NULL;
   TanBoard anBoard;
   oldpositionkey key;
@@ -795,6 +1477,9 @@ static PyObject *PythonPositionFromKey(PyObject *self, PyObject *args) {
  * Creates a cube info dictionary.
  */
 static PyObject *PythonCubeInfo(PyObject *self, PyObject *args) {
+  SessionLock session;
+  if (!session.Held())
+    return NULL;
   cubeinfo ci;
   // Default values for money game when no arguments provided
   int nCube = 1;
@@ -847,6 +1532,9 @@ static PyObject *PythonCubeInfo(PyObject *self, PyObject *args) {
  * Creates a position info dictionary.
  */
 static PyObject *PythonPosInfo(PyObject *self, PyObject *args) {
+  SessionLock session;
+  if (!session.Held())
+    return NULL;
   posinfo pi;
   // Default values when no arguments provided
   int fTurn = 0;                // Player 0's turn
@@ -1002,12 +1690,166 @@ static int PyToEvalContext(PyObject *p, evalcontext *pec) {
   return 0;
 }
 
+/*
+ * Convert a rolloutcontext dict (see gnubg.rolloutcontext()) on top of
+ * *prc. The keys "chequerplay" and "cubedecision" may also give evalcontext
+ * dicts, applied to both players, early and late. Returns 0 on success, -1
+ * on error.
+ */
+static int PyToRolloutContext(PyObject *p, rolloutcontext *prc) {
+  PyObject *pyKey, *pyValue;
+  Py_ssize_t iPos = 0;
+  static const char *aszKeys[] = {"cubeful",
+                                  "variance-reduction",
+                                  "initial-position",
+                                  "quasi-random-dice",
+                                  "late-eval",
+                                  "truncated-rollouts",
+                                  "n-truncation",
+                                  "truncate-bearoff2",
+                                  "truncate-bearoffOS",
+                                  "stop-on-std",
+                                  "trials",
+                                  "seed",
+                                  "minimum-games",
+                                  "stop-on-jsd",
+                                  "late-on-move-n",
+                                  "minimum-jsd-games",
+                                  "std-limit",
+                                  "jsd-limit",
+                                  "chequerplay",
+                                  "cubedecision",
+                                  NULL};
+
+  if (!PyDict_Check(p)) {
+    PyErr_SetString(PyExc_TypeError,
+                    "rolloutcontext must be a dict (see gnubg.rolloutcontext())");
+    return -1;
+  }
+
+  while (PyDict_Next(p, &iPos, &pyKey, &pyValue)) {
+    PyObject *utf8 = NULL;
+    const char *pchKey = NULL;
+    int iKey = -1;
+
+    utf8 = PyUnicode_AsUTF8String(pyKey);
+    if (!utf8)
+      return -1;
+    pchKey = PyBytes_AsString(utf8);
+    if (!pchKey) {
+      Py_DECREF(utf8);
+      return -1;
+    }
+
+    for (int i = 0; aszKeys[i]; ++i)
+      if (strcmp(aszKeys[i], pchKey) == 0) {
+        iKey = i;
+        break;
+      }
+    Py_DECREF(utf8);
+
+    if (iKey < 0) {
+      PyErr_SetString(
+          PyExc_ValueError,
+          "invalid key in rolloutcontext (see gnubg.rolloutcontext())");
+      return -1;
+    }
+
+    if (iKey < 16) {
+      long n;
+
+      if (!PyLong_Check(pyValue)) {
+        PyErr_SetString(
+            PyExc_ValueError,
+            "invalid value in rolloutcontext (see gnubg.rolloutcontext())");
+        return -1;
+      }
+      n = PyLong_AsLong(pyValue);
+      switch (iKey) {
+      case 0:
+        prc->fCubeful = n ? 1 : 0;
+        break;
+      case 1:
+        prc->fVarRedn = n ? 1 : 0;
+        break;
+      case 2:
+        prc->fInitial = n ? 1 : 0;
+        break;
+      case 3:
+        prc->fRotate = n ? 1 : 0;
+        break;
+      case 4:
+        prc->fLateEvals = n ? 1 : 0;
+        break;
+      case 5:
+        prc->fDoTruncate = n ? 1 : 0;
+        break;
+      case 6:
+        prc->nTruncate = (unsigned short)n;
+        break;
+      case 7:
+        prc->fTruncBearoff2 = n ? 1 : 0;
+        break;
+      case 8:
+        prc->fTruncBearoffOS = n ? 1 : 0;
+        break;
+      case 9:
+        prc->fStopOnSTD = n ? 1 : 0;
+        break;
+      case 10:
+        prc->nTrials = (unsigned int)n;
+        break;
+      case 11:
+        prc->nSeed = (unsigned long)n;
+        break;
+      case 12:
+        prc->nMinimumGames = (unsigned int)n;
+        break;
+      case 13:
+        prc->fStopOnJsd = n ? 1 : 0;
+        break;
+      case 14:
+        prc->nLate = (unsigned short)n;
+        break;
+      default:
+        prc->nMinimumJsdGames = (unsigned int)n;
+        break;
+      }
+    } else if (iKey < 18) {
+      if (!PyFloat_Check(pyValue) && !PyLong_Check(pyValue)) {
+        PyErr_SetString(
+            PyExc_ValueError,
+            "invalid value in rolloutcontext (see gnubg.rolloutcontext())");
+        return -1;
+      }
+      if (iKey == 16)
+        prc->rStdLimit = (float)PyFloat_AsDouble(pyValue);
+      else
+        prc->rJsdLimit = (float)PyFloat_AsDouble(pyValue);
+    } else {
+      evalcontext ec = iKey == 18 ? prc->aecChequer[0] : prc->aecCube[0];
+
+      if (PyToEvalContext(pyValue, &ec) != 0)
+        return -1;
+      for (int i = 0; i < 2; ++i)
+        if (iKey == 18)
+          prc->aecChequer[i] = prc->aecChequerLate[i] = ec;
+        else
+          prc->aecCube[i] = prc->aecCubeLate[i] = ec;
+    }
+  }
+  return 0;
+}
+
 /*
  * Exposed as: gnubg.evaluate([board], [cubeinfo], [evalcontext])
  * Evaluate position; returns tuple of 6 floats (win, wingammon, winbackgammon,
  * losegammon, losebackgammon, equity).
  */
 static PyObject *PythonEvaluate(PyObject *self, PyObject *args) {
+  SessionLock session;
+  if (!session.Held())
+    return NULL;
   PyObject *pyBoard = NULL;
   PyObject *pyCubeInfo = NULL;
   PyObject *pyEvalContext = NULL;
@@ -1019,7 +1861,7 @@ static PyObject *PythonEvaluate(PyObject *self, PyObject *args) {
   (void)self;
   memcpy(anBoard, msBoard(), sizeof(TanBoard));
   GetMatchStateCubeInfo(&ci, &ms);
-  memcpy(&ec, &ecBasic, sizeof(evalcontext));
+  memcpy(&ec, SessionEvalContext(), sizeof(evalcontext));
 
   if (!PyArg_ParseTuple(args, "|OOO:evaluate", &pyBoard, &pyCubeInfo,
                         &pyEvalContext))
@@ -1034,11 +1876,43 @@ static PyObject *PythonEvaluate(PyObject *self, PyObject *args) {
   if (pyEvalContext && PyToEvalContext(pyEvalContext, &ec) != 0)
     return NULL;
 
-  if (GeneralEvaluationE(arOutput, (ConstTanBoard)anBoard, &ci, &ec) < 0) {
-    PyErr_SetString(PyExc_RuntimeError, "EvaluatePosition failed");
+  /* A 0-ply evaluation may end before the watch first looks. */
+  int nCancel = CancelState(apctActive);
+
+  if (nCancel) {
+    SetCancelError(nCancel);
     return NULL;
   }
 
+  ResultCacheKey key;
+  std::array<float, NUM_ROLLOUT_OUTPUTS> aOutput;
+  int fCache =
+      MakeResultCacheKey((ConstTanBoard)anBoard, NULL, &ci, &ec, NULL, 0, &key);
+
+  if (fCache && rcEvals.Lookup(key, &aOutput)) {
+    std::copy(aOutput.begin(), aOutput.end(), arOutput);
+  } else {
+    InterruptWatch iw;
+    int ret;
+
+    Py_BEGIN_ALLOW_THREADS
+    ret = GeneralEvaluationE(arOutput, (ConstTanBoard)anBoard, &ci, &ec);
+    Py_END_ALLOW_THREADS
+
+    if ((nCancel = iw.Finish()) != 0) {
+      SetCancelError(nCancel);
+      return NULL;
+    }
+    if (ret < 0) {
+      PyErr_SetString(PyExc_RuntimeError, "EvaluatePosition failed");
+      return NULL;
+    }
+    if (fCache) {
+      std::copy(arOutput, arOutput + NUM_ROLLOUT_OUTPUTS, aOutput.begin());
+      rcEvals.Insert(key, aOutput);
+    }
+  }
+
   return Py_BuildValue("(ffffff)", (double)arOutput[0], (double)arOutput[1],
                        (double)arOutput[2], (double)arOutput[3],
                        (double)arOutput[4], (double)arOutput[5]);
@@ -1050,6 +1924,9 @@ static PyObject *PythonEvaluate(PyObject *self, PyObject *args) {
  * ...) 1-based, or empty tuple if no move.
  */
 static PyObject *PythonFindBestMove(PyObject *self, PyObject *args) {
+  SessionLock session;
+  if (!session.Held())
+    return NULL;
   PyObject *pyBoard = NULL;
   PyObject *pyCubeInfo = NULL;
   PyObject *pyEvalContext = NULL;
@@ -1065,8 +1942,8 @@ static PyObject *PythonFindBestMove(PyObject *self, PyObject *args) {
   (void)self;
   memcpy(anBoard, msBoard(), sizeof(TanBoard));
   GetMatchStateCubeInfo(&ci, &ms);
-  memcpy(&ec, &ecBasic, sizeof(evalcontext));
-  memcpy(aamf, defaultFilters, sizeof(aamf));
+  memcpy(&ec, SessionEvalContext(), sizeof(evalcontext));
+  memcpy(aamf, SessionMoveFilters(), sizeof(aamf));
 
   if (!PyArg_ParseTuple(args, "|OOOOO:findbestmove", &pyBoard, &pyCubeInfo,
                         &pyEvalContext, &pyDice, &pyMoveFilters))
@@ -1099,7 +1976,19 @@ static PyObject *PythonFindBestMove(PyObject *self, PyObject *args) {
   if (pyMoveFilters && PyToMoveFilters(pyMoveFilters, aamf) != 0)
     return NULL;
 
-  if (FindBestMove(anMove, anDice[0], anDice[1], anBoard, &ci, &ec, aamf) < 0) {
+  InterruptWatch iw;
+  int ret;
+
+  Py_BEGIN_ALLOW_THREADS
+  ret = FindBestMove(anMove, anDice[0], anDice[1], anBoard, &ci, &ec, aamf);
+  Py_END_ALLOW_THREADS
+  int nCancel = iw.Finish();
+
+  if (nCancel) {
+    SetCancelError(nCancel);
+    return NULL;
+  }
+  if (ret < 0) {
     PyErr_SetString(PyExc_RuntimeError, "FindBestMove failed");
     return NULL;
   }
@@ -1121,6 +2010,9 @@ static PyObject *PythonFindBestMove(PyObject *self, PyObject *args) {
  * ordered by score descending (best first). Best move is moves[0]["move"].
  */
 static PyObject *PythonFindBestMoves(PyObject *self, PyObject *args) {
+  SessionLock session;
+  if (!session.Held())
+    return NULL;
   PyObject *pyBoard = NULL;
   PyObject *pyCubeInfo = NULL;
   PyObject *pyEvalContext = NULL;
@@ -1131,13 +2023,15 @@ static PyObject *PythonFindBestMoves(PyObject *self, PyObject *args) {
   evalcontext ec;
   movefilter aamf[MAX_FILTER_PLIES][MAX_FILTER_PLIES];
   movelist ml;
+  move *amFree = NULL; /* ml.amMoves when it came from FindnSaveBestMoves */
   int anDice[2] = {0, 0};
+  ArenaScope scope;
 
   (void)self;
   memcpy(anBoard, msBoard(), sizeof(TanBoard));
   GetMatchStateCubeInfo(&ci, &ms);
-  memcpy(&ec, &ecBasic, sizeof(evalcontext));
-  memcpy(aamf, defaultFilters, sizeof(aamf));
+  memcpy(&ec, SessionEvalContext(), sizeof(evalcontext));
+  memcpy(aamf, SessionMoveFilters(), sizeof(aamf));
 
   if (!PyArg_ParseTuple(args, "|OOOOO:findbestmoves", &pyBoard, &pyCubeInfo,
                         &pyEvalContext, &pyDice, &pyMoveFilters))
@@ -1170,869 +2064,3677 @@ static PyObject *PythonFindBestMoves(PyObject *self, PyObject *args) {
   if (pyMoveFilters && PyToMoveFilters(pyMoveFilters, aamf) != 0)
     return NULL;
 
-  if (FindnSaveBestMoves(&ml, anDice[0], anDice[1], (ConstTanBoard)anBoard,
-                        NULL, 0.0f, &ci, &ec, aamf) < 0) {
-    PyErr_SetString(PyExc_RuntimeError, "FindnSaveBestMoves failed");
-    return NULL;
-  }
+  ResultCacheKey key;
+  std::vector<move> amCached;
+  int fCache = MakeResultCacheKey((ConstTanBoard)anBoard, anDice, &ci, &ec,
+                                  aamf, 0, &key);
 
-  /* Build (score, move_tuple) pairs and sort by score descending */
-  std::vector<std::pair<float, std::vector<long>>> scored;
-  scored.reserve(ml.cMoves);
-  for (unsigned int i = 0; i < ml.cMoves; i++) {
-    const move *pm = &ml.amMoves[i];
-    std::vector<long> m;
-    for (int k = 0; k < 8 && pm->anMove[k] >= 0; k++)
-      m.push_back(pm->anMove[k] + 1);
-    scored.push_back(std::make_pair(pm->rScore, std::move(m)));
-  }
-  g_free(ml.amMoves);
+  if (fCache && rcMoves.Lookup(key, &amCached)) {
+    memset(&ml, 0, sizeof(ml));
+    ml.cMoves = (unsigned int)amCached.size();
+    ml.amMoves = amCached.data();
+  } else {
+    InterruptWatch iw;
+    int ret;
 
-  std::sort(scored.begin(), scored.end(),
-            [](const std::pair<float, std::vector<long>> &a,
-               const std::pair<float, std::vector<long>> &b) {
-              return a.first > b.first;
-            });
+    Py_BEGIN_ALLOW_THREADS
+    ret = FindnSaveBestMoves(&ml, anDice[0], anDice[1], (ConstTanBoard)anBoard,
+                             NULL, 0.0f, &ci, &ec, aamf);
+    Py_END_ALLOW_THREADS
+    int nCancel = iw.Finish();
 
-  PyObject *list = PyList_New(0);
-  if (!list)
-    return NULL;
-  for (const auto &p : scored) {
-    PyObject *moveTuple = PyTuple_New((Py_ssize_t)p.second.size());
-    if (!moveTuple) {
-      Py_DECREF(list);
+    if (nCancel) {
+      SetCancelError(nCancel);
       return NULL;
     }
-    for (size_t k = 0; k < p.second.size(); ++k)
-      PyTuple_SET_ITEM(moveTuple, (Py_ssize_t)k, PyLong_FromLong(p.second[k]));
-    PyObject *dict = Py_BuildValue("{s:O s:f}", "move", moveTuple, "score", p.first);
-    Py_DECREF(moveTuple);
-    if (!dict) {
-      Py_DECREF(list);
+    if (ret < 0) {
+      PyErr_SetString(PyExc_RuntimeError, "FindnSaveBestMoves failed");
       return NULL;
     }
-    if (PyList_Append(list, dict) != 0) {
-      Py_DECREF(dict);
-      Py_DECREF(list);
-      return NULL;
+    RefreshMoveList(&ml, NULL);
+    if (fCache)
+      rcMoves.Insert(key, std::vector<move>(ml.amMoves, ml.amMoves + ml.cMoves));
+    amFree = ml.amMoves;
+  }
+
+  /* Sort by score descending; ties keep the engine's order */
+  const move **apm = scope.Alloc<const move *>(ml.cMoves);
+  for (unsigned int i = 0; i < ml.cMoves; i++)
+    apm[i] = &ml.amMoves[i];
+  std::stable_sort(apm, apm + ml.cMoves, [](const move *a, const move *b) {
+    return a->rScore > b->rScore;
+  });
+
+  PyObject *list = PyList_New(0);
+  for (unsigned int i = 0; list && i < ml.cMoves; i++) {
+    const move *pm = apm[i];
+    Py_ssize_t cMove = 0;
+
+    while (cMove < 8 && pm->anMove[cMove] >= 0)
+      cMove++;
+    PyObject *moveTuple = PyTuple_New(cMove);
+    if (!moveTuple) {
+      Py_CLEAR(list);
+      break;
     }
-    Py_DECREF(dict);
+    for (Py_ssize_t k = 0; k < cMove; ++k)
+      PyTuple_SET_ITEM(moveTuple, k, PyLong_FromLong(pm->anMove[k] + 1));
+    PyObject *dict = Py_BuildValue("{s:O s:f}", "move", moveTuple, "score",
+                                   pm->rScore);
+    Py_DECREF(moveTuple);
+    if (!dict || PyList_Append(list, dict) != 0)
+      Py_CLEAR(list);
+    Py_XDECREF(dict);
   }
+  g_free(amFree);
   return list;
 }
 
-/*
- * Ported from gnubgmodule.c: PythonClassifyPosition
- * Exposed as: gnubg.classify(board, variant)
- * Classifies a backgammon position.
- */
-static PyObject *PythonClassifyPosition(PyObject *self, PyObject *args) {
-  PyObject *pyBoard = NULL;
-  TanBoard anBoard;
-  bgvariation iVariant = ms.bgv;
-
-  memcpy(anBoard, msBoard(), sizeof(TanBoard));
+/* -------------------------------------------------------------------------
+ * Engine task helpers
+ * ------------------------------------------------------------------------- */
 
-  if (!PyArg_ParseTuple(args, "|Oi:classify", &pyBoard, &iVariant))
-    return NULL;
+/* MT_WaitForTasks waits on the process-wide task counters, so only one batch
+ * may be queued and waited on at a time. */
+static GMutex mtxEngineTasks;
 
-  if (pyBoard && !PyToBoard(pyBoard, anBoard)) {
-    PyErr_SetString(PyExc_TypeError, "Invalid board format");
-    return NULL;
-  }
+/*
+ * Queue one engine task per element of aData (each cbData bytes) and wait
+ * for them on the thread pool with the GIL released. Only for tasks that
+ * must each run on their own worker; use RunEngineTasks otherwise.
+ * Returns the MT_WaitForTasks result (-1 if any task failed).
+ */
+static int RunEngineTaskList(AsyncFun fun, void *aData, size_t cbData,
+                             size_t n) {
+  int ret;
 
-  if (iVariant >= NUM_VARIATIONS) {
-    PyErr_SetString(PyExc_ValueError, "Unknown variation");
-    return NULL;
+  if (RefuseInEngineCallback())
+    return -1;
+  InterruptLock lock(FALSE);
+  Py_BEGIN_ALLOW_THREADS
+  g_mutex_lock(&mtxEngineTasks);
+  for (size_t i = 0; i < n; ++i) {
+    Task *pt = (Task *)g_malloc(sizeof(Task));
+    pt->pLinkedTask = NULL;
+    pt->fun = fun;
+    pt->data = (char *)aData + i * cbData;
+    MT_AddTask(pt, TRUE);
   }
+  ret = MT_WaitForTasks(NULL, 100, FALSE);
+  g_mutex_unlock(&mtxEngineTasks);
+  Py_END_ALLOW_THREADS
 
-  return PyLong_FromLong(ClassifyPosition((ConstTanBoard)anBoard, iVariant));
+  return ret;
 }
 
+/* Scheduler counters, reported by gnubg.taskstats(). */
+static struct {
+  std::atomic<unsigned long long> cBatches, cTasks, cSteals;
+  std::atomic<unsigned long long> cStarts; /* worker starts on a batch */
+  std::atomic<long long> tWait, tWaitMax;  /* microseconds */
+} tsEngine;
+
 /*
- * Ported from gnubgmodule.c: PythonLuckRating
- * Exposed as: gnubg.luckrating(luck)
- * Converts luck value to rating (0-5).
+ * A RunEngineTasks batch. The tasks are split into one contiguous range per
+ * worker; a worker that has run its range steals the upper half of another
+ * worker's. A range [first, last) is packed into one word so that both
+ * taking and stealing from it are a single compare-and-swap.
  */
-static PyObject *PythonLuckRating(PyObject *self, PyObject *args) {
-  float r;
-  if (!PyArg_ParseTuple(args, "f:luckrating", &r))
-    return NULL;
+typedef struct {
+  AsyncFun fun;
+  char *aData;
+  size_t cbData;
+  size_t cWorkers;
+  std::atomic<guint64> *aRange;
+  gint64 tQueued;
+  const canceltokens *pact; /* of the calling thread */
+  std::atomic<int> nCancel; /* CancelState once the batch was stopped */
+} taskbatch;
+
+typedef struct {
+  taskbatch *ptb;
+  size_t iWorker;
+} taskworker;
+
+static inline guint64 TaskRange(guint32 iFirst, guint32 iLast) {
+  return ((guint64)iFirst << 32) | iLast;
+}
 
-  return PyLong_FromLong(getLuckRating(r));
+static inline guint32 TaskRangeFirst(guint64 r) { return (guint32)(r >> 32); }
+
+static inline guint32 TaskRangeLast(guint64 r) { return (guint32)r; }
+
+/* Take the first task of *par; returns FALSE if the range is empty. */
+static int TakeTask(std::atomic<guint64> *par, guint32 *pi) {
+  guint64 r = par->load();
+
+  do {
+    if (TaskRangeFirst(r) >= TaskRangeLast(r))
+      return FALSE;
+  } while (!par->compare_exchange_weak(
+      r, TaskRange(TaskRangeFirst(r) + 1, TaskRangeLast(r))));
+  *pi = TaskRangeFirst(r);
+  return TRUE;
 }
 
-/*
- * Ported from gnubgmodule.c: PythonErrorRating
- * Exposed as: gnubg.errorrating(error)
- * Converts error value to rating (0-7).
- */
-static PyObject *PythonErrorRating(PyObject *self, PyObject *args) {
-  float r;
-  if (!PyArg_ParseTuple(args, "f:errorrating", &r))
-    return NULL;
+/* Move the upper half of *parFrom, at least one task, to the empty *parTo. */
+static int StealTasks(std::atomic<guint64> *parFrom,
+                      std::atomic<guint64> *parTo) {
+  guint64 r = parFrom->load();
+  guint32 iMid;
+
+  do {
+    if (TaskRangeFirst(r) >= TaskRangeLast(r))
+      return FALSE;
+    iMid = TaskRangeFirst(r) + (TaskRangeLast(r) - TaskRangeFirst(r)) / 2;
+  } while (!parFrom->compare_exchange_weak(
+      r, TaskRange(TaskRangeFirst(r), iMid)));
+  parTo->store(TaskRange(iMid, TaskRangeLast(r)));
+  return TRUE;
+}
 
-  return PyLong_FromLong(GetRating(r));
+static void TaskWorker(void *p) {
+  taskworker *ptw = (taskworker *)p;
+  taskbatch *ptb = ptw->ptb;
+  std::atomic<guint64> *par = &ptb->aRange[ptw->iWorker];
+  long long tWait = g_get_monotonic_time() - ptb->tQueued;
+  long long tMax = tsEngine.tWaitMax.load();
+  unsigned long long cSteals = 0;
+  guint32 i;
+
+  tsEngine.cStarts += 1;
+  tsEngine.tWait += tWait;
+  while (tWait > tMax && !tsEngine.tWaitMax.compare_exchange_weak(tMax, tWait))
+    ;
+
+  for (;;) {
+    size_t j;
+
+    while (!ptb->nCancel && TakeTask(par, &i)) {
+      int nCancel;
+
+      ptb->fun(ptb->aData + i * ptb->cbData);
+      if ((nCancel = CancelState(*ptb->pact)) != 0)
+        ptb->nCancel = nCancel;
+    }
+    if (ptb->nCancel)
+      break;
+    for (j = 1; j < ptb->cWorkers; ++j)
+      if (StealTasks(&ptb->aRange[(ptw->iWorker + j) % ptb->cWorkers], par))
+        break;
+    if (j == ptb->cWorkers)
+      break;
+    ++cSteals;
+  }
+  tsEngine.cSteals += cSteals;
 }
 
 /*
- * Ported from gnubgmodule.c: PythonParseMove
- * Exposed as: gnubg.parsemove(string)
- * Parses a move string and returns move tuple.
+ * Run fun on each of the n consecutive elements of aData (each cbData
+ * bytes) on the thread pool with the GIL released. Only one engine task per
+ * worker is queued, whatever n is; the workers share the elements out
+ * among themselves by work stealing. With cMaxWorkers, at most that many
+ * workers of the pool are used.
+ * Returns the MT_WaitForTasks result (-1 if any task failed). If a token
+ * of the calling thread is cancelled, the workers stop taking elements and
+ * -1 is returned with the Python exception set; callers only set their own
+ * error if none is set.
  */
-static PyObject *PythonParseMove(PyObject *self, PyObject *args) {
-  PyObject *pyMoves;
-  char *pch;
-  char *sz;
-  int an[8];
-  int nummoves;
-  int movesidx;
-  int saved_errno;
-
-  if (!PyArg_ParseTuple(args, "s:parsemove", &pch))
-    return NULL;
-
-  sz = g_strdup(pch);
-  if (!sz) {
-    PyErr_SetString(PyExc_MemoryError, "Failed to allocate memory");
-    return NULL;
+static int RunEngineTasksOn(AsyncFun fun, void *aData, size_t cbData,
+                            size_t n, unsigned int cMaxWorkers) {
+  size_t cWorkers = MIN((size_t)MAX(1u, MT_GetNumThreads()), n);
+
+  if (cMaxWorkers)
+    cWorkers = MIN(cWorkers, (size_t)cMaxWorkers);
+  std::vector<std::atomic<guint64>> aRange(cWorkers);
+  std::vector<taskworker> atw(cWorkers);
+  taskbatch tb;
+  int ret;
+
+  g_assert(n <= G_MAXUINT32);
+  if (RefuseInEngineCallback())
+    return -1;
+  if (n == 0)
+    return 0;
+  if ((ret = CancelState(apctActive)) != 0) {
+    SetCancelError(ret);
+    return -1;
   }
-
-  // Convert dashes to slashes
-  for (char *p = sz; *p; p++)
-    if (*p == '-')
-      *p = '/';
-
-  saved_errno = errno;
-  errno = 0;
-  nummoves = ParseMove(sz, an);
-  g_free(sz);
-  errno = saved_errno;
-
-  if (nummoves < 0) {
-    // ParseMove sets errno on error (EINVAL = 22)
-    // The original implementation just returns NULL without setting an error,
-    // but we need to set an error for Python 3
-    // Note: ParseMove validates moves and may reject them for various reasons
-    PyErr_SetString(PyExc_ValueError, "Invalid move string");
-    return NULL;
+  for (size_t k = 0; k < cWorkers; ++k) {
+    aRange[k].store(TaskRange((guint32)(n * k / cWorkers),
+                              (guint32)(n * (k + 1) / cWorkers)));
+    atw[k].ptb = &tb;
+    atw[k].iWorker = k;
   }
+  tb.fun = fun;
+  tb.aData = (char *)aData;
+  tb.cbData = cbData;
+  tb.cWorkers = cWorkers;
+  tb.aRange = aRange.data();
+  tb.tQueued = g_get_monotonic_time();
+  tb.pact = &apctActive;
+  tb.nCancel = 0;
+
+  ret = RunEngineTaskList(TaskWorker, atw.data(), sizeof(taskworker),
+                          cWorkers);
+  tsEngine.cBatches += 1;
+  tsEngine.cTasks += n;
+  if (tb.nCancel) {
+    SetCancelError(tb.nCancel);
+    return -1;
+  }
+  return ret;
+}
 
-  if (!(pyMoves = PyTuple_New(nummoves)))
-    return NULL;
+/* RunEngineTasksOn with the whole pool. */
+static int RunEngineTasks(AsyncFun fun, void *aData, size_t cbData, size_t n) {
+  return RunEngineTasksOn(fun, aData, cbData, n, 0);
+}
 
-  for (movesidx = 0; movesidx < nummoves; movesidx++) {
-    PyObject *pyMove;
-    PyObject *pyMoveL;
-    PyObject *pyMoveR;
+/* -------------------------------------------------------------------------
+ * Threads
+ * ------------------------------------------------------------------------- */
 
-    pyMoveL = PyLong_FromLong(an[movesidx * 2]);
-    pyMoveR = PyLong_FromLong(an[movesidx * 2 + 1]);
+/* Seconds a pinning task waits for the other workers to pick up theirs. */
+#define PIN_TIMEOUT 5
 
-    if (!(pyMove = PyTuple_New(2)))
-      return NULL;
+/*
+ * Shared by the tasks of one pinning pass. Each task holds its worker until
+ * all cWorkers tasks are running, so every worker runs exactly one of them
+ * and pins itself to the next CPU of aiCPU.
+ */
+typedef struct {
+  GMutex mtx;
+  GCond cond;
+  unsigned int cWorkers, cRunning, iNext;
+  const int *aiCPU;
+  unsigned int cCPU;
+  int fFailed;
+} pinstate;
+
+typedef struct {
+  pinstate *pps;
+} pintask;
+
+/* Largest CPU number PinCurrentThread accepts, or -1 if it is unsupported. */
+static int MaxPinnableCPU(void) {
+#if defined(__linux__)
+  return CPU_SETSIZE - 1;
+#elif defined(_WIN32) || defined(WIN32) || defined(__MINGW32__)
+  return (int)(sizeof(DWORD_PTR) * CHAR_BIT) - 1;
+#else
+  return -1;
+#endif
+}
 
-    if (PyTuple_SetItem(pyMove, 0, pyMoveL) < 0)
-      return NULL;
-    if (PyTuple_SetItem(pyMove, 1, pyMoveR) < 0)
-      return NULL;
+static int PinCurrentThread(int iCPU) {
+#if defined(__linux__)
+  cpu_set_t set;
 
-    if (PyTuple_SetItem(pyMoves, movesidx, pyMove) < 0)
-      return NULL;
-  }
+  CPU_ZERO(&set);
+  CPU_SET(iCPU, &set);
+  return sched_setaffinity(0, sizeof(set), &set);
+#elif defined(_WIN32) || defined(WIN32) || defined(__MINGW32__)
+  return SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)1 << iCPU) ? 0
+                                                                          : -1;
+#else
+  (void)iCPU;
+  return -1;
+#endif
+}
 
-  return pyMoves;
+static void PinTask(void *p) {
+  pinstate *pps = ((pintask *)p)->pps;
+  gint64 tEnd = g_get_monotonic_time() + PIN_TIMEOUT * G_TIME_SPAN_SECOND;
+  int fOK = TRUE;
+  int iCPU;
+
+  g_mutex_lock(&pps->mtx);
+  iCPU = pps->aiCPU[pps->iNext++ % pps->cCPU];
+  if (++pps->cRunning == pps->cWorkers)
+    g_cond_broadcast(&pps->cond);
+  while (fOK && pps->cRunning < pps->cWorkers)
+    fOK = g_cond_wait_until(&pps->cond, &pps->mtx, tEnd);
+  if (!fOK || PinCurrentThread(iCPU) != 0)
+    pps->fFailed = TRUE;
+  g_mutex_unlock(&pps->mtx);
 }
 
 /*
- * Ported from gnubgmodule.c: PythonMoveTuple2String
- * Exposed as: gnubg.movetupletostring(move, board)
- * Converts a move tuple to a string representation.
+ * Exposed as: gnubg.set_threads(n, cpus=None)
+ * Resize the engine thread pool to n workers; waits for running engine work
+ * to finish first. With cpus, a sequence of CPU numbers, worker i is pinned
+ * to cpus[i % len(cpus)] (Linux and Windows only).
  */
-static PyObject *PythonMoveTuple2String(PyObject *self, PyObject *args) {
-  PyObject *pyBoard = NULL;
-  PyObject *pyMove = NULL;
-  char szMove[FORMATEDMOVESIZE];
-  signed int anMove[8];
-  TanBoard anBoard;
-
-  memset(anBoard, 0, sizeof(TanBoard));
-  memset(anMove, -1, sizeof(anMove));
+static PyObject *PythonSetThreads(PyObject *self, PyObject *args,
+                                  PyObject *keywds) {
+  static const char *kwlist[] = {"n", "cpus", NULL};
+  int n;
+  PyObject *pyCPUs = Py_None;
+  std::vector<int> aiCPU;
 
-  if (!PyArg_ParseTuple(args, "OO:movetupletostring", &pyMove, &pyBoard))
+  (void)self;
+  if (!PyArg_ParseTupleAndKeywords(args, keywds, "i|O:set_threads",
+                                   (char **)kwlist, &n, &pyCPUs))
     return NULL;
-
-  if (!pyMove || !pyBoard) {
-    PyErr_SetString(PyExc_TypeError,
-                    "Requires 2 arguments (move tuple, board)");
+  if (n < 1 || n > MAX_NUMTHREADS) {
+    PyErr_Format(PyExc_ValueError, "threads must be between 1 and %d",
+                 MAX_NUMTHREADS);
     return NULL;
   }
-
-  if (!PyToMove(pyMove, anMove)) {
-    PyErr_SetString(PyExc_TypeError, "Invalid move tuple");
-    return NULL;
+  if (pyCPUs != Py_None) {
+    PyObject *seq = PySequence_Fast(pyCPUs, "cpus must be a sequence");
+    if (!seq)
+      return NULL;
+    Py_ssize_t c = PySequence_Fast_GET_SIZE(seq);
+    for (Py_ssize_t i = 0; i < c; ++i) {
+      long iCPU = PyLong_AsLong(PySequence_Fast_GET_ITEM(seq, i));
+      if (iCPU == -1 && PyErr_Occurred()) {
+        Py_DECREF(seq);
+        return NULL;
+      }
+      if (iCPU < 0 || iCPU > MaxPinnableCPU()) {
+        Py_DECREF(seq);
+        if (MaxPinnableCPU() < 0)
+          PyErr_SetString(PyExc_NotImplementedError,
+                          "CPU pinning is not supported on this platform");
+        else
+          PyErr_Format(PyExc_ValueError, "CPU %ld out of range", iCPU);
+        return NULL;
+      }
+      aiCPU.push_back((int)iCPU);
+    }
+    Py_DECREF(seq);
+    if (aiCPU.empty()) {
+      PyErr_SetString(PyExc_ValueError, "cpus must not be empty");
+      return NULL;
+    }
   }
 
-  if (!PyToBoard(pyBoard, anBoard)) {
-    PyErr_SetString(PyExc_TypeError, "Invalid board format");
+  if (RefuseInEngineCallback())
     return NULL;
+  Py_BEGIN_ALLOW_THREADS
+  g_mutex_lock(&mtxEngineTasks);
+  MT_SetNumThreads((unsigned int)n);
+  g_mutex_unlock(&mtxEngineTasks);
+  Py_END_ALLOW_THREADS
+
+  if (!aiCPU.empty()) {
+    pinstate ps;
+    std::vector<pintask> apt((size_t)n);
+
+    g_mutex_init(&ps.mtx);
+    g_cond_init(&ps.cond);
+    ps.cWorkers = (unsigned int)n;
+    ps.cRunning = ps.iNext = 0;
+    ps.aiCPU = aiCPU.data();
+    ps.cCPU = (unsigned int)aiCPU.size();
+    ps.fFailed = FALSE;
+    for (pintask &pt : apt)
+      pt.pps = &ps;
+    int ret =
+        RunEngineTaskList(PinTask, apt.data(), sizeof(pintask), apt.size());
+    g_cond_clear(&ps.cond);
+    g_mutex_clear(&ps.mtx);
+    if (ret < 0 || ps.fFailed) {
+      PyErr_SetString(PyExc_OSError, "could not pin the engine threads");
+      return NULL;
+    }
   }
-
-  szMove[0] = '\0';
-  FormatMove(szMove, (ConstTanBoard)anBoard, anMove);
-
-  return PyUnicode_FromString(szMove);
+  Py_RETURN_NONE;
 }
 
 /*
- * Ported from gnubgmodule.c: PythonMET
- * Exposed as: gnubg.met([maxscore])
- * Returns match equity table (list of lists).
+ * Exposed as: gnubg.taskstats(reset=False)
+ * Scheduler counters since import or the last reset: batches and tasks run,
+ * steals (ranges of tasks moved between workers) and steal_rate (steals per
+ * task), and the mean and largest time in seconds from submitting a batch
+ * to a worker starting on it (queue_wait, queue_wait_max).
  */
-static PyObject *PythonMET(PyObject *self, PyObject *args) {
-  int n = ms.nMatchTo ? ms.nMatchTo : MAXSCORE;
-  if (!PyArg_ParseTuple(args, "|i:met", &n))
-    return NULL;
-  if (n < 0 || n > MAXSCORE) {
-    PyErr_SetString(PyExc_ValueError, "invalid match length");
+static PyObject *PythonTaskStats(PyObject *self, PyObject *args,
+                                 PyObject *keywds) {
+  static const char *kwlist[] = {"reset", NULL};
+  int fReset = FALSE;
+  unsigned long long cTasks = tsEngine.cTasks, cSteals = tsEngine.cSteals;
+  unsigned long long cStarts = tsEngine.cStarts;
+  long long tWait = tsEngine.tWait;
+
+  (void)self;
+  if (!PyArg_ParseTupleAndKeywords(args, keywds, "|p:taskstats",
+                                   (char **)kwlist, &fReset))
     return NULL;
+  PyObject *dict = Py_BuildValue(
+      "{s:K,s:K,s:K,s:d,s:d,s:d}", "batches",
+      (unsigned long long)tsEngine.cBatches, "tasks", cTasks, "steals",
+      cSteals, "steal_rate", cTasks ? (double)cSteals / cTasks : 0.0,
+      "queue_wait", cStarts ? tWait / 1e6 / cStarts : 0.0, "queue_wait_max",
+      tsEngine.tWaitMax / 1e6);
+  if (dict && fReset) {
+    tsEngine.cBatches = 0;
+    tsEngine.cTasks = 0;
+    tsEngine.cSteals = 0;
+    tsEngine.cStarts = 0;
+    tsEngine.tWait = 0;
+    tsEngine.tWaitMax = 0;
   }
+  return dict;
+}
 
-  PyObject *pyMET = PyList_New(3);
-  if (!pyMET)
-    return NULL;
+/*
+ * Exposed as: gnubg.get_threads()
+ * Number of engine worker threads.
+ */
+static PyObject *PythonGetThreads(PyObject *self, PyObject *args) {
+  (void)self;
+  (void)args;
+  return PyLong_FromUnsignedLong(MT_GetNumThreads());
+}
 
-  PyObject *pyList = METPre(aafMET, n);
-  if (!pyList) {
-    Py_DECREF(pyMET);
+/* -------------------------------------------------------------------------
+ * Engine objects
+ * ------------------------------------------------------------------------- */
+
+/*
+ * Exposed as: gnubg.Engine(evalcontext=None, movefilters=None)
+ * A new session with no match, a copy of the current settings (see
+ * struct sessionstate for which), its own dice generator, and the given
+ * defaults for calls without an evalcontext or movefilters.
+ */
+static PyObject *EngineNew(PyTypeObject *type, PyObject *args,
+                           PyObject *keywds) {
+  static const char *kwlist[] = {"evalcontext", "movefilters", NULL};
+  PyObject *pyEvalContext = Py_None, *pyMoveFilters = Py_None;
+  EngineObject *peng;
+
+  if (!PyArg_ParseTupleAndKeywords(args, keywds, "|OO:Engine",
+                                   (char **)kwlist, &pyEvalContext,
+                                   &pyMoveFilters))
     return NULL;
-  }
-  if (PyList_SetItem(pyMET, 0, pyList) < 0) {
-    Py_DECREF(pyMET);
+  if (!(peng = (EngineObject *)type->tp_alloc(type, 0)))
+    return NULL;
+  memcpy(&peng->ec, &ecBasic, sizeof(evalcontext));
+  memcpy(peng->aamf, defaultFilters, sizeof(peng->aamf));
+  if ((pyEvalContext != Py_None &&
+       PyToEvalContext(pyEvalContext, &peng->ec) != 0) ||
+      (pyMoveFilters != Py_None &&
+       PyToMoveFilters(pyMoveFilters, peng->aamf) != 0)) {
+    Py_DECREF(peng);
     return NULL;
   }
+  {
+    /* Copy the settings of the process-wide session. */
+    SessionLock session;
+    std::vector<EngineObject *> apeng;
 
-  for (int i = 0; i < 2; ++i) {
-    pyList = METRow(aafMETPostCrawford[i], n);
-    if (!pyList) {
-      Py_DECREF(pyMET);
+    if (!session.Held()) {
+      Py_DECREF(peng);
       return NULL;
     }
-    if (PyList_SetItem(pyMET, i + 1, pyList) < 0) {
-      Py_DECREF(pyMET);
-      return NULL;
+    apeng.swap(apengActive);
+    peng->pss = gnubg_lib_session_new();
+    apeng.swap(apengActive);
+  }
+  return (PyObject *)peng;
+}
+
+static void EngineDealloc(PyObject *self) {
+  EngineObject *peng = (EngineObject *)self;
+
+  if (peng->pss) {
+    apssRetired.push_back(peng->pss);
+    if (cSessionDepth == 0 && !fInEngineCallback) {
+      SessionLock session; /* frees it on release */
     }
   }
-  return pyMET;
+  Py_TYPE(self)->tp_free(self);
 }
 
-/*
- * Ported from gnubgmodule.c: PythonMatchID
- * Exposed as: gnubg.matchid([cubeinfo], [posinfo])
- * Returns match ID string.
- */
-static PyObject *PythonMatchID(PyObject *self, PyObject *args) {
-  PyObject *pyCubeInfo = NULL;
-  PyObject *pyPosInfo = NULL;
-  cubeinfo ci = {1,
-                 0,
-                 0,
-                 0,
-                 {0, 0},
-                 FALSE,
-                 TRUE,
-                 FALSE,
-                 {1.0f, 1.0f, 1.0f, 1.0f},
-                 VARIATION_STANDARD};
-  posinfo pi = {{0, 0}, 0, 0, 0, GAME_NONE};
+static PyObject *EngineEnter(PyObject *self, PyObject *args) {
+  (void)args;
+  Py_INCREF(self);
+  apengActive.push_back((EngineObject *)self);
+  Py_INCREF(self);
+  return self;
+}
 
-  if (!PyArg_ParseTuple(args, "|OO:matchid", &pyCubeInfo, &pyPosInfo))
+static PyObject *EngineExit(PyObject *self, PyObject *args) {
+  (void)args;
+  if (apengActive.empty() || apengActive.back() != (EngineObject *)self) {
+    PyErr_SetString(PyExc_RuntimeError,
+                    "engine is not the innermost one entered on this thread");
     return NULL;
+  }
+  apengActive.pop_back();
+  Py_DECREF(self);
+  Py_RETURN_FALSE;
+}
 
-  if (!pyCubeInfo && ms.gs == GAME_NONE) {
-    PyErr_SetString(PyExc_ValueError, "no current position available");
-    return NULL;
+static PyMethodDef EngineMethods[] = {
+    {"__enter__", EngineEnter, METH_NOARGS,
+     "Use this engine for gnubg calls on this thread; stateful calls of\n"
+     "all engines still take turns under one session lock"},
+    {"__exit__", EngineExit, METH_VARARGS,
+     "Go back to the engine used before"},
+    {NULL, NULL, 0, NULL}};
+
+static PyTypeObject EngineType = {PyVarObject_HEAD_INIT(NULL, 0)};
+
+/* Fill in EngineType; called once from module init. */
+static int InitEngineType(void) {
+  EngineType.tp_name = "gnubg.Engine";
+  EngineType.tp_basicsize = sizeof(EngineObject);
+  EngineType.tp_dealloc = EngineDealloc;
+  EngineType.tp_flags = Py_TPFLAGS_DEFAULT;
+  EngineType.tp_doc =
+      "Engine(evalcontext=None, movefilters=None)\n"
+      "A session of its own: match, games and settings. Inside\n"
+      "'with engine:' gnubg calls on this thread use it instead of the\n"
+      "process-wide session.\n"
+      "It starts with a copy of the current cube, Jacoby, Crawford,\n"
+      "beaver and match length settings, match equity table, players,\n"
+      "evaluation, rollout and analysis settings, and its own dice\n"
+      "generator of the current kind, freshly seeded.\n"
+      "All engines share one session lock: calls that read or change\n"
+      "session state run one at a time across every engine and thread,\n"
+      "though each call's work still uses the whole thread pool. Engines\n"
+      "isolate state; they do not run stateful calls in parallel.";
+  EngineType.tp_new = EngineNew;
+  EngineType.tp_methods = EngineMethods;
+  return PyType_Ready(&EngineType);
+}
+
+/* -------------------------------------------------------------------------
+ * Cube decisions
+ * ------------------------------------------------------------------------- */
+
+/* One cube decision, evaluated on a worker thread by CubeDecisionTask. */
+typedef struct {
+  TanBoard anBoard;
+  cubeinfo ci;
+  evalsetup es;
+  float aarOutput[2][NUM_ROLLOUT_OUTPUTS];
+  float arDouble[4];
+  cubedecision cd;
+  int fFailed;
+} cubedecisiontask;
+
+static void CubeDecisionTask(void *p) {
+  cubedecisiontask *pcd = (cubedecisiontask *)p;
+
+  if (GeneralCubeDecisionE(pcd->aarOutput, (ConstTanBoard)pcd->anBoard,
+                           &pcd->ci, &pcd->es.ec, &pcd->es) < 0) {
+    pcd->fFailed = TRUE;
+    MT_SetResultFailed();
+    return;
   }
-  if (pyCubeInfo && PyToCubeInfo(pyCubeInfo, &ci) != 0)
-    return NULL;
-  if (pyPosInfo && PyToPosInfo(pyPosInfo, &pi) != 0)
-    return NULL;
-  if (pyCubeInfo && !pyPosInfo) {
-    PyErr_SetString(PyExc_TypeError,
-                    "matchid: cubeinfo requires posinfo (see gnubg.matchid())");
-    return NULL;
+  pcd->cd = FindCubeDecision(pcd->arDouble, pcd->aarOutput, &pcd->ci);
+}
+
+/* Should the player on roll double / should the opponent take, for cd. */
+static void CubeActions(cubedecision cd, int *pfDouble, int *pfTake) {
+  switch (cd) {
+  case DOUBLE_TAKE:
+  case DOUBLE_BEAVER:
+  case REDOUBLE_TAKE:
+    *pfDouble = TRUE;
+    *pfTake = TRUE;
+    break;
+  case DOUBLE_PASS:
+  case REDOUBLE_PASS:
+    *pfDouble = TRUE;
+    *pfTake = FALSE;
+    break;
+  case TOOGOOD_PASS:
+  case TOOGOODRE_PASS:
+  case OPTIONAL_DOUBLE_PASS:
+  case OPTIONAL_REDOUBLE_PASS:
+    *pfDouble = FALSE;
+    *pfTake = FALSE;
+    break;
+  default:
+    *pfDouble = FALSE;
+    *pfTake = TRUE;
+    break;
   }
+}
 
-  if (!pyCubeInfo)
-    return PyUnicode_FromString(MatchIDFromMatchState(&ms));
-  return PyUnicode_FromString(MatchID((unsigned int *)pi.anDice, pi.fTurn,
-                                      pi.fResigned, pi.fDoubled, ci.fMove,
-                                      ci.fCubeOwner, ci.fCrawford, ci.nMatchTo,
-                                      ci.anScore, ci.nCube, ci.fJacoby, pi.gs));
+/*
+ * Converts a finished cube decision to
+ * {"nodouble": f, "take": f, "pass": f, "optimal": f, "decision": i,
+ *  "recommendation": s, "double": b, "takes": b, "probs": (f,f,f,f,f)}.
+ */
+static PyObject *CubeDecisionToPy(const cubedecisiontask *pcd) {
+  int fDouble, fTake;
+  const float *ar = pcd->aarOutput[0];
+
+  CubeActions(pcd->cd, &fDouble, &fTake);
+  return Py_BuildValue(
+      "{s:f,s:f,s:f,s:f,s:i,s:s,s:N,s:N,s:(fffff)}", "nodouble",
+      (double)pcd->arDouble[OUTPUT_NODOUBLE], "take",
+      (double)pcd->arDouble[OUTPUT_TAKE], "pass",
+      (double)pcd->arDouble[OUTPUT_DROP], "optimal",
+      (double)pcd->arDouble[OUTPUT_OPTIMAL], "decision", (int)pcd->cd,
+      "recommendation", GetCubeRecommendation(pcd->cd), "double",
+      PyBool_FromLong(fDouble), "takes", PyBool_FromLong(fTake), "probs",
+      (double)ar[0], (double)ar[1], (double)ar[2], (double)ar[3],
+      (double)ar[4]);
+}
+
+/* Fill pcd from optional Python board/cubeinfo and a parsed evalcontext. */
+static int PyToCubeDecision(PyObject *pyBoard, PyObject *pyCubeInfo,
+                            const evalcontext *pec, cubedecisiontask *pcd) {
+  memset(pcd, 0, sizeof(*pcd));
+  memcpy(pcd->anBoard, msBoard(), sizeof(TanBoard));
+  GetMatchStateCubeInfo(&pcd->ci, &ms);
+  pcd->es.et = EVAL_EVAL;
+  pcd->es.ec = *pec;
+
+  if (pyBoard && !PyToBoard(pyBoard, pcd->anBoard)) {
+    PyErr_SetString(PyExc_TypeError, "Invalid board format");
+    return -1;
+  }
+  if (pyCubeInfo && PyToCubeInfo(pyCubeInfo, &pcd->ci) != 0) {
+    if (!PyErr_Occurred())
+      PyErr_SetString(PyExc_TypeError,
+                      "cubeinfo must be a dict (see gnubg.cubeinfo())");
+    return -1;
+  }
+  return 0;
 }
 
 /*
- * Ported from gnubgmodule.c: PythonGnubgID
- * Exposed as: gnubg.gnubgid([board], [cubeinfo], [posinfo])
- * Returns GNUbgID string (positionid:matchid).
+ * Exposed as: gnubg.cubedecision([board], [cubeinfo], [evalcontext])
+ * Cube analysis for the player on roll; evalcontext defaults to the
+ * cube evaluation settings.
  */
-static PyObject *PythonGnubgID(PyObject *self, PyObject *args) {
+static PyObject *PythonCubeDecision(PyObject *self, PyObject *args) {
+  SessionLock session;
+  if (!session.Held())
+    return NULL;
   PyObject *pyBoard = NULL;
   PyObject *pyCubeInfo = NULL;
-  PyObject *pyPosInfo = NULL;
-  TanBoard anBoard;
-  cubeinfo ci;
-  posinfo pi;
-  char *szPosID = NULL;
-  char *szMatchID = NULL;
-  char *szGnubgID = NULL;
-  PyObject *pyRetVal = NULL;
+  PyObject *pyEvalContext = NULL;
+  evalcontext ec;
+  cubedecisiontask cd;
 
-  memcpy(anBoard, msBoard(), sizeof(TanBoard));
-  pi.anDice[0] = ms.anDice[0];
-  pi.anDice[1] = ms.anDice[1];
-  pi.fTurn = ms.fTurn;
-  pi.fResigned = ms.fResigned;
-  pi.fDoubled = ms.fDoubled;
-  pi.gs = ms.gs;
-  GetMatchStateCubeInfo(&ci, &ms);
+  (void)self;
+  memcpy(&ec, &GetEvalCube()->ec, sizeof(evalcontext));
 
-  if (!PyArg_ParseTuple(args, "|OOO:gnubgid", &pyBoard, &pyCubeInfo,
-                        &pyPosInfo))
+  if (!PyArg_ParseTuple(args, "|OOO:cubedecision", &pyBoard, &pyCubeInfo,
+                        &pyEvalContext))
     return NULL;
 
-  if (pyBoard && (!pyPosInfo || !pyCubeInfo)) {
-    PyErr_SetString(
-        PyExc_TypeError,
-        "gnubgid requires 0 or exactly 3 arguments (board, cubeinfo, posinfo). "
-        "See gnubg.board(), gnubg.cubeinfo(), gnubg.posinfo().");
+  if (pyEvalContext && PyToEvalContext(pyEvalContext, &ec) != 0)
     return NULL;
-  }
-  if (pyBoard && !PyToBoard(pyBoard, anBoard)) {
-    PyErr_SetString(PyExc_TypeError, "Invalid board format");
+  if (PyToCubeDecision(pyBoard, pyCubeInfo, &ec, &cd) != 0)
     return NULL;
-  }
-  if (!pyBoard && ms.gs == GAME_NONE) {
-    PyErr_SetString(PyExc_ValueError, "no current position available");
+
+  if (RunEngineTasks(CubeDecisionTask, &cd, sizeof(cd), 1) < 0 ||
+      cd.fFailed) {
+    if (!PyErr_Occurred())
+      PyErr_SetString(PyExc_RuntimeError, "GeneralCubeDecisionE failed");
     return NULL;
   }
-  if (pyCubeInfo && PyToCubeInfo(pyCubeInfo, &ci) != 0)
-    return NULL;
-  if (pyPosInfo && PyToPosInfo(pyPosInfo, &pi) != 0)
-    return NULL;
 
-  szPosID = g_strdup(PositionID((ConstTanBoard)anBoard));
-  szMatchID =
-      g_strdup(MatchID((unsigned int *)pi.anDice, pi.fTurn, pi.fResigned,
-                       pi.fDoubled, ci.fMove, ci.fCubeOwner, ci.fCrawford,
-                       ci.nMatchTo, ci.anScore, ci.nCube, ci.fJacoby, pi.gs));
-  szGnubgID = g_strjoin(":", szPosID, szMatchID, NULL);
-  pyRetVal = PyUnicode_FromString(szGnubgID);
-  g_free(szPosID);
-  g_free(szMatchID);
-  g_free(szGnubgID);
-  return pyRetVal;
+  return CubeDecisionToPy(&cd);
 }
 
 /*
- * Ported from gnubgmodule.c: PythonDiceRolls
- * Exposed as: gnubg.dicerolls(n)
- * Returns list of n dice rolls as tuples (die1, die2).
+ * Exposed as: gnubg.cubedecisions(positions, [evalcontext])
+ * positions is a sequence of (board, cubeinfo) pairs; all of them are
+ * evaluated on the thread pool with the GIL released.
  */
-static PyObject *PythonDiceRolls(PyObject *self, PyObject *args) {
-  long n;
-  unsigned int anDice[2];
-  if (!PyArg_ParseTuple(args, "l:dicerolls", &n))
+static PyObject *PythonCubeDecisions(PyObject *self, PyObject *args) {
+  SessionLock session;
+  if (!session.Held())
     return NULL;
-  if (n <= 0) {
-    PyErr_SetString(PyExc_ValueError, "number of rolls must be greater than 0");
+  PyObject *pyPositions = NULL;
+  PyObject *pyEvalContext = NULL;
+  PyObject *pySeq = NULL;
+  PyObject *list = NULL;
+  evalcontext ec;
+
+  (void)self;
+  memcpy(&ec, &GetEvalCube()->ec, sizeof(evalcontext));
+
+  if (!PyArg_ParseTuple(args, "O|O:cubedecisions", &pyPositions,
+                        &pyEvalContext))
+    return NULL;
+  if (pyEvalContext && PyToEvalContext(pyEvalContext, &ec) != 0)
     return NULL;
-  }
 
-  PyObject *pyDiceRolls = PyTuple_New((Py_ssize_t)n);
-  if (!pyDiceRolls)
+  pySeq = PySequence_Fast(pyPositions,
+                          "positions must be a sequence of (board, cubeinfo)");
+  if (!pySeq)
     return NULL;
 
-  for (Py_ssize_t idx = 0; idx < n; ++idx) {
-    RollDice(anDice, &rngCurrent, rngctxCurrent);
-    PyObject *pyDie1 = PyLong_FromLong(anDice[0]);
-    PyObject *pyDie2 = PyLong_FromLong(anDice[1]);
-    if (!pyDie1 || !pyDie2) {
-      Py_XDECREF(pyDie1);
-      Py_XDECREF(pyDie2);
-      Py_DECREF(pyDiceRolls);
+  Py_ssize_t n = PySequence_Fast_GET_SIZE(pySeq);
+  std::vector<cubedecisiontask> acd((size_t)n);
+  for (Py_ssize_t i = 0; i < n; ++i) {
+    PyObject *pyPos = PySequence_Fast_GET_ITEM(pySeq, i);
+    if (!PyTuple_Check(pyPos) || PyTuple_GET_SIZE(pyPos) != 2) {
+      PyErr_SetString(PyExc_TypeError,
+                      "positions must be a sequence of (board, cubeinfo)");
+      Py_DECREF(pySeq);
       return NULL;
     }
-    PyObject *pyDiceRoll = PyTuple_Pack(2, pyDie1, pyDie2);
-    Py_DECREF(pyDie1);
-    Py_DECREF(pyDie2);
-    if (!pyDiceRoll) {
-      Py_DECREF(pyDiceRolls);
+    if (PyToCubeDecision(PyTuple_GET_ITEM(pyPos, 0), PyTuple_GET_ITEM(pyPos, 1),
+                         &ec, &acd[(size_t)i]) != 0) {
+      Py_DECREF(pySeq);
       return NULL;
     }
-    if (PyTuple_SetItem(pyDiceRolls, idx, pyDiceRoll) < 0) {
-      Py_DECREF(pyDiceRolls);
+  }
+  Py_DECREF(pySeq);
+
+  if (n > 0 &&
+      RunEngineTasks(CubeDecisionTask, acd.data(), sizeof(cubedecisiontask),
+                     (size_t)n) < 0) {
+    if (!PyErr_Occurred())
+      PyErr_SetString(PyExc_RuntimeError, "GeneralCubeDecisionE failed");
+    return NULL;
+  }
+
+  if (!(list = PyList_New(n)))
+    return NULL;
+  for (Py_ssize_t i = 0; i < n; ++i) {
+    PyObject *pyCube = CubeDecisionToPy(&acd[(size_t)i]);
+    if (!pyCube) {
+      Py_DECREF(list);
       return NULL;
     }
+    PyList_SET_ITEM(list, i, pyCube);
   }
-  return pyDiceRolls;
+  return list;
 }
 
+/* -------------------------------------------------------------------------
+ * Stateless hints
+ * ------------------------------------------------------------------------- */
+
+/* One chequer play search, run on a worker thread by HintMovesTask. */
+typedef struct {
+  TanBoard anBoard;
+  int anDice[2];
+  cubeinfo ci;
+  evalcontext ec;
+  movefilter aamf[MAX_FILTER_PLIES][MAX_FILTER_PLIES];
+  unsigned int k; /* 0: plain movefilter search, else top-k search */
+  move *amTop;    /* k > 0: room for MIN(k, MAX_MOVES) results */
+  movelist ml;
+  int fFailed;
+} hintdata;
+
 /*
- * Ported from gnubgmodule.c: PythonMatchChecksum
- * Exposed as: gnubg.matchchecksum()
- * Returns MD5 checksum of current match as 32-char hex string.
+ * Approximate top-k variant of FindnSaveBestMoves. The movefilters are
+ * applied as usual, but when rescoring the survivors at the next ply (best
+ * first), a candidate whose shallower score plus the filter threshold is
+ * below the k-th best deeper score found so far is dropped together with
+ * all weaker candidates. This is not a bound: it assumes no move gains more
+ * than the threshold from one ply to the next, as the movefilter itself
+ * does, so the result can differ from FindnSaveBestMoves when one does.
+ * Only the best k moves are returned in phd->ml, which points into
+ * phd->amTop.
  */
-static PyObject *PythonMatchChecksum(PyObject *self, PyObject *args) {
-  if (!PyArg_ParseTuple(args, ":matchchecksum"))
-    return NULL;
-  return PyUnicode_FromString(GetMatchCheckSum());
+static int FindTopKMoves(hintdata *phd) {
+  const int nPlies = phd->ec.nPlies;
+  ArenaScope scope;
+  movelist ml;
+  move *am;
+  float *arTop; /* best k scores at the current ply, descending */
+  unsigned int cMoves, k;
+  float rMargin = 0.0f; /* assumed largest gain per ply, not a bound */
+  int fRescore = FALSE;
+
+  GenerateMoves(&ml, (ConstTanBoard)phd->anBoard, phd->anDice[0],
+                phd->anDice[1], FALSE);
+  cMoves = ml.cMoves;
+  k = MIN(phd->k, MAX(cMoves, 1U));
+  /* GenerateMoves fills a per-thread buffer; take a private copy. */
+  am = scope.Alloc<move>(cMoves);
+  memcpy(am, ml.amMoves, cMoves * sizeof(move));
+  arTop = scope.Alloc<float>(k + 1);
+
+  for (int iPly = 0; cMoves > 1 && iPly <= nPlies; ++iPly) {
+    const movefilter *pmf = iPly < nPlies ? &phd->aamf[nPlies - 1][iPly] : NULL;
+    unsigned int cScored = 0, cTop = 0;
+
+    if (pmf && pmf->Accept < 0)
+      continue;
+
+    for (; cScored < cMoves; ++cScored) {
+      move *pm = &am[cScored];
+      float *pr;
+
+      /* am is sorted on the previous ply, so everything after the first
+       * candidate that cannot reach the bound is out as well. */
+      if (fRescore && cTop == k && pm->rScore + rMargin < arTop[k - 1])
+        break;
+      if (ScoreMove(NULL, pm, &phd->ci, &phd->ec, iPly) < 0)
+        return -1;
+      pr = std::upper_bound(arTop, arTop + cTop, pm->rScore,
+                            std::greater<float>());
+      memmove(pr + 1, pr, (size_t)(arTop + cTop - pr) * sizeof(float));
+      *pr = pm->rScore;
+      if (cTop < k)
+        cTop++;
+    }
+    cMoves = cScored;
+    std::stable_sort(am, am + cMoves, [](const move &a, const move &b) {
+      return a.rScore > b.rScore;
+    });
+
+    if (!pmf)
+      break;
+
+    /* Apply the movefilter: keep Accept moves plus up to Extra more within
+     * Threshold of the best. */
+    unsigned int cKeep = MIN(MAX((unsigned int)pmf->Accept, 1U), cMoves);
+    unsigned int cLimit = MIN(cMoves, cKeep + (unsigned int)pmf->Extra);
+    while (cKeep < cLimit && am[0].rScore - am[cKeep].rScore <= pmf->Threshold)
+      cKeep++;
+    cMoves = cKeep;
+    rMargin = pmf->Threshold;
+    fRescore = TRUE;
+  }
+
+  if (cMoves == 1 && !fRescore &&
+      ScoreMove(NULL, &am[0], &phd->ci, &phd->ec, 0) < 0)
+    return -1;
+
+  /* Only the k results leave this scope, into the caller's buffer. */
+  memset(&phd->ml, 0, sizeof(phd->ml));
+  phd->ml.cMoves = MIN(cMoves, k);
+  phd->ml.cMaxMoves = ml.cMaxMoves;
+  phd->ml.cMaxPips = ml.cMaxPips;
+  phd->ml.amMoves = phd->amTop;
+  memcpy(phd->ml.amMoves, am, phd->ml.cMoves * sizeof(move));
+  if (cMoves)
+    phd->ml.rBestScore = am[0].rScore;
+  return 0;
+}
+
+static void HintMovesTask(void *p) {
+  hintdata *phd = (hintdata *)p;
+
+  if (phd->k) {
+    if (FindTopKMoves(phd) < 0) {
+      phd->fFailed = TRUE;
+      MT_SetResultFailed();
+    }
+    return;
+  }
+  if (FindnSaveBestMoves(&phd->ml, phd->anDice[0], phd->anDice[1],
+                         (ConstTanBoard)phd->anBoard, NULL, 0.0f, &phd->ci,
+                         &phd->ec, phd->aamf) < 0) {
+    phd->fFailed = TRUE;
+    MT_SetResultFailed();
+    return;
+  }
+  RefreshMoveList(&phd->ml, NULL);
 }
 
 /*
- * Ported from gnubgmodule.c: PythonPositionBearoff
- * Exposed as: gnubg.positionbearoff([board], [nPoints], [nChequers])
- * Returns bearoff id for the given position (one side of board).
+ * Fill phd from Python arguments. Board and dice are required; a missing
+ * evalcontext or movefilters comes from the session (see
+ * SessionEvalContext), never from the match state.
  */
-static PyObject *PythonPositionBearoff(PyObject *self, PyObject *args) {
-  PyObject *pyBoard = NULL;
-  int nChequers = 15;
-  int nPoints = 6;
-  TanBoard anBoard;
-  memset(anBoard, 0, sizeof(anBoard));
-  memcpy(anBoard, msBoard(), sizeof(TanBoard));
+static int PyToHintData(PyObject *pyBoard, PyObject *pyDice,
+                        PyObject *pyCubeInfo, PyObject *pyEvalContext,
+                        PyObject *pyMoveFilters, hintdata *phd) {
+  int anScore[2] = {0, 0};
 
-  if (!PyArg_ParseTuple(args, "|Oii:positionbearoff", &pyBoard, &nPoints,
-                        &nChequers))
-    return NULL;
-  if (pyBoard && !PyToBoard1(pyBoard, anBoard[0])) {
+  memset(phd, 0, sizeof(*phd));
+  SetCubeInfo(&phd->ci, 1, -1, 0, 0, anScore, FALSE, TRUE, FALSE,
+              VARIATION_STANDARD);
+  if (!pyEvalContext || pyEvalContext == Py_None || !pyMoveFilters ||
+      pyMoveFilters == Py_None) {
+    /* Hold the session only while copying the defaults, so that calls
+     * given both still run alongside stateful ones. */
+    SessionLock session;
+
+    if (!session.Held())
+      return -1;
+    memcpy(&phd->ec, SessionEvalContext(), sizeof(evalcontext));
+    memcpy(phd->aamf, SessionMoveFilters(), sizeof(phd->aamf));
+  }
+
+  if (!PyToBoard(pyBoard, phd->anBoard)) {
     PyErr_SetString(PyExc_TypeError, "Invalid board format");
-    return NULL;
+    return -1;
   }
-  return PyLong_FromLong((long)PositionBearoff(
-      anBoard[0], (unsigned int)nPoints, (unsigned int)nChequers));
+  if (!PyToDice(pyDice, phd->anDice)) {
+    PyErr_SetString(PyExc_TypeError,
+                    "dice must be a sequence of 2 integers (1-6)");
+    return -1;
+  }
+  if (phd->anDice[0] < 1 || phd->anDice[0] > 6 || phd->anDice[1] < 1 ||
+      phd->anDice[1] > 6) {
+    PyErr_SetString(PyExc_ValueError, "dice values must be 1-6");
+    return -1;
+  }
+  if (pyCubeInfo && pyCubeInfo != Py_None &&
+      PyToCubeInfo(pyCubeInfo, &phd->ci) != 0)
+    return -1;
+  if (pyEvalContext && pyEvalContext != Py_None &&
+      PyToEvalContext(pyEvalContext, &phd->ec) != 0)
+    return -1;
+  if (pyMoveFilters && pyMoveFilters != Py_None &&
+      PyToMoveFilters(pyMoveFilters, phd->aamf) != 0)
+    return -1;
+  return 0;
 }
 
 /*
- * Ported from gnubgmodule.c: PythonPositionFromBearoff
- * Exposed as: gnubg.positionfrombearoff([id], [nChequers], [nPoints])
- * Returns single board (25 ints) from bearoff id.
+ * Converts a searched movelist (best first) to a list of at most nMaxMoves
+ * {"move": (from, to, ...), "movestr": s, "equity": f, "eqdiff": f,
+ *  "probs": (f,f,f,f,f), "plies": i}; points are 1-based (25 is the bar,
+ *  0 is off).
  */
-static PyObject *PythonPositionFromBearoff(PyObject *self, PyObject *args) {
-  TanBoard anBoard;
-  unsigned int iPos = 0;
-  int nChequers = 15;
-  int nPoints = 6;
-  memset(anBoard, 0, sizeof(anBoard));
+static PyObject *HintMovesToPy(const hintdata *phd, int nMaxMoves) {
+  char szMove[FORMATEDMOVESIZE];
+  Py_ssize_t n = (Py_ssize_t)phd->ml.cMoves;
+  PyObject *list;
 
-  if (!PyArg_ParseTuple(args, "|iii:positionfrombearoff", &iPos, &nChequers,
-                        &nPoints))
+  if (nMaxMoves >= 0 && n > nMaxMoves)
+    n = nMaxMoves;
+  if (!(list = PyList_New(n)))
     return NULL;
-  if (nChequers < 1 || nChequers > 15 || nPoints < 1 || nPoints > 25) {
-    PyErr_SetString(PyExc_ValueError, "invalid number of chequers or points");
-    return NULL;
-  }
 
-  unsigned int n =
-      Combination((unsigned int)(nChequers + nPoints), (unsigned int)nPoints);
-  if (iPos >= n) {
-    PyErr_SetString(PyExc_ValueError, "invalid position number");
-    return NULL;
+  for (Py_ssize_t i = 0; i < n; ++i) {
+    const move *pm = &phd->ml.amMoves[i];
+    const float *p = pm->arEvalMove;
+    Py_ssize_t cMove = 0;
+    PyObject *moveTuple, *dict;
+
+    /* Sources end the move; a destination of -1 (bear off) becomes 0. */
+    while (cMove < 8 && pm->anMove[cMove] >= 0)
+      cMove += 2;
+    if (!(moveTuple = PyTuple_New(cMove))) {
+      Py_DECREF(list);
+      return NULL;
+    }
+    for (Py_ssize_t k = 0; k < cMove; ++k)
+      PyTuple_SET_ITEM(moveTuple, k, PyLong_FromLong(pm->anMove[k] + 1));
+
+    FormatMove(szMove, (ConstTanBoard)phd->anBoard, pm->anMove);
+    dict = Py_BuildValue(
+        "{s:N,s:s,s:f,s:f,s:(fffff),s:i}", "move", moveTuple, "movestr",
+        szMove, "equity", (double)pm->rScore, "eqdiff",
+        (double)(pm->rScore - phd->ml.amMoves[0].rScore), "probs",
+        (double)p[0], (double)p[1], (double)p[2], (double)p[3], (double)p[4],
+        "plies", (int)pm->esMove.ec.nPlies);
+    if (!dict) {
+      Py_DECREF(list);
+      return NULL;
+    }
+    PyList_SET_ITEM(list, i, dict);
   }
-  PositionFromBearoff(anBoard[0], iPos, (unsigned int)nPoints,
-                      (unsigned int)nChequers);
-  return Board1ToPy(anBoard[0]);
+  return list;
 }
 
 /*
- * Ported from gnubgmodule.c: PythonEq2mwc
- * Exposed as: gnubg.eq2mwc([equity], [cubeinfo])
- * Converts cubeless equity to match-winning chance.
+ * Exposed as: gnubg.hintmoves(board, dice, [cubeinfo], [evalcontext],
+ * [movefilters], [maxmoves], [k])
+ * Chequer play hint for an explicit position. Does not read or modify the
+ * current match, so it may be called from several threads at once.
+ * With k > 0 only the best k moves are searched for, approximately (see
+ * FindTopKMoves).
  */
-static PyObject *PythonEq2mwc(PyObject *self, PyObject *args) {
+static PyObject *PythonHintMoves(PyObject *self, PyObject *args) {
+  PyObject *pyBoard = NULL;
+  PyObject *pyDice = NULL;
   PyObject *pyCubeInfo = NULL;
-  float r = 0.0f;
-  cubeinfo ci;
-  if (!PyArg_ParseTuple(args, "|fO:eq2mwc", &r, &pyCubeInfo))
+  PyObject *pyEvalContext = NULL;
+  PyObject *pyMoveFilters = NULL;
+  int nMaxMoves = -1;
+  int k = 0;
+  hintdata hd;
+  move *amFree = NULL; /* hd.ml.amMoves when it came from FindnSaveBestMoves */
+  ArenaScope scope;
+  PyObject *list;
+
+  (void)self;
+  if (!PyArg_ParseTuple(args, "OO|OOOii:hintmoves", &pyBoard, &pyDice,
+                        &pyCubeInfo, &pyEvalContext, &pyMoveFilters,
+                        &nMaxMoves, &k))
     return NULL;
-  GetMatchStateCubeInfo(&ci, &ms);
-  if (pyCubeInfo && PyToCubeInfo(pyCubeInfo, &ci) != 0)
+  if (PyToHintData(pyBoard, pyDice, pyCubeInfo, pyEvalContext, pyMoveFilters,
+                   &hd) != 0)
     return NULL;
-  return PyFloat_FromDouble((double)eq2mwc(r, &ci));
+  if (k < 0) {
+    PyErr_SetString(PyExc_ValueError, "k must be >= 0");
+    return NULL;
+  }
+  if (k > 0 && hd.ec.nPlies > MAX_FILTER_PLIES) {
+    PyErr_Format(PyExc_ValueError, "top-k search supports at most %d plies",
+                 MAX_FILTER_PLIES);
+    return NULL;
+  }
+  hd.k = (unsigned int)k;
+
+  ResultCacheKey key;
+  std::vector<move> amCached;
+  int fCache = MakeResultCacheKey((ConstTanBoard)hd.anBoard, hd.anDice, &hd.ci,
+                                  &hd.ec, hd.aamf, hd.k, &key);
+
+  if (fCache && rcMoves.Lookup(key, &amCached)) {
+    hd.ml.cMoves = (unsigned int)amCached.size();
+    hd.ml.amMoves = amCached.data();
+  } else {
+    if (hd.k)
+      hd.amTop = scope.Alloc<move>(MIN(hd.k, (unsigned int)MAX_MOVES));
+    if (RunEngineTasks(HintMovesTask, &hd, sizeof(hd), 1) < 0 || hd.fFailed) {
+      if (!PyErr_Occurred())
+        PyErr_SetString(PyExc_RuntimeError, "FindnSaveBestMoves failed");
+      return NULL;
+    }
+    if (fCache)
+      rcMoves.Insert(key, std::vector<move>(hd.ml.amMoves,
+                                            hd.ml.amMoves + hd.ml.cMoves));
+    if (!hd.k)
+      amFree = hd.ml.amMoves;
+  }
+
+  list = HintMovesToPy(&hd, nMaxMoves);
+  g_free(amFree);
+  return list;
 }
 
 /*
- * Ported from gnubgmodule.c: PythonEq2mwcStdErr
- * Exposed as: gnubg.eq2mwc_stderr([equity], [cubeinfo])
+ * Exposed as: gnubg.arenastats()
+ * Statistics of the per-thread search arenas, as of their last reset.
  */
-static PyObject *PythonEq2mwcStdErr(PyObject *self, PyObject *args) {
-  PyObject *pyCubeInfo = NULL;
-  float r = 0.0f;
-  cubeinfo ci;
-  if (!PyArg_ParseTuple(args, "|fO:eq2mwc_stderr", &r, &pyCubeInfo))
-    return NULL;
-  GetMatchStateCubeInfo(&ci, &ms);
-  if (pyCubeInfo && PyToCubeInfo(pyCubeInfo, &ci) != 0)
-    return NULL;
-  return PyFloat_FromDouble((double)se_eq2mwc(r, &ci));
+static PyObject *PythonArenaStats(PyObject *self, PyObject *args) {
+  arenastats as;
+
+  (void)self;
+  (void)args;
+  ArenaGetStats(&as);
+  return Py_BuildValue("{s:K,s:K,s:K,s:K,s:K,s:K,s:K,s:K}", "arenas",
+                       as.cArenas, "chunks", as.cChunks, "reserved",
+                       as.cbReserved, "peak", as.cbPeak, "allocations",
+                       as.cAllocs, "allocated", as.cbAllocated, "resets",
+                       as.cResets, "chunkallocations", as.cChunkAllocs);
 }
 
 /*
- * Ported from gnubgmodule.c: PythonMwc2eq
- * Exposed as: gnubg.mwc2eq([mwc], [cubeinfo])
- * Converts match-winning chance to equity.
+ * Exposed as: gnubg.setcachesize(size)
+ * Set the number of entries kept in each result cache (0 disables them).
  */
-static PyObject *PythonMwc2eq(PyObject *self, PyObject *args) {
-  PyObject *pyCubeInfo = NULL;
-  float r = 0.0f;
-  cubeinfo ci;
-  if (!PyArg_ParseTuple(args, "|fO:mwc2eq", &r, &pyCubeInfo))
+static PyObject *PythonSetCacheSize(PyObject *self, PyObject *args) {
+  Py_ssize_t n;
+
+  (void)self;
+  if (!PyArg_ParseTuple(args, "n:setcachesize", &n))
     return NULL;
-  GetMatchStateCubeInfo(&ci, &ms);
-  if (pyCubeInfo && PyToCubeInfo(pyCubeInfo, &ci) != 0)
+  if (n < 0) {
+    PyErr_SetString(PyExc_ValueError, "cache size must be >= 0");
     return NULL;
-  return PyFloat_FromDouble((double)mwc2eq(r, &ci));
+  }
+  rcMoves.SetCapacity((size_t)n);
+  rcEvals.SetCapacity((size_t)n);
+  Py_RETURN_NONE;
 }
 
 /*
- * Ported from gnubgmodule.c: PythonMwc2eqStdErr
- * Exposed as: gnubg.mwc2eq_stderr([mwc], [cubeinfo])
+ * Exposed as: gnubg.cachestats()
+ * Returns {"moves": stats, "evaluations": stats} for the result caches.
  */
-static PyObject *PythonMwc2eqStdErr(PyObject *self, PyObject *args) {
-  PyObject *pyCubeInfo = NULL;
-  float r = 0.0f;
+static PyObject *PythonCacheStats(PyObject *self, PyObject *args) {
+  (void)self;
+  (void)args;
+  return Py_BuildValue("{s:N,s:N}", "moves", rcMoves.StatsToPy(),
+                       "evaluations", rcEvals.StatsToPy());
+}
+
+/*
+ * Exposed as: gnubg.clearcache()
+ */
+static PyObject *PythonClearCache(PyObject *self, PyObject *args) {
+  (void)self;
+  (void)args;
+  rcMoves.Clear();
+  rcEvals.Clear();
+  Py_RETURN_NONE;
+}
+
+/* -------------------------------------------------------------------------
+ * Rollouts
+ * ------------------------------------------------------------------------- */
+
+/* Minimum time between two calls of a rollout progress callback. */
+#define ROLLOUT_PROGRESS_INTERVAL 100000 /* microseconds */
+
+/* One position (or position after a candidate move) to roll out. */
+typedef struct {
+  TanBoard anBoard;
   cubeinfo ci;
-  if (!PyArg_ParseTuple(args, "|fO:mwc2eq_stderr", &r, &pyCubeInfo))
+  evalsetup es;
+  int fCubeDecTop;
+  float arOutput[NUM_ROLLOUT_OUTPUTS];
+  float arStdDev[NUM_ROLLOUT_OUTPUTS];
+  rolloutstat ars[2];
+} rolloutalternative;
+
+/* Passed to RolloutProgressToPy as user data while a rollout runs. */
+typedef struct {
+  PyObject *pyProgress; /* callable or NULL */
+  GMutex mtx;           /* guards tvLast; progress comes from all workers */
+  gint64 tvLast;
+  int fStopped;         /* the callback returned False or raised */
+  PyObject *pyExcType, *pyExcValue, *pyExcTraceback;
+} rolloutprogressdata;
+
+static PyObject *RolloutOutputToPy(const float ar[NUM_ROLLOUT_OUTPUTS]) {
+  PyObject *p = PyTuple_New(NUM_ROLLOUT_OUTPUTS);
+
+  if (!p)
     return NULL;
-  GetMatchStateCubeInfo(&ci, &ms);
-  if (pyCubeInfo && PyToCubeInfo(pyCubeInfo, &ci) != 0)
+  for (int i = 0; i < NUM_ROLLOUT_OUTPUTS; ++i)
+    PyTuple_SET_ITEM(p, i, PyFloat_FromDouble((double)ar[i]));
+  return p;
+}
+
+static PyObject *IntArrayToPy(const int *an, int n) {
+  PyObject *p = PyTuple_New(n);
+
+  if (!p)
     return NULL;
-  return PyFloat_FromDouble((double)se_mwc2eq(r, &ci));
+  for (int i = 0; i < n; ++i)
+    PyTuple_SET_ITEM(p, i, PyLong_FromLong(an[i]));
+  return p;
+}
+
+/* Histograms are indexed by log2 of the final cube value. */
+static PyObject *RolloutStatToPy(const rolloutstat *prs) {
+  return Py_BuildValue(
+      "{s:N,s:N,s:N,s:N,s:N,s:i,s:f,s:i,s:i,s:i,s:f}", "win",
+      IntArrayToPy(prs->acWin, STAT_MAXCUBE), "wingammon",
+      IntArrayToPy(prs->acWinGammon, STAT_MAXCUBE), "winbackgammon",
+      IntArrayToPy(prs->acWinBackgammon, STAT_MAXCUBE), "doubledrop",
+      IntArrayToPy(prs->acDoubleDrop, STAT_MAXCUBE), "doubletake",
+      IntArrayToPy(prs->acDoubleTake, STAT_MAXCUBE), "opponenthit",
+      prs->nOpponentHit, "opponenthitmove", (double)prs->rOpponentHitMove,
+      "bearoffmoves", prs->nBearoffMoves, "bearoffpipslost",
+      prs->nBearoffPipsLost, "opponentclosedout", prs->nOpponentClosedOut,
+      "opponentclosedoutmove", (double)prs->rOpponentClosedOutMove);
 }
 
 /*
- * Hint callback: called from C (hint_move). Must have C linkage.
+ * Converts a finished rollout to {"probs": (7 floats), "std": (7 floats),
+ * "stats": (player 0, player 1), "trials": i}. The outputs are win, win
+ * gammon, win backgammon, lose gammon, lose backgammon, cubeless equity
+ * and cubeful equity.
  */
-extern "C" {
-static int PythonHint_Callback(procrecorddata *pr) {
+static PyObject *RolloutResultToPy(const rolloutalternative *pra) {
+  return Py_BuildValue("{s:N,s:N,s:(NN),s:i}", "probs",
+                       RolloutOutputToPy(pra->arOutput), "std",
+                       RolloutOutputToPy(pra->arStdDev), "stats",
+                       RolloutStatToPy(&pra->ars[0]),
+                       RolloutStatToPy(&pra->ars[1]), "trials",
+                       (int)pra->es.rc.nGamesDone);
+}
+
+/*
+ * Read a sequence of candidate move tuples for the player on roll in
+ * anBoard. Returns 0, or -1 with an exception set (ValueError for an
+ * illegal move).
+ */
+static int PyToCandidateMoves(PyObject *pyMoves, ConstTanBoard anBoard,
+                              std::vector<std::array<int, 8>> *paanMove) {
+  PyObject *pySeq = PySequence_Fast(pyMoves, "moves must be a sequence");
+
+  if (!pySeq)
+    return -1;
+  for (Py_ssize_t i = 0; i < PySequence_Fast_GET_SIZE(pySeq); ++i) {
+    PyObject *pyMove = PySequence_Fast_GET_ITEM(pySeq, i);
+    PyObject *pyFast = PySequence_Fast(pyMove, "move must be a sequence");
+    std::array<int, 8> anMove;
+    TanBoard an;
+    int fOK;
+
+    anMove.fill(-1);
+    fOK = pyFast && PyToMove(pyFast, anMove.data());
+    Py_XDECREF(pyFast);
+    memcpy(an, anBoard, sizeof(TanBoard));
+    if (!fOK || ApplyMove(an, anMove.data(), TRUE) < 0) {
+      Py_DECREF(pySeq);
+      PyErr_Format(PyExc_ValueError, "moves[%zd] is not a legal move", i);
+      return -1;
+    }
+    paanMove->push_back(anMove);
+  }
+  Py_DECREF(pySeq);
+  return 0;
+}
+
+/* The position after a (checked) move, with the opponent on roll. */
+static void BoardAfterMove(ConstTanBoard anBoard, const int anMove[8],
+                           TanBoard anAfter) {
+  memcpy(anAfter, anBoard, sizeof(TanBoard));
+  ApplyMove(anAfter, anMove, FALSE);
+  SwapSides(anAfter);
+}
+
+/* pci with the opponent on roll. */
+static void OpponentCubeInfo(const cubeinfo *pci, cubeinfo *pciOpp) {
+  SetCubeInfo(pciOpp, pci->nCube, pci->fCubeOwner, !pci->fMove,
+              pci->nMatchTo, pci->anScore, pci->fCrawford, pci->fJacoby,
+              pci->fBeavers, pci->bgv);
+}
+
+/* Add "move" (1-based tuple) and "movestr" for anMove in anBoard to dict. */
+static void AddCandidateMove(PyObject *dict, ConstTanBoard anBoard,
+                             const int anMove[8]) {
   char szMove[FORMATEDMOVESIZE];
-  PyObject *list = (PyObject *)pr->pvUserData;
-  PyObject *hintdict = NULL, *ctxdict = NULL, *details = NULL;
+  Py_ssize_t cMove = 0;
+  PyObject *moveTuple;
+
+  while (cMove < 8 && anMove[cMove] >= 0)
+    cMove += 2;
+  moveTuple = PyTuple_New(cMove);
+  for (Py_ssize_t k = 0; moveTuple && k < cMove; ++k)
+    PyTuple_SET_ITEM(moveTuple, k, PyLong_FromLong(anMove[k] + 1));
+  FormatMove(szMove, anBoard, anMove);
+  if (moveTuple)
+    DictSetItemSteal(dict, "move", moveTuple);
+  DictSetItemSteal(dict, "movestr", PyUnicode_FromString(szMove));
+}
 
-  int index = (int)(intptr_t)pr->avOutputData[PROCREC_HINT_ARGOUT_INDEX];
-  const matchstate *pms =
-      (const matchstate *)pr->avOutputData[PROCREC_HINT_ARGOUT_MATCHSTATE];
-  const movelist *pml =
-      (const movelist *)pr->avOutputData[PROCREC_HINT_ARGOUT_MOVELIST];
-  const evalsetup *pes = &pml->amMoves[index].esMove;
-  float rEq = pml->amMoves[index].rScore;
-  float rEqTop = pml->amMoves[0].rScore;
-  float rEqDiff = rEq - rEqTop;
+/*
+ * Called by RolloutGeneral from the worker threads. Takes the GIL to call
+ * the Python callback at most every ROLLOUT_PROGRESS_INTERVAL and on the
+ * last trial; a False return or an exception interrupts the rollout.
+ */
+extern "C" {
+static void RolloutProgressToPy(float aarOutput[][NUM_ROLLOUT_OUTPUTS],
+                                float aarStdDev[][NUM_ROLLOUT_OUTPUTS],
+                                const rolloutcontext *prc, const cubeinfo aci[],
+                                unsigned int initial_game_count,
+                                const int iGame, const int iAlternative,
+                                const int nRank, const float rJsd,
+                                const int fStopped, const int fShowRanks,
+                                int fCubeRollout, void *pUserData) {
+  rolloutprogressdata *prp = (rolloutprogressdata *)pUserData;
+  gint64 tv = g_get_monotonic_time();
+  PyGILState_STATE gstate;
+  PyObject *pyResult;
+  int fDue;
+
+  (void)aci;
+  (void)initial_game_count;
+  (void)fShowRanks;
+  (void)fCubeRollout;
+
+  if (!prp->pyProgress || prp->fStopped)
+    return;
 
-  FormatMove(szMove, (ConstTanBoard)pms->anBoard, pml->amMoves[index].anMove);
+  g_mutex_lock(&prp->mtx);
+  fDue = tv - prp->tvLast >= ROLLOUT_PROGRESS_INTERVAL ||
+         iGame + 1 >= (int)prc->nTrials;
+  if (fDue)
+    prp->tvLast = tv;
+  g_mutex_unlock(&prp->mtx);
+  if (!fDue)
+    return;
 
-  switch (pes->et) {
-  case EVAL_NONE:
-    hintdict =
-        Py_BuildValue("{s:i,s:s,s:f,s:f}", "movenum", index + 1, "type", "none",
-                      "equity", (double)rEq, "eqdiff", (double)rEqDiff);
-    break;
-  case EVAL_EVAL: {
-    const move *pmi = &pml->amMoves[index];
-    details =
-        Py_BuildValue("{s:(fffff),s:f}", "probs", (double)pmi->arEvalMove[0],
-                      (double)pmi->arEvalMove[1], (double)pmi->arEvalMove[2],
-                      (double)pmi->arEvalMove[3], (double)pmi->arEvalMove[4],
-                      "score", (double)pmi->rScore);
-    ctxdict = EvalContextToPy(&pes->ec);
-    hintdict = Py_BuildValue("{s:i,s:s,s:s,s:f,s:f,s:N,s:N}", "movenum",
-                             index + 1, "type", "eval", "move", szMove,
-                             "equity", (double)rEq, "eqdiff", (double)rEqDiff,
-                             "context", ctxdict, "details", details);
-    break;
-  }
-  case EVAL_ROLLOUT: {
-    const move *pmi = &pml->amMoves[index];
-    const float *p = pmi->arEvalMove;
-    const float *s = pmi->arEvalStdDev;
-    details = Py_BuildValue(
-        "{s:(fffff),s:(fffff),s:f,s:f,s:f,s:f,s:i,s:f}", "probs", (double)p[0],
-        (double)p[1], (double)p[2], (double)p[3], (double)p[4], "probs-std",
-        (double)s[0], (double)s[1], (double)s[2], (double)s[3], (double)s[4],
-        "match-eq", (double)p[OUTPUT_EQUITY], "cubeful-eq",
-        (double)p[OUTPUT_CUBEFUL_EQUITY], "score", (double)pmi->rScore,
-        "score2", (double)pmi->rScore2, "trials", (int)pes->rc.nGamesDone,
-        "stopped-on-jsd", (double)pes->rc.rStoppedOnJSD);
-    ctxdict = RolloutContextToPy(&pes->rc);
-    hintdict = Py_BuildValue("{s:i,s:s,s:s,s:f,s:f,s:N,s:N}", "movenum",
-                             index + 1, "type", "rollout", "move", szMove,
-                             "equity", (double)rEq, "eqdiff", (double)rEqDiff,
-                             "context", ctxdict, "details", details);
-    break;
-  }
-  default:
-    hintdict = Py_BuildValue("{s:i,s:s,s:i}", "movenum", index + 1, "type",
-                             "unknown", "typenum", (int)pes->et);
-    break;
+  gstate = PyGILState_Ensure();
+  fInEngineCallback = TRUE;
+  pyResult = PyObject_CallFunction(
+      prp->pyProgress, "N",
+      Py_BuildValue("{s:i,s:i,s:i,s:N,s:N,s:i,s:f,s:N}", "trials", iGame + 1,
+                    "total", (int)prc->nTrials, "alternative", iAlternative,
+                    "probs", RolloutOutputToPy(aarOutput[iAlternative]), "std",
+                    RolloutOutputToPy(aarStdDev[iAlternative]), "rank", nRank,
+                    "jsd", (double)rJsd, "stopped", PyBool_FromLong(fStopped)));
+  fInEngineCallback = FALSE;
+  if (!pyResult) {
+    if (!prp->pyExcType)
+      PyErr_Fetch(&prp->pyExcType, &prp->pyExcValue, &prp->pyExcTraceback);
+    else
+      PyErr_Clear();
   }
-  if (hintdict) {
-    PyList_Append(list, hintdict);
-    Py_DECREF(hintdict);
+  if (!pyResult || pyResult == Py_False) {
+    prp->fStopped = TRUE;
+    MT_SafeSet(&fInterrupt, TRUE);
   }
-  return 1; /* TRUE */
+  Py_XDECREF(pyResult);
+  PyGILState_Release(gstate);
 }
 }
 
 /*
- * Ported from gnubgmodule.c: PythonHint
- * Exposed as: gnubg.hint([maxmoves])
+ * Roll out all alternatives together with RolloutGeneral, using the
+ * engine's worker threads with the GIL released. fInvert is set when the
+ * alternatives are positions after a move by the player on roll. Returns 0,
+ * or -1 with a Python exception set.
  */
-static PyObject *PythonHint(PyObject *self, PyObject *args) {
-  int nMaxMoves = -1;
-  char szNumber[11];
-  procrecorddata prochint;
-  PyObject *retval = NULL;
-  PyObject *gnubgid = NULL;
+static int RunRollout(std::vector<rolloutalternative> &ara, int fInvert,
+                      PyObject *pyProgress) {
+  const size_t n = ara.size();
+  std::vector<ConstTanBoard> apBoard(n);
+  std::vector<float(*)[NUM_ROLLOUT_OUTPUTS]> apOutput(n), apStdDev(n);
+  std::vector<rolloutstat> ars(2 * n);
+  std::vector<evalsetup *> apes(n);
+  std::vector<const cubeinfo *> apci(n);
+  std::vector<int *> apCubeDecTop(n);
+  rolloutprogressdata rp;
+  int ret, nCancel;
+
+  for (size_t i = 0; i < n; ++i) {
+    apBoard[i] = (ConstTanBoard)ara[i].anBoard;
+    apOutput[i] = &ara[i].arOutput;
+    apStdDev[i] = &ara[i].arStdDev;
+    apes[i] = &ara[i].es;
+    apci[i] = &ara[i].ci;
+    apCubeDecTop[i] = &ara[i].fCubeDecTop;
+  }
 
-  if (!PyArg_ParseTuple(args, "|i:hint", &nMaxMoves))
+  memset(&rp, 0, sizeof(rp));
+  g_mutex_init(&rp.mtx);
+  rp.pyProgress = pyProgress;
+
+  InterruptWatch iw(pyProgress != NULL);
+  Py_BEGIN_ALLOW_THREADS
+  g_mutex_lock(&mtxEngineTasks);
+  ret = RolloutGeneral(apBoard.data(), apOutput.data(), apStdDev.data(),
+                       (rolloutstat(*)[2])ars.data(), apes.data(), apci.data(),
+                       apCubeDecTop.data(), (int)n, fInvert, FALSE,
+                       RolloutProgressToPy, &rp);
+  g_mutex_unlock(&mtxEngineTasks);
+  Py_END_ALLOW_THREADS
+
+  nCancel = iw.Finish();
+  g_mutex_clear(&rp.mtx);
+  if (rp.fStopped)
+    MT_SafeSet(&fInterrupt, FALSE);
+  if (rp.pyExcType) {
+    PyErr_Restore(rp.pyExcType, rp.pyExcValue, rp.pyExcTraceback);
+    return -1;
+  }
+  if (nCancel) {
+    SetCancelError(nCancel);
+    return -1;
+  }
+  if (ret < 0 && !rp.fStopped) {
+    PyErr_SetString(PyExc_RuntimeError, "RolloutGeneral failed");
+    return -1;
+  }
+  for (size_t i = 0; i < n; ++i)
+    memcpy(ara[i].ars, &ars[2 * i], sizeof(ara[i].ars));
+  return 0;
+}
+
+/* Below, with the trial rollouts. */
+static PyObject *DeterministicRollout(PyObject *pyBoard, PyObject *pyCubeInfo,
+                                      PyObject *pyRolloutContext,
+                                      PyObject *pyMoves, PyObject *pyProgress,
+                                      const char *szCheckpoint);
+
+/*
+ * Exposed as: gnubg.rollout(board, [cubeinfo], [rolloutcontext], [moves],
+ * [progress], [deterministic], [checkpoint])
+ * Roll out a position, or with moves the positions after each candidate
+ * move (all on the same dice). rolloutcontext defaults to the rollout
+ * settings; progress(dict) is called at most every 0.1 seconds and may
+ * return False to stop early. This runs RolloutGeneral, which adds up the
+ * games in the order the threads finish them and stops on std or jsd when
+ * it sees fit, so the same seed can give different results from run to
+ * run with more than one thread, and it cannot be resumed. With
+ * deterministic the rollout runs on the trial kernel instead, which gives
+ * the same result for any number of threads and can keep a checkpoint
+ * (see DeterministicRollout).
+ */
+static PyObject *PythonRollout(PyObject *self, PyObject *args,
+                               PyObject *keywds) {
+  SessionLock session;
+  if (!session.Held())
     return NULL;
-  if (nMaxMoves < 0)
-    nMaxMoves = MAX_MOVES;
+  PyObject *pyBoard = NULL;
+  PyObject *pyCubeInfo = NULL;
+  PyObject *pyRolloutContext = NULL;
+  PyObject *pyMoves = NULL;
+  PyObject *pyProgress = NULL;
+  static const char *kwlist[] = {"board",    "cubeinfo",      "rolloutcontext",
+                                 "moves",    "progress",      "deterministic",
+                                 "checkpoint", NULL};
+  TanBoard anBoard;
+  cubeinfo ci;
+  rolloutcontext rc;
+  int anScore[2] = {0, 0};
+  int fDeterministic = FALSE;
+  const char *szCheckpoint = NULL;
+  std::vector<rolloutalternative> ara;
+  std::vector<std::array<int, 8>> aanMove;
 
-  if (ms.gs != GAME_PLAYING) {
-    PyErr_SetString(PyExc_RuntimeError, "You must set up a board first.");
+  (void)self;
+  if (!PyArg_ParseTupleAndKeywords(args, keywds, "O|OOOOiz:rollout",
+                                   (char **)kwlist, &pyBoard, &pyCubeInfo,
+                                   &pyRolloutContext, &pyMoves, &pyProgress,
+                                   &fDeterministic, &szCheckpoint))
     return NULL;
-  }
-  if (!ms.anDice[0] && !ms.fDoubled && !ms.fResigned) {
-    PyErr_SetString(PyExc_RuntimeError,
-                    "Hints for cube actions not yet implemented");
+  if (fDeterministic)
+    return DeterministicRollout(pyBoard, pyCubeInfo, pyRolloutContext, pyMoves,
+                                pyProgress == Py_None ? NULL : pyProgress,
+                                szCheckpoint);
+  if (szCheckpoint) {
+    PyErr_SetString(PyExc_ValueError,
+                    "checkpoint needs deterministic=True");
     return NULL;
   }
-  if (ms.fResigned) {
-    PyErr_SetString(PyExc_RuntimeError,
-                    "Hints for resignations not yet implemented");
+
+  if (!PyToBoard(pyBoard, anBoard)) {
+    PyErr_SetString(PyExc_TypeError, "Invalid board format");
     return NULL;
   }
-  if (ms.fDoubled) {
-    PyErr_SetString(PyExc_RuntimeError,
-                    "Hints for take actions not yet implemented");
+  SetCubeInfo(&ci, 1, -1, 0, 0, anScore, FALSE, TRUE, FALSE,
+              VARIATION_STANDARD);
+  if (pyCubeInfo && pyCubeInfo != Py_None && PyToCubeInfo(pyCubeInfo, &ci) != 0)
     return NULL;
-  }
-  if (!ms.anDice[0]) {
-    PyErr_SetString(PyExc_RuntimeError, "No dice");
+  memcpy(&rc, &rcRollout, sizeof(rc));
+  if (pyRolloutContext && pyRolloutContext != Py_None &&
+      PyToRolloutContext(pyRolloutContext, &rc) != 0)
+    return NULL;
+  if (pyProgress == Py_None)
+    pyProgress = NULL;
+  if (pyProgress && !PyCallable_Check(pyProgress)) {
+    PyErr_SetString(PyExc_TypeError, "progress must be callable");
     return NULL;
   }
+  rc.nGamesDone = 0;
+  rc.nSkip = 0;
 
-  snprintf(szNumber, sizeof(szNumber), "%d", nMaxMoves);
-  memset(&prochint, 0, sizeof(prochint));
-  prochint.pvUserData = PyList_New(0);
-  if (!prochint.pvUserData)
-    return NULL;
-  prochint.pfProcessRecord = PythonHint_Callback;
-  prochint.avInputData[PROCREC_HINT_ARGIN_SHOWPROGRESS] = (void *)(intptr_t)0;
-  prochint.avInputData[PROCREC_HINT_ARGIN_MAXMOVES] =
-      (void *)(intptr_t)nMaxMoves;
-  hint_move(szNumber, FALSE, &prochint);
-  if (MT_SafeGet(&fInterrupt)) {
-    ResetInterrupt();
-    Py_DECREF((PyObject *)prochint.pvUserData);
-    PyErr_SetString(PyExc_RuntimeError, "interrupted/errno in hint_move");
-    return NULL;
+  if (pyMoves && pyMoves != Py_None) {
+    cubeinfo ciMove;
+
+    if (PyToCandidateMoves(pyMoves, (ConstTanBoard)anBoard, &aanMove) != 0)
+      return NULL;
+    if (aanMove.empty())
+      return PyList_New(0);
+    OpponentCubeInfo(&ci, &ciMove);
+    for (const auto &anMove : aanMove) {
+      rolloutalternative ra;
+
+      memset(&ra, 0, sizeof(ra));
+      BoardAfterMove((ConstTanBoard)anBoard, anMove.data(), ra.anBoard);
+      ra.ci = ciMove;
+      ra.es.et = EVAL_ROLLOUT;
+      ra.es.rc = rc;
+      ara.push_back(ra);
+    }
+  } else {
+    rolloutalternative ra;
+
+    memset(&ra, 0, sizeof(ra));
+    memcpy(ra.anBoard, anBoard, sizeof(TanBoard));
+    ra.ci = ci;
+    ra.es.et = EVAL_ROLLOUT;
+    ra.es.rc = rc;
+    ara.push_back(ra);
   }
-  retval = (PyObject *)prochint.pvUserData;
-  gnubgid = PythonGnubgID(self, Py_BuildValue("()"));
-  if (gnubgid) {
-    PyObject *tmp = Py_BuildValue("{s:s,s:N,s:N}", "hinttype", "chequer",
-                                  "gnubgid", gnubgid, "hint", retval);
-    Py_DECREF(retval);
-    Py_DECREF(gnubgid);
-    retval = tmp;
+
+  if (RunRollout(ara, !aanMove.empty(), pyProgress) != 0)
+    return NULL;
+
+  if (aanMove.empty())
+    return RolloutResultToPy(&ara[0]);
+
+  PyObject *list = PyList_New((Py_ssize_t)ara.size());
+  if (!list)
+    return NULL;
+  for (size_t i = 0; i < ara.size(); ++i) {
+    PyObject *dict = RolloutResultToPy(&ara[i]);
+
+    if (!dict) {
+      Py_DECREF(list);
+      return NULL;
+    }
+    AddCandidateMove(dict, (ConstTanBoard)anBoard, aanMove[i].data());
+    PyList_SET_ITEM(list, (Py_ssize_t)i, dict);
   }
-  return retval;
+  return list;
 }
 
-/* Helper: set dict key and decref value (steal reference) */
-static void DictSetItemSteal(PyObject *dict, const char *key, PyObject *val) {
-  if (PyDict_SetItemString(dict, key, val) == 0)
-    Py_DECREF(val);
+/* -------------------------------------------------------------------------
+ * Trial rollouts
+ * ------------------------------------------------------------------------- */
+
+/* Trials per engine task. */
+#define TRIAL_BLOCK 36
+
+/* trialshard.fFlags: the positions are the candidate moves of one board. */
+#define TRIAL_FLAG_MOVES 1
+
+/* Default trials between two saves of a rollout checkpoint. */
+#define TRIAL_CHECKPOINT_INTERVAL 1296
+
+/* A trial rollout job with the positions and moves it was built from. */
+struct TrialJob {
+  trialjob tj;
+  TanBoard anBoard;
+  std::vector<std::array<int, 8>> aanMove;
+  std::vector<trialposition> atp;
+  uint64_t nJob;
+  guint32 fFlags;
+};
+
+/* Consecutive trials of some positions of a job, played on a worker by
+ * TrialBlockTask. */
+typedef struct {
+  const trialjob *ptj;
+  unsigned int iFirst, iLast;
+  unsigned int iPosition, cPositions;
+  trialsums *ats; /* one per position played */
+} trialblock;
+
+static void TrialBlockTask(void *p) {
+  trialblock *ptb = (trialblock *)p;
+
+  for (unsigned int i = ptb->iFirst; i < ptb->iLast; ++i)
+    for (unsigned int j = 0; j < ptb->cPositions; ++j) {
+      float arOutput[NUM_ROLLOUT_OUTPUTS];
+      rolloutstat ars[2];
+
+      if (TrialRollout(ptb->ptj, ptb->iPosition + j, i, arOutput, ars) < 0) {
+        MT_SetResultFailed();
+        return;
+      }
+      TrialSumsAdd(&ptb->ats[j], arOutput, ars);
+    }
 }
 
-/* No-op for library build (no GUI) */
-static PyObject *PythonUpdateUI(PyObject *self, PyObject *args) {
-  (void)self;
-  (void)args;
-  Py_INCREF(Py_None);
-  return Py_None;
+/* Everything the trials of a job depend on; the number of trials and the
+ * stopping rules are left out so that shards of one job can be merged. */
+static uint64_t HashTrialJob(const trialjob *ptj) {
+  const rolloutcontext *prc = &ptj->rc;
+  const int an[] = {(int)prc->fVarRedn,       (int)prc->fInitial,
+                    (int)prc->fRotate,        (int)prc->fTruncBearoff2,
+                    (int)prc->fTruncBearoffOS, (int)prc->fLateEvals,
+                    (int)prc->fDoTruncate,    (int)prc->nTruncate,
+                    (int)prc->nLate};
+  uint64_t h = HashBytes(0xcbf29ce484222325ULL, an, sizeof(an));
+
+  h = HashBytes(h, &ptj->nSeed, sizeof(ptj->nSeed));
+  for (int i = 0; i < 2; ++i) {
+    h = HashEvalContext(h, &prc->aecChequer[i]);
+    h = HashEvalContext(h, &prc->aecChequerLate[i]);
+    h = HashMoveFilters(h, prc->aaamfChequer[i]);
+    h = HashMoveFilters(h, prc->aaamfLate[i]);
+  }
+  /* Only for cubeful jobs, so cubeless jobs keep their earlier hashes. */
+  if (prc->fCubeful) {
+    const int fCubeful = TRUE;
+
+    h = HashBytes(h, &fCubeful, sizeof(fCubeful));
+    for (int i = 0; i < 2; ++i) {
+      h = HashEvalContext(h, &prc->aecCube[i]);
+      h = HashEvalContext(h, &prc->aecCubeLate[i]);
+    }
+  }
+  h = HashEvalContext(h, &prc->aecChequerTrunc);
+  for (unsigned int i = 0; i < ptj->cPositions; ++i) {
+    oldpositionkey key;
+
+    oldPositionKey((ConstTanBoard)ptj->atp[i].anBoard, &key);
+    h = HashBytes(h, key.auch, sizeof(key.auch));
+    h = HashCubeInfo(h, &ptj->atp[i].ci);
+    h = HashBytes(h, &ptj->atp[i].fInvert, sizeof(ptj->atp[i].fInvert));
+  }
+  return h;
+}
+
+/* Trials must not depend on noise drawn per evaluation. */
+static int TrialContextDeterministic(const rolloutcontext *prc) {
+  const evalcontext *apec[] = {
+      &prc->aecChequer[0],     &prc->aecChequer[1], &prc->aecChequerLate[0],
+      &prc->aecChequerLate[1], &prc->aecChequerTrunc};
+  const evalcontext *apecCube[] = {&prc->aecCube[0], &prc->aecCube[1],
+                                   &prc->aecCubeLate[0], &prc->aecCubeLate[1]};
+
+  for (const evalcontext *pec : apec)
+    if (pec->rNoise > 0.0f && !pec->fDeterministic)
+      return FALSE;
+  for (const evalcontext *pec : apecCube)
+    if (prc->fCubeful && pec->rNoise > 0.0f && !pec->fDeterministic)
+      return FALSE;
+  return TRUE;
 }
 
 /*
- * Ported from gnubgmodule.c: PythonNavigate
- * Exposed as: gnubg.navigate(next=..., game=...)
+ * Set up a trial rollout of board, or of the candidate moves in it, from
+ * the Python arguments. rolloutcontext defaults to the session's rollout
+ * settings, cube included. Returns 0, or -1 with an exception set.
  */
-static PyObject *PythonNavigate(PyObject *self, PyObject *args,
-                                PyObject *keywds) {
-  int nextRecord = INT_MIN;
-  int nextGame = INT_MIN;
-  PyObject *r = NULL;
-  static const char *kwlist[] = {"next", "game", NULL};
+static int PyToTrialJob(PyObject *pyBoard, PyObject *pyCubeInfo,
+                        PyObject *pyRolloutContext, PyObject *pyMoves,
+                        TrialJob *pjob) {
+  rolloutcontext *prc = &pjob->tj.rc;
+  int anScore[2] = {0, 0};
+  cubeinfo ci;
 
-  (void)self;
-  if (!lMatch.plNext) {
-    PyErr_SetString(PyExc_RuntimeError, "no active match");
-    return NULL;
+  if (!PyToBoard(pyBoard, pjob->anBoard)) {
+    PyErr_SetString(PyExc_TypeError, "Invalid board format");
+    return -1;
+  }
+  SetCubeInfo(&ci, 1, -1, 0, 0, anScore, FALSE, TRUE, FALSE,
+              VARIATION_STANDARD);
+  if (pyCubeInfo && pyCubeInfo != Py_None && PyToCubeInfo(pyCubeInfo, &ci) != 0)
+    return -1;
+  memcpy(prc, &rcRollout, sizeof(*prc));
+  if (pyRolloutContext && pyRolloutContext != Py_None &&
+      PyToRolloutContext(pyRolloutContext, prc) != 0)
+    return -1;
+  if (!TrialContextDeterministic(prc)) {
+    PyErr_SetString(PyExc_ValueError,
+                    "trial rollouts need deterministic evaluation noise");
+    return -1;
   }
-  if (!PyArg_ParseTupleAndKeywords(args, keywds, "|ii", (char **)kwlist,
-                                   &nextRecord, &nextGame))
-    return NULL;
 
-  if (nextRecord == INT_MIN && nextGame == INT_MIN) {
-    if (lMatch.plNext->p)
-      ChangeGame((listOLD *)lMatch.plNext->p);
-  } else {
-    int gamesDif = 0;
-    int recordsDiff = 0;
+  if (pyMoves && pyMoves != Py_None) {
+    cubeinfo ciMove;
 
-    if (nextRecord != INT_MIN && nextRecord < 0) {
-      PyErr_SetString(PyExc_ValueError, "negative next record");
-      return NULL;
+    if (PyToCandidateMoves(pyMoves, (ConstTanBoard)pjob->anBoard,
+                           &pjob->aanMove) != 0)
+      return -1;
+    OpponentCubeInfo(&ci, &ciMove);
+    for (const auto &anMove : pjob->aanMove) {
+      trialposition tp;
+
+      BoardAfterMove((ConstTanBoard)pjob->anBoard, anMove.data(), tp.anBoard);
+      tp.ci = ciMove;
+      tp.fInvert = TRUE;
+      pjob->atp.push_back(tp);
     }
-    if (nextGame != INT_MIN && nextGame != 0) {
-      listOLD *pl = lMatch.plNext;
-      while ((listOLD *)pl->p != plGame && pl != &lMatch)
-        pl = pl->plNext;
-      int n = nextGame;
-      if (n > 0) {
-        while (n > 0 && pl->plNext->p) {
-          pl = pl->plNext;
-          --n;
-        }
-      } else {
-        while (n < 0 && pl->plPrev->p) {
-          pl = pl->plPrev;
-          ++n;
-        }
+    pjob->fFlags = TRIAL_FLAG_MOVES;
+  } else {
+    trialposition tp;
+
+    memcpy(tp.anBoard, pjob->anBoard, sizeof(TanBoard));
+    tp.ci = ci;
+    tp.fInvert = FALSE;
+    pjob->atp.push_back(tp);
+    pjob->fFlags = 0;
+  }
+
+  pjob->tj.nSeed = prc->nSeed;
+  pjob->tj.cPositions = (unsigned int)pjob->atp.size();
+  pjob->tj.atp = pjob->atp.data();
+  pjob->nJob = HashTrialJob(&pjob->tj);
+  return 0;
+}
+
+/*
+ * Play trials [iFirst, iLast) of a job on the thread pool and add them to
+ * psh, which must not have them yet. Returns 0, or -1 with an exception
+ * set.
+ */
+static int RunTrials(const TrialJob *pjob, unsigned int iFirst,
+                     unsigned int iLast, trialshard *psh) {
+  const size_t cPositions = pjob->atp.size();
+  const size_t cBlocks = (iLast - iFirst + TRIAL_BLOCK - 1) / TRIAL_BLOCK;
+  ArenaScope scope;
+
+  if (!cBlocks || !cPositions)
+    return 0;
+
+  trialsums *ats = scope.Alloc<trialsums>(cBlocks * cPositions);
+  trialblock *atb = scope.Alloc<trialblock>(cBlocks);
+
+  memset(ats, 0, cBlocks * cPositions * sizeof(trialsums));
+  for (size_t i = 0; i < cBlocks; ++i) {
+    atb[i].ptj = &pjob->tj;
+    atb[i].iFirst = iFirst + (unsigned int)i * TRIAL_BLOCK;
+    atb[i].iLast = MIN(iLast, atb[i].iFirst + TRIAL_BLOCK);
+    atb[i].iPosition = 0;
+    atb[i].cPositions = (unsigned int)cPositions;
+    atb[i].ats = &ats[i * cPositions];
+  }
+  if (RunEngineTasks(TrialBlockTask, atb, sizeof(trialblock), cBlocks) < 0) {
+    if (!PyErr_Occurred())
+      PyErr_SetString(PyExc_RuntimeError, "trial rollout failed");
+    return -1;
+  }
+  for (size_t i = 0; i < cBlocks; ++i)
+    for (size_t j = 0; j < cPositions; ++j)
+      TrialSumsMerge(&psh->ats[j], &atb[i].ats[j]);
+  TrialShardAddRange(psh, iFirst, iLast);
+  return 0;
+}
+
+/*
+ * Continue psh from the checkpoint szFile if it exists. Returns 0, or -1
+ * with an exception set if the file belongs to another rollout or has
+ * trials outside [iFirst, iLast).
+ */
+static int LoadTrialCheckpoint(const char *szFile, const TrialJob *pjob,
+                               unsigned int iFirst, unsigned int iLast,
+                               trialshard *psh) {
+  GError *pError = NULL;
+  trialshard shFile;
+
+  if (!g_file_test(szFile, G_FILE_TEST_EXISTS))
+    return 0;
+  if (TrialShardLoad(&shFile, szFile, &pError) != 0) {
+    PyErr_SetString(PyExc_OSError, pError->message);
+    g_error_free(pError);
+    return -1;
+  }
+  if (shFile.nJob != pjob->nJob || shFile.fFlags != pjob->fFlags ||
+      shFile.cPositions != pjob->tj.cPositions) {
+    PyErr_Format(PyExc_ValueError, "%s is a checkpoint of another rollout",
+                 szFile);
+    TrialShardFree(&shFile);
+    return -1;
+  }
+  if (shFile.cRanges && (shFile.atr[0].iFirst < iFirst ||
+                         shFile.atr[shFile.cRanges - 1].iLast > iLast)) {
+    PyErr_Format(PyExc_ValueError, "%s has trials outside [%u, %u)", szFile,
+                 iFirst, iLast);
+    TrialShardFree(&shFile);
+    return -1;
+  }
+  TrialShardFree(psh);
+  *psh = shFile;
+  return 0;
+}
+
+/*
+ * Play the trials in [iFirst, iLast) that psh does not have yet, nInterval
+ * at a time. After each step psh is saved to szCheckpoint (unless NULL) and
+ * pending signals are handled, so KeyboardInterrupt loses at most one step.
+ * Returns 0, or -1 with an exception set.
+ */
+static int RunTrialsCheckpointed(const TrialJob *pjob, unsigned int iFirst,
+                                 unsigned int iLast, trialshard *psh,
+                                 const char *szCheckpoint,
+                                 unsigned int nInterval) {
+  unsigned int iNext = iFirst;
+
+  while (iNext < iLast) {
+    unsigned int iEnd = iLast;
+    GError *pError = NULL;
+
+    for (guint32 i = 0; i < psh->cRanges; ++i) {
+      if (psh->atr[i].iLast <= iNext)
+        continue;
+      if (psh->atr[i].iFirst <= iNext)
+        iNext = psh->atr[i].iLast;
+      else {
+        iEnd = MIN(iEnd, psh->atr[i].iFirst);
+        break;
       }
-      ChangeGame((listOLD *)pl->p);
-      gamesDif = abs(nextGame) - n;
     }
-    if (nextRecord != INT_MIN)
-      recordsDiff = nextRecord - InternalCommandNext(0, 0, nextRecord);
+    if (iNext >= iLast)
+      break;
+    iEnd = MIN(iEnd, iNext + nInterval);
 
-    if (plLastMove->plNext && plLastMove->plNext->p) {
-      const moverecord *pmr = (const moverecord *)(plLastMove->plNext->p);
-      if (pmr->mt == MOVE_NORMAL)
-        memcpy(ms.anDice, pmr->anDice, sizeof(ms.anDice));
+    if (RunTrials(pjob, iNext, iEnd, psh) != 0)
+      return -1;
+    if (szCheckpoint && TrialShardSave(psh, szCheckpoint, &pError) != 0) {
+      PyErr_SetString(PyExc_OSError, pError->message);
+      g_error_free(pError);
+      return -1;
     }
-    if (recordsDiff || gamesDif)
-      r = Py_BuildValue("(ii)", recordsDiff, gamesDif);
+    if (PyErr_CheckSignals() != 0)
+      return -1;
+    iNext = iEnd;
   }
-  if (ms.gs == GAME_NONE)
-    ms.gs = GAME_PLAYING;
-  if (!r)
-    r = Py_None;
-  Py_INCREF(r);
-  return r;
+  return 0;
 }
 
-static void addProperty(PyObject *dict, const char *name, const char *val) {
-  if (!val)
-    return;
-  PyObject *v = PyUnicode_FromString(val);
-  if (v) {
-    PyDict_SetItemString(dict, name, v);
-    Py_DECREF(v);
-  }
+static PyObject *TrialSumsToPy(const trialsums *pts) {
+  float arOutput[NUM_ROLLOUT_OUTPUTS], arStdDev[NUM_ROLLOUT_OUTPUTS];
+
+  TrialSumsResult(pts, arOutput, arStdDev);
+  return Py_BuildValue("{s:N,s:N,s:(NN),s:i}", "probs",
+                       RolloutOutputToPy(arOutput), "std",
+                       RolloutOutputToPy(arStdDev), "stats",
+                       RolloutStatToPy(&pts->ars[0]),
+                       RolloutStatToPy(&pts->ars[1]), "trials",
+                       (int)pts->cTrials);
 }
 
-/* Format anMove[8] as tuple of (from, to) pairs. */
-static PyObject *PyMove(const int move[8]) {
-  int n = 0;
-  while (n < 4 && move[2 * n] >= 0)
-    ++n;
-  PyObject *moveTuple = PyTuple_New(n);
-  if (!moveTuple)
-    return NULL;
-  for (int i = 0; i < n; ++i) {
-    PyObject *c = Py_BuildValue("(ii)", move[2 * i] + 1, move[2 * i + 1] + 1);
-    if (!c) {
-      Py_DECREF(moveTuple);
+/* A dict for a single position, a list of dicts for candidate moves. */
+static PyObject *TrialShardResultToPy(const trialshard *psh) {
+  PyObject *list;
+
+  if (!(psh->fFlags & TRIAL_FLAG_MOVES))
+    return TrialSumsToPy(&psh->ats[0]);
+  list = PyList_New((Py_ssize_t)psh->cPositions);
+  for (guint32 i = 0; list && i < psh->cPositions; ++i) {
+    PyObject *dict = TrialSumsToPy(&psh->ats[i]);
+
+    if (!dict) {
+      Py_DECREF(list);
       return NULL;
     }
-    PyTuple_SET_ITEM(moveTuple, i, c);
+    PyList_SET_ITEM(list, (Py_ssize_t)i, dict);
   }
-  return moveTuple;
+  return list;
 }
 
-/* Minimal PythonGame: info + game records (no analysis). For full match()
- * output. */
-static PyObject *PythonGame(const listOLD *plGame, int /* doAnalysis */,
-                            int /* verbose */, void * /* scMatch */,
-                            int includeBoards, void * /* ms */) {
-  const listOLD *pl = plGame->plNext;
-  const moverecord *pmr = (const moverecord *)pl->p;
-  const xmovegameinfo *g = &pmr->g;
-  PyObject *gameDict = PyDict_New();
-  PyObject *gameInfoDict = PyDict_New();
-  if (!gameDict || !gameInfoDict) {
-    Py_XDECREF(gameDict);
-    Py_XDECREF(gameInfoDict);
+static PyObject *TrialShardToPy(const trialshard *psh) {
+  PyObject *pyShard =
+      PyBytes_FromStringAndSize(NULL, (Py_ssize_t)TrialShardSize(psh));
+
+  if (pyShard)
+    TrialShardWrite(psh, (unsigned char *)PyBytes_AS_STRING(pyShard));
+  return pyShard;
+}
+
+/* Returns 0, or -1 with an exception set. */
+static int PyToTrialShard(PyObject *p, trialshard *psh) {
+  Py_buffer view;
+  int ret;
+
+  if (PyObject_GetBuffer(p, &view, PyBUF_SIMPLE) != 0)
+    return -1;
+  ret = TrialShardRead(psh, (const unsigned char *)view.buf, (size_t)view.len);
+  PyBuffer_Release(&view);
+  if (ret < 0)
+    PyErr_SetString(PyExc_ValueError, "not a rollout shard");
+  return ret;
+}
+
+/*
+ * Exposed as: gnubg.rolloutshard(board, [cubeinfo], [rolloutcontext],
+ * [moves], [first], [last], [checkpoint], [interval])
+ * Play trials [first, last) of a rollout (last defaults to the trials in
+ * rolloutcontext) and return their partial sums as bytes. Trial i uses the
+ * same dice wherever it is played, so shards from other processes or
+ * hosts can be combined with rolloutmerge. With checkpoint, the shard is
+ * saved to that file every interval trials and a run finds the trials
+ * already done there; the result is the same as an uninterrupted run.
+ * Cubeful contexts play the cube as RolloutGeneral does (see
+ * TrialRollout), but with the trial dice, so the merged result is an
+ * estimate of the same equities rather than RolloutGeneral's numbers.
+ */
+static PyObject *PythonRolloutShard(PyObject *self, PyObject *args,
+                                    PyObject *keywds) {
+  SessionLock session;
+  if (!session.Held())
+    return NULL;
+  PyObject *pyBoard = NULL;
+  PyObject *pyCubeInfo = NULL;
+  PyObject *pyRolloutContext = NULL;
+  PyObject *pyMoves = NULL;
+  static const char *kwlist[] = {"board", "cubeinfo",   "rolloutcontext",
+                                 "moves", "first",      "last",
+                                 "checkpoint", "interval", NULL};
+  int iFirst = 0, iLast = -1;
+  const char *szCheckpoint = NULL;
+  int nInterval = TRIAL_CHECKPOINT_INTERVAL;
+  TrialJob job;
+  trialshard sh;
+  PyObject *pyShard;
+
+  (void)self;
+  if (!PyArg_ParseTupleAndKeywords(args, keywds, "O|OOOiizi:rolloutshard",
+                                   (char **)kwlist, &pyBoard, &pyCubeInfo,
+                                   &pyRolloutContext, &pyMoves, &iFirst,
+                                   &iLast, &szCheckpoint, &nInterval))
+    return NULL;
+  if (nInterval < 1) {
+    PyErr_SetString(PyExc_ValueError, "interval must be positive");
     return NULL;
   }
-  DictSetItemSteal(gameInfoDict, "score-X", PyLong_FromLong(g->anScore[0]));
-  DictSetItemSteal(gameInfoDict, "score-O", PyLong_FromLong(g->anScore[1]));
-  if (g->anScore[0] + 1 == (int)g->nMatch ||
-      g->anScore[1] + 1 == (int)g->nMatch)
-    DictSetItemSteal(gameInfoDict, "crawford",
-                     PyBool_FromLong(g->fCrawfordGame));
-  if (g->fWinner >= 0) {
-    DictSetItemSteal(gameInfoDict, "winner",
-                     PyUnicode_FromString(g->fWinner ? "O" : "X"));
-    DictSetItemSteal(gameInfoDict, "points-won", PyLong_FromLong(g->nPoints));
-    DictSetItemSteal(gameInfoDict, "resigned", PyBool_FromLong(g->fResigned));
-  } else {
-    PyObject *none = Py_None;
-    Py_INCREF(none);
-    DictSetItemSteal(gameInfoDict, "winner", none);
+  if (PyToTrialJob(pyBoard, pyCubeInfo, pyRolloutContext, pyMoves, &job) != 0)
+    return NULL;
+  if (iLast < 0)
+    iLast = (int)job.tj.rc.nTrials;
+  if (iFirst < 0 || iFirst > iLast) {
+    PyErr_SetString(PyExc_ValueError, "need 0 <= first <= last");
+    return NULL;
   }
-  if (g->nAutoDoubles)
-    DictSetItemSteal(gameInfoDict, "initial-cube",
-                     PyLong_FromLong(1 << g->nAutoDoubles));
-  DictSetItemSteal(gameDict, "info", gameInfoDict);
 
-  TanBoard anBoard;
-  int nRecords = 0;
-  for (const listOLD *t = pl->plNext; t != plGame; t = t->plNext)
-    ++nRecords;
-  PyObject *gameTuple = PyTuple_New(nRecords);
-  if (!gameTuple) {
-    Py_DECREF(gameDict);
+  TrialShardInit(&sh, job.nJob, job.fFlags, job.tj.cPositions);
+  if ((szCheckpoint &&
+       LoadTrialCheckpoint(szCheckpoint, &job, (unsigned int)iFirst,
+                           (unsigned int)iLast, &sh) != 0) ||
+      RunTrialsCheckpointed(&job, (unsigned int)iFirst, (unsigned int)iLast,
+                            &sh, szCheckpoint,
+                            szCheckpoint ? (unsigned int)nInterval
+                                         : (unsigned int)(iLast - iFirst)) !=
+          0) {
+    TrialShardFree(&sh);
     return NULL;
   }
-  if (includeBoards)
-    InitBoard(anBoard, g->bgv);
-  nRecords = 0;
-  for (pl = pl->plNext; pl != plGame; pl = pl->plNext) {
-    pmr = (const moverecord *)pl->p;
-    PyObject *recordDict = PyDict_New();
-    if (!recordDict) {
-      Py_DECREF(gameTuple);
-      Py_DECREF(gameDict);
-      return NULL;
-    }
-    const char *action = NULL;
-    int player = -1;
-    long points = -1;
-    switch (pmr->mt) {
+  pyShard = TrialShardToPy(&sh);
+  TrialShardFree(&sh);
+  return pyShard;
+}
+
+/*
+ * Exposed as: gnubg.rolloutmerge(shards)
+ * Combine shards of one rollout into a single shard. The sums are exact,
+ * so the result does not depend on how the trials were split.
+ */
+static PyObject *PythonRolloutMerge(PyObject *self, PyObject *args) {
+  PyObject *pyShards = NULL;
+  PyObject *pySeq;
+  PyObject *pyShard = NULL;
+  trialshard sh;
+  int fOK = TRUE;
+
+  (void)self;
+  if (!PyArg_ParseTuple(args, "O:rolloutmerge", &pyShards))
+    return NULL;
+  if (!(pySeq = PySequence_Fast(pyShards, "shards must be a sequence")))
+    return NULL;
+  if (PySequence_Fast_GET_SIZE(pySeq) == 0) {
+    Py_DECREF(pySeq);
+    PyErr_SetString(PyExc_ValueError, "no shards to merge");
+    return NULL;
+  }
+  if (PyToTrialShard(PySequence_Fast_GET_ITEM(pySeq, 0), &sh) != 0) {
+    Py_DECREF(pySeq);
+    return NULL;
+  }
+
+  for (Py_ssize_t i = 1; fOK && i < PySequence_Fast_GET_SIZE(pySeq); ++i) {
+    trialshard shFrom;
+    int ret;
+
+    if (PyToTrialShard(PySequence_Fast_GET_ITEM(pySeq, i), &shFrom) != 0) {
+      fOK = FALSE;
+      break;
+    }
+    ret = TrialShardMerge(&sh, &shFrom);
+    TrialShardFree(&shFrom);
+    if (ret == -1)
+      PyErr_Format(PyExc_ValueError, "shards[%zd] is from another rollout", i);
+    else if (ret < 0)
+      PyErr_Format(PyExc_ValueError,
+                   "shards[%zd] repeats trials of an earlier shard", i);
+    fOK = ret == 0;
+  }
+  if (fOK)
+    pyShard = TrialShardToPy(&sh);
+  TrialShardFree(&sh);
+  Py_DECREF(pySeq);
+  return pyShard;
+}
+
+/*
+ * Exposed as: gnubg.rolloutresult(shard)
+ * The rollout result in a shard, in the form gnubg.rollout returns it: a
+ * dict, or for candidate moves a list of dicts in the order of the moves.
+ */
+static PyObject *PythonRolloutResult(PyObject *self, PyObject *args) {
+  PyObject *pyShard = NULL;
+  PyObject *pyResult;
+  trialshard sh;
+
+  (void)self;
+  if (!PyArg_ParseTuple(args, "O:rolloutresult", &pyShard))
+    return NULL;
+  if (PyToTrialShard(pyShard, &sh) != 0)
+    return NULL;
+  pyResult = TrialShardResultToPy(&sh);
+  TrialShardFree(&sh);
+  return pyResult;
+}
+
+/*
+ * For each of n candidate moves, the equity difference to the best one in
+ * units of their joint standard error (the quantity RolloutGeneral
+ * compares with rJsdLimit); 0 for the best move. The cubeful equity is
+ * compared in cubeful rollouts.
+ */
+static std::vector<double> CandidateJsd(const trialsums *ats, size_t n,
+                                        int fCubeful) {
+  const int iEquity = fCubeful ? OUTPUT_CUBEFUL_EQUITY : OUTPUT_EQUITY;
+  std::vector<double> arEquity(n), arStdErr(n), arJsd(n);
+  size_t iBest = 0;
+
+  for (size_t i = 0; i < n; ++i) {
+    float arOutput[NUM_ROLLOUT_OUTPUTS], arStdDev[NUM_ROLLOUT_OUTPUTS];
+
+    TrialSumsResult(&ats[i], arOutput, arStdDev);
+    arEquity[i] = arOutput[iEquity];
+    arStdErr[i] = arStdDev[iEquity];
+    if (arEquity[i] > arEquity[iBest])
+      iBest = i;
+  }
+  for (size_t i = 0; i < n; ++i) {
+    double rDiff = arEquity[iBest] - arEquity[i];
+    double rStdErr = sqrt(arStdErr[iBest] * arStdErr[iBest] +
+                          arStdErr[i] * arStdErr[i]);
+
+    arJsd[i] = rStdErr > 0.0 ? rDiff / rStdErr : rDiff > 0.0 ? HUGE_VAL : 0.0;
+  }
+  return arJsd;
+}
+
+/* Add move, movestr and jsd to the result dicts of the candidates. */
+static void AddCandidateInfo(PyObject *list, const TrialJob *pjob,
+                             const std::vector<double> &arJsd) {
+  for (size_t i = 0; i < pjob->aanMove.size(); ++i) {
+    PyObject *dict = PyList_GET_ITEM(list, (Py_ssize_t)i);
+
+    AddCandidateMove(dict, (ConstTanBoard)pjob->anBoard,
+                     pjob->aanMove[i].data());
+    DictSetItemSteal(dict, "jsd", PyFloat_FromDouble(arJsd[i]));
+  }
+}
+
+/*
+ * Iterator returned by gnubg.rollout_iter: plays the trials of a job in
+ * steps and yields a snapshot after each step.
+ */
+typedef struct {
+  PyObject_HEAD
+  TrialJob *pjob; /* NULL once finished or closed */
+  trialshard sh;
+  unsigned int iNext, iLast, nEvery;
+} RolloutIterObject;
+
+/*
+ * The snapshot after a step: {"trials": done, "total": trials in the
+ * rolloutcontext, "result": as rolloutresult}. For candidate moves each
+ * result also has move, movestr and jsd (see CandidateJsd).
+ */
+static PyObject *RolloutIterSnapshot(RolloutIterObject *pri) {
+  PyObject *pyResult = TrialShardResultToPy(&pri->sh);
+
+  if (!pyResult)
+    return NULL;
+  if (pri->sh.fFlags & TRIAL_FLAG_MOVES)
+    AddCandidateInfo(pyResult, pri->pjob,
+                     CandidateJsd(pri->sh.ats, pri->sh.cPositions,
+                                  pri->pjob->tj.rc.fCubeful));
+  return Py_BuildValue("{s:i,s:i,s:N}", "trials",
+                       (int)TrialShardTrials(&pri->sh), "total",
+                       (int)pri->iLast, "result", pyResult);
+}
+
+static void RolloutIterFinish(RolloutIterObject *pri) {
+  delete pri->pjob;
+  pri->pjob = NULL;
+}
+
+static void RolloutIterDealloc(PyObject *self) {
+  RolloutIterObject *pri = (RolloutIterObject *)self;
+
+  RolloutIterFinish(pri);
+  TrialShardFree(&pri->sh);
+  Py_TYPE(self)->tp_free(self);
+}
+
+static PyObject *RolloutIterNext(PyObject *self) {
+  RolloutIterObject *pri = (RolloutIterObject *)self;
+  unsigned int iEnd;
+
+  if (!pri->pjob)
+    return NULL;
+  if (pri->iNext >= pri->iLast) {
+    RolloutIterFinish(pri);
+    return NULL;
+  }
+  iEnd = MIN(pri->iLast, pri->iNext + pri->nEvery);
+  if (RunTrials(pri->pjob, pri->iNext, iEnd, &pri->sh) != 0) {
+    RolloutIterFinish(pri);
+    return NULL;
+  }
+  pri->iNext = iEnd;
+  return RolloutIterSnapshot(pri);
+}
+
+static PyObject *RolloutIterClose(PyObject *self, PyObject *args) {
+  (void)args;
+  RolloutIterFinish((RolloutIterObject *)self);
+  Py_RETURN_NONE;
+}
+
+static PyObject *RolloutIterShard(PyObject *self, PyObject *args) {
+  (void)args;
+  return TrialShardToPy(&((RolloutIterObject *)self)->sh);
+}
+
+static PyMethodDef RolloutIterMethods[] = {
+    {"close", RolloutIterClose, METH_NOARGS,
+     "Stop the rollout; no more trials are played"},
+    {"shard", RolloutIterShard, METH_NOARGS,
+     "The trials played so far as a shard (see rolloutshard)"},
+    {NULL, NULL, 0, NULL}};
+
+static PyTypeObject RolloutIterType = {PyVarObject_HEAD_INIT(NULL, 0)};
+
+/* Fill in RolloutIterType; called once from module init. */
+static int InitRolloutIterType(void) {
+  RolloutIterType.tp_name = "gnubg.RolloutIterator";
+  RolloutIterType.tp_basicsize = sizeof(RolloutIterObject);
+  RolloutIterType.tp_dealloc = RolloutIterDealloc;
+  RolloutIterType.tp_flags = Py_TPFLAGS_DEFAULT;
+  RolloutIterType.tp_doc = "Snapshots of a running rollout";
+  RolloutIterType.tp_iter = PyObject_SelfIter;
+  RolloutIterType.tp_iternext = RolloutIterNext;
+  RolloutIterType.tp_methods = RolloutIterMethods;
+  return PyType_Ready(&RolloutIterType);
+}
+
+/*
+ * Exposed as: gnubg.rollout_iter(board, [cubeinfo], [rolloutcontext],
+ * [moves], [every])
+ * Roll out like rolloutshard, yielding a snapshot after every `every`
+ * trials (default 36 per engine thread) so the caller can apply its own
+ * stopping rule; breaking out of the loop or calling close() stops the
+ * rollout.
+ */
+static PyObject *PythonRolloutIter(PyObject *self, PyObject *args,
+                                   PyObject *keywds) {
+  SessionLock session;
+  if (!session.Held())
+    return NULL;
+  PyObject *pyBoard = NULL;
+  PyObject *pyCubeInfo = NULL;
+  PyObject *pyRolloutContext = NULL;
+  PyObject *pyMoves = NULL;
+  static const char *kwlist[] = {"board", "cubeinfo", "rolloutcontext",
+                                 "moves", "every",    NULL};
+  int nEvery = (int)(TRIAL_BLOCK * MAX(1u, MT_GetNumThreads()));
+  TrialJob *pjob;
+  RolloutIterObject *pri;
+
+  (void)self;
+  if (!PyArg_ParseTupleAndKeywords(args, keywds, "O|OOOi:rollout_iter",
+                                   (char **)kwlist, &pyBoard, &pyCubeInfo,
+                                   &pyRolloutContext, &pyMoves, &nEvery))
+    return NULL;
+  if (nEvery < 1) {
+    PyErr_SetString(PyExc_ValueError, "every must be positive");
+    return NULL;
+  }
+  pjob = new TrialJob();
+  if (PyToTrialJob(pyBoard, pyCubeInfo, pyRolloutContext, pyMoves, pjob) !=
+      0) {
+    delete pjob;
+    return NULL;
+  }
+  if (!(pri = PyObject_New(RolloutIterObject, &RolloutIterType))) {
+    delete pjob;
+    return NULL;
+  }
+  pri->pjob = pjob;
+  TrialShardInit(&pri->sh, pjob->nJob, pjob->fFlags, pjob->tj.cPositions);
+  pri->iNext = 0;
+  pri->iLast = pjob->tj.rc.nTrials;
+  pri->nEvery = (unsigned int)nEvery;
+  return (PyObject *)pri;
+}
+
+/* Default trials per round of gnubg.rolloutmoves between two JSD checks. */
+#define TRIAL_ROUND 324
+
+/* The blocks of one round of gnubg.rolloutmoves, in the order they are
+ * handed out. Each task has its own sums; the round's are added to a
+ * candidate's only if it was still active when the round began. */
+typedef struct {
+  trialblock *atb;
+  size_t cTasks;
+  size_t iNext, cDone; /* under movesschedule.mtx */
+} movesround;
+
+/*
+ * Shared by the workers of one pass of gnubg.rolloutmoves. Workers take
+ * blocks of the current round; once none is left to take they take blocks
+ * of the next round instead, until the current one is done. The blocks of
+ * the next round are queued least decided candidate first (lowest jsd, the
+ * furthest from rJsdLimit), as those are the least likely to be dropped at
+ * the end of the current round and have their blocks thrown away.
+ */
+typedef struct {
+  GMutex mtx;
+  movesround *prdNow, *prdNext;
+  const canceltokens *pact; /* of the calling thread */
+  int nCancel;
+  size_t cRun, cAhead; /* blocks run, of them from the next round */
+} movesschedule;
+
+static void MovesWorker(void *p) {
+  movesschedule *pms = *(movesschedule **)p;
+
+  for (;;) {
+    movesround *prd = NULL;
+    trialblock *ptb;
+    int nCancel;
+
+    g_mutex_lock(&pms->mtx);
+    if (!pms->nCancel) {
+      if (pms->prdNow->iNext < pms->prdNow->cTasks)
+        prd = pms->prdNow;
+      else if (pms->prdNow->cDone < pms->prdNow->cTasks &&
+               pms->prdNext->iNext < pms->prdNext->cTasks) {
+        prd = pms->prdNext;
+        pms->cAhead++;
+      }
+    }
+    if (!prd) {
+      g_mutex_unlock(&pms->mtx);
+      return;
+    }
+    ptb = &prd->atb[prd->iNext++];
+    pms->cRun++;
+    g_mutex_unlock(&pms->mtx);
+
+    TrialBlockTask(ptb);
+    nCancel = CancelState(*pms->pact);
+
+    g_mutex_lock(&pms->mtx);
+    prd->cDone++;
+    if (nCancel)
+      pms->nCancel = nCancel;
+    g_mutex_unlock(&pms->mtx);
+  }
+}
+
+/* Active candidates, least decided first. */
+static std::vector<size_t> CandidatesByJsd(const std::vector<char> &afActive,
+                                           const std::vector<double> &arJsd) {
+  std::vector<size_t> ai;
+
+  for (size_t i = 0; i < afActive.size(); ++i)
+    if (afActive[i])
+      ai.push_back(i);
+  std::stable_sort(ai.begin(), ai.end(), [&arJsd](size_t a, size_t b) {
+    return arJsd[a] < arJsd[b];
+  });
+  return ai;
+}
+
+/* Queue trials [iFirst, iLast) of the candidates in aiOrder into prd, whose
+ * atb has room and whose ats has one zeroed trialsums per block. */
+static void FillMovesRound(movesround *prd, trialsums *ats, const trialjob *ptj,
+                           unsigned int iFirst, unsigned int iLast,
+                           const std::vector<size_t> &aiOrder) {
+  prd->cTasks = prd->iNext = prd->cDone = 0;
+  for (size_t i : aiOrder)
+    for (unsigned int j = iFirst; j < iLast; j += TRIAL_BLOCK) {
+      trialblock *ptb = &prd->atb[prd->cTasks];
+
+      ptb->ptj = ptj;
+      ptb->iFirst = j;
+      ptb->iLast = MIN(iLast, j + TRIAL_BLOCK);
+      ptb->iPosition = (unsigned int)i;
+      ptb->cPositions = 1;
+      ptb->ats = &ats[prd->cTasks++];
+      memset(ptb->ats, 0, sizeof(trialsums));
+    }
+}
+
+/* Drop the blocks of inactive candidates that prd has not handed out yet,
+ * and queue the rest least decided first. */
+static void PruneMovesRound(movesround *prd, const std::vector<char> &afActive,
+                            const std::vector<double> &arJsd) {
+  trialblock *ptb = prd->atb + prd->iNext;
+  trialblock *ptbEnd =
+      std::stable_partition(ptb, prd->atb + prd->cTasks,
+                            [&afActive](const trialblock &tb) {
+                              return afActive[tb.iPosition] != 0;
+                            });
+
+  std::stable_sort(ptb, ptbEnd,
+                   [&arJsd](const trialblock &a, const trialblock &b) {
+                     return arJsd[a.iPosition] < arJsd[b.iPosition];
+                   });
+  prd->cTasks = (size_t)(ptbEnd - prd->atb);
+}
+
+/*
+ * Exposed as: gnubg.rolloutmoves(board, moves, [cubeinfo], [rolloutcontext],
+ * [every])
+ * Roll out candidate moves in rounds of `every` trials. All candidates play
+ * the same trials, so they see the same dice. With fStopOnJsd set, after
+ * each round a candidate whose jsd has reached rJsdLimit (after at least
+ * nMinimumJsdGames trials) is dropped, and the rollout ends when one
+ * candidate is left; otherwise every candidate plays all trials. Threads
+ * left without work at the end of a round start on the next one, on the
+ * candidates furthest from rJsdLimit (see movesschedule), instead of
+ * waiting. Blocks played ahead for a candidate that is then dropped are
+ * not counted, so the result does not depend on the number of threads.
+ */
+static PyObject *PythonRolloutMoves(PyObject *self, PyObject *args,
+                                    PyObject *keywds) {
+  SessionLock session;
+  if (!session.Held())
+    return NULL;
+  PyObject *pyBoard = NULL;
+  PyObject *pyMoves = NULL;
+  PyObject *pyCubeInfo = NULL;
+  PyObject *pyRolloutContext = NULL;
+  static const char *kwlist[] = {"board", "moves", "cubeinfo",
+                                 "rolloutcontext", "every", NULL};
+  int nEvery = TRIAL_ROUND;
+  TrialJob job;
+
+  (void)self;
+  if (!PyArg_ParseTupleAndKeywords(args, keywds, "OO|OOi:rolloutmoves",
+                                   (char **)kwlist, &pyBoard, &pyMoves,
+                                   &pyCubeInfo, &pyRolloutContext, &nEvery))
+    return NULL;
+  if (nEvery < 1) {
+    PyErr_SetString(PyExc_ValueError, "every must be positive");
+    return NULL;
+  }
+  if (pyMoves == Py_None) {
+    PyErr_SetString(PyExc_TypeError, "moves must be a sequence");
+    return NULL;
+  }
+  if (PyToTrialJob(pyBoard, pyCubeInfo, pyRolloutContext, pyMoves, &job) != 0)
+    return NULL;
+
+  const rolloutcontext *prc = &job.tj.rc;
+  const size_t n = job.atp.size();
+  const size_t cRoom =
+      n * ((MIN(prc->nTrials, (unsigned int)nEvery) + TRIAL_BLOCK - 1) /
+           TRIAL_BLOCK);
+  std::vector<trialsums> ats(n);
+  std::vector<char> afActive(n, TRUE);
+  std::vector<double> arJsd(n, 0.0);
+  size_t cActive = n;
+  unsigned int iNext = 0;
+  ArenaScope scope;
+  movesround ard[2];
+  trialsums *aats[2];
+  movesround *prdNow = &ard[0], *prdNext = &ard[1];
+  movesschedule ms;
+
+  for (int i = 0; i < 2; ++i) {
+    ard[i].atb = scope.Alloc<trialblock>(cRoom);
+    aats[i] = scope.Alloc<trialsums>(cRoom);
+  }
+  FillMovesRound(prdNow, aats[0], &job.tj, 0,
+                 MIN(prc->nTrials, (unsigned int)nEvery),
+                 CandidatesByJsd(afActive, arJsd));
+  g_mutex_init(&ms.mtx);
+  ms.pact = &apctActive;
+
+  while (iNext < prc->nTrials && (cActive > 1 || n == 1)) {
+    const unsigned int iEnd = MIN(prc->nTrials, iNext + (unsigned int)nEvery);
+    const size_t cWorkers =
+        MIN((size_t)MAX(1u, MT_GetNumThreads()), prdNow->cTasks);
+    std::vector<movesschedule *> apms(cWorkers, &ms);
+    int ret;
+
+    /* prdNext takes the slot of the round before prdNow, whose sums have
+     * been added up. */
+    FillMovesRound(prdNext, aats[prdNext - ard], &job.tj, iEnd,
+                   MIN(prc->nTrials, iEnd + (unsigned int)nEvery),
+                   CandidatesByJsd(afActive, arJsd));
+    ms.prdNow = prdNow;
+    ms.prdNext = prdNext;
+    ms.nCancel = 0;
+    ms.cRun = ms.cAhead = 0;
+    if ((ret = CancelState(apctActive)) != 0) {
+      g_mutex_clear(&ms.mtx);
+      SetCancelError(ret);
+      return NULL;
+    }
+    ret = RunEngineTaskList(MovesWorker, apms.data(), sizeof(movesschedule *),
+                            cWorkers);
+    tsEngine.cBatches += 1;
+    tsEngine.cTasks += ms.cRun;
+    tsEngine.cSteals += ms.cAhead;
+    if (ms.nCancel || ret < 0) {
+      g_mutex_clear(&ms.mtx);
+      if (ms.nCancel)
+        SetCancelError(ms.nCancel);
+      else if (!PyErr_Occurred())
+        PyErr_SetString(PyExc_RuntimeError, "trial rollout failed");
+      return NULL;
+    }
+    for (size_t i = 0; i < prdNow->cTasks; ++i)
+      if (afActive[prdNow->atb[i].iPosition])
+        TrialSumsMerge(&ats[prdNow->atb[i].iPosition], prdNow->atb[i].ats);
+    iNext = iEnd;
+
+    arJsd = CandidateJsd(ats.data(), n, prc->fCubeful);
+    for (size_t i = 0; prc->fStopOnJsd && i < n; ++i)
+      if (afActive[i] && ats[i].cTrials >= prc->nMinimumJsdGames &&
+          arJsd[i] >= prc->rJsdLimit) {
+        afActive[i] = FALSE;
+        cActive--;
+      }
+    if (PyErr_CheckSignals() != 0) {
+      g_mutex_clear(&ms.mtx);
+      return NULL;
+    }
+    std::swap(prdNow, prdNext);
+    PruneMovesRound(prdNow, afActive, arJsd);
+  }
+  g_mutex_clear(&ms.mtx);
+
+  PyObject *list = PyList_New((Py_ssize_t)n);
+  if (!list)
+    return NULL;
+  for (size_t i = 0; i < n; ++i) {
+    PyObject *dict = TrialSumsToPy(&ats[i]);
+
+    if (!dict) {
+      Py_DECREF(list);
+      return NULL;
+    }
+    DictSetItemSteal(dict, "dropped", PyBool_FromLong(!afActive[i]));
+    PyList_SET_ITEM(list, (Py_ssize_t)i, dict);
+  }
+  AddCandidateInfo(list, &job, CandidateJsd(ats.data(), n, prc->fCubeful));
+  return list;
+}
+
+/*
+ * gnubg.rollout(..., deterministic=True): roll out on the trial kernel in
+ * rounds of TRIAL_ROUND trials. The dice of each trial depend only on the
+ * seed and the trial index and the sums are exact, so the result is the
+ * same bit for bit whatever the number of threads or the order the trials
+ * ran in. The context is used as given, cube included (see TrialRollout for
+ * how the trials play the cube). With szCheckpoint the sums are saved
+ * there after each round and a later call continues from them, as with
+ * gnubg.rolloutshard. progress({"trials", "total"}) is called after each
+ * round and may return False to stop. Each result carries "job", the hash
+ * of the inputs in hex, as a cache key.
+ */
+static PyObject *DeterministicRollout(PyObject *pyBoard, PyObject *pyCubeInfo,
+                                      PyObject *pyRolloutContext,
+                                      PyObject *pyMoves, PyObject *pyProgress,
+                                      const char *szCheckpoint) {
+  TrialJob job;
+  trialshard sh;
+  PyObject *pyResult;
+  unsigned int iNext = 0;
+  char szJob[17];
+
+  if (pyProgress && !PyCallable_Check(pyProgress)) {
+    PyErr_SetString(PyExc_TypeError, "progress must be callable");
+    return NULL;
+  }
+  if (PyToTrialJob(pyBoard, pyCubeInfo, pyRolloutContext, pyMoves, &job) != 0)
+    return NULL;
+  if (job.atp.empty())
+    return PyList_New(0);
+
+  TrialShardInit(&sh, job.nJob, job.fFlags, job.tj.cPositions);
+  if (szCheckpoint && LoadTrialCheckpoint(szCheckpoint, &job, 0,
+                                          job.tj.rc.nTrials, &sh) != 0) {
+    TrialShardFree(&sh);
+    return NULL;
+  }
+  while (iNext < job.tj.rc.nTrials) {
+    unsigned int iEnd = MIN(job.tj.rc.nTrials, iNext + TRIAL_ROUND);
+    int fStop = FALSE;
+
+    if (RunTrialsCheckpointed(&job, iNext, iEnd, &sh, szCheckpoint,
+                              TRIAL_ROUND) != 0) {
+      TrialShardFree(&sh);
+      return NULL;
+    }
+    iNext = iEnd;
+    if (pyProgress) {
+      PyObject *pyRet =
+          PyObject_CallFunction(pyProgress, "N",
+                                Py_BuildValue("{s:i,s:i}", "trials", (int)iNext,
+                                              "total", (int)job.tj.rc.nTrials));
+      if (!pyRet) {
+        TrialShardFree(&sh);
+        return NULL;
+      }
+      fStop = pyRet == Py_False;
+      Py_DECREF(pyRet);
+    }
+    if (fStop)
+      break;
+  }
+
+  pyResult = TrialShardResultToPy(&sh);
+  if (pyResult && (job.fFlags & TRIAL_FLAG_MOVES))
+    AddCandidateInfo(pyResult, &job, CandidateJsd(sh.ats, sh.cPositions,
+                                                  job.tj.rc.fCubeful));
+  TrialShardFree(&sh);
+  if (!pyResult)
+    return NULL;
+  snprintf(szJob, sizeof(szJob), "%016llx", (unsigned long long)job.nJob);
+  if (job.fFlags & TRIAL_FLAG_MOVES) {
+    for (Py_ssize_t i = 0; i < PyList_GET_SIZE(pyResult); ++i)
+      DictSetItemSteal(PyList_GET_ITEM(pyResult, i), "job",
+                       PyUnicode_FromString(szJob));
+  } else
+    DictSetItemSteal(pyResult, "job", PyUnicode_FromString(szJob));
+  return pyResult;
+}
+
+/*
+ * Ported from gnubgmodule.c: PythonClassifyPosition
+ * Exposed as: gnubg.classify(board, variant)
+ * Classifies a backgammon position.
+ */
+static PyObject *PythonClassifyPosition(PyObject *self, PyObject *args) {
+  SessionLock session;
+  if (!session.Held())
+    return NULL;
+  PyObject *pyBoard = NULL;
+  TanBoard anBoard;
+  bgvariation iVariant = ms.bgv;
+
+  memcpy(anBoard, msBoard(), sizeof(TanBoard));
+
+  if (!PyArg_ParseTuple(args, "|Oi:classify", &pyBoard, &iVariant))
+    return NULL;
+
+  if (pyBoard && !PyToBoard(pyBoard, anBoard)) {
+    PyErr_SetString(PyExc_TypeError, "Invalid board format");
+    return NULL;
+  }
+
+  if (iVariant >= NUM_VARIATIONS) {
+    PyErr_SetString(PyExc_ValueError, "Unknown variation");
+    return NULL;
+  }
+
+  return PyLong_FromLong(ClassifyPosition((ConstTanBoard)anBoard, iVariant));
+}
+
+/*
+ * Ported from gnubgmodule.c: PythonLuckRating
+ * Exposed as: gnubg.luckrating(luck)
+ * Converts luck value to rating (0-5).
+ */
+static PyObject *PythonLuckRating(PyObject *self, PyObject *args) {
+  float r;
+  if (!PyArg_ParseTuple(args, "f:luckrating", &r))
+    return NULL;
+
+  return PyLong_FromLong(getLuckRating(r));
+}
+
+/*
+ * Ported from gnubgmodule.c: PythonErrorRating
+ * Exposed as: gnubg.errorrating(error)
+ * Converts error value to rating (0-7).
+ */
+static PyObject *PythonErrorRating(PyObject *self, PyObject *args) {
+  float r;
+  if (!PyArg_ParseTuple(args, "f:errorrating", &r))
+    return NULL;
+
+  return PyLong_FromLong(GetRating(r));
+}
+
+/*
+ * Ported from gnubgmodule.c: PythonParseMove
+ * Exposed as: gnubg.parsemove(string)
+ * Parses a move string and returns move tuple.
+ */
+static PyObject *PythonParseMove(PyObject *self, PyObject *args) {
+  PyObject *pyMoves;
+  char *pch;
+  char *sz;
+  int an[8];
+  int nummoves;
+  int movesidx;
+  int saved_errno;
+
+  if (!PyArg_ParseTuple(args, "s:parsemove", &pch))
+    return NULL;
+
+  sz = g_strdup(pch);
+  if (!sz) {
+    PyErr_SetString(PyExc_MemoryError, "Failed to allocate memory");
+    return NULL;
+  }
+
+  // Convert dashes to slashes
+  for (char *p = sz; *p; p++)
+    if (*p == '-')
+      *p = '/';
+
+  saved_errno = errno;
+  errno = 0;
+  nummoves = ParseMove(sz, an);
+  g_free(sz);
+  errno = saved_errno;
+
+  if (nummoves < 0) {
+    // ParseMove sets errno on error (EINVAL = 22)
+    // The original implementation just returns NULL without setting an error,
+    // but we need to set an error for Python 3
+    // Note: ParseMove validates moves and may reject them for various reasons
+    PyErr_SetString(PyExc_ValueError, "Invalid move string");
+    return NULL;
+  }
+
+  if (!(pyMoves = PyTuple_New(nummoves)))
+    return NULL;
+
+  for (movesidx = 0; movesidx < nummoves; movesidx++) {
+    PyObject *pyMove;
+    PyObject *pyMoveL;
+    PyObject *pyMoveR;
+
+    pyMoveL = PyLong_FromLong(an[movesidx * 2]);
+    pyMoveR = PyLong_FromLong(an[movesidx * 2 + 1]);
+
+    if (!(pyMove = PyTuple_New(2)))
+      return NULL;
+
+    if (PyTuple_SetItem(pyMove, 0, pyMoveL) < 0)
+      return NULL;
+    if (PyTuple_SetItem(pyMove, 1, pyMoveR) < 0)
+      return NULL;
+
+    if (PyTuple_SetItem(pyMoves, movesidx, pyMove) < 0)
+      return NULL;
+  }
+
+  return pyMoves;
+}
+
+/*
+ * Ported from gnubgmodule.c: PythonMoveTuple2String
+ * Exposed as: gnubg.movetupletostring(move, board)
+ * Converts a move tuple to a string representation.
+ */
+static PyObject *PythonMoveTuple2String(PyObject *self, PyObject *args) {
+  PyObject *pyBoard = NULL;
+  PyObject *pyMove = NULL;
+  char szMove[FORMATEDMOVESIZE];
+  signed int anMove[8];
+  TanBoard anBoard;
+
+  memset(anBoard, 0, sizeof(TanBoard));
+  memset(anMove, -1, sizeof(anMove));
+
+  if (!PyArg_ParseTuple(args, "OO:movetupletostring", &pyMove, &pyBoard))
+    return NULL;
+
+  if (!pyMove || !pyBoard) {
+    PyErr_SetString(PyExc_TypeError,
+                    "Requires 2 arguments (move tuple, board)");
+    return NULL;
+  }
+
+  if (!PyToMove(pyMove, anMove)) {
+    PyErr_SetString(PyExc_TypeError, "Invalid move tuple");
+    return NULL;
+  }
+
+  if (!PyToBoard(pyBoard, anBoard)) {
+    PyErr_SetString(PyExc_TypeError, "Invalid board format");
+    return NULL;
+  }
+
+  szMove[0] = '\0';
+  FormatMove(szMove, (ConstTanBoard)anBoard, anMove);
+
+  return PyUnicode_FromString(szMove);
+}
+
+/*
+ * Ported from gnubgmodule.c: PythonMET
+ * Exposed as: gnubg.met([maxscore])
+ * Returns match equity table (list of lists).
+ */
+static PyObject *PythonMET(PyObject *self, PyObject *args) {
+  SessionLock session;
+  if (!session.Held())
+    return NULL;
+  int n = ms.nMatchTo ? ms.nMatchTo : MAXSCORE;
+  if (!PyArg_ParseTuple(args, "|i:met", &n))
+    return NULL;
+  if (n < 0 || n > MAXSCORE) {
+    PyErr_SetString(PyExc_ValueError, "invalid match length");
+    return NULL;
+  }
+
+  PyObject *pyMET = PyList_New(3);
+  if (!pyMET)
+    return NULL;
+
+  PyObject *pyList = METPre(aafMET, n);
+  if (!pyList) {
+    Py_DECREF(pyMET);
+    return NULL;
+  }
+  if (PyList_SetItem(pyMET, 0, pyList) < 0) {
+    Py_DECREF(pyMET);
+    return NULL;
+  }
+
+  for (int i = 0; i < 2; ++i) {
+    pyList = METRow(aafMETPostCrawford[i], n);
+    if (!pyList) {
+      Py_DECREF(pyMET);
+      return NULL;
+    }
+    if (PyList_SetItem(pyMET, i + 1, pyList) < 0) {
+      Py_DECREF(pyMET);
+      return NULL;
+    }
+  }
+  return pyMET;
+}
+
+/*
+ * Ported from gnubgmodule.c: PythonMatchID
+ * Exposed as: gnubg.matchid([cubeinfo], [posinfo])
+ * Returns match ID string.
+ */
+static PyObject *PythonMatchID(PyObject *self, PyObject *args) {
+  SessionLock session;
+  if (!session.Held())
+    return NULL;
+  PyObject *pyCubeInfo = NULL;
+  PyObject *pyPosInfo = NULL;
+  cubeinfo ci = {1,
+                 0,
+                 0,
+                 0,
+                 {0, 0},
+                 FALSE,
+                 TRUE,
+                 FALSE,
+                 {1.0f, 1.0f, 1.0f, 1.0f},
+                 VARIATION_STANDARD};
+  posinfo pi = {{0, 0}, 0, 0, 0, GAME_NONE};
+
+  if (!PyArg_ParseTuple(args, "|OO:matchid", &pyCubeInfo, &pyPosInfo))
+    return NULL;
+
+  if (!pyCubeInfo && ms.gs == GAME_NONE) {
+    PyErr_SetString(PyExc_ValueError, "no current position available");
+    return NULL;
+  }
+  if (pyCubeInfo && PyToCubeInfo(pyCubeInfo, &ci) != 0)
+    return NULL;
+  if (pyPosInfo && PyToPosInfo(pyPosInfo, &pi) != 0)
+    return NULL;
+  if (pyCubeInfo && !pyPosInfo) {
+    PyErr_SetString(PyExc_TypeError,
+                    "matchid: cubeinfo requires posinfo (see gnubg.matchid())");
+    return NULL;
+  }
+
+  if (!pyCubeInfo)
+    return PyUnicode_FromString(MatchIDFromMatchState(&ms));
+  return PyUnicode_FromString(MatchID((unsigned int *)pi.anDice, pi.fTurn,
+                                      pi.fResigned, pi.fDoubled, ci.fMove,
+                                      ci.fCubeOwner, ci.fCrawford, ci.nMatchTo,
+                                      ci.anScore, ci.nCube, ci.fJacoby, pi.gs));
+}
+
+/*
+ * Ported from gnubgmodule.c: PythonGnubgID
+ * Exposed as: gnubg.gnubgid([board], [cubeinfo], [posinfo])
+ * Returns GNUbgID string (positionid:matchid).
+ */
+static PyObject *PythonGnubgID(PyObject *self, PyObject *args) {
+  SessionLock session;
+  if (!session.Held())
+    return NULL;
+  PyObject *pyBoard = NULL;
+  PyObject *pyCubeInfo = NULL;
+  PyObject *pyPosInfo = NULL;
+  TanBoard anBoard;
+  cubeinfo ci;
+  posinfo pi;
+  char *szPosID = NULL;
+  char *szMatchID = NULL;
+  char *szGnubgID = NULL;
+  PyObject *pyRetVal = NULL;
+
+  memcpy(anBoard, msBoard(), sizeof(TanBoard));
+  pi.anDice[0] = ms.anDice[0];
+  pi.anDice[1] = ms.anDice[1];
+  pi.fTurn = ms.fTurn;
+  pi.fResigned = ms.fResigned;
+  pi.fDoubled = ms.fDoubled;
+  pi.gs = ms.gs;
+  GetMatchStateCubeInfo(&ci, &ms);
+
+  if (!PyArg_ParseTuple(args, "|OOO:gnubgid", &pyBoard, &pyCubeInfo,
+                        &pyPosInfo))
+    return NULL;
+
+  if (pyBoard && (!pyPosInfo || !pyCubeInfo)) {
+    PyErr_SetString(
+        PyExc_TypeError,
+        "gnubgid requires 0 or exactly 3 arguments (board, cubeinfo, posinfo). "
+        "See gnubg.board(), gnubg.cubeinfo(), gnubg.posinfo().");
+    return NULL;
+  }
+  if (pyBoard && !PyToBoard(pyBoard, anBoard)) {
+    PyErr_SetString(PyExc_TypeError, "Invalid board format");
+    return NULL;
+  }
+  if (!pyBoard && ms.gs == GAME_NONE) {
+    PyErr_SetString(PyExc_ValueError, "no current position available");
+    return NULL;
+  }
+  if (pyCubeInfo && PyToCubeInfo(pyCubeInfo, &ci) != 0)
+    return NULL;
+  if (pyPosInfo && PyToPosInfo(pyPosInfo, &pi) != 0)
+    return NULL;
+
+  szPosID = g_strdup(PositionID((ConstTanBoard)anBoard));
+  szMatchID =
+      g_strdup(MatchID((unsigned int *)pi.anDice, pi.fTurn, pi.fResigned,
+                       pi.fDoubled, ci.fMove, ci.fCubeOwner, ci.fCrawford,
+                       ci.nMatchTo, ci.anScore, ci.nCube, ci.fJacoby, pi.gs));
+  szGnubgID = g_strjoin(":", szPosID, szMatchID, NULL);
+  pyRetVal = PyUnicode_FromString(szGnubgID);
+  g_free(szPosID);
+  g_free(szMatchID);
+  g_free(szGnubgID);
+  return pyRetVal;
+}
+
+/*
+ * Ported from gnubgmodule.c: PythonDiceRolls
+ * Exposed as: gnubg.dicerolls(n)
+ * Returns list of n dice rolls as tuples (die1, die2).
+ */
+static PyObject *PythonDiceRolls(PyObject *self, PyObject *args) {
+  long n;
+  unsigned int anDice[2];
+  if (!PyArg_ParseTuple(args, "l:dicerolls", &n))
+    return NULL;
+  if (n <= 0) {
+    PyErr_SetString(PyExc_ValueError, "number of rolls must be greater than 0");
+    return NULL;
+  }
+
+  PyObject *pyDiceRolls = PyTuple_New((Py_ssize_t)n);
+  if (!pyDiceRolls)
+    return NULL;
+
+  for (Py_ssize_t idx = 0; idx < n; ++idx) {
+    RollDice(anDice, &rngCurrent, rngctxCurrent);
+    PyObject *pyDie1 = PyLong_FromLong(anDice[0]);
+    PyObject *pyDie2 = PyLong_FromLong(anDice[1]);
+    if (!pyDie1 || !pyDie2) {
+      Py_XDECREF(pyDie1);
+      Py_XDECREF(pyDie2);
+      Py_DECREF(pyDiceRolls);
+      return NULL;
+    }
+    PyObject *pyDiceRoll = PyTuple_Pack(2, pyDie1, pyDie2);
+    Py_DECREF(pyDie1);
+    Py_DECREF(pyDie2);
+    if (!pyDiceRoll) {
+      Py_DECREF(pyDiceRolls);
+      return NULL;
+    }
+    if (PyTuple_SetItem(pyDiceRolls, idx, pyDiceRoll) < 0) {
+      Py_DECREF(pyDiceRolls);
+      return NULL;
+    }
+  }
+  return pyDiceRolls;
+}
+
+/*
+ * Ported from gnubgmodule.c: PythonMatchChecksum
+ * Exposed as: gnubg.matchchecksum()
+ * Returns MD5 checksum of current match as 32-char hex string.
+ */
+static PyObject *PythonMatchChecksum(PyObject *self, PyObject *args) {
+  SessionLock session;
+  if (!session.Held())
+    return NULL;
+  if (!PyArg_ParseTuple(args, ":matchchecksum"))
+    return NULL;
+  return PyUnicode_FromString(GetMatchCheckSum());
+}
+
+/*
+ * Ported from gnubgmodule.c: PythonPositionBearoff
+ * Exposed as: gnubg.positionbearoff([board], [nPoints], [nChequers])
+ * Returns bearoff id for the given position (one side of board).
+ */
+static PyObject *PythonPositionBearoff(PyObject *self, PyObject *args) {
+  SessionLock session;
+  if (!session.Held())
+    return NULL;
+  PyObject *pyBoard = NULL;
+  int nChequers = 15;
+  int nPoints = 6;
+  TanBoard anBoard;
+  memset(anBoard, 0, sizeof(anBoard));
+  memcpy(anBoard, msBoard(), sizeof(TanBoard));
+
+  if (!PyArg_ParseTuple(args, "|Oii:positionbearoff", &pyBoard, &nPoints,
+                        &nChequers))
+    return NULL;
+  if (pyBoard && !PyToBoard1(pyBoard, anBoard[0])) {
+    PyErr_SetString(PyExc_TypeError, "Invalid board format");
+    return NULL;
+  }
+  return PyLong_FromLong((long)PositionBearoff(
+      anBoard[0], (unsigned int)nPoints, (unsigned int)nChequers));
+}
+
+/*
+ * Ported from gnubgmodule.c: PythonPositionFromBearoff
+ * Exposed as: gnubg.positionfrombearoff([id], [nChequers], [nPoints])
+ * Returns single board (25 ints) from bearoff id.
+ */
+static PyObject *PythonPositionFromBearoff(PyObject *self, PyObject *args) {
+  TanBoard anBoard;
+  unsigned int iPos = 0;
+  int nChequers = 15;
+  int nPoints = 6;
+  memset(anBoard, 0, sizeof(anBoard));
+
+  if (!PyArg_ParseTuple(args, "|iii:positionfrombearoff", &iPos, &nChequers,
+                        &nPoints))
+    return NULL;
+  if (nChequers < 1 || nChequers > 15 || nPoints < 1 || nPoints > 25) {
+    PyErr_SetString(PyExc_ValueError, "invalid number of chequers or points");
+    return NULL;
+  }
+
+  unsigned int n =
+      Combination((unsigned int)(nChequers + nPoints), (unsigned int)nPoints);
+  if (iPos >= n) {
+    PyErr_SetString(PyExc_ValueError, "invalid position number");
+    return NULL;
+  }
+  PositionFromBearoff(anBoard[0], iPos, (unsigned int)nPoints,
+                      (unsigned int)nChequers);
+  return Board1ToPy(anBoard[0]);
+}
+
+/*
+ * Ported from gnubgmodule.c: PythonEq2mwc
+ * Exposed as: gnubg.eq2mwc([equity], [cubeinfo])
+ * Converts cubeless equity to match-winning chance.
+ */
+static PyObject *PythonEq2mwc(PyObject *self, PyObject *args) {
+  SessionLock session;
+  if (!session.Held())
+    return NULL;
+  PyObject *pyCubeInfo = NULL;
+  float r = 0.0f;
+  cubeinfo ci;
+  if (!PyArg_ParseTuple(args, "|fO:eq2mwc", &r, &pyCubeInfo))
+    return NULL;
+  GetMatchStateCubeInfo(&ci, &ms);
+  if (pyCubeInfo && PyToCubeInfo(pyCubeInfo, &ci) != 0)
+    return NULL;
+  return PyFloat_FromDouble((double)eq2mwc(r, &ci));
+}
+
+/*
+ * Ported from gnubgmodule.c: PythonEq2mwcStdErr
+ * Exposed as: gnubg.eq2mwc_stderr([equity], [cubeinfo])
+ */
+static PyObject *PythonEq2mwcStdErr(PyObject *self, PyObject *args) {
+  SessionLock session;
+  if (!session.Held())
+    return NULL;
+  PyObject *pyCubeInfo = NULL;
+  float r = 0.0f;
+  cubeinfo ci;
+  if (!PyArg_ParseTuple(args, "|fO:eq2mwc_stderr", &r, &pyCubeInfo))
+    return NULL;
+  GetMatchStateCubeInfo(&ci, &ms);
+  if (pyCubeInfo && PyToCubeInfo(pyCubeInfo, &ci) != 0)
+    return NULL;
+  return PyFloat_FromDouble((double)se_eq2mwc(r, &ci));
+}
+
+/*
+ * Ported from gnubgmodule.c: PythonMwc2eq
+ * Exposed as: gnubg.mwc2eq([mwc], [cubeinfo])
+ * Converts match-winning chance to equity.
+ */
+static PyObject *PythonMwc2eq(PyObject *self, PyObject *args) {
+  SessionLock session;
+  if (!session.Held())
+    return NULL;
+  PyObject *pyCubeInfo = NULL;
+  float r = 0.0f;
+  cubeinfo ci;
+  if (!PyArg_ParseTuple(args, "|fO:mwc2eq", &r, &pyCubeInfo))
+    return NULL;
+  GetMatchStateCubeInfo(&ci, &ms);
+  if (pyCubeInfo && PyToCubeInfo(pyCubeInfo, &ci) != 0)
+    return NULL;
+  return PyFloat_FromDouble((double)mwc2eq(r, &ci));
+}
+
+/*
+ * Ported from gnubgmodule.c: PythonMwc2eqStdErr
+ * Exposed as: gnubg.mwc2eq_stderr([mwc], [cubeinfo])
+ */
+static PyObject *PythonMwc2eqStdErr(PyObject *self, PyObject *args) {
+  SessionLock session;
+  if (!session.Held())
+    return NULL;
+  PyObject *pyCubeInfo = NULL;
+  float r = 0.0f;
+  cubeinfo ci;
+  if (!PyArg_ParseTuple(args, "|fO:mwc2eq_stderr", &r, &pyCubeInfo))
+    return NULL;
+  GetMatchStateCubeInfo(&ci, &ms);
+  if (pyCubeInfo && PyToCubeInfo(pyCubeInfo, &ci) != 0)
+    return NULL;
+  return PyFloat_FromDouble((double)se_mwc2eq(r, &ci));
+}
+
+/*
+ * Hint callback: called from C (hint_move). Must have C linkage.
+ */
+extern "C" {
+static int PythonHint_Callback(procrecorddata *pr) {
+  char szMove[FORMATEDMOVESIZE];
+  PyObject *list = (PyObject *)pr->pvUserData;
+  PyObject *hintdict = NULL, *ctxdict = NULL, *details = NULL;
+
+  int index = (int)(intptr_t)pr->avOutputData[PROCREC_HINT_ARGOUT_INDEX];
+  const matchstate *pms =
+      (const matchstate *)pr->avOutputData[PROCREC_HINT_ARGOUT_MATCHSTATE];
+  const movelist *pml =
+      (const movelist *)pr->avOutputData[PROCREC_HINT_ARGOUT_MOVELIST];
+  const evalsetup *pes = &pml->amMoves[index].esMove;
+  float rEq = pml->amMoves[index].rScore;
+  float rEqTop = pml->amMoves[0].rScore;
+  float rEqDiff = rEq - rEqTop;
+
+  FormatMove(szMove, (ConstTanBoard)pms->anBoard, pml->amMoves[index].anMove);
+
+  switch (pes->et) {
+  case EVAL_NONE:
+    hintdict =
+        Py_BuildValue("{s:i,s:s,s:f,s:f}", "movenum", index + 1, "type", "none",
+                      "equity", (double)rEq, "eqdiff", (double)rEqDiff);
+    break;
+  case EVAL_EVAL: {
+    const move *pmi = &pml->amMoves[index];
+    details =
+        Py_BuildValue("{s:(fffff),s:f}", "probs", (double)pmi->arEvalMove[0],
+                      (double)pmi->arEvalMove[1], (double)pmi->arEvalMove[2],
+                      (double)pmi->arEvalMove[3], (double)pmi->arEvalMove[4],
+                      "score", (double)pmi->rScore);
+    ctxdict = EvalContextToPy(&pes->ec);
+    hintdict = Py_BuildValue("{s:i,s:s,s:s,s:f,s:f,s:N,s:N}", "movenum",
+                             index + 1, "type", "eval", "move", szMove,
+                             "equity", (double)rEq, "eqdiff", (double)rEqDiff,
+                             "context", ctxdict, "details", details);
+    break;
+  }
+  case EVAL_ROLLOUT: {
+    const move *pmi = &pml->amMoves[index];
+    const float *p = pmi->arEvalMove;
+    const float *s = pmi->arEvalStdDev;
+    details = Py_BuildValue(
+        "{s:(fffff),s:(fffff),s:f,s:f,s:f,s:f,s:i,s:f}", "probs", (double)p[0],
+        (double)p[1], (double)p[2], (double)p[3], (double)p[4], "probs-std",
+        (double)s[0], (double)s[1], (double)s[2], (double)s[3], (double)s[4],
+        "match-eq", (double)p[OUTPUT_EQUITY], "cubeful-eq",
+        (double)p[OUTPUT_CUBEFUL_EQUITY], "score", (double)pmi->rScore,
+        "score2", (double)pmi->rScore2, "trials", (int)pes->rc.nGamesDone,
+        "stopped-on-jsd", (double)pes->rc.rStoppedOnJSD);
+    ctxdict = RolloutContextToPy(&pes->rc);
+    hintdict = Py_BuildValue("{s:i,s:s,s:s,s:f,s:f,s:N,s:N}", "movenum",
+                             index + 1, "type", "rollout", "move", szMove,
+                             "equity", (double)rEq, "eqdiff", (double)rEqDiff,
+                             "context", ctxdict, "details", details);
+    break;
+  }
+  default:
+    hintdict = Py_BuildValue("{s:i,s:s,s:i}", "movenum", index + 1, "type",
+                             "unknown", "typenum", (int)pes->et);
+    break;
+  }
+  if (hintdict) {
+    PyList_Append(list, hintdict);
+    Py_DECREF(hintdict);
+  }
+  return 1; /* TRUE */
+}
+}
+
+/*
+ * Ported from gnubgmodule.c: PythonHint
+ * Exposed as: gnubg.hint([maxmoves])
+ */
+static PyObject *PythonHint(PyObject *self, PyObject *args) {
+  SessionLock session;
+  if (!session.Held())
+    return NULL;
+  int nMaxMoves = -1;
+  int nCancel;
+  char szNumber[11];
+  procrecorddata prochint;
+  PyObject *retval = NULL;
+  PyObject *gnubgid = NULL;
+
+  if (!PyArg_ParseTuple(args, "|i:hint", &nMaxMoves))
+    return NULL;
+  if (nMaxMoves < 0)
+    nMaxMoves = MAX_MOVES;
+
+  if (ms.gs != GAME_PLAYING) {
+    PyErr_SetString(PyExc_RuntimeError, "You must set up a board first.");
+    return NULL;
+  }
+  if (ms.fResigned) {
+    PyErr_SetString(PyExc_RuntimeError,
+                    "Hints for resignations not yet implemented");
+    return NULL;
+  }
+  if (ms.fDoubled || !ms.anDice[0]) {
+    /* Double and take hints share the analysis from the doubler's side. */
+    cubedecisiontask cd;
+
+    if (PyToCubeDecision(NULL, NULL, &GetEvalCube()->ec, &cd) != 0)
+      return NULL;
+    if (RunEngineTasks(CubeDecisionTask, &cd, sizeof(cd), 1) < 0 ||
+        cd.fFailed) {
+      if (!PyErr_Occurred())
+        PyErr_SetString(PyExc_RuntimeError, "GeneralCubeDecisionE failed");
+      return NULL;
+    }
+    if (!(retval = CubeDecisionToPy(&cd)))
+      return NULL;
+    gnubgid = PythonGnubgID(self, Py_BuildValue("()"));
+    if (!gnubgid) {
+      Py_DECREF(retval);
+      return NULL;
+    }
+    return Py_BuildValue("{s:s,s:N,s:N}", "hinttype",
+                         ms.fDoubled ? "take" : "cube", "gnubgid", gnubgid,
+                         "hint", retval);
+  }
+  if (!ms.anDice[0]) {
+    PyErr_SetString(PyExc_RuntimeError, "No dice");
+    return NULL;
+  }
+
+  snprintf(szNumber, sizeof(szNumber), "%d", nMaxMoves);
+  memset(&prochint, 0, sizeof(prochint));
+  prochint.pvUserData = PyList_New(0);
+  if (!prochint.pvUserData)
+    return NULL;
+  prochint.pfProcessRecord = PythonHint_Callback;
+  prochint.avInputData[PROCREC_HINT_ARGIN_SHOWPROGRESS] = (void *)(intptr_t)0;
+  prochint.avInputData[PROCREC_HINT_ARGIN_MAXMOVES] =
+      (void *)(intptr_t)nMaxMoves;
+  InterruptWatch iw;
+  hint_move(szNumber, FALSE, &prochint);
+  if ((nCancel = iw.Finish()) != 0) {
+    Py_DECREF((PyObject *)prochint.pvUserData);
+    SetCancelError(nCancel);
+    return NULL;
+  }
+  if (MT_SafeGet(&fInterrupt)) {
+    ResetInterrupt();
+    Py_DECREF((PyObject *)prochint.pvUserData);
+    PyErr_SetString(PyExc_RuntimeError, "interrupted/errno in hint_move");
+    return NULL;
+  }
+  retval = (PyObject *)prochint.pvUserData;
+  gnubgid = PythonGnubgID(self, Py_BuildValue("()"));
+  if (gnubgid) {
+    PyObject *tmp = Py_BuildValue("{s:s,s:N,s:N}", "hinttype", "chequer",
+                                  "gnubgid", gnubgid, "hint", retval);
+    Py_DECREF(retval);
+    Py_DECREF(gnubgid);
+    retval = tmp;
+  }
+  return retval;
+}
+
+/* No-op for library build (no GUI) */
+static PyObject *PythonUpdateUI(PyObject *self, PyObject *args) {
+  (void)self;
+  (void)args;
+  Py_INCREF(Py_None);
+  return Py_None;
+}
+
+/*
+ * Ported from gnubgmodule.c: PythonNavigate
+ * Exposed as: gnubg.navigate(next=..., game=...)
+ */
+static PyObject *PythonNavigate(PyObject *self, PyObject *args,
+                                PyObject *keywds) {
+  SessionLock session;
+  if (!session.Held())
+    return NULL;
+  int nextRecord = INT_MIN;
+  int nextGame = INT_MIN;
+  PyObject *r = NULL;
+  static const char *kwlist[] = {"next", "game", NULL};
+
+  (void)self;
+  if (!lMatch.plNext) {
+    PyErr_SetString(PyExc_RuntimeError, "no active match");
+    return NULL;
+  }
+  if (!PyArg_ParseTupleAndKeywords(args, keywds, "|ii", (char **)kwlist,
+                                   &nextRecord, &nextGame))
+    return NULL;
+
+  if (nextRecord == INT_MIN && nextGame == INT_MIN) {
+    if (lMatch.plNext->p)
+      ChangeGame((listOLD *)lMatch.plNext->p);
+  } else {
+    int gamesDif = 0;
+    int recordsDiff = 0;
+
+    if (nextRecord != INT_MIN && nextRecord < 0) {
+      PyErr_SetString(PyExc_ValueError, "negative next record");
+      return NULL;
+    }
+    if (nextGame != INT_MIN && nextGame != 0) {
+      listOLD *pl = lMatch.plNext;
+      while ((listOLD *)pl->p != plGame && pl != &lMatch)
+        pl = pl->plNext;
+      int n = nextGame;
+      if (n > 0) {
+        while (n > 0 && pl->plNext->p) {
+          pl = pl->plNext;
+          --n;
+        }
+      } else {
+        while (n < 0 && pl->plPrev->p) {
+          pl = pl->plPrev;
+          ++n;
+        }
+      }
+      ChangeGame((listOLD *)pl->p);
+      gamesDif = abs(nextGame) - n;
+    }
+    if (nextRecord != INT_MIN)
+      recordsDiff = nextRecord - InternalCommandNext(0, 0, nextRecord);
+
+    if (plLastMove->plNext && plLastMove->plNext->p) {
+      const moverecord *pmr = (const moverecord *)(plLastMove->plNext->p);
+      if (pmr->mt == MOVE_NORMAL)
+        memcpy(ms.anDice, pmr->anDice, sizeof(ms.anDice));
+    }
+    if (recordsDiff || gamesDif)
+      r = Py_BuildValue("(ii)", recordsDiff, gamesDif);
+  }
+  if (ms.gs == GAME_NONE)
+    ms.gs = GAME_PLAYING;
+  if (!r)
+    r = Py_None;
+  Py_INCREF(r);
+  return r;
+}
+
+static void addProperty(PyObject *dict, const char *name, const char *val) {
+  if (!val)
+    return;
+  PyObject *v = PyUnicode_FromString(val);
+  if (v) {
+    PyDict_SetItemString(dict, name, v);
+    Py_DECREF(v);
+  }
+}
+
+/* Format anMove[8] as tuple of (from, to) pairs. */
+static PyObject *PyMove(const int move[8]) {
+  int n = 0;
+  while (n < 4 && move[2 * n] >= 0)
+    ++n;
+  PyObject *moveTuple = PyTuple_New(n);
+  if (!moveTuple)
+    return NULL;
+  for (int i = 0; i < n; ++i) {
+    PyObject *c = Py_BuildValue("(ii)", move[2 * i] + 1, move[2 * i + 1] + 1);
+    if (!c) {
+      Py_DECREF(moveTuple);
+      return NULL;
+    }
+    PyTuple_SET_ITEM(moveTuple, i, c);
+  }
+  return moveTuple;
+}
+
+/* Names of the skill and luck ratings, indexed by skilltype and lucktype. */
+static const char *aszSkillName[N_SKILLS] = {"very bad", "bad", "doubtful",
+                                             "none"};
+static const char *aszLuckName[N_LUCKS] = {"very unlucky", "unlucky", "none",
+                                           "lucky", "very lucky"};
+
+/* {name: count} over the first n ratings, as in statcontext.anMoves. */
+static PyObject *RatingCountsToPy(const char **asz, const int *an, int n) {
+  PyObject *d = PyDict_New();
+  if (!d)
+    return NULL;
+  for (int i = 0; i < n; ++i)
+    DictSetItemSteal(d, asz[i], PyLong_FromLong(an[i]));
+  return d;
+}
+
+/*
+ * The statistics of a game or match as {"games": n, "moves": {"X": ...,
+ * "O": ...}, "cube": {...}, "dice": {...}}, leaving out the sections gnubg
+ * has not computed. Errors and luck are pairs (normalised, cost): EMG and
+ * MWC in match play, normalised and unnormalised equity for money.
+ */
+static PyObject *StatcontextToPy(const statcontext *psc) {
+  PyObject *d = PyDict_New();
+  if (!d)
+    return NULL;
+  DictSetItemSteal(d, "games", PyLong_FromLong(psc->nGames));
+  for (int section = 0; section < 3; ++section) {
+    static const char *aszSection[3] = {"moves", "cube", "dice"};
+    const int af[3] = {psc->fMoves, psc->fCube, psc->fDice};
+    if (!af[section])
+      continue;
+    PyObject *sides[2] = {NULL, NULL};
+    for (int side = 0; side < 2; ++side) {
+      switch (section) {
+      case 0: {
+        int n = psc->anUnforcedMoves[side];
+        const float *ar = psc->arErrorCheckerplay[side];
+        sides[side] = Py_BuildValue(
+            "{s:i,s:i,s:(ff),s:(ff),s:N}", "unforced-moves", n, "total-moves",
+            psc->anTotalMoves[side], "error", (double)ar[0], (double)ar[1],
+            "error-rate", n ? (double)ar[0] / n : 0.0,
+            n ? (double)ar[1] / n : 0.0, "marked",
+            RatingCountsToPy(aszSkillName, psc->anMoves[side], N_SKILLS));
+        break;
+      }
+      case 1:
+        sides[side] = Py_BuildValue(
+            "{s:i,s:i,s:i,s:i,s:i,s:i,s:i,s:i,s:i,s:i,s:i,"
+            "s:(ff),s:(ff),s:(ff),s:(ff),s:(ff),s:(ff)}",
+            "total-cube", psc->anTotalCube[side], "close-cube",
+            psc->anCloseCube[side], "doubles", psc->anDouble[side], "takes",
+            psc->anTake[side], "drops", psc->anPass[side], "missed-double-dp",
+            psc->anCubeMissedDoubleDP[side], "missed-double-tg",
+            psc->anCubeMissedDoubleTG[side], "wrong-double-dp",
+            psc->anCubeWrongDoubleDP[side], "wrong-double-tg",
+            psc->anCubeWrongDoubleTG[side], "wrong-take",
+            psc->anCubeWrongTake[side], "wrong-drop",
+            psc->anCubeWrongPass[side], "missed-double-dp-error",
+            (double)psc->arErrorMissedDoubleDP[side][0],
+            (double)psc->arErrorMissedDoubleDP[side][1],
+            "missed-double-tg-error",
+            (double)psc->arErrorMissedDoubleTG[side][0],
+            (double)psc->arErrorMissedDoubleTG[side][1],
+            "wrong-double-dp-error",
+            (double)psc->arErrorWrongDoubleDP[side][0],
+            (double)psc->arErrorWrongDoubleDP[side][1],
+            "wrong-double-tg-error",
+            (double)psc->arErrorWrongDoubleTG[side][0],
+            (double)psc->arErrorWrongDoubleTG[side][1], "wrong-take-error",
+            (double)psc->arErrorWrongTake[side][0],
+            (double)psc->arErrorWrongTake[side][1], "wrong-drop-error",
+            (double)psc->arErrorWrongPass[side][0],
+            (double)psc->arErrorWrongPass[side][1]);
+        break;
+      default:
+        sides[side] = Py_BuildValue(
+            "{s:(ff),s:f,s:f,s:N}", "luck", (double)psc->arLuck[side][0],
+            (double)psc->arLuck[side][1], "actual-result",
+            (double)psc->arActualResult[side], "luck-adjusted-result",
+            (double)psc->arLuckAdj[side], "rolls",
+            RatingCountsToPy(aszLuckName, psc->anLuck[side], N_LUCKS));
+        break;
+      }
+    }
+    if (!sides[0] || !sides[1]) {
+      Py_XDECREF(sides[0]);
+      Py_XDECREF(sides[1]);
+      Py_DECREF(d);
+      return NULL;
+    }
+    DictSetItemSteal(d, aszSection[section],
+                     Py_BuildValue("{s:N,s:N}", "X", sides[0], "O", sides[1]));
+  }
+  return d;
+}
+
+/*
+ * The analysis stored with a move record: for moves the chosen move's
+ * index, equity and error, the skill and luck ratings and, if verbose,
+ * every analysed move; for cube actions and the cube decision before a
+ * roll, the cube analysis as cubedecision() returns it. pms is the match
+ * state before the record, so cube equities are for the player on roll
+ * (the doubler, for takes and drops). Empty if nothing was analysed.
+ */
+static PyObject *RecordAnalysisToPy(const moverecord *pmr,
+                                    const matchstate *pms, int verbose) {
+  PyObject *d = PyDict_New();
+  skilltype st = SKILL_NONE;
+  if (!d)
+    return NULL;
+
+  switch (pmr->mt) {
+  case MOVE_NORMAL:
+    if (pmr->n.iMove < pmr->ml.cMoves) {
+      const move *pm = &pmr->ml.amMoves[pmr->n.iMove];
+      float rBest = pmr->ml.amMoves[0].rScore;
+      DictSetItemSteal(d, "imove", PyLong_FromLong((long)pmr->n.iMove));
+      DictSetItemSteal(d, "equity", PyFloat_FromDouble(pm->rScore));
+      DictSetItemSteal(d, "best-equity", PyFloat_FromDouble(rBest));
+      DictSetItemSteal(d, "error", PyFloat_FromDouble(rBest - pm->rScore));
+    }
+    if (verbose && pmr->ml.cMoves) {
+      PyObject *moves = PyTuple_New((Py_ssize_t)pmr->ml.cMoves);
+      if (!moves) {
+        Py_DECREF(d);
+        return NULL;
+      }
+      for (unsigned int i = 0; i < pmr->ml.cMoves; ++i) {
+        const move *pm = &pmr->ml.amMoves[i];
+        const float *p = pm->arEvalMove;
+        PyObject *m = Py_BuildValue(
+            "{s:N,s:f,s:(fffff)}", "move", PyMove(pm->anMove), "equity",
+            (double)pm->rScore, "probs", (double)p[0], (double)p[1],
+            (double)p[2], (double)p[3], (double)p[4]);
+        if (!m) {
+          Py_DECREF(moves);
+          Py_DECREF(d);
+          return NULL;
+        }
+        PyTuple_SET_ITEM(moves, i, m);
+      }
+      DictSetItemSteal(d, "moves", moves);
+    }
+    if (pmr->rLuck != ERR_VAL) {
+      DictSetItemSteal(d, "luck", PyFloat_FromDouble(pmr->rLuck));
+      DictSetItemSteal(d, "luck-rating",
+                       PyUnicode_FromString(aszLuckName[pmr->lt]));
+    }
+    st = pmr->n.stMove;
+    break;
+  case MOVE_DOUBLE:
+  case MOVE_TAKE:
+  case MOVE_DROP:
+    st = pmr->stCube;
+    break;
+  default:
+    break;
+  }
+  if (st != SKILL_NONE)
+    DictSetItemSteal(d, "skill", PyUnicode_FromString(aszSkillName[st]));
+
+  if ((pmr->mt == MOVE_NORMAL || pmr->mt == MOVE_DOUBLE ||
+       pmr->mt == MOVE_TAKE || pmr->mt == MOVE_DROP) &&
+      pmr->CubeDecPtr && pmr->CubeDecPtr->esDouble.et != EVAL_NONE) {
+    cubedecisiontask cd;
+    PyObject *cube;
+    memset(&cd, 0, sizeof(cd));
+    memcpy(cd.aarOutput, pmr->CubeDecPtr->aarOutput, sizeof(cd.aarOutput));
+    GetMatchStateCubeInfo(&cd.ci, pms);
+    cd.cd = FindCubeDecision(cd.arDouble, cd.aarOutput, &cd.ci);
+    if (!(cube = CubeDecisionToPy(&cd))) {
+      Py_DECREF(d);
+      return NULL;
+    }
+    if (pmr->stCube != SKILL_NONE)
+      DictSetItemSteal(cube, "skill",
+                       PyUnicode_FromString(aszSkillName[pmr->stCube]));
+    DictSetItemSteal(d, "cube", cube);
+  }
+  return d;
+}
+
+/* How match() reports the board before each record. */
+enum {
+  MATCH_BOARDS_NONE,
+  MATCH_BOARDS_ID,     /* "board": position ID string */
+  MATCH_BOARDS_KEY,    /* "board": 10-byte position key */
+  MATCH_BOARDS_PACKED  /* game "boards": one 10-byte key per record */
+};
+
+/* Parse boards=: a flag (position IDs when true), "id", "key" or "packed". */
+static int PyToMatchBoards(PyObject *p, int *pfBoards) {
+  const char *sz = p && PyUnicode_Check(p) ? PyUnicode_AsUTF8(p) : NULL;
+
+  if (!p)
+    *pfBoards = MATCH_BOARDS_ID;
+  else if (p == Py_None)
+    *pfBoards = MATCH_BOARDS_NONE;
+  else if (PyLong_Check(p))
+    *pfBoards = PyObject_IsTrue(p) ? MATCH_BOARDS_ID : MATCH_BOARDS_NONE;
+  else if (sz && !strcmp(sz, "id"))
+    *pfBoards = MATCH_BOARDS_ID;
+  else if (sz && !strcmp(sz, "key"))
+    *pfBoards = MATCH_BOARDS_KEY;
+  else if (sz && !strcmp(sz, "packed"))
+    *pfBoards = MATCH_BOARDS_PACKED;
+  else {
+    PyErr_SetString(PyExc_ValueError,
+                    "boards must be a flag, 'id', 'key' or 'packed'");
+    return -1;
+  }
+  return 0;
+}
+
+/* A record's "board" as a position ID or, for MATCH_BOARDS_KEY, as the
+ * bytes of its position key. */
+static PyObject *MatchBoardToPy(ConstTanBoard anBoard, int fBoards) {
+  if (fBoards == MATCH_BOARDS_KEY) {
+    oldpositionkey key;
+    oldPositionKey(anBoard, &key);
+    return PyBytes_FromStringAndSize((const char *)key.auch, 10);
+  }
+  return PyUnicode_FromString(PositionID(anBoard));
+}
+
+/*
+ * Info and records of one game for match(). With doAnalysis each record
+ * carries the analysis stored with it; with psc the game's statistics are
+ * recomputed from that analysis, returned as info["stats"] and added to
+ * *psc. fBoards is one of MATCH_BOARDS_*; the board is only replayed when
+ * it is not MATCH_BOARDS_NONE.
+ */
+static PyObject *PythonGame(const listOLD *plGame, int doAnalysis,
+                            int verbose, statcontext *psc, int fBoards) {
+  const listOLD *pl = plGame->plNext;
+  const moverecord *pmr = (const moverecord *)pl->p;
+  const xmovegameinfo *g = &pmr->g;
+  matchstate msAnalyse;
+  PyObject *gameDict = PyDict_New();
+  PyObject *gameInfoDict = PyDict_New();
+  if (!gameDict || !gameInfoDict) {
+    Py_XDECREF(gameDict);
+    Py_XDECREF(gameInfoDict);
+    return NULL;
+  }
+  DictSetItemSteal(gameInfoDict, "score-X", PyLong_FromLong(g->anScore[0]));
+  DictSetItemSteal(gameInfoDict, "score-O", PyLong_FromLong(g->anScore[1]));
+  if (g->anScore[0] + 1 == (int)g->nMatch ||
+      g->anScore[1] + 1 == (int)g->nMatch)
+    DictSetItemSteal(gameInfoDict, "crawford",
+                     PyBool_FromLong(g->fCrawfordGame));
+  if (g->fWinner >= 0) {
+    DictSetItemSteal(gameInfoDict, "winner",
+                     PyUnicode_FromString(g->fWinner ? "O" : "X"));
+    DictSetItemSteal(gameInfoDict, "points-won", PyLong_FromLong(g->nPoints));
+    DictSetItemSteal(gameInfoDict, "resigned", PyBool_FromLong(g->fResigned));
+  } else {
+    PyObject *none = Py_None;
+    Py_INCREF(none);
+    DictSetItemSteal(gameInfoDict, "winner", none);
+  }
+  if (g->nAutoDoubles)
+    DictSetItemSteal(gameInfoDict, "initial-cube",
+                     PyLong_FromLong(1 << g->nAutoDoubles));
+  if (psc) {
+    updateStatisticsGame(plGame);
+    AddStatcontext(&g->sc, psc);
+    PyObject *stats = StatcontextToPy(&g->sc);
+    if (!stats) {
+      Py_DECREF(gameDict);
+      Py_DECREF(gameInfoDict);
+      return NULL;
+    }
+    DictSetItemSteal(gameInfoDict, "stats", stats);
+  }
+  DictSetItemSteal(gameDict, "info", gameInfoDict);
+
+  TanBoard anBoard;
+  int nRecords = 0;
+  for (const listOLD *t = pl->plNext; t != plGame; t = t->plNext)
+    ++nRecords;
+  PyObject *gameTuple = PyTuple_New(nRecords);
+  if (!gameTuple) {
+    Py_DECREF(gameDict);
+    return NULL;
+  }
+  std::vector<unsigned char> abPacked;
+  if (fBoards != MATCH_BOARDS_NONE)
+    InitBoard(anBoard, g->bgv);
+  if (fBoards == MATCH_BOARDS_PACKED)
+    abPacked.reserve(10 * nRecords);
+  if (doAnalysis) {
+    memset(&msAnalyse, 0, sizeof(msAnalyse));
+    ApplyMoveRecord(&msAnalyse, plGame, pmr);
+  }
+  nRecords = 0;
+  for (pl = pl->plNext; pl != plGame; pl = pl->plNext) {
+    pmr = (const moverecord *)pl->p;
+    PyObject *recordDict = PyDict_New();
+    if (!recordDict) {
+      Py_DECREF(gameTuple);
+      Py_DECREF(gameDict);
+      return NULL;
+    }
+    if (doAnalysis) {
+      FixMatchState(&msAnalyse, pmr);
+      PyObject *analysis = RecordAnalysisToPy(pmr, &msAnalyse, verbose);
+      if (!analysis) {
+        Py_DECREF(recordDict);
+        Py_DECREF(gameTuple);
+        Py_DECREF(gameDict);
+        return NULL;
+      }
+      if (PyDict_Size(analysis))
+        DictSetItemSteal(recordDict, "analysis", analysis);
+      else
+        Py_DECREF(analysis);
+      ApplyMoveRecord(&msAnalyse, plGame, pmr);
+    }
+    /* The record board of MOVE_NORMAL and MOVE_DOUBLE, or every record's
+     * packed board. */
+    int fRecordBoard = fBoards == MATCH_BOARDS_ID || fBoards == MATCH_BOARDS_KEY;
+    if (fBoards == MATCH_BOARDS_PACKED) {
+      oldpositionkey key;
+      oldPositionKey((ConstTanBoard)anBoard, &key);
+      abPacked.insert(abPacked.end(), key.auch, key.auch + 10);
+    }
+    const char *action = NULL;
+    int player = -1;
+    long points = -1;
+    switch (pmr->mt) {
     case MOVE_NORMAL:
       action = "move";
       player = pmr->fPlayer;
       DictSetItemSteal(recordDict, "dice",
                        Py_BuildValue("(ii)", pmr->anDice[0], pmr->anDice[1]));
       DictSetItemSteal(recordDict, "move", PyMove(pmr->n.anMove));
-      if (includeBoards) {
-        DictSetItemSteal(
-            recordDict, "board",
-            PyUnicode_FromString(PositionID((ConstTanBoard)anBoard)));
+      if (fRecordBoard)
+        DictSetItemSteal(recordDict, "board",
+                         MatchBoardToPy((ConstTanBoard)anBoard, fBoards));
+      if (fBoards != MATCH_BOARDS_NONE) {
         ApplyMove(anBoard, pmr->n.anMove, 0);
         SwapSides(anBoard);
       }
@@ -2040,10 +5742,9 @@ static PyObject *PythonGame(const listOLD *plGame, int /* doAnalysis */,
     case MOVE_DOUBLE:
       action = "double";
       player = pmr->fPlayer;
-      if (includeBoards)
-        DictSetItemSteal(
-            recordDict, "board",
-            PyUnicode_FromString(PositionID((ConstTanBoard)anBoard)));
+      if (fRecordBoard)
+        DictSetItemSteal(recordDict, "board",
+                         MatchBoardToPy((ConstTanBoard)anBoard, fBoards));
       break;
     case MOVE_TAKE:
       action = "take";
@@ -2064,10 +5765,14 @@ static PyObject *PythonGame(const listOLD *plGame, int /* doAnalysis */,
       break;
     case MOVE_SETBOARD:
       action = "set";
-      DictSetItemSteal(recordDict, "board",
-                       PyUnicode_FromString(PositionIDFromKey(&pmr->sb.key)));
-      if (includeBoards)
+      if (fBoards != MATCH_BOARDS_NONE)
         PositionFromKey(anBoard, &pmr->sb.key);
+      if (fBoards == MATCH_BOARDS_KEY)
+        DictSetItemSteal(recordDict, "board",
+                         MatchBoardToPy((ConstTanBoard)anBoard, fBoards));
+      else
+        DictSetItemSteal(recordDict, "board",
+                         PyUnicode_FromString(PositionIDFromKey(&pmr->sb.key)));
       break;
     case MOVE_SETDICE:
       action = "set";
@@ -2091,140 +5796,2094 @@ static PyObject *PythonGame(const listOLD *plGame, int /* doAnalysis */,
     default:
       break;
     }
-    if (action)
-      DictSetItemSteal(recordDict, "action", PyUnicode_FromString(action));
-    if (player >= 0)
-      DictSetItemSteal(recordDict, "player",
-                       PyUnicode_FromString(player ? "O" : "X"));
-    if (points >= 0)
-      DictSetItemSteal(recordDict, "points", PyLong_FromLong(points));
-    if (pmr->sz)
-      DictSetItemSteal(recordDict, "comment", PyUnicode_FromString(pmr->sz));
-    PyTuple_SET_ITEM(gameTuple, nRecords++, recordDict);
+    if (action)
+      DictSetItemSteal(recordDict, "action", PyUnicode_FromString(action));
+    if (player >= 0)
+      DictSetItemSteal(recordDict, "player",
+                       PyUnicode_FromString(player ? "O" : "X"));
+    if (points >= 0)
+      DictSetItemSteal(recordDict, "points", PyLong_FromLong(points));
+    if (pmr->sz)
+      DictSetItemSteal(recordDict, "comment", PyUnicode_FromString(pmr->sz));
+    PyTuple_SET_ITEM(gameTuple, nRecords++, recordDict);
+  }
+  DictSetItemSteal(gameDict, "game", gameTuple);
+  if (fBoards == MATCH_BOARDS_PACKED)
+    DictSetItemSteal(gameDict, "boards",
+                     PyBytes_FromStringAndSize((const char *)abPacked.data(),
+                                               abPacked.size()));
+  return gameDict;
+}
+
+/*
+ * Ported from gnubgmodule.c: PythonMatch
+ * Exposed as: gnubg.match(analysis=..., boards=..., statistics=...,
+ * verbose=...)
+ * statistics adds "stats" to each game's info and to the match, in the
+ * layout of StatcontextToPy. boards is a flag for position ID strings, or
+ * "key" for each move and double's position key as 10 bytes, or "packed"
+ * for a game "boards" of one key per record, the board before it.
+ */
+static PyObject *PythonMatch(PyObject *self, PyObject *args, PyObject *keywds) {
+  SessionLock session;
+  if (!session.Held())
+    return NULL;
+  static const char *kwlist[] = {"analysis", "boards", "statistics", "verbose",
+                                 NULL};
+  int includeAnalysis = 1, verboseAnalysis = 0, statistics = 0, boards;
+  PyObject *pyBoards = NULL;
+  const listOLD *firstGame =
+      lMatch.plNext ? (const listOLD *)lMatch.plNext->p : NULL;
+  PyObject *matchDict = NULL;
+  PyObject *matchInfoDict = NULL;
+
+  (void)self;
+  if (!firstGame || !firstGame->plNext) {
+    Py_INCREF(Py_None);
+    return Py_None;
+  }
+  const moverecord *pmr = (const moverecord *)firstGame->plNext->p;
+  const xmovegameinfo *g = &pmr->g;
+  if (g->i != 0) {
+    PyErr_SetString(PyExc_RuntimeError, "First game missing from match");
+    return NULL;
+  }
+  if (!PyArg_ParseTupleAndKeywords(args, keywds, "|iOii", (char **)kwlist,
+                                   &includeAnalysis, &pyBoards, &statistics,
+                                   &verboseAnalysis) ||
+      PyToMatchBoards(pyBoards, &boards) != 0)
+    return NULL;
+
+  matchDict = PyDict_New();
+  matchInfoDict = PyDict_New();
+  if (!matchDict || !matchInfoDict) {
+    Py_XDECREF(matchDict);
+    Py_XDECREF(matchInfoDict);
+    return NULL;
+  }
+  for (int side = 0; side < 2; ++side) {
+    PyObject *d = PyDict_New();
+    if (!d) {
+      Py_DECREF(matchDict);
+      Py_DECREF(matchInfoDict);
+      return NULL;
+    }
+    addProperty(d, "rating", mi.pchRating[side]);
+    addProperty(d, "name", ap[side].szName);
+    DictSetItemSteal(matchInfoDict, side == 0 ? "X" : "O", d);
+  }
+  DictSetItemSteal(matchInfoDict, "match-length", PyLong_FromLong(g->nMatch));
+  if (mi.nYear) {
+    PyObject *date = Py_BuildValue("(iii)", mi.nDay, mi.nMonth, mi.nYear);
+    DictSetItemSteal(matchInfoDict, "date", date);
+  }
+  addProperty(matchInfoDict, "event", mi.pchEvent);
+  addProperty(matchInfoDict, "round", mi.pchRound);
+  addProperty(matchInfoDict, "place", mi.pchPlace);
+  addProperty(matchInfoDict, "annotator", mi.pchAnnotator);
+  addProperty(matchInfoDict, "comment", mi.pchComment);
+  int result = 0;
+  int anFinalScore[2];
+  if (getFinalScore(anFinalScore)) {
+    if (anFinalScore[0] > (int)g->nMatch)
+      result = -1;
+    else if (anFinalScore[1] > (int)g->nMatch)
+      result = 1;
+  }
+  DictSetItemSteal(matchInfoDict, "result", PyLong_FromLong(result));
+  {
+    const char *v[] = {"Standard", "Nackgammon", "Hypergammon1", "Hypergammon2",
+                       "Hypergammon3"};
+    addProperty(matchInfoDict, "variation", v[g->bgv]);
+  }
+  {
+    unsigned int n = !g->fCubeUse + !!g->fCrawford + !!g->fJacoby;
+    if (n) {
+      PyObject *rules = PyTuple_New(n);
+      if (rules) {
+        unsigned int idx = 0;
+        if (!g->fCubeUse)
+          PyTuple_SET_ITEM(rules, idx++, PyUnicode_FromString("NoCube"));
+        if (g->fCrawford)
+          PyTuple_SET_ITEM(rules, idx++, PyUnicode_FromString("Crawford"));
+        if (g->fJacoby)
+          PyTuple_SET_ITEM(rules, idx, PyUnicode_FromString("Jacoby"));
+        DictSetItemSteal(matchInfoDict, "rules", rules);
+      }
+    }
+  }
+  DictSetItemSteal(matchDict, "match-info", matchInfoDict);
+
+  statcontext scm;
+  if (statistics)
+    IniStatcontext(&scm);
+  Py_ssize_t nGames = 0;
+  for (const listOLD *pl = lMatch.plNext; pl != &lMatch; pl = pl->plNext)
+    ++nGames;
+  PyObject *matchTuple = PyTuple_New(nGames);
+  if (!matchTuple) {
+    Py_DECREF(matchDict);
+    return NULL;
+  }
+  nGames = 0;
+  for (const listOLD *pl = lMatch.plNext; pl != &lMatch; pl = pl->plNext) {
+    PyObject *pg =
+        PythonGame((const listOLD *)pl->p, includeAnalysis, verboseAnalysis,
+                   statistics ? &scm : NULL, boards);
+    if (!pg) {
+      Py_DECREF(matchTuple);
+      Py_DECREF(matchDict);
+      return NULL;
+    }
+    PyTuple_SET_ITEM(matchTuple, nGames++, pg);
+  }
+  DictSetItemSteal(matchDict, "games", matchTuple);
+  if (statistics) {
+    PyObject *stats = StatcontextToPy(&scm);
+    if (!stats) {
+      Py_DECREF(matchDict);
+      return NULL;
+    }
+    DictSetItemSteal(matchDict, "stats", stats);
+  }
+  return matchDict;
+}
+
+/* -------------------------------------------------------------------------
+ * Record iteration
+ * ------------------------------------------------------------------------- */
+
+/*
+ * One move record as yielded by gnubg.iter_records: a copy of the fields
+ * match() reports for it, turned into Python objects only when read.
+ */
+typedef struct {
+  PyObject_HEAD
+  int iGame, iRecord;
+  movetype mt;
+  int fPlayer; /* -1 if the record has no player */
+  unsigned int anDice[2];
+  int anMove[8];
+  int n;      /* points resigned, cube value or cube owner, by mt */
+  int fBoard; /* anBoard is set */
+  TanBoard anBoard;
+  char *szComment;
+} RecordObject;
+
+static PyTypeObject RecordType = {PyVarObject_HEAD_INIT(NULL, 0)};
+
+static void RecordDealloc(PyObject *self) {
+  g_free(((RecordObject *)self)->szComment);
+  Py_TYPE(self)->tp_free(self);
+}
+
+static PyObject *RecordGetGame(PyObject *self, void *) {
+  return PyLong_FromLong(((RecordObject *)self)->iGame);
+}
+
+static PyObject *RecordGetIndex(PyObject *self, void *) {
+  return PyLong_FromLong(((RecordObject *)self)->iRecord);
+}
+
+/* The actions of match() records, and the index of a record's action
+ * there (-1 for records without one). */
+static const char *aszRecordAction[] = {"move",   "double", "take",
+                                        "drop",   "resign", "set"};
+
+static int RecordAction(movetype mt) {
+  switch (mt) {
+  case MOVE_NORMAL:
+    return 0;
+  case MOVE_DOUBLE:
+    return 1;
+  case MOVE_TAKE:
+    return 2;
+  case MOVE_DROP:
+    return 3;
+  case MOVE_RESIGN:
+    return 4;
+  case MOVE_SETBOARD:
+  case MOVE_SETDICE:
+  case MOVE_SETCUBEVAL:
+  case MOVE_SETCUBEPOS:
+    return 5;
+  default:
+    return -1;
+  }
+}
+
+static PyObject *RecordGetAction(PyObject *self, void *) {
+  int iAction = RecordAction(((RecordObject *)self)->mt);
+  if (iAction < 0)
+    Py_RETURN_NONE;
+  return PyUnicode_FromString(aszRecordAction[iAction]);
+}
+
+static PyObject *RecordGetPlayer(PyObject *self, void *) {
+  const RecordObject *pr = (const RecordObject *)self;
+  if (pr->fPlayer < 0)
+    Py_RETURN_NONE;
+  return PyUnicode_FromString(pr->fPlayer ? "O" : "X");
+}
+
+static PyObject *RecordGetDice(PyObject *self, void *) {
+  const RecordObject *pr = (const RecordObject *)self;
+  if (pr->mt != MOVE_NORMAL && pr->mt != MOVE_SETDICE)
+    Py_RETURN_NONE;
+  return Py_BuildValue("(ii)", pr->anDice[0], pr->anDice[1]);
+}
+
+static PyObject *RecordGetMove(PyObject *self, void *) {
+  const RecordObject *pr = (const RecordObject *)self;
+  if (pr->mt != MOVE_NORMAL)
+    Py_RETURN_NONE;
+  return PyMove(pr->anMove);
+}
+
+static PyObject *RecordGetBoard(PyObject *self, void *) {
+  const RecordObject *pr = (const RecordObject *)self;
+  if (!pr->fBoard)
+    Py_RETURN_NONE;
+  return PyUnicode_FromString(PositionID((ConstTanBoard)pr->anBoard));
+}
+
+static PyObject *RecordGetComment(PyObject *self, void *) {
+  const RecordObject *pr = (const RecordObject *)self;
+  if (!pr->szComment)
+    Py_RETURN_NONE;
+  return PyUnicode_FromString(pr->szComment);
+}
+
+static PyObject *RecordGetPoints(PyObject *self, void *) {
+  const RecordObject *pr = (const RecordObject *)self;
+  if (pr->mt != MOVE_RESIGN)
+    Py_RETURN_NONE;
+  return PyLong_FromLong(pr->n);
+}
+
+static PyObject *RecordGetCube(PyObject *self, void *) {
+  const RecordObject *pr = (const RecordObject *)self;
+  if (pr->mt != MOVE_SETCUBEVAL)
+    Py_RETURN_NONE;
+  return PyLong_FromLong(pr->n);
+}
+
+static PyObject *RecordGetCubeOwner(PyObject *self, void *) {
+  const RecordObject *pr = (const RecordObject *)self;
+  if (pr->mt != MOVE_SETCUBEPOS)
+    Py_RETURN_NONE;
+  return PyUnicode_FromString(pr->n == 0 ? "X"
+                                         : (pr->n == 1 ? "O" : "centered"));
+}
+
+static PyGetSetDef RecordGetSet[] = {
+    {(char *)"game", RecordGetGame, NULL, (char *)"Game number, from 0",
+     NULL},
+    {(char *)"index", RecordGetIndex, NULL,
+     (char *)"Position in the game's records, from 0", NULL},
+    {(char *)"action", RecordGetAction, NULL,
+     (char *)"move, double, take, drop, resign or set", NULL},
+    {(char *)"player", RecordGetPlayer, NULL, (char *)"X, O or None", NULL},
+    {(char *)"dice", RecordGetDice, NULL, (char *)"Dice, or None", NULL},
+    {(char *)"move", RecordGetMove, NULL,
+     (char *)"Tuple of (from, to) pairs, or None", NULL},
+    {(char *)"board", RecordGetBoard, NULL,
+     (char *)"Position ID before the record, or None", NULL},
+    {(char *)"comment", RecordGetComment, NULL, (char *)"Comment, or None",
+     NULL},
+    {(char *)"points", RecordGetPoints, NULL,
+     (char *)"Points resigned, or None", NULL},
+    {(char *)"cube", RecordGetCube, NULL, (char *)"Cube value set, or None",
+     NULL},
+    {(char *)"cube_owner", RecordGetCubeOwner, NULL,
+     (char *)"Cube owner set (X, O or centered), or None", NULL},
+    {NULL, NULL, NULL, NULL, NULL}};
+
+/* Fill in RecordType; called once from module init. */
+static int InitRecordType(void) {
+  RecordType.tp_name = "gnubg.Record";
+  RecordType.tp_basicsize = sizeof(RecordObject);
+  RecordType.tp_dealloc = RecordDealloc;
+  RecordType.tp_flags = Py_TPFLAGS_DEFAULT;
+  RecordType.tp_doc = "A move record of the match, read lazily";
+  RecordType.tp_getset = RecordGetSet;
+  return PyType_Ready(&RecordType);
+}
+
+/*
+ * Iterator returned by gnubg.iter_records: walks lMatch of the session it
+ * was created in, one record per step. It keeps its place by pointer, so
+ * any call that may change the match (see SessionMatchChanged) makes the
+ * next step raise RuntimeError, as changing a dict does, before a pointer
+ * into the old match is followed.
+ */
+typedef struct {
+  PyObject_HEAD
+  EngineObject *peng; /* session iterated; NULL for the process-wide one */
+  int fBoards;
+  int fDone;
+  const listOLD *plGameNode; /* node of lMatch holding the current game */
+  const listOLD *plRecord;   /* last record visited */
+  unsigned long nGeneration; /* SessionMatchGeneration at the first step */
+  int iGame, iRecord;
+  TanBoard anBoard; /* before the next record, if fBoards */
+} RecordIterObject;
+
+static void RecordIterDealloc(PyObject *self) {
+  Py_XDECREF(((RecordIterObject *)self)->peng);
+  Py_TYPE(self)->tp_free(self);
+}
+
+/* A Record for pmr, advancing pri->anBoard past it. */
+static PyObject *RecordFromMoveRecord(RecordIterObject *pri,
+                                      const moverecord *pmr) {
+  RecordObject *pr = PyObject_New(RecordObject, &RecordType);
+  if (!pr)
+    return NULL;
+  pr->iGame = pri->iGame;
+  pr->iRecord = pri->iRecord++;
+  pr->mt = pmr->mt;
+  pr->fPlayer = -1;
+  pr->n = 0;
+  pr->fBoard = FALSE;
+  pr->szComment = pmr->sz ? g_strdup(pmr->sz) : NULL;
+
+  switch (pmr->mt) {
+  case MOVE_NORMAL:
+    pr->fPlayer = pmr->fPlayer;
+    pr->anDice[0] = pmr->anDice[0];
+    pr->anDice[1] = pmr->anDice[1];
+    memcpy(pr->anMove, pmr->n.anMove, sizeof(pr->anMove));
+    if (pri->fBoards) {
+      memcpy(pr->anBoard, pri->anBoard, sizeof(TanBoard));
+      pr->fBoard = TRUE;
+      ApplyMove(pri->anBoard, pmr->n.anMove, 0);
+      SwapSides(pri->anBoard);
+    }
+    break;
+  case MOVE_DOUBLE:
+    pr->fPlayer = pmr->fPlayer;
+    if (pri->fBoards) {
+      memcpy(pr->anBoard, pri->anBoard, sizeof(TanBoard));
+      pr->fBoard = TRUE;
+    }
+    break;
+  case MOVE_TAKE:
+  case MOVE_DROP:
+    pr->fPlayer = pmr->fPlayer;
+    break;
+  case MOVE_RESIGN:
+    pr->fPlayer = pmr->fPlayer;
+    pr->n = MAX(1, MIN(3, pmr->r.nResigned));
+    break;
+  case MOVE_SETBOARD:
+    PositionFromKey(pr->anBoard, &pmr->sb.key);
+    pr->fBoard = TRUE;
+    if (pri->fBoards)
+      memcpy(pri->anBoard, pr->anBoard, sizeof(TanBoard));
+    break;
+  case MOVE_SETDICE:
+    pr->fPlayer = pmr->fPlayer;
+    pr->anDice[0] = pmr->anDice[0];
+    pr->anDice[1] = pmr->anDice[1];
+    break;
+  case MOVE_SETCUBEVAL:
+    pr->n = pmr->scv.nCube;
+    break;
+  case MOVE_SETCUBEPOS:
+    pr->n = pmr->scp.fCubeOwner;
+    break;
+  default:
+    break;
+  }
+  return (PyObject *)pr;
+}
+
+/* Step over the session swapped in; NULL at the end or with an exception
+ * set. */
+static PyObject *RecordIterStep(RecordIterObject *pri) {
+  const listOLD *plGame;
+  const moverecord *pmr;
+
+  if (!pri->plGameNode) {
+    pri->nGeneration = SessionMatchGeneration();
+    if ((pri->plGameNode = lMatch.plNext) == &lMatch) {
+      pri->fDone = TRUE;
+      return NULL;
+    }
+    pri->plRecord = (const listOLD *)pri->plGameNode->p;
+  } else if (SessionMatchGeneration() != pri->nGeneration) {
+    pri->fDone = TRUE;
+    PyErr_SetString(PyExc_RuntimeError, "match changed during iteration");
+    return NULL;
+  }
+
+  for (;;) {
+    plGame = (const listOLD *)pri->plGameNode->p;
+    if (pri->plRecord->plNext == plGame) {
+      if ((pri->plGameNode = pri->plGameNode->plNext) == &lMatch) {
+        pri->fDone = TRUE;
+        return NULL;
+      }
+      pri->plRecord = (const listOLD *)pri->plGameNode->p;
+      pri->iGame++;
+      pri->iRecord = 0;
+      continue;
+    }
+    pri->plRecord = pri->plRecord->plNext;
+    pmr = (const moverecord *)pri->plRecord->p;
+    if (pmr->mt != MOVE_GAMEINFO)
+      break;
+    if (pri->fBoards)
+      InitBoard(pri->anBoard, pmr->g.bgv);
+  }
+  return RecordFromMoveRecord(pri, pmr);
+}
+
+static PyObject *RecordIterNext(PyObject *self) {
+  RecordIterObject *pri = (RecordIterObject *)self;
+  std::vector<EngineObject *> apeng;
+  PyObject *pyRecord;
+
+  if (pri->fDone)
+    return NULL;
+  if (pri->peng)
+    apeng.push_back(pri->peng);
+  apeng.swap(apengActive);
+  {
+    SessionLock session;
+    pyRecord = session.Held() ? RecordIterStep(pri) : NULL;
+  }
+  apeng.swap(apengActive);
+  return pyRecord;
+}
+
+static PyTypeObject RecordIterType = {PyVarObject_HEAD_INIT(NULL, 0)};
+
+/* Fill in RecordIterType; called once from module init. */
+static int InitRecordIterType(void) {
+  RecordIterType.tp_name = "gnubg.RecordIterator";
+  RecordIterType.tp_basicsize = sizeof(RecordIterObject);
+  RecordIterType.tp_dealloc = RecordIterDealloc;
+  RecordIterType.tp_flags = Py_TPFLAGS_DEFAULT;
+  RecordIterType.tp_doc = "Move records of the match, one at a time";
+  RecordIterType.tp_iter = PyObject_SelfIter;
+  RecordIterType.tp_iternext = RecordIterNext;
+  return PyType_Ready(&RecordIterType);
+}
+
+/*
+ * Exposed as: gnubg.iter_records(boards=False)
+ * The records of the current match as gnubg.Record objects, in the order
+ * of match(), without building the whole match. With boards, each move
+ * and double has the position ID before it.
+ */
+static PyObject *PythonIterRecords(PyObject *self, PyObject *args,
+                                   PyObject *keywds) {
+  static const char *kwlist[] = {"boards", NULL};
+  int fBoards = FALSE;
+  RecordIterObject *pri;
+
+  (void)self;
+  if (!PyArg_ParseTupleAndKeywords(args, keywds, "|i:iter_records",
+                                   (char **)kwlist, &fBoards))
+    return NULL;
+  if (!(pri = PyObject_New(RecordIterObject, &RecordIterType)))
+    return NULL;
+  pri->peng = apengActive.empty() ? NULL : apengActive.back();
+  Py_XINCREF(pri->peng);
+  pri->fBoards = fBoards;
+  pri->fDone = FALSE;
+  pri->plGameNode = pri->plRecord = NULL;
+  pri->nGeneration = 0;
+  pri->iGame = pri->iRecord = 0;
+  return (PyObject *)pri;
+}
+
+/* -------------------------------------------------------------------------
+ * In-memory import
+ * ------------------------------------------------------------------------- */
+
+/* The match readers of import.c by format name; szName is only used in
+ * their messages. */
+typedef struct {
+  const char *szFormat;
+  int (*pfImport)(FILE *pf, char *szName);
+} importformat;
+
+static const importformat aImportFormat[] = {
+    {"mat", [](FILE *pf, char *sz) { return ImportMat(pf, sz); }},
+    {"oldmoves", [](FILE *pf, char *sz) { return ImportOldmoves(pf, sz); }},
+    {"sgg", [](FILE *pf, char *sz) { return ImportSGG(pf, sz); }},
+    {"tmg", [](FILE *pf, char *sz) { return ImportTMG(pf, sz); }},
+    {"gam", [](FILE *pf, char *sz) { return ImportGAM(pf, sz); }},
+    {"bkg", [](FILE *pf, char *sz) { return ImportBKG(pf, sz); }}};
+
+/* A read-only stream over cb bytes at pv (cb > 0): fmemopen where there is
+ * one, otherwise an anonymous temporary file. */
+static FILE *OpenMemoryStream(const void *pv, size_t cb) {
+#if defined(_WIN32) || defined(WIN32) || defined(__MINGW32__)
+  FILE *pf = tmpfile();
+  if (pf && (fwrite(pv, 1, cb, pf) != cb || fseek(pf, 0, SEEK_SET) != 0)) {
+    fclose(pf);
+    pf = NULL;
+  }
+  return pf;
+#else
+  return fmemopen(const_cast<void *>(pv), cb, "r");
+#endif
+}
+
+/*
+ * Load SGF data as "load match" would. sgf.c's LoadCollection opens "-" as
+ * stdin, but SGFParse takes the input set here and never reads the stream.
+ * The current match is dropped first, so that a failed load leaves none.
+ */
+static void ImportSGFBytes(const char *pch, size_t cb) {
+  char szStdin[] = "-";
+
+  FreeMatch();
+  ClearMatch();
+  SGFParseSetInput(pch, cb);
+  outputoff();
+  CommandLoadMatch(szStdin);
+  outputon();
+  SGFParseSetInput(NULL, 0);
+}
+
+/*
+ * Exposed as: gnubg.import_bytes(data, format="mat")
+ * Replace the current match with one read from data, any bytes-like
+ * object: sgf as by "load match", which keeps the analysis saved with the
+ * match, or any other format (mat, oldmoves, sgg, tmg, gam or bkg) by its
+ * import.c reader. No file is written and no command is parsed. Raises
+ * ValueError if no match could be read.
+ */
+static PyObject *PythonImportBytes(PyObject *self, PyObject *args,
+                                   PyObject *keywds) {
+  SessionLock session;
+  if (!session.Held())
+    return NULL;
+  static const char *kwlist[] = {"data", "format", NULL};
+  Py_buffer buf;
+  const char *szFormat = "mat";
+  const importformat *pif = NULL;
+  FILE *pf;
+  int rc;
+
+  (void)self;
+  if (!PyArg_ParseTupleAndKeywords(args, keywds, "y*|s:import_bytes",
+                                   (char **)kwlist, &buf, &szFormat))
+    return NULL;
+  for (const importformat &imf : aImportFormat)
+    if (!strcmp(imf.szFormat, szFormat))
+      pif = &imf;
+  if (!pif && strcmp(szFormat, "sgf")) {
+    PyBuffer_Release(&buf);
+    PyErr_Format(PyExc_ValueError,
+                 "unknown format %s (use sgf, mat, oldmoves, sgg, tmg, gam "
+                 "or bkg)",
+                 szFormat);
+    return NULL;
+  }
+  if (!buf.len) {
+    PyBuffer_Release(&buf);
+    PyErr_SetString(PyExc_ValueError, "no match in empty data");
+    return NULL;
+  }
+
+  SessionMatchChanged();
+  if (!pif) {
+    ImportSGFBytes((const char *)buf.buf, (size_t)buf.len);
+    rc = 0;
+  } else {
+    if (!(pf = OpenMemoryStream(buf.buf, (size_t)buf.len))) {
+      PyBuffer_Release(&buf);
+      return PyErr_SetFromErrno(PyExc_OSError);
+    }
+    outputoff();
+    rc = pif->pfImport(pf, (char *)"<bytes>");
+    outputon();
+    fclose(pf);
+  }
+  PyBuffer_Release(&buf);
+  if (rc != 0 || lMatch.plNext == &lMatch) {
+    PyErr_Format(PyExc_ValueError, "could not import %s data", szFormat);
+    return NULL;
+  }
+  Py_RETURN_NONE;
+}
+
+/* -------------------------------------------------------------------------
+ * Batch analysis
+ * ------------------------------------------------------------------------- */
+
+/*
+ * Iterator returned by gnubg.analyse_files: imports and analyses one file
+ * per step, each in a session of its own, and yields its result.
+ */
+typedef struct {
+  PyObject_HEAD
+  PyObject *pyPaths; /* list of str; NULL once finished or closed */
+  Py_ssize_t iNext;
+  int fChequer, fCube, fFilters; /* which settings were given */
+  evalcontext ecChequer, ecCube;
+  movefilter aamf[MAX_FILTER_PLIES][MAX_FILTER_PLIES];
+  unsigned int cMaxWorkers; /* threads argument; 0 for the whole pool */
+} AnalyseFilesObject;
+
+static void AnalyseFilesFinish(AnalyseFilesObject *paf) {
+  Py_CLEAR(paf->pyPaths);
+}
+
+/*
+ * Import szPath into the current session, which must have no match.
+ * Returns 0, or -1 with ValueError set if nothing could be imported. The
+ * caller holds a SessionLock.
+ */
+static int ImportFile(const char *szPath) {
+  char *szArg = g_strdup_printf("\"%s\"", szPath);
+
+  outputoff();
+  CommandImportAuto(szArg);
+  outputon();
+  g_free(szArg);
+  if (lMatch.plNext == &lMatch) {
+    PyErr_Format(PyExc_ValueError, "could not import %s", szPath);
+    return -1;
+  }
+  return 0;
+}
+
+/* Below, with analyse_match. */
+static PyObject *AnalyseMatch(PyObject *pyStore, PyObject *pyCallback,
+                              unsigned int cMaxWorkers);
+
+/*
+ * Import szPath into the current session, which must have no match, and
+ * analyse it as gnubg.analyse_match does, on at most paf->cMaxWorkers
+ * workers of the pool. Returns the match as from gnubg.match(analysis=True,
+ * boards=False, statistics=True), or NULL with an exception set.
+ */
+static PyObject *AnalyseFile(const AnalyseFilesObject *paf,
+                             const char *szPath) {
+  SessionLock session;
+  if (!session.Held())
+    return NULL;
+  PyObject *pyResult;
+
+  if (paf->fChequer) {
+    esAnalysisChequer.et = EVAL_EVAL;
+    esAnalysisChequer.ec = paf->ecChequer;
+  }
+  if (paf->fCube) {
+    esAnalysisCube.et = EVAL_EVAL;
+    esAnalysisCube.ec = paf->ecCube;
+  }
+  if (paf->fFilters)
+    memcpy(aamfAnalysis, paf->aamf, sizeof(aamfAnalysis));
+  if (ImportFile(szPath) != 0 ||
+      !(pyResult = AnalyseMatch(Py_None, Py_None, paf->cMaxWorkers)))
+    return NULL;
+  Py_DECREF(pyResult);
+
+  PyObject *args = PyTuple_New(0);
+  PyObject *keywds = Py_BuildValue("{s:i,s:i,s:i}", "analysis", 1, "boards",
+                                   0, "statistics", 1);
+  PyObject *pyMatch =
+      args && keywds ? PythonMatch(NULL, args, keywds) : NULL;
+  Py_XDECREF(args);
+  Py_XDECREF(keywds);
+  return pyMatch;
+}
+
+static void AnalyseFilesDealloc(PyObject *self) {
+  AnalyseFilesFinish((AnalyseFilesObject *)self);
+  Py_TYPE(self)->tp_free(self);
+}
+
+/*
+ * The next file as {"path": path, "match": match} or, if it could not be
+ * imported or analysed, {"path": path, "error": message}. Cancellation and
+ * KeyboardInterrupt end the iteration with the exception instead.
+ */
+static PyObject *AnalyseFilesNext(PyObject *self) {
+  AnalyseFilesObject *paf = (AnalyseFilesObject *)self;
+  PyObject *pyPath, *pyEngine, *pyMatch;
+
+  if (!paf->pyPaths)
+    return NULL;
+  if (paf->iNext >= PyList_GET_SIZE(paf->pyPaths)) {
+    AnalyseFilesFinish(paf);
+    return NULL;
+  }
+  pyPath = PyList_GET_ITEM(paf->pyPaths, paf->iNext++);
+  Py_INCREF(pyPath);
+  if (!(pyEngine = PyObject_CallObject((PyObject *)&EngineType, NULL))) {
+    Py_DECREF(pyPath);
+    return NULL;
+  }
+  apengActive.push_back((EngineObject *)pyEngine);
+  pyMatch = AnalyseFile(paf, PyUnicode_AsUTF8(pyPath));
+  apengActive.pop_back();
+  Py_DECREF(pyEngine);
+
+  if (pyMatch)
+    return Py_BuildValue("{s:N,s:N}", "path", pyPath, "match", pyMatch);
+  if (PyErr_ExceptionMatches(pyCancelledError) ||
+      PyErr_ExceptionMatches(PyExc_TimeoutError) ||
+      PyErr_ExceptionMatches(PyExc_KeyboardInterrupt)) {
+    Py_DECREF(pyPath);
+    AnalyseFilesFinish(paf);
+    return NULL;
+  }
+  PyObject *pyType, *pyValue, *pyTraceback;
+  PyErr_Fetch(&pyType, &pyValue, &pyTraceback);
+  PyObject *pyMessage = pyValue ? PyObject_Str(pyValue) : NULL;
+  Py_XDECREF(pyType);
+  Py_XDECREF(pyValue);
+  Py_XDECREF(pyTraceback);
+  if (!pyMessage) {
+    Py_DECREF(pyPath);
+    return NULL;
+  }
+  return Py_BuildValue("{s:N,s:N}", "path", pyPath, "error", pyMessage);
+}
+
+static PyObject *AnalyseFilesClose(PyObject *self, PyObject *args) {
+  (void)args;
+  AnalyseFilesFinish((AnalyseFilesObject *)self);
+  Py_RETURN_NONE;
+}
+
+static PyMethodDef AnalyseFilesMethods[] = {
+    {"close", AnalyseFilesClose, METH_NOARGS,
+     "Stop; no more files are analysed"},
+    {NULL, NULL, 0, NULL}};
+
+static PyTypeObject AnalyseFilesType = {PyVarObject_HEAD_INIT(NULL, 0)};
+
+/* Fill in AnalyseFilesType; called once from module init. */
+static int InitAnalyseFilesType(void) {
+  AnalyseFilesType.tp_name = "gnubg.AnalyseFilesIterator";
+  AnalyseFilesType.tp_basicsize = sizeof(AnalyseFilesObject);
+  AnalyseFilesType.tp_dealloc = AnalyseFilesDealloc;
+  AnalyseFilesType.tp_flags = Py_TPFLAGS_DEFAULT;
+  AnalyseFilesType.tp_doc = "Results of a batch analysis, file by file";
+  AnalyseFilesType.tp_iter = PyObject_SelfIter;
+  AnalyseFilesType.tp_iternext = AnalyseFilesNext;
+  AnalyseFilesType.tp_methods = AnalyseFilesMethods;
+  return PyType_Ready(&AnalyseFilesType);
+}
+
+/* Read analysis_settings: a dict with optional "chequer" and "cube"
+ * evalcontexts and "movefilters". Returns 0, or -1 with an exception set. */
+static int PyToAnalysisSettings(PyObject *p, AnalyseFilesObject *paf) {
+  PyObject *pyKey, *pyValue;
+  Py_ssize_t iPos = 0;
+
+  if (!PyDict_Check(p)) {
+    PyErr_SetString(PyExc_TypeError, "analysis_settings must be a dict");
+    return -1;
+  }
+  while (PyDict_Next(p, &iPos, &pyKey, &pyValue)) {
+    const char *szKey = PyUnicode_Check(pyKey) ? PyUnicode_AsUTF8(pyKey) : "";
+
+    if (!strcmp(szKey, "chequer")) {
+      if (PyToEvalContext(pyValue, &paf->ecChequer) != 0)
+        return -1;
+      paf->fChequer = TRUE;
+    } else if (!strcmp(szKey, "cube")) {
+      if (PyToEvalContext(pyValue, &paf->ecCube) != 0)
+        return -1;
+      paf->fCube = TRUE;
+    } else if (!strcmp(szKey, "movefilters")) {
+      if (PyToMoveFilters(pyValue, paf->aamf) != 0)
+        return -1;
+      paf->fFilters = TRUE;
+    } else {
+      PyErr_Format(PyExc_ValueError,
+                   "unknown analysis setting %R (use chequer, cube, "
+                   "movefilters)",
+                   pyKey);
+      return -1;
+    }
+  }
+  return 0;
+}
+
+/* A list of str from an iterable of str, bytes or os.PathLike, or NULL
+ * with an exception set. */
+static PyObject *PyToPaths(PyObject *pyPaths) {
+  PyObject *pyList, *pyIter, *pyItem;
+
+  if (!(pyList = PyList_New(0)))
+    return NULL;
+  if (!(pyIter = PyObject_GetIter(pyPaths))) {
+    Py_DECREF(pyList);
+    return NULL;
+  }
+  while ((pyItem = PyIter_Next(pyIter))) {
+    PyObject *pyPath = PyOS_FSPath(pyItem);
+    int fOK = pyPath != NULL;
+
+    Py_DECREF(pyItem);
+    if (fOK && PyBytes_Check(pyPath)) {
+      PyObject *pyDecoded = PyUnicode_DecodeFSDefaultAndSize(
+          PyBytes_AS_STRING(pyPath), PyBytes_GET_SIZE(pyPath));
+      Py_DECREF(pyPath);
+      fOK = (pyPath = pyDecoded) != NULL;
+    }
+    fOK = fOK && PyList_Append(pyList, pyPath) == 0;
+    Py_XDECREF(pyPath);
+    if (!fOK)
+      break;
+  }
+  Py_DECREF(pyIter);
+  if (PyErr_Occurred()) {
+    Py_DECREF(pyList);
+    return NULL;
+  }
+  return pyList;
+}
+
+/*
+ * Exposed as: gnubg.analyse_files(paths, analysis_settings=None, threads=0)
+ * Import and analyse each file (any format "import auto" recognises) in a
+ * session of its own, yielding the results as they complete. Unset analysis
+ * settings are those of the current session. The files are analysed one
+ * after another, each as gnubg.analyse_match does: its moves are tasks on
+ * the engine pool, on at most threads workers of it (all of them if 0).
+ * The pool itself is left as set_threads made it. Rollout analysis
+ * settings go through "analyse match" and use the whole pool.
+ */
+static PyObject *PythonAnalyseFiles(PyObject *self, PyObject *args,
+                                    PyObject *keywds) {
+  static const char *kwlist[] = {"paths", "analysis_settings", "threads",
+                                 NULL};
+  PyObject *pyPaths, *pySettings = Py_None;
+  int nThreads = 0;
+  AnalyseFilesObject *paf;
+
+  (void)self;
+  if (!PyArg_ParseTupleAndKeywords(args, keywds, "O|Oi:analyse_files",
+                                   (char **)kwlist, &pyPaths, &pySettings,
+                                   &nThreads))
+    return NULL;
+  if (nThreads < 0 || nThreads > MAX_NUMTHREADS) {
+    PyErr_Format(PyExc_ValueError, "threads must be between 0 and %d",
+                 MAX_NUMTHREADS);
+    return NULL;
+  }
+  if (!(paf = PyObject_New(AnalyseFilesObject, &AnalyseFilesType)))
+    return NULL;
+  paf->pyPaths = NULL;
+  paf->iNext = 0;
+  paf->fChequer = paf->fCube = paf->fFilters = FALSE;
+  paf->cMaxWorkers = (unsigned int)nThreads;
+  if ((pySettings != Py_None && PyToAnalysisSettings(pySettings, paf) != 0) ||
+      !(paf->pyPaths = PyToPaths(pyPaths))) {
+    Py_DECREF(paf);
+    return NULL;
+  }
+  return (PyObject *)paf;
+}
+
+/* -------------------------------------------------------------------------
+ * Batch export
+ * ------------------------------------------------------------------------- */
+
+/* Formats of gnubg.export_files: the "export match" command and the file
+ * extension of its output. */
+typedef struct {
+  const char *szFormat;
+  const char *szExtension;
+} exportformat;
+
+static const exportformat aExportFormat[] = {
+    {"html", "html"}, {"latex", "tex"}, {"text", "txt"}};
+
+/*
+ * Iterator returned by gnubg.export_files: imports and exports one file per
+ * step, each in a session of its own, and yields where it went.
+ */
+typedef struct {
+  PyObject_HEAD
+  PyObject *pyPaths; /* list of str; NULL once finished or closed */
+  Py_ssize_t iNext;
+  const exportformat *pef;
+  char *szFolder;
+  char *szPictureURL;              /* NULL: the current setting */
+  std::set<std::string> *psetName; /* output names used so far */
+} ExportFilesObject;
+
+static void ExportFilesFinish(ExportFilesObject *pxf) {
+  Py_CLEAR(pxf->pyPaths);
+  g_free(pxf->szFolder);
+  g_free(pxf->szPictureURL);
+  delete pxf->psetName;
+  pxf->szFolder = pxf->szPictureURL = NULL;
+  pxf->psetName = NULL;
+}
+
+/* The output file for szPath: its base name with the format's extension,
+ * numbered if an earlier file of the batch had the same name. */
+static char *ExportFileName(ExportFilesObject *pxf, const char *szPath) {
+  char *szBase = g_path_get_basename(szPath);
+  char *pch = strrchr(szBase, '.');
+  std::string sName;
+
+  if (pch && pch != szBase)
+    *pch = 0;
+  sName = szBase;
+  for (int i = 2; !pxf->psetName->insert(sName).second; ++i)
+    sName = std::string(szBase) + "-" + std::to_string(i);
+  g_free(szBase);
+
+  std::string sFile = sName + "." + pxf->pef->szExtension;
+  return g_build_filename(pxf->szFolder, sFile.c_str(), NULL);
+}
+
+/*
+ * Import szPath into the current session, which must have no match, and
+ * export it to szOutput. HTML pages link the stylesheet and the board
+ * images rather than embedding them, so every page of the batch shares one
+ * gnubg.css and one set of images. Returns 0, or -1 with an exception set.
+ */
+static int ExportFile(const ExportFilesObject *pxf, const char *szPath,
+                      const char *szOutput) {
+  SessionLock session;
+  if (!session.Held())
+    return -1;
+  htmlexportcss hecss = exsExport.hecss;
+  char *szPictureURL = exsExport.szHTMLPictureURL;
+  char *sz;
+
+  if (ImportFile(szPath) != 0)
+    return -1;
+  /* A file left by an earlier run would look like success, and "export
+   * match" may decline to overwrite it. */
+  if (g_unlink(szOutput) != 0 && errno != ENOENT) {
+    PyErr_SetFromErrnoWithFilename(PyExc_OSError, szOutput);
+    return -1;
+  }
+
+  exsExport.hecss = HTML_EXPORT_CSS_EXTERNAL;
+  if (pxf->szPictureURL)
+    exsExport.szHTMLPictureURL = pxf->szPictureURL;
+  sz = g_strdup_printf("export match %s \"%s\"", pxf->pef->szFormat,
+                       szOutput);
+  outputoff();
+  Py_BEGIN_ALLOW_THREADS
+  HandleCommand(sz, acTop);
+  Py_END_ALLOW_THREADS
+  outputon();
+  g_free(sz);
+  exsExport.hecss = hecss;
+  exsExport.szHTMLPictureURL = szPictureURL;
+
+  if (!g_file_test(szOutput, G_FILE_TEST_EXISTS)) {
+    PyErr_Format(PyExc_ValueError, "could not export %s", szPath);
+    return -1;
+  }
+  return 0;
+}
+
+static void ExportFilesDealloc(PyObject *self) {
+  ExportFilesFinish((ExportFilesObject *)self);
+  Py_TYPE(self)->tp_free(self);
+}
+
+/*
+ * The next file as {"path": path, "output": file} or, if it could not be
+ * imported or exported, {"path": path, "error": message}. KeyboardInterrupt
+ * ends the iteration with the exception instead.
+ */
+static PyObject *ExportFilesNext(PyObject *self) {
+  ExportFilesObject *pxf = (ExportFilesObject *)self;
+  PyObject *pyPath, *pyEngine;
+  char *szOutput;
+  int rc;
+
+  if (!pxf->pyPaths)
+    return NULL;
+  if (pxf->iNext >= PyList_GET_SIZE(pxf->pyPaths)) {
+    ExportFilesFinish(pxf);
+    return NULL;
+  }
+  pyPath = PyList_GET_ITEM(pxf->pyPaths, pxf->iNext++);
+  Py_INCREF(pyPath);
+  if (!(pyEngine = PyObject_CallObject((PyObject *)&EngineType, NULL))) {
+    Py_DECREF(pyPath);
+    return NULL;
+  }
+  szOutput = ExportFileName(pxf, PyUnicode_AsUTF8(pyPath));
+  apengActive.push_back((EngineObject *)pyEngine);
+  rc = ExportFile(pxf, PyUnicode_AsUTF8(pyPath), szOutput);
+  apengActive.pop_back();
+  Py_DECREF(pyEngine);
+
+  if (rc == 0) {
+    PyObject *pyOutput = PyUnicode_DecodeFSDefault(szOutput);
+    g_free(szOutput);
+    if (!pyOutput) {
+      Py_DECREF(pyPath);
+      return NULL;
+    }
+    return Py_BuildValue("{s:N,s:N}", "path", pyPath, "output", pyOutput);
+  }
+  g_free(szOutput);
+  if (PyErr_ExceptionMatches(PyExc_KeyboardInterrupt)) {
+    Py_DECREF(pyPath);
+    ExportFilesFinish(pxf);
+    return NULL;
+  }
+  PyObject *pyType, *pyValue, *pyTraceback;
+  PyErr_Fetch(&pyType, &pyValue, &pyTraceback);
+  PyObject *pyMessage = pyValue ? PyObject_Str(pyValue) : NULL;
+  Py_XDECREF(pyType);
+  Py_XDECREF(pyValue);
+  Py_XDECREF(pyTraceback);
+  if (!pyMessage) {
+    Py_DECREF(pyPath);
+    return NULL;
+  }
+  return Py_BuildValue("{s:N,s:N}", "path", pyPath, "error", pyMessage);
+}
+
+static PyObject *ExportFilesClose(PyObject *self, PyObject *args) {
+  (void)args;
+  ExportFilesFinish((ExportFilesObject *)self);
+  Py_RETURN_NONE;
+}
+
+static PyMethodDef ExportFilesMethods[] = {
+    {"close", ExportFilesClose, METH_NOARGS,
+     "Stop; no more files are exported"},
+    {NULL, NULL, 0, NULL}};
+
+static PyTypeObject ExportFilesType = {PyVarObject_HEAD_INIT(NULL, 0)};
+
+/* Fill in ExportFilesType; called once from module init. */
+static int InitExportFilesType(void) {
+  ExportFilesType.tp_name = "gnubg.ExportFilesIterator";
+  ExportFilesType.tp_basicsize = sizeof(ExportFilesObject);
+  ExportFilesType.tp_dealloc = ExportFilesDealloc;
+  ExportFilesType.tp_flags = Py_TPFLAGS_DEFAULT;
+  ExportFilesType.tp_doc = "Results of a batch export, file by file";
+  ExportFilesType.tp_iter = PyObject_SelfIter;
+  ExportFilesType.tp_iternext = ExportFilesNext;
+  ExportFilesType.tp_methods = ExportFilesMethods;
+  return PyType_Ready(&ExportFilesType);
+}
+
+/*
+ * Exposed as: gnubg.export_files(paths, folder, format="html",
+ * picture_url=None)
+ * Import each file (any format "import auto" recognises) in a session of
+ * its own and export it to folder as html, latex or text, named after the
+ * file. The exporters work on the process-wide session, so files are
+ * exported one at a time, with the GIL released while each is written.
+ * HTML pages share folder/gnubg.css and take their board images from
+ * picture_url (default: the "set export html pictureurl" setting), so the
+ * images are made once, with "export htmlimages", for the whole batch.
+ */
+static PyObject *PythonExportFiles(PyObject *self, PyObject *args,
+                                   PyObject *keywds) {
+  static const char *kwlist[] = {"paths", "folder", "format", "picture_url",
+                                 NULL};
+  PyObject *pyPaths, *pyFolder, *pyFolderBytes = NULL;
+  const char *szFormat = "html", *szPictureURL = NULL;
+  const exportformat *pef = NULL;
+  ExportFilesObject *pxf;
+
+  (void)self;
+  if (!PyArg_ParseTupleAndKeywords(args, keywds, "OO|sz:export_files",
+                                   (char **)kwlist, &pyPaths, &pyFolder,
+                                   &szFormat, &szPictureURL))
+    return NULL;
+  for (const exportformat &ef : aExportFormat)
+    if (!strcmp(ef.szFormat, szFormat))
+      pef = &ef;
+  if (!pef) {
+    PyErr_Format(PyExc_ValueError,
+                 "unknown export format '%s' (use html, latex, text)",
+                 szFormat);
+    return NULL;
+  }
+  if (!PyUnicode_FSConverter(pyFolder, &pyFolderBytes))
+    return NULL;
+  if (g_mkdir_with_parents(PyBytes_AS_STRING(pyFolderBytes), 0755) != 0) {
+    PyErr_SetFromErrnoWithFilenameObject(PyExc_OSError, pyFolder);
+    Py_DECREF(pyFolderBytes);
+    return NULL;
+  }
+  if (!(pxf = PyObject_New(ExportFilesObject, &ExportFilesType))) {
+    Py_DECREF(pyFolderBytes);
+    return NULL;
+  }
+  pxf->iNext = 0;
+  pxf->pef = pef;
+  pxf->szFolder = g_strdup(PyBytes_AS_STRING(pyFolderBytes));
+  pxf->szPictureURL = g_strdup(szPictureURL);
+  pxf->psetName = new std::set<std::string>();
+  Py_DECREF(pyFolderBytes);
+  if (!(pxf->pyPaths = PyToPaths(pyPaths))) {
+    Py_DECREF(pxf);
+    return NULL;
+  }
+  return (PyObject *)pxf;
+}
+
+/* -------------------------------------------------------------------------
+ * Incremental analysis
+ * ------------------------------------------------------------------------- */
+
+/* Bump when storedanalysis or the derivation of record keys changes. */
+#define ANALYSIS_STORE_VERSION 1
+
+/*
+ * The analysis fields of a move record as kept in an analysis store; the
+ * blob of a MOVE_NORMAL record is followed by its ml.cMoves moves. Blobs
+ * are in the native layout, which is part of the settings digest, so a
+ * store is never read back by a build that lays them out differently.
+ */
+typedef struct {
+  movetype mt;
+  lucktype lt;
+  float rLuck;
+  unsigned int iMove;
+  skilltype stMove, stCube;
+  evalsetup esChequer;
+  int fCubeDec; /* cd holds the record's cube analysis */
+  cubedecisiondata cd;
+  movelist ml; /* amMoves is not used */
+} storedanalysis;
+
+/* One record of the match, with the match state before it and, if its
+ * analysis goes to the store, its key. */
+typedef struct {
+  moverecord *pmr;
+  const listOLD *plGame;
+  matchstate ms;
+  int iGame, iRecord;
+  int fAnalyse;   /* not restored from the store */
+  char szKey[33]; /* empty if not stored */
+} analysisrecord;
+
+/* Records whose analysis depends only on the match state before them. */
+static int IsStoredRecord(movetype mt) {
+  return mt == MOVE_NORMAL || mt == MOVE_DOUBLE || mt == MOVE_TAKE ||
+         mt == MOVE_DROP || mt == MOVE_SETDICE;
+}
+
+/*
+ * Hash of what the analysis of a record depends on besides the record and
+ * the match state: the session's analysis settings and thresholds, the
+ * luck evalcontext, the beavers allowed, the match equity table and the
+ * blob layout. These are the globals AnalyzeMove reads; the players to
+ * analyse are not among them, as AnalyseRecordsTask analyses both. 0
+ * unless both chequer and cube analysis are evaluations; rollout results
+ * are not stored.
+ */
+static uint64_t AnalysisSettingsHash(void) {
+  const int an[] = {ANALYSIS_STORE_VERSION, (int)sizeof(storedanalysis),
+                    (int)sizeof(move),      fAnalyseMove,
+                    fAnalyseCube,           fAnalyseDice,
+                    (int)nBeavers};
+  uint64_t h;
+
+  if (esAnalysisChequer.et != EVAL_EVAL || esAnalysisCube.et != EVAL_EVAL)
+    return 0;
+  h = HashBytes(0xcbf29ce484222325ULL, an, sizeof(an));
+  h = HashEvalContext(h, &esAnalysisChequer.ec);
+  h = HashEvalContext(h, &esAnalysisCube.ec);
+  h = HashEvalContext(h, &ecLuck);
+  h = HashMoveFilters(h, aamfAnalysis);
+  h = HashBytes(h, arSkillLevel, sizeof(arSkillLevel));
+  h = HashBytes(h, arLuckLevel, sizeof(arLuckLevel));
+  h = HashBytes(h, aafMET, sizeof(aafMET));
+  h = HashBytes(h, aafMETPostCrawford, sizeof(aafMETPostCrawford));
+  return h ? h : 1;
+}
+
+/*
+ * The store key of pmr: the settings hash and a hash of the match state
+ * before the record and the record's own action, dice and move. Comments
+ * and the rest of the match are not part of it, so editing one move leaves
+ * the keys of the others unchanged.
+ */
+static void AnalysisRecordKey(uint64_t nSettings, const moverecord *pmr,
+                              const matchstate *pms, char szKey[33]) {
+  const int an[] = {(int)pmr->mt,          pmr->fPlayer,
+                    (int)pmr->anDice[0],   (int)pmr->anDice[1],
+                    pms->fMove,            pms->fTurn,
+                    pms->fCubeOwner,       (int)pms->nCube,
+                    pms->fDoubled,         pms->fCrawford,
+                    pms->fPostCrawford,    pms->nMatchTo,
+                    pms->anScore[0],       pms->anScore[1],
+                    (int)pms->bgv,         pms->fCubeUse,
+                    pms->fJacoby,          (int)pms->cBeavers,
+                    (int)pms->gs};
+  uint64_t h = HashBytes(0xcbf29ce484222325ULL, an, sizeof(an));
+
+  h = HashBytes(h, pms->anBoard, sizeof(pms->anBoard));
+  if (pmr->mt == MOVE_NORMAL)
+    h = HashBytes(h, pmr->n.anMove, sizeof(pmr->n.anMove));
+  snprintf(szKey, 33, "%016llx%016llx", (unsigned long long)nSettings,
+           (unsigned long long)h);
+}
+
+/* The analysis of pmr as a store blob. */
+static PyObject *StoredAnalysisToPy(const moverecord *pmr) {
+  size_t cMoves = pmr->mt == MOVE_NORMAL ? pmr->ml.cMoves : 0;
+  PyObject *pyBlob = PyBytes_FromStringAndSize(
+      NULL, (Py_ssize_t)(sizeof(storedanalysis) + cMoves * sizeof(move)));
+  storedanalysis sa;
+
+  if (!pyBlob)
+    return NULL;
+  memset(&sa, 0, sizeof(sa));
+  sa.mt = pmr->mt;
+  sa.lt = pmr->lt;
+  sa.rLuck = pmr->rLuck;
+  sa.stCube = pmr->stCube;
+  if ((sa.fCubeDec = pmr->CubeDecPtr != NULL))
+    sa.cd = *pmr->CubeDecPtr;
+  if (pmr->mt == MOVE_NORMAL) {
+    sa.iMove = pmr->n.iMove;
+    sa.stMove = pmr->n.stMove;
+    sa.esChequer = pmr->esChequer;
+    sa.ml = pmr->ml;
+    sa.ml.amMoves = NULL;
+  }
+  memcpy(PyBytes_AS_STRING(pyBlob), &sa, sizeof(sa));
+  if (cMoves)
+    memcpy(PyBytes_AS_STRING(pyBlob) + sizeof(sa), pmr->ml.amMoves,
+           cMoves * sizeof(move));
+  return pyBlob;
+}
+
+/* Copy the blob pyBlob into pmr. Returns FALSE, leaving pmr as it is, if
+ * pyBlob is not a blob for a record like pmr. Only the size and record
+ * type are checked: the store is trusted input, and a blob written by
+ * someone else is taken as the analysis it claims to be. */
+static int RestoreStoredAnalysis(moverecord *pmr, PyObject *pyBlob) {
+  storedanalysis sa;
+  size_t cb, cMoves;
+
+  if (!PyBytes_Check(pyBlob) ||
+      (cb = (size_t)PyBytes_GET_SIZE(pyBlob)) < sizeof(sa))
+    return FALSE;
+  memcpy(&sa, PyBytes_AS_STRING(pyBlob), sizeof(sa));
+  cMoves = sa.mt == MOVE_NORMAL ? sa.ml.cMoves : 0;
+  if (sa.mt != pmr->mt || cMoves > (cb - sizeof(sa)) / sizeof(move) ||
+      cb != sizeof(sa) + cMoves * sizeof(move) ||
+      (sa.fCubeDec && !pmr->CubeDecPtr))
+    return FALSE;
+
+  pmr->lt = sa.lt;
+  pmr->rLuck = sa.rLuck;
+  pmr->stCube = sa.stCube;
+  if (sa.fCubeDec)
+    *pmr->CubeDecPtr = sa.cd;
+  if (pmr->mt == MOVE_NORMAL) {
+    g_free(pmr->ml.amMoves);
+    pmr->ml = sa.ml;
+    pmr->ml.amMoves = NULL;
+    if (cMoves) {
+      pmr->ml.amMoves = (move *)g_malloc(cMoves * sizeof(move));
+      memcpy(pmr->ml.amMoves, PyBytes_AS_STRING(pyBlob) + sizeof(sa),
+             cMoves * sizeof(move));
+    }
+    pmr->n.iMove = sa.iMove;
+    pmr->n.stMove = sa.stMove;
+    pmr->esChequer = sa.esChequer;
+  }
+  return TRUE;
+}
+
+/*
+ * The records of one analyse_match call. A task analyses a range of them
+ * in order: a double with the take or drop that answers it, as the take's
+ * analysis reuses the double's, or else one record. afDone and iNext pass
+ * the results to the callback in match order, from whichever thread
+ * completes the next record.
+ */
+typedef struct {
+  std::vector<analysisrecord> aar;
+  std::vector<char> afDone;
+  GMutex mtx;           /* guards afDone, iNext and fEmitting */
+  size_t iNext;         /* first record not yet passed to the callback */
+  int fEmitting;        /* a thread is calling the callback */
+  PyObject *pyCallback; /* callable or NULL */
+  PyObject *pyExcType, *pyExcValue, *pyExcTraceback;
+  unsigned int cMaxWorkers; /* of the pool; 0 for all */
+} analysisjob;
+
+typedef struct {
+  analysisjob *paj;
+  size_t iFirst, iLast;
+} analysistask;
+
+/* Call the callback for record i, with the GIL held. An exception is kept
+ * for the caller and interrupts the analysis. */
+static void AnalysisCallback(analysisjob *paj, size_t i) {
+  const analysisrecord *par = &paj->aar[i];
+  PyObject *pyAnalysis, *pyResult = NULL;
+
+  if (paj->pyExcType)
+    return;
+  if ((pyAnalysis = RecordAnalysisToPy(par->pmr, &par->ms, FALSE)))
+    pyResult = PyObject_CallFunction(paj->pyCallback, "iiN", par->iGame,
+                                     par->iRecord, pyAnalysis);
+  if (!pyResult) {
+    PyErr_Fetch(&paj->pyExcType, &paj->pyExcValue, &paj->pyExcTraceback);
+    MT_SafeSet(&fInterrupt, TRUE);
+  }
+  Py_XDECREF(pyResult);
+}
+
+/*
+ * Mark records [iFirst, iLast) done and, unless another thread is already
+ * at it, pass every record that is now next in match order to the
+ * callback. Called from the workers without the GIL.
+ */
+static void AnalysisDone(analysisjob *paj, size_t iFirst, size_t iLast) {
+  g_mutex_lock(&paj->mtx);
+  for (size_t i = iFirst; i < iLast; ++i)
+    paj->afDone[i] = TRUE;
+  if (paj->pyCallback && !paj->fEmitting) {
+    paj->fEmitting = TRUE;
+    while (paj->iNext < paj->aar.size() && paj->afDone[paj->iNext]) {
+      size_t i = paj->iNext++;
+      PyGILState_STATE gstate;
+
+      g_mutex_unlock(&paj->mtx);
+      gstate = PyGILState_Ensure();
+      fInEngineCallback = TRUE;
+      AnalysisCallback(paj, i);
+      fInEngineCallback = FALSE;
+      PyGILState_Release(gstate);
+      g_mutex_lock(&paj->mtx);
+    }
+    paj->fEmitting = FALSE;
+  }
+  g_mutex_unlock(&paj->mtx);
+}
+
+/* Engine task: analyse a range of records in order, as "analyse match"
+ * does. */
+static void AnalyseRecordsTask(void *p) {
+  analysistask *pat = (analysistask *)p;
+
+  for (size_t i = pat->iFirst; i < pat->iLast; ++i) {
+    analysisrecord *par = &pat->paj->aar[i];
+    matchstate ms = par->ms; /* AnalyzeMove moves it past the record */
+
+    if (par->fAnalyse &&
+        AnalyzeMove(par->pmr, &ms, par->plGame, NULL, &esAnalysisChequer,
+                    &esAnalysisCube, aamfAnalysis, NULL, NULL) < 0) {
+      MT_SetResultFailed();
+      return;
+    }
+  }
+  AnalysisDone(pat->paj, pat->iFirst, pat->iLast);
+}
+
+/*
+ * Collect the records of the current match into paj, restoring those found
+ * in pyStore (if not None) under the settings hash nSettings. Returns the
+ * number restored, or -1 with an exception set. The caller holds a
+ * SessionLock.
+ */
+static long CollectAnalysisRecords(analysisjob *paj, PyObject *pyStore,
+                                   uint64_t nSettings) {
+  long cReused = 0;
+  int iGame = 0;
+
+  for (const listOLD *plg = lMatch.plNext; plg != &lMatch;
+       plg = plg->plNext, ++iGame) {
+    const listOLD *plGame = (const listOLD *)plg->p;
+    const listOLD *pl = plGame->plNext;
+    matchstate msRecord;
+    int iRecord = 0;
+
+    if (pl == plGame)
+      continue;
+    memset(&msRecord, 0, sizeof(msRecord));
+    ApplyMoveRecord(&msRecord, plGame, (const moverecord *)pl->p);
+    for (pl = pl->plNext; pl != plGame; pl = pl->plNext, ++iRecord) {
+      moverecord *pmr = (moverecord *)pl->p;
+      analysisrecord ar;
+
+      FixMatchState(&msRecord, pmr);
+      ar.pmr = pmr;
+      ar.plGame = plGame;
+      ar.ms = msRecord;
+      ar.iGame = iGame;
+      ar.iRecord = iRecord;
+      ar.fAnalyse = TRUE;
+      ar.szKey[0] = 0;
+      if (nSettings && IsStoredRecord(pmr->mt)) {
+        PyObject *pyBlob;
+
+        AnalysisRecordKey(nSettings, pmr, &msRecord, ar.szKey);
+        if (!(pyBlob = PyMapping_GetItemString(pyStore, ar.szKey))) {
+          if (!PyErr_ExceptionMatches(PyExc_KeyError))
+            return -1;
+          PyErr_Clear();
+        }
+        if (pyBlob && RestoreStoredAnalysis(pmr, pyBlob)) {
+          ar.fAnalyse = FALSE;
+          ++cReused;
+        }
+        Py_XDECREF(pyBlob);
+      }
+      paj->aar.push_back(ar);
+      ApplyMoveRecord(&msRecord, plGame, pmr);
+    }
+  }
+  return cReused;
+}
+
+/*
+ * Analyse the records of paj that were not restored, and pass every
+ * record to the callback. Returns 0, or -1 with an exception set. The
+ * caller holds a SessionLock.
+ */
+static int RunAnalysisJob(analysisjob *paj) {
+  std::vector<analysistask> aat;
+  const size_t n = paj->aar.size();
+  int ret, nCancel;
+
+  paj->afDone.assign(n, FALSE);
+  for (size_t i = 0; i < n; ++i) {
+    analysistask at;
+
+    if (!paj->aar[i].fAnalyse) {
+      paj->afDone[i] = TRUE;
+      continue;
+    }
+    at.paj = paj;
+    at.iFirst = i;
+    at.iLast = i + 1;
+    if (paj->aar[i].pmr->mt == MOVE_DOUBLE && at.iLast < n &&
+        paj->aar[at.iLast].plGame == paj->aar[i].plGame &&
+        (paj->aar[at.iLast].pmr->mt == MOVE_TAKE ||
+         paj->aar[at.iLast].pmr->mt == MOVE_DROP))
+      ++at.iLast;
+    aat.push_back(at);
+    i = at.iLast - 1;
   }
-  DictSetItemSteal(gameDict, "game", gameTuple);
-  return gameDict;
+
+  outputoff();
+  InterruptWatch iw(paj->pyCallback != NULL);
+  if (esAnalysisChequer.et == EVAL_ROLLOUT ||
+      esAnalysisCube.et == EVAL_ROLLOUT) {
+    /* Rollouts use the thread pool themselves. */
+    Py_BEGIN_ALLOW_THREADS
+    g_mutex_lock(&mtxEngineTasks);
+    CommandAnalyseMatch(NULL);
+    g_mutex_unlock(&mtxEngineTasks);
+    Py_END_ALLOW_THREADS
+    ret = 0;
+    paj->afDone.assign(n, TRUE);
+  } else {
+    ret = RunEngineTasksOn(AnalyseRecordsTask, aat.data(),
+                           sizeof(analysistask), aat.size(), paj->cMaxWorkers);
+  }
+  nCancel = iw.Finish();
+  outputon();
+  if (!nCancel && !MT_SafeGet(&fInterrupt) && ret >= 0)
+    AnalysisDone(paj, 0, 0); /* records no task was run for */
+
+  if (paj->pyExcType) {
+    ResetInterrupt();
+    PyErr_Restore(paj->pyExcType, paj->pyExcValue, paj->pyExcTraceback);
+    paj->pyExcType = paj->pyExcValue = paj->pyExcTraceback = NULL;
+    return -1;
+  }
+  if (nCancel) {
+    PyErr_Clear();
+    SetCancelError(nCancel);
+    return -1;
+  }
+  if (MT_SafeGet(&fInterrupt)) {
+    ResetInterrupt();
+    PyErr_Clear();
+    PyErr_SetString(PyExc_RuntimeError, "analysis interrupted");
+    return -1;
+  }
+  if (ret < 0) {
+    if (!PyErr_Occurred())
+      PyErr_SetString(PyExc_RuntimeError, "analysis failed");
+    return -1;
+  }
+  return 0;
+}
+
+/* Analyse the current match for PythonAnalyseMatch, with the settings in
+ * place. The caller holds a SessionLock. */
+static PyObject *AnalyseMatch(PyObject *pyStore, PyObject *pyCallback,
+                              unsigned int cMaxWorkers) {
+  analysisjob aj;
+  uint64_t nSettings = pyStore != Py_None ? AnalysisSettingsHash() : 0;
+  long cReused;
+  int ret;
+
+  aj.iNext = 0;
+  aj.fEmitting = FALSE;
+  aj.pyCallback = pyCallback != Py_None ? pyCallback : NULL;
+  aj.pyExcType = aj.pyExcValue = aj.pyExcTraceback = NULL;
+  aj.cMaxWorkers = cMaxWorkers;
+  if ((cReused = CollectAnalysisRecords(&aj, pyStore, nSettings)) < 0)
+    return NULL;
+  g_mutex_init(&aj.mtx);
+  ret = RunAnalysisJob(&aj);
+  g_mutex_clear(&aj.mtx);
+  if (ret < 0)
+    return NULL;
+
+  for (const listOLD *plg = lMatch.plNext; plg != &lMatch; plg = plg->plNext)
+    if (((const listOLD *)plg->p)->plNext != (const listOLD *)plg->p)
+      updateStatisticsGame((const listOLD *)plg->p);
+
+  for (const analysisrecord &ar : aj.aar) {
+    PyObject *pyBlob;
+
+    if (!ar.fAnalyse || !ar.szKey[0])
+      continue;
+    if (!(pyBlob = StoredAnalysisToPy(ar.pmr)))
+      return NULL;
+    ret = PyMapping_SetItemString(pyStore, ar.szKey, pyBlob);
+    Py_DECREF(pyBlob);
+    if (ret < 0)
+      return NULL;
+  }
+
+  return Py_BuildValue("{s:s,s:l,s:l,s:l}", "checksum", GetMatchCheckSum(),
+                       "records", (long)aj.aar.size(), "reused", cReused,
+                       "analysed", (long)aj.aar.size() - cReused);
 }
 
 /*
- * Ported from gnubgmodule.c: PythonMatch
- * Exposed as: gnubg.match(analysis=..., boards=..., statistics=...,
- * verbose=...)
+ * Exposed as: gnubg.analyse_match(store=None, callback=None, quick=False)
+ * Analyse the current match with the session's analysis settings, as
+ * "analyse match" does, reusing the results kept in store. store maps
+ * record keys (str) to analysis blobs (bytes): a dict, or a dbm or shelve
+ * to keep them on disk. A record's key covers the settings, the match
+ * state before it and its own dice and move, so after an edit only the
+ * changed records and those after them in the same game are analysed
+ * again; comment edits reuse everything. Records analysed are added to
+ * store. Rollout analysis settings bypass the store. The store is trusted:
+ * blobs are only checked for size and record type, so keep it where only
+ * this program writes (see RestoreStoredAnalysis).
+ * Every record is analysed as a task of its own on the thread pool (a
+ * double together with its take or drop). callback(game, record,
+ * analysis) is called for each record in match order as soon as it and
+ * all before it are done, with analysis as in match(); it runs on a worker
+ * thread while the session is busy, so it must not call into gnubg. An
+ * exception from it stops the analysis and is raised. quick analyses
+ * chequer play and cube at 0 plies instead of the session's settings.
+ * Returns {"checksum": matchchecksum(), "records": n, "reused": n,
+ * "analysed": n}.
  */
-static PyObject *PythonMatch(PyObject *self, PyObject *args, PyObject *keywds) {
-  static const char *kwlist[] = {"analysis", "boards", "statistics", "verbose",
-                                 NULL};
-  int includeAnalysis = 1, verboseAnalysis = 0, statistics = 0, boards = 1;
-  const listOLD *firstGame =
-      lMatch.plNext ? (const listOLD *)lMatch.plNext->p : NULL;
-  PyObject *matchDict = NULL;
-  PyObject *matchInfoDict = NULL;
+static PyObject *PythonAnalyseMatch(PyObject *self, PyObject *args,
+                                    PyObject *keywds) {
+  SessionLock session;
+  if (!session.Held())
+    return NULL;
+  static const char *kwlist[] = {"store", "callback", "quick", NULL};
+  PyObject *pyStore = Py_None, *pyCallback = Py_None, *pyResult;
+  int fQuick = FALSE;
+  evalsetup esChequer, esCube;
 
   (void)self;
-  if (!firstGame || !firstGame->plNext) {
-    Py_INCREF(Py_None);
-    return Py_None;
+  if (!PyArg_ParseTupleAndKeywords(args, keywds, "|OOi:analyse_match",
+                                   (char **)kwlist, &pyStore, &pyCallback,
+                                   &fQuick))
+    return NULL;
+  if (pyStore != Py_None && !PyMapping_Check(pyStore)) {
+    PyErr_SetString(PyExc_TypeError, "store must be a mapping");
+    return NULL;
   }
-  const moverecord *pmr = (const moverecord *)firstGame->plNext->p;
-  const xmovegameinfo *g = &pmr->g;
-  if (g->i != 0) {
-    PyErr_SetString(PyExc_RuntimeError, "First game missing from match");
+  if (pyCallback != Py_None && !PyCallable_Check(pyCallback)) {
+    PyErr_SetString(PyExc_TypeError, "callback must be callable");
     return NULL;
   }
-  if (!PyArg_ParseTupleAndKeywords(args, keywds, "|iiii", (char **)kwlist,
-                                   &includeAnalysis, &boards, &statistics,
-                                   &verboseAnalysis))
+  if (lMatch.plNext == &lMatch) {
+    PyErr_SetString(PyExc_ValueError, "no match to analyse");
     return NULL;
+  }
 
-  matchDict = PyDict_New();
-  matchInfoDict = PyDict_New();
-  if (!matchDict || !matchInfoDict) {
-    Py_XDECREF(matchDict);
-    Py_XDECREF(matchInfoDict);
-    return NULL;
+  esChequer = esAnalysisChequer;
+  esCube = esAnalysisCube;
+  if (fQuick) {
+    esAnalysisChequer.et = esAnalysisCube.et = EVAL_EVAL;
+    esAnalysisChequer.ec.nPlies = esAnalysisCube.ec.nPlies = 0;
   }
-  for (int side = 0; side < 2; ++side) {
-    PyObject *d = PyDict_New();
-    if (!d) {
-      Py_DECREF(matchDict);
-      Py_DECREF(matchInfoDict);
-      return NULL;
+  SessionMatchChanged();
+  pyResult = AnalyseMatch(pyStore, pyCallback, 0);
+  esAnalysisChequer = esChequer;
+  esAnalysisCube = esCube;
+  return pyResult;
+}
+
+/* -------------------------------------------------------------------------
+ * Columnar export
+ * ------------------------------------------------------------------------- */
+
+/* What the board column of match_columns holds. */
+enum { COLUMN_BOARD_NONE, COLUMN_BOARD_ARRAY, COLUMN_BOARD_KEY };
+
+/*
+ * Move records of one or more matches as fixed-width columns, one row per
+ * record that has an action, in the order of match(). Analysis columns are
+ * NaN where nothing was analysed.
+ */
+typedef struct {
+  int fBoard; /* COLUMN_BOARD_* */
+  std::vector<gint32> aiMatch, aiGame, aiRecord;
+  std::vector<gint8> aiAction;   /* index into aszRecordAction */
+  std::vector<gint8> afPlayer;   /* 0 for X, 1 for O, -1 for none */
+  std::vector<guint8> anDice;    /* 2 per row, 0 for none */
+  std::vector<gint8> anMove;     /* 8 per row, (from, to) as in match() */
+  std::vector<guint8> anBoard;   /* 50 or 10 per row, by fBoard */
+  std::vector<gint32> anCube;
+  std::vector<gint8> afCubeOwner; /* 0, 1 or -1 for centered */
+  std::vector<gint8> aSkill;      /* skilltype; SKILL_NONE if unrated */
+  std::vector<float> arEquity, arBestEquity, arLuck;
+} matchcolumns;
+
+/*
+ * Equity of the cube action pmr took and of the best one, for the player
+ * taking it. pms is the match state before pmr.
+ */
+static void CubeActionEquities(const moverecord *pmr, const matchstate *pms,
+                               float *prEquity, float *prBest) {
+  float aarOutput[2][NUM_ROLLOUT_OUTPUTS];
+  float arDouble[4];
+  cubeinfo ci;
+
+  memcpy(aarOutput, pmr->CubeDecPtr->aarOutput, sizeof(aarOutput));
+  GetMatchStateCubeInfo(&ci, pms);
+  FindCubeDecision(arDouble, aarOutput, &ci);
+  if (pmr->mt == MOVE_DOUBLE) {
+    *prEquity = MIN(arDouble[OUTPUT_TAKE], arDouble[OUTPUT_DROP]);
+    *prBest = arDouble[OUTPUT_OPTIMAL];
+  } else {
+    /* The analysis is from the doubler's side. */
+    *prEquity = -arDouble[pmr->mt == MOVE_TAKE ? OUTPUT_TAKE : OUTPUT_DROP];
+    *prBest = -MIN(arDouble[OUTPUT_TAKE], arDouble[OUTPUT_DROP]);
+  }
+}
+
+/* Append a row for pmr; pms is the match state before it. */
+static void AddRecordRow(matchcolumns *pmc, gint32 iMatch, gint32 iGame,
+                         gint32 iRecord, const moverecord *pmr,
+                         const matchstate *pms) {
+  float rEquity = NAN, rBest = NAN, rLuck = NAN;
+  skilltype st = SKILL_NONE;
+  int anMove[8];
+  unsigned int anDice[2] = {0, 0};
+
+  for (int i = 0; i < 8; ++i)
+    anMove[i] = -1;
+  switch (pmr->mt) {
+  case MOVE_NORMAL:
+    for (int i = 0; i < 4 && pmr->n.anMove[2 * i] >= 0; ++i) {
+      anMove[2 * i] = pmr->n.anMove[2 * i] + 1;
+      anMove[2 * i + 1] = pmr->n.anMove[2 * i + 1] + 1;
     }
-    addProperty(d, "rating", mi.pchRating[side]);
-    addProperty(d, "name", ap[side].szName);
-    DictSetItemSteal(matchInfoDict, side == 0 ? "X" : "O", d);
+    if (pmr->n.iMove < pmr->ml.cMoves) {
+      rEquity = pmr->ml.amMoves[pmr->n.iMove].rScore;
+      rBest = pmr->ml.amMoves[0].rScore;
+    }
+    if (pmr->rLuck != ERR_VAL)
+      rLuck = pmr->rLuck;
+    st = pmr->n.stMove;
+    /* fall through */
+  case MOVE_SETDICE:
+    anDice[0] = pmr->anDice[0];
+    anDice[1] = pmr->anDice[1];
+    break;
+  case MOVE_DOUBLE:
+  case MOVE_TAKE:
+  case MOVE_DROP:
+    if (pmr->CubeDecPtr && pmr->CubeDecPtr->esDouble.et != EVAL_NONE)
+      CubeActionEquities(pmr, pms, &rEquity, &rBest);
+    st = pmr->stCube;
+    break;
+  default:
+    break;
   }
-  DictSetItemSteal(matchInfoDict, "match-length", PyLong_FromLong(g->nMatch));
-  if (mi.nYear) {
-    PyObject *date = Py_BuildValue("(iii)", mi.nDay, mi.nMonth, mi.nYear);
-    DictSetItemSteal(matchInfoDict, "date", date);
+
+  pmc->aiMatch.push_back(iMatch);
+  pmc->aiGame.push_back(iGame);
+  pmc->aiRecord.push_back(iRecord);
+  pmc->aiAction.push_back((gint8)RecordAction(pmr->mt));
+  pmc->afPlayer.push_back(
+      (gint8)(pmr->mt == MOVE_SETBOARD || pmr->mt == MOVE_SETCUBEVAL ||
+                      pmr->mt == MOVE_SETCUBEPOS
+                  ? -1
+                  : pmr->fPlayer));
+  pmc->anDice.push_back((guint8)anDice[0]);
+  pmc->anDice.push_back((guint8)anDice[1]);
+  for (int i = 0; i < 8; ++i)
+    pmc->anMove.push_back((gint8)anMove[i]);
+  if (pmc->fBoard == COLUMN_BOARD_ARRAY) {
+    for (int i = 0; i < 2; ++i)
+      for (int j = 0; j < 25; ++j)
+        pmc->anBoard.push_back((guint8)pms->anBoard[i][j]);
+  } else if (pmc->fBoard == COLUMN_BOARD_KEY) {
+    oldpositionkey key;
+    oldPositionKey((ConstTanBoard)pms->anBoard, &key);
+    pmc->anBoard.insert(pmc->anBoard.end(), key.auch, key.auch + 10);
   }
-  addProperty(matchInfoDict, "event", mi.pchEvent);
-  addProperty(matchInfoDict, "round", mi.pchRound);
-  addProperty(matchInfoDict, "place", mi.pchPlace);
-  addProperty(matchInfoDict, "annotator", mi.pchAnnotator);
-  addProperty(matchInfoDict, "comment", mi.pchComment);
-  int result = 0;
-  int anFinalScore[2];
-  if (getFinalScore(anFinalScore)) {
-    if (anFinalScore[0] > (int)g->nMatch)
-      result = -1;
-    else if (anFinalScore[1] > (int)g->nMatch)
-      result = 1;
+  pmc->anCube.push_back(pms->nCube);
+  pmc->afCubeOwner.push_back((gint8)pms->fCubeOwner);
+  pmc->aSkill.push_back((gint8)st);
+  pmc->arEquity.push_back(rEquity);
+  pmc->arBestEquity.push_back(rBest);
+  pmc->arLuck.push_back(rLuck);
+}
+
+/* Append the rows of the current match, replaying it for the board and
+ * cube before each record. The caller holds a SessionLock. */
+static void AddMatchColumns(matchcolumns *pmc, gint32 iMatch) {
+  gint32 iGame = 0;
+
+  for (const listOLD *plg = lMatch.plNext; plg != &lMatch;
+       plg = plg->plNext, ++iGame) {
+    const listOLD *plGame = (const listOLD *)plg->p;
+    const listOLD *pl = plGame->plNext;
+    matchstate msRecord;
+    gint32 iRecord = 0;
+
+    if (pl == plGame)
+      continue;
+    memset(&msRecord, 0, sizeof(msRecord));
+    ApplyMoveRecord(&msRecord, plGame, (const moverecord *)pl->p);
+    for (pl = pl->plNext; pl != plGame; pl = pl->plNext, ++iRecord) {
+      const moverecord *pmr = (const moverecord *)pl->p;
+
+      FixMatchState(&msRecord, pmr);
+      if (RecordAction(pmr->mt) >= 0)
+        AddRecordRow(pmc, iMatch, iGame, iRecord, pmr, &msRecord);
+      ApplyMoveRecord(&msRecord, plGame, pmr);
+    }
   }
-  DictSetItemSteal(matchInfoDict, "result", PyLong_FromLong(result));
-  {
-    const char *v[] = {"Standard", "Nackgammon", "Hypergammon1", "Hypergammon2",
-                       "Hypergammon3"};
-    addProperty(matchInfoDict, "variation", v[g->bgv]);
+}
+
+/*
+ * Fill *pmc from the current match or, given pyPaths, from each file
+ * imported in a session of its own (the match column is its index).
+ * Returns 0, or -1 with an exception set.
+ */
+static int CollectMatchColumns(matchcolumns *pmc, PyObject *pyPaths) {
+  if (pyPaths == Py_None) {
+    SessionLock session;
+    if (!session.Held())
+      return -1;
+    AddMatchColumns(pmc, 0);
+    return 0;
   }
-  {
-    unsigned int n = !g->fCubeUse + !!g->fCrawford + !!g->fJacoby;
-    if (n) {
-      PyObject *rules = PyTuple_New(n);
-      if (rules) {
-        unsigned int idx = 0;
-        if (!g->fCubeUse)
-          PyTuple_SET_ITEM(rules, idx++, PyUnicode_FromString("NoCube"));
-        if (g->fCrawford)
-          PyTuple_SET_ITEM(rules, idx++, PyUnicode_FromString("Crawford"));
-        if (g->fJacoby)
-          PyTuple_SET_ITEM(rules, idx, PyUnicode_FromString("Jacoby"));
-        DictSetItemSteal(matchInfoDict, "rules", rules);
-      }
+
+  PyObject *pyList = PyToPaths(pyPaths);
+  if (!pyList)
+    return -1;
+  for (Py_ssize_t i = 0; i < PyList_GET_SIZE(pyList); ++i) {
+    PyObject *pyEngine = PyObject_CallObject((PyObject *)&EngineType, NULL);
+    int n;
+
+    if (!pyEngine) {
+      Py_DECREF(pyList);
+      return -1;
+    }
+    apengActive.push_back((EngineObject *)pyEngine);
+    {
+      SessionLock session;
+      n = session.Held()
+              ? ImportFile(PyUnicode_AsUTF8(PyList_GET_ITEM(pyList, i)))
+              : -1;
+      if (n == 0)
+        AddMatchColumns(pmc, (gint32)i);
+    }
+    apengActive.pop_back();
+    Py_DECREF(pyEngine);
+    if (n != 0) {
+      Py_DECREF(pyList);
+      return -1;
     }
   }
-  DictSetItemSteal(matchDict, "match-info", matchInfoDict);
+  Py_DECREF(pyList);
+  return 0;
+}
 
-  statcontext scm;
-  if (statistics)
-    IniStatcontext(&scm);
-  Py_ssize_t nGames = 0;
-  for (const listOLD *pl = lMatch.plNext; pl != &lMatch; pl = pl->plNext)
-    ++nGames;
-  PyObject *matchTuple = PyTuple_New(nGames);
-  if (!matchTuple) {
-    Py_DECREF(matchDict);
+/* One column of a matchcolumns, described for export. */
+typedef struct {
+  const char *szName;
+  const char *szFormat;    /* struct module format of a value */
+  const char *szArrowType; /* pyarrow type factory; NULL for binary */
+  Py_ssize_t cWidth;       /* values (or bytes, for binary) per row */
+  Py_ssize_t cb;
+  const void *pv;
+} columnview;
+
+template <typename T>
+static columnview MakeColumnView(const char *szName, const char *szFormat,
+                                 const char *szArrowType, Py_ssize_t cWidth,
+                                 const std::vector<T> &av) {
+  columnview cv = {szName,          szFormat,
+                   szArrowType,     cWidth,
+                   (Py_ssize_t)(av.size() * sizeof(T)), av.data()};
+  return cv;
+}
+
+static std::vector<columnview> MatchColumnViews(const matchcolumns *pmc) {
+  std::vector<columnview> acv = {
+      MakeColumnView("match", "i", "int32", 1, pmc->aiMatch),
+      MakeColumnView("game", "i", "int32", 1, pmc->aiGame),
+      MakeColumnView("record", "i", "int32", 1, pmc->aiRecord),
+      MakeColumnView("action", "b", "int8", 1, pmc->aiAction),
+      MakeColumnView("player", "b", "int8", 1, pmc->afPlayer),
+      MakeColumnView("dice", "B", "uint8", 2, pmc->anDice),
+      MakeColumnView("move", "b", "int8", 8, pmc->anMove),
+      MakeColumnView("cube", "i", "int32", 1, pmc->anCube),
+      MakeColumnView("cube_owner", "b", "int8", 1, pmc->afCubeOwner),
+      MakeColumnView("skill", "b", "int8", 1, pmc->aSkill),
+      MakeColumnView("equity", "f", "float32", 1, pmc->arEquity),
+      MakeColumnView("best_equity", "f", "float32", 1, pmc->arBestEquity),
+      MakeColumnView("luck", "f", "float32", 1, pmc->arLuck)};
+
+  if (pmc->fBoard == COLUMN_BOARD_ARRAY)
+    acv.push_back(MakeColumnView("board", "B", "uint8", 50, pmc->anBoard));
+  else if (pmc->fBoard == COLUMN_BOARD_KEY)
+    acv.push_back(MakeColumnView("board", "B", NULL, 10, pmc->anBoard));
+  return acv;
+}
+
+/* Parse boards=: None or False, "array" or "key". */
+static int PyToColumnBoard(PyObject *p, int *pfBoard) {
+  const char *sz = p && PyUnicode_Check(p) ? PyUnicode_AsUTF8(p) : NULL;
+
+  if (!p || p == Py_None || p == Py_False)
+    *pfBoard = COLUMN_BOARD_NONE;
+  else if (sz && !strcmp(sz, "array"))
+    *pfBoard = COLUMN_BOARD_ARRAY;
+  else if (sz && !strcmp(sz, "key"))
+    *pfBoard = COLUMN_BOARD_KEY;
+  else {
+    PyErr_SetString(PyExc_ValueError, "boards must be None, 'array' or 'key'");
+    return -1;
+  }
+  return 0;
+}
+
+/*
+ * Exposed as: gnubg.match_columns(boards=None, paths=None)
+ * The move records of the current match, or of the match files in paths,
+ * as {name: memoryview}: one row per record, cast to the column's type
+ * and, for columns of several values per row, shaped (rows, width).
+ */
+static PyObject *PythonMatchColumns(PyObject *self, PyObject *args,
+                                    PyObject *keywds) {
+  static const char *kwlist[] = {"boards", "paths", NULL};
+  PyObject *pyBoards = Py_None, *pyPaths = Py_None, *pyColumns;
+  matchcolumns mc;
+
+  (void)self;
+  if (!PyArg_ParseTupleAndKeywords(args, keywds, "|OO:match_columns",
+                                   (char **)kwlist, &pyBoards, &pyPaths) ||
+      PyToColumnBoard(pyBoards, &mc.fBoard) != 0 ||
+      CollectMatchColumns(&mc, pyPaths) != 0 || !(pyColumns = PyDict_New()))
     return NULL;
+
+  Py_ssize_t cRows = (Py_ssize_t)mc.aiGame.size();
+  for (const columnview &cv : MatchColumnViews(&mc)) {
+    PyObject *pyBytes =
+        PyBytes_FromStringAndSize((const char *)cv.pv, cv.cb);
+    PyObject *pyView = pyBytes ? PyMemoryView_FromObject(pyBytes) : NULL;
+    PyObject *pyCast = NULL;
+
+    Py_XDECREF(pyBytes);
+    if (pyView)
+      pyCast = cv.cWidth == 1 || !cRows
+                   ? PyObject_CallMethod(pyView, "cast", "s", cv.szFormat)
+                   : PyObject_CallMethod(pyView, "cast", "s(nn)",
+                                         cv.szFormat, cRows, cv.cWidth);
+    Py_XDECREF(pyView);
+    if (!pyCast) {
+      Py_DECREF(pyColumns);
+      return NULL;
+    }
+    DictSetItemSteal(pyColumns, cv.szName, pyCast);
   }
-  nGames = 0;
-  for (const listOLD *pl = lMatch.plNext; pl != &lMatch; pl = pl->plNext) {
-    PyObject *pg =
-        PythonGame((const listOLD *)pl->p, includeAnalysis, verboseAnalysis,
-                   statistics ? &scm : NULL, boards, NULL);
-    if (!pg) {
-      Py_DECREF(matchTuple);
-      Py_DECREF(matchDict);
+  return pyColumns;
+}
+
+/* pa.<szClass>.<szMethod>(*pyArgs); steals pyArgs, which may be NULL. */
+static PyObject *ArrowClassCall(PyObject *pa, const char *szClass,
+                                const char *szMethod, PyObject *pyArgs) {
+  PyObject *pyClass = pyArgs ? PyObject_GetAttrString(pa, szClass) : NULL;
+  PyObject *pyMethod =
+      pyClass ? PyObject_GetAttrString(pyClass, szMethod) : NULL;
+  PyObject *pyResult = pyMethod ? PyObject_CallObject(pyMethod, pyArgs) : NULL;
+
+  Py_XDECREF(pyMethod);
+  Py_XDECREF(pyClass);
+  Py_XDECREF(pyArgs);
+  return pyResult;
+}
+
+/* The pyarrow array of one column, wrapping a copy of its values; the
+ * action column is dictionary encoded with the action names. */
+static PyObject *ColumnToArrow(PyObject *pa, const columnview *pcv,
+                               Py_ssize_t cRows) {
+  PyObject *pyBytes =
+      PyBytes_FromStringAndSize((const char *)pcv->pv, pcv->cb);
+  PyObject *pyBuffer =
+      pyBytes ? PyObject_CallMethod(pa, "py_buffer", "O", pyBytes) : NULL;
+  PyObject *pyType = NULL, *pyArray = NULL;
+
+  Py_XDECREF(pyBytes);
+  if (!pyBuffer)
+    return NULL;
+  if (pcv->szArrowType)
+    pyType = PyObject_CallMethod(pa, pcv->szArrowType, NULL);
+  else
+    pyType = PyObject_CallMethod(pa, "binary", "n", pcv->cWidth);
+  if (pyType)
+    pyArray = ArrowClassCall(
+        pa, "Array", "from_buffers",
+        Py_BuildValue("On[OO]", pyType,
+                      pcv->szArrowType ? cRows * pcv->cWidth : cRows, Py_None,
+                      pyBuffer));
+  Py_XDECREF(pyType);
+  Py_DECREF(pyBuffer);
+
+  if (pyArray && pcv->szArrowType && pcv->cWidth > 1)
+    pyArray = ArrowClassCall(pa, "FixedSizeListArray", "from_arrays",
+                             Py_BuildValue("Nn", pyArray, pcv->cWidth));
+  else if (pyArray && !strcmp(pcv->szName, "action")) {
+    PyObject *pyNames = PyObject_CallMethod(
+        pa, "array", "([ssssss])", aszRecordAction[0], aszRecordAction[1],
+        aszRecordAction[2], aszRecordAction[3], aszRecordAction[4],
+        aszRecordAction[5]);
+    if (!pyNames) {
+      Py_DECREF(pyArray);
       return NULL;
     }
-    PyTuple_SET_ITEM(matchTuple, nGames++, pg);
+    pyArray = ArrowClassCall(pa, "DictionaryArray", "from_arrays",
+                             Py_BuildValue("NN", pyArray, pyNames));
   }
-  DictSetItemSteal(matchDict, "games", matchTuple);
-  /* statistics/stats: PyGameStats lives in original gnubgmodule.c; omit for
-   * library build */
-  (void)statistics;
-  (void)scm;
-  return matchDict;
+  return pyArray;
+}
+
+/*
+ * Write batch as an Arrow IPC stream to pySink, or to memory if it is
+ * None. Returns the stream as bytes, None, or NULL with an exception set.
+ */
+static PyObject *WriteArrowStream(PyObject *pa, PyObject *pyBatch,
+                                  PyObject *pySink) {
+  PyObject *pyStream = pySink != Py_None
+                           ? (Py_INCREF(pySink), pySink)
+                           : PyObject_CallMethod(pa, "BufferOutputStream",
+                                                 NULL);
+  PyObject *pyIpc = PyObject_GetAttrString(pa, "ipc");
+  PyObject *pySchema = PyObject_GetAttrString(pyBatch, "schema");
+  PyObject *pyWriter = pyStream && pyIpc && pySchema
+                           ? PyObject_CallMethod(pyIpc, "new_stream", "OO",
+                                                 pyStream, pySchema)
+                           : NULL;
+  PyObject *pyResult = NULL;
+
+  Py_XDECREF(pyIpc);
+  Py_XDECREF(pySchema);
+  if (pyWriter) {
+    PyObject *pyWritten =
+        PyObject_CallMethod(pyWriter, "write_batch", "O", pyBatch);
+    PyObject *pyClosed = PyObject_CallMethod(pyWriter, "close", NULL);
+
+    if (pyWritten && pyClosed) {
+      if (pySink != Py_None) {
+        Py_INCREF(Py_None);
+        pyResult = Py_None;
+      } else {
+        PyObject *pyValue = PyObject_CallMethod(pyStream, "getvalue", NULL);
+        if (pyValue) {
+          pyResult = PyObject_CallMethod(pyValue, "to_pybytes", NULL);
+          Py_DECREF(pyValue);
+        }
+      }
+    }
+    Py_XDECREF(pyWritten);
+    Py_XDECREF(pyClosed);
+    Py_DECREF(pyWriter);
+  }
+  Py_XDECREF(pyStream);
+  return pyResult;
+}
+
+/*
+ * Exposed as: gnubg.export_arrow(sink=None, boards=None, paths=None)
+ * The columns of match_columns() as one record batch of an Arrow IPC
+ * stream, written to sink (a path or a writable file) or returned as
+ * bytes. Columns of several values per row become fixed-size lists (the
+ * key board column fixed_size_binary(10)); action is dictionary encoded.
+ * Needs pyarrow.
+ */
+static PyObject *PythonExportArrow(PyObject *self, PyObject *args,
+                                   PyObject *keywds) {
+  static const char *kwlist[] = {"sink", "boards", "paths", NULL};
+  PyObject *pySink = Py_None, *pyBoards = Py_None, *pyPaths = Py_None;
+  PyObject *pa, *pyArrays, *pyNames, *pyBatch, *pyResult;
+  matchcolumns mc;
+
+  (void)self;
+  if (!PyArg_ParseTupleAndKeywords(args, keywds, "|OOO:export_arrow",
+                                   (char **)kwlist, &pySink, &pyBoards,
+                                   &pyPaths) ||
+      PyToColumnBoard(pyBoards, &mc.fBoard) != 0)
+    return NULL;
+  if (!(pa = PyImport_ImportModule("pyarrow"))) {
+    if (PyErr_ExceptionMatches(PyExc_ImportError)) {
+      PyErr_Clear();
+      PyErr_SetString(PyExc_ImportError, "export_arrow needs pyarrow");
+    }
+    return NULL;
+  }
+  if (CollectMatchColumns(&mc, pyPaths) != 0) {
+    Py_DECREF(pa);
+    return NULL;
+  }
+
+  Py_ssize_t cRows = (Py_ssize_t)mc.aiGame.size();
+  pyArrays = PyList_New(0);
+  pyNames = PyList_New(0);
+  for (const columnview &cv : MatchColumnViews(&mc)) {
+    PyObject *pyArray =
+        pyArrays && pyNames ? ColumnToArrow(pa, &cv, cRows) : NULL;
+    PyObject *pyName = pyArray ? PyUnicode_FromString(cv.szName) : NULL;
+    int fOK = pyName && PyList_Append(pyArrays, pyArray) == 0 &&
+              PyList_Append(pyNames, pyName) == 0;
+
+    Py_XDECREF(pyArray);
+    Py_XDECREF(pyName);
+    if (!fOK)
+      break;
+  }
+  pyBatch = PyErr_Occurred() || !pyArrays || !pyNames
+                ? NULL
+                : ArrowClassCall(pa, "RecordBatch", "from_arrays",
+                                 Py_BuildValue("OO", pyArrays, pyNames));
+  Py_XDECREF(pyArrays);
+  Py_XDECREF(pyNames);
+  pyResult = pyBatch ? WriteArrowStream(pa, pyBatch, pySink) : NULL;
+  Py_XDECREF(pyBatch);
+  Py_DECREF(pa);
+  return pyResult;
 }
 
 /*
@@ -2232,6 +7891,9 @@ static PyObject *PythonMatch(PyObject *self, PyObject *args, PyObject *keywds) {
  * Exposed as: gnubg.getevalhintfilter()
  */
 static PyObject *PythonGetEvalHintFilter(PyObject *self, PyObject *args) {
+  SessionLock session;
+  if (!session.Held())
+    return NULL;
   if (!PyArg_ParseTuple(args, ":getevalhintfilter"))
     return NULL;
   return MoveFiltersToPy(*GetEvalMoveFilter());
@@ -2242,6 +7904,9 @@ static PyObject *PythonGetEvalHintFilter(PyObject *self, PyObject *args) {
  * Exposed as: gnubg.setevalhintfilter(list_of_movefilters)
  */
 static PyObject *PythonSetEvalHintFilter(PyObject *self, PyObject *args) {
+  SessionLock session;
+  if (!session.Held())
+    return NULL;
   PyObject *pyMoveFilters = NULL;
   TmoveFilter *aamf = GetEvalMoveFilter();
   if (!PyArg_ParseTuple(args, "|O:setevalhintfilter", &pyMoveFilters))
@@ -2263,10 +7928,14 @@ static PyObject *PythonSetEvalHintFilter(PyObject *self, PyObject *args) {
  * Exposed as: gnubg.command(cmd_string)
  */
 static PyObject *PythonCommand(PyObject *self, PyObject *args) {
+  SessionLock session;
+  if (!session.Held())
+    return NULL;
   const char *pch = NULL;
   char *sz = NULL;
   psighandler sh;
   int suppress_output = 0;
+  int nCancel;
   if (!PyArg_ParseTuple(args, "s:command", &pch))
     return NULL;
   sz = g_strdup(pch);
@@ -2278,10 +7947,13 @@ static PyObject *PythonCommand(PyObject *self, PyObject *args) {
   }
   if (suppress_output)
     outputoff();
-  PortableSignal(SIGINT, HandleInterrupt, &sh, FALSE);
+  SessionMatchChanged();
+  PortableSignal(SIGINT, HandleCommandInterrupt, &sh, FALSE);
+  InterruptWatch iw;
   HandleCommand(sz, acTop);
   while (fNextTurn)
     NextTurn(TRUE);
+  nCancel = iw.Finish();
   outputx();
   if (suppress_output)
     outputon();
@@ -2290,6 +7962,10 @@ static PyObject *PythonCommand(PyObject *self, PyObject *args) {
   if (MT_SafeGet(&fInterrupt)) {
     MT_SafeSet(&fInterrupt, FALSE);
   }
+  if (nCancel) {
+    SetCancelError(nCancel);
+    return NULL;
+  }
   Py_INCREF(Py_None);
   return Py_None;
 }
@@ -2299,6 +7975,9 @@ static PyObject *PythonCommand(PyObject *self, PyObject *args) {
  * Exposed as: gnubg.show(arguments_string)
  */
 static PyObject *PythonShow(PyObject *self, PyObject *args) {
+  SessionLock session;
+  if (!session.Held())
+    return NULL;
   const char *pch = NULL;
   char *sz = NULL;
   PyObject *p = NULL;
@@ -2327,8 +8006,12 @@ static PyObject *PythonShow(PyObject *self, PyObject *args) {
  * Exposed as: gnubg.nextturn()
  */
 static PyObject *PythonNextTurn(PyObject *self, PyObject *args) {
+  SessionLock session;
+  if (!session.Held())
+    return NULL;
   if (!PyArg_ParseTuple(args, ":nextturn"))
     return NULL;
+  SessionMatchChanged();
   fNextTurn = TRUE;
   while (fNextTurn) {
     if (NextTurn(TRUE) == -1)
@@ -2342,11 +8025,15 @@ static PyObject *PythonNextTurn(PyObject *self, PyObject *args) {
  * Exposed as: gnubg.setgnubgid(gnubgid_or_xgid_string)
  */
 static PyObject *PythonSetGNUbgID(PyObject *self, PyObject *args) {
+  SessionLock session;
+  if (!session.Held())
+    return NULL;
   const char *pch = NULL;
   char *sz = NULL;
   if (!PyArg_ParseTuple(args, "s:setgnubgid", &pch))
     return NULL;
   sz = g_strdup(pch);
+  SessionMatchChanged();
   SetGNUbgID(sz);
   g_free(sz);
   Py_RETURN_NONE;
@@ -2413,6 +8100,103 @@ static PyMethodDef GnubgMethods[] = {
      "...)\n"
      "    returns: rolloutcontext dictionary"},
 
+    {"rollout", (PyCFunction)(PyCFunctionWithKeywords)PythonRollout,
+     METH_VARARGS | METH_KEYWORDS,
+     "Roll out a position or the candidate moves in it\n"
+     "    arguments: board, [cubeinfo], [rolloutcontext], [moves], "
+     "[progress],\n"
+     "        [deterministic], [checkpoint file]\n"
+     "    returns: dict with probs, std, stats and trials; with moves a list\n"
+     "        of such dicts (plus move, movestr) in the order given\n"
+     "    by default the result can vary from run to run with more than one\n"
+     "        thread, even with the same seed\n"
+     "    deterministic=True uses the trial engine of rolloutshard instead:\n"
+     "        the result is the same for any number of threads, checkpoint\n"
+     "        saves it after each round and resumes from it, progress only\n"
+     "        gets trials and total once per round, and results also carry\n"
+     "        job (and jsd with moves)"},
+
+    {"rolloutshard", (PyCFunction)(PyCFunctionWithKeywords)PythonRolloutShard,
+     METH_VARARGS | METH_KEYWORDS,
+     "Play a range of rollout trials and return their partial sums\n"
+     "    arguments: board, [cubeinfo], [rolloutcontext], [moves], [first],\n"
+     "        [last], [checkpoint file], [interval]\n"
+     "    returns: shard (bytes) for rolloutmerge and rolloutresult\n"
+     "    trials play the cube when rolloutcontext is cubeful; their dice are\n"
+     "        not rollout's, so merged shards match each other, not rollout"},
+
+    {"rolloutmerge", PythonRolloutMerge, METH_VARARGS,
+     "Combine rollout shards of one rollout\n"
+     "    arguments: sequence of shards\n"
+     "    returns: merged shard (bytes)"},
+
+    {"rolloutresult", PythonRolloutResult, METH_VARARGS,
+     "Rollout result of a shard\n"
+     "    arguments: shard\n"
+     "    returns: dict as from rollout, or a list of them for moves"},
+
+    {"rollout_iter", (PyCFunction)(PyCFunctionWithKeywords)PythonRolloutIter,
+     METH_VARARGS | METH_KEYWORDS,
+     "Roll out step by step on the trial engine of rolloutshard\n"
+     "    arguments: board, [cubeinfo], [rolloutcontext], [moves], [every]\n"
+     "    returns: iterator of snapshots {trials, total, result}; close()\n"
+     "        stops it and shard() returns the trials so far"},
+
+    {"rolloutmoves", (PyCFunction)(PyCFunctionWithKeywords)PythonRolloutMoves,
+     METH_VARARGS | METH_KEYWORDS,
+     "Roll out candidate moves on shared dice, dropping decided ones\n"
+     "    if the rollout context stops on jsd (on cubeful equity if cubeful)\n"
+     "    after each round of `every` trials; idle threads start on the next\n"
+     "    round, least decided candidates first\n"
+     "    arguments: board, moves, [cubeinfo], [rolloutcontext], [every]\n"
+     "    returns: list of dicts (probs, std, stats, trials, move, movestr,\n"
+     "        jsd, dropped) in the order of the moves"},
+
+    {"set_threads", (PyCFunction)(PyCFunctionWithKeywords)PythonSetThreads,
+     METH_VARARGS | METH_KEYWORDS,
+     "Resize the engine thread pool\n"
+     "    arguments: number of threads, [cpus to pin the workers to]\n"
+     "    returns: None"},
+
+    {"get_threads", PythonGetThreads, METH_NOARGS,
+     "Number of engine threads\n"
+     "    arguments: none\n"
+     "    returns: int"},
+
+    {"analyse_files",
+     (PyCFunction)(PyCFunctionWithKeywords)PythonAnalyseFiles,
+     METH_VARARGS | METH_KEYWORDS,
+     "Import and analyse match files, each in a session of its own\n"
+     "    arguments: paths, [analysis_settings dict: chequer, cube,\n"
+     "        movefilters], [threads]\n"
+     "    returns: iterator of {path, match} or {path, error}, one per file\n"
+     "    files are analysed one after another (sequentially), each on at\n"
+     "    most threads workers of the pool (0: all); the pool is not resized"},
+
+    {"export_files", (PyCFunction)(PyCFunctionWithKeywords)PythonExportFiles,
+     METH_VARARGS | METH_KEYWORDS,
+     "Import match files and export each, in a session of its own, to folder\n"
+     "    arguments: paths, folder, [format: html, latex or text],\n"
+     "        [picture_url shared by the HTML pages]\n"
+     "    returns: iterator of {path, output} or {path, error}, one per file"},
+
+    {"analyse_match", (PyCFunction)(PyCFunctionWithKeywords)PythonAnalyseMatch,
+     METH_VARARGS | METH_KEYWORDS,
+     "Analyse the current match in parallel, reusing results kept in a store\n"
+     "    arguments: [store mapping of str keys to bytes, e.g. dict or dbm],\n"
+     "        [callback(game, record, analysis) in match order; it may not\n"
+     "        call gnubg functions that use the session or thread pool],\n"
+     "        [quick]\n"
+     "    returns: {checksum, records, reused, analysed}\n"
+     "    the store is trusted: its blobs are used as stored, unverified"},
+
+    {"taskstats", (PyCFunction)(PyCFunctionWithKeywords)PythonTaskStats,
+     METH_VARARGS | METH_KEYWORDS,
+     "Engine task scheduler counters\n"
+     "    arguments: [reset]\n"
+     "    returns: dict (batches, tasks, steals, steal_rate, queue_wait,\n"
+     "        queue_wait_max); queue times in seconds"},
+
     {"classify", PythonClassifyPosition, METH_VARARGS,
      "Classify position type\n"
      "    arguments: [board, variant]\n"
@@ -2449,6 +8233,50 @@ static PyMethodDef GnubgMethods[] = {
      "    arguments: same as findbestmove\n"
      "    returns: list of dicts {\"move\": (from,to,...), \"score\": float}"},
 
+    {"cubedecision", PythonCubeDecision, METH_VARARGS,
+     "Cube decision for the player on roll\n"
+     "    arguments: [board], [cubeinfo], [evalcontext] (all optional)\n"
+     "    returns: dict with nodouble, take, pass and optimal equities,\n"
+     "        decision, recommendation, double and takes"},
+
+    {"cubedecisions", PythonCubeDecisions, METH_VARARGS,
+     "Cube decisions for many positions on the thread pool\n"
+     "    arguments: sequence of (board, cubeinfo) pairs, [evalcontext]\n"
+     "    returns: list of dicts, as for cubedecision"},
+
+    {"hintmoves", PythonHintMoves, METH_VARARGS,
+     "Chequer play hint for a position, independent of the current match\n"
+     "    arguments: board, dice, [cubeinfo], [evalcontext], [movefilters],\n"
+     "        [maxmoves], [k] (k > 0: approximate top-k search, which drops\n"
+     "        moves more than the filter threshold behind the k-th best and\n"
+     "        may then differ from the full search)\n"
+     "    evalcontext and movefilters default to the session's, which waits\n"
+     "        for the session lock; pass both to run beside stateful calls\n"
+     "    returns: list of dicts (move, movestr, equity, eqdiff, probs, plies)\n"
+     "        best first"},
+
+    {"arenastats", PythonArenaStats, METH_VARARGS,
+     "Per-thread search arena statistics\n"
+     "    arguments: none\n"
+     "    returns: dict with arenas, chunks, reserved (bytes), peak (bytes),\n"
+     "        allocations, allocated (bytes), resets, chunkallocations"},
+
+    {"setcachesize", PythonSetCacheSize, METH_VARARGS,
+     "Set the capacity of the move list and evaluation result caches\n"
+     "    arguments: number of entries per cache (0 disables caching)\n"
+     "    returns: None"},
+
+    {"cachestats", PythonCacheStats, METH_NOARGS,
+     "Result cache statistics\n"
+     "    arguments: none\n"
+     "    returns: dict with moves and evaluations, each a dict of size,\n"
+     "        capacity, hits, misses and evictions"},
+
+    {"clearcache", PythonClearCache, METH_NOARGS,
+     "Empty the result caches\n"
+     "    arguments: none\n"
+     "    returns: None"},
+
     {"met", PythonMET, METH_VARARGS,
      "Return match equity table\n"
      "    arguments: [max score] (optional)\n"
@@ -2538,9 +8366,10 @@ static PyMethodDef GnubgMethods[] = {
      "    returns: None"},
 
     {"hint", PythonHint, METH_VARARGS,
-     "Get hint for current position (chequer play)\n"
+     "Get hint for current position (chequer play, double or take)\n"
      "    arguments: [maxmoves] (optional)\n"
-     "    returns: dict with hinttype, gnubgid, hint (list of move analyses)"},
+     "    returns: dict with hinttype, gnubgid, hint (list of move analyses,\n"
+     "        or a cubedecision dict for cube and take hints)"},
 
     {"navigate", (PyCFunction)(PyCFunctionWithKeywords)PythonNavigate,
      METH_VARARGS | METH_KEYWORDS,
@@ -2551,8 +8380,31 @@ static PyMethodDef GnubgMethods[] = {
     {"match", (PyCFunction)(PyCFunctionWithKeywords)PythonMatch,
      METH_VARARGS | METH_KEYWORDS,
      "Get current match\n"
-     "    arguments: analysis=, boards=, statistics=, verbose= (optional)\n"
+     "    arguments: analysis=, boards= (flag, 'key' or 'packed'),\n"
+     "        statistics=, verbose= (optional)\n"
      "    returns: dict with match-info and games"},
+    {"iter_records", (PyCFunction)(PyCFunctionWithKeywords)PythonIterRecords,
+     METH_VARARGS | METH_KEYWORDS,
+     "Iterate over the move records of the current match\n"
+     "    arguments: boards=False\n"
+     "    returns: iterator of gnubg.Record"},
+    {"match_columns",
+     (PyCFunction)(PyCFunctionWithKeywords)PythonMatchColumns,
+     METH_VARARGS | METH_KEYWORDS,
+     "Move records of the current match, or of match files, as columns\n"
+     "    arguments: boards=None ('array' or 'key'), paths=None\n"
+     "    returns: dict of column name to memoryview"},
+    {"export_arrow", (PyCFunction)(PyCFunctionWithKeywords)PythonExportArrow,
+     METH_VARARGS | METH_KEYWORDS,
+     "Export the columns of match_columns as an Arrow IPC stream\n"
+     "    arguments: sink=None, boards=None, paths=None\n"
+     "    returns: bytes if sink is None, else None (needs pyarrow)"},
+    {"import_bytes", (PyCFunction)(PyCFunctionWithKeywords)PythonImportBytes,
+     METH_VARARGS | METH_KEYWORDS,
+     "Replace the current match with one read from memory\n"
+     "    arguments: data (bytes-like), format='mat' (sgf, mat, oldmoves,\n"
+     "               sgg, tmg, gam or bkg)\n"
+     "    returns: None"},
 
     {"updateui", PythonUpdateUI, METH_VARARGS,
      "No-op in library build (no GUI). Kept for API compatibility."},
@@ -2705,6 +8557,23 @@ extern "C" {
 PyMODINIT_FUNC PyInit__gnubg(void) {
   set_pkg_datadir_from_module();
   gnubg_lib_init_for_python();
-  return PyModule_Create(&gnubgmodule);
+  if (InitRolloutIterType() < 0 || InitEngineType() < 0 ||
+      InitCancelTokenType() < 0 || InitAnalyseFilesType() < 0 ||
+      InitExportFilesType() < 0 || InitRecordType() < 0 ||
+      InitRecordIterType() < 0)
+    return NULL;
+  PyObject *m = PyModule_Create(&gnubgmodule);
+  if (!m)
+    return NULL;
+  Py_INCREF(&EngineType);
+  Py_INCREF(&CancelTokenType);
+  Py_INCREF(pyCancelledError);
+  if (PyModule_AddObject(m, "Engine", (PyObject *)&EngineType) < 0 ||
+      PyModule_AddObject(m, "CancelToken", (PyObject *)&CancelTokenType) < 0 ||
+      PyModule_AddObject(m, "CancelledError", pyCancelledError) < 0) {
+    Py_DECREF(m);
+    return NULL;
+  }
+  return m;
 }
 }
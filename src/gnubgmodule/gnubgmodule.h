@@ -35,6 +35,13 @@ void gnubg_lib_set_pkg_datadir(const char *path);
 /* Ensure neural nets and match equity are loaded (for standalone Python module use). */
 void gnubg_lib_init_for_python(void);
 
+/* Match and settings of one gnubg.Engine; swapped with the process globals
+ * while the engine is in use. */
+typedef struct sessionstate sessionstate;
+sessionstate *gnubg_lib_session_new(void);
+void gnubg_lib_session_swap(sessionstate *pss);
+void gnubg_lib_session_free(sessionstate *pss);
+
 #ifdef __cplusplus
 }
 #endif
@@ -41,20 +41,10 @@ void LoadPythonFile(const char *sz, int fQuiet) {
 /* DrawBoard and FIBSBoard are defined in drawboard.c (linked via libgnubg) - do
  * not stub here */
 
-void SGFErrorHandler(void *unused1, void *unused2) {
-  (void)unused1;
-  (void)unused2;
-}
-
 /* Move formatting and parsing functions (FormatMove, FormatMovePlain,
  * ParseMove, CanonicalMoveOrder) are now provided by drawboard.c - no stubs
  * needed */
 
-/* Stub: SGF parsing - not needed for Python module */
-int SGFParse(void *unused1) {
-  /* Not needed for Python module */
-  (void)unused1;
-  return -1;
-}
+/* SGFParse and SGFErrorHandler are provided by sgfparse.c - no stubs needed */
 
 #endif /* USE_PYTHON */
@@ -0,0 +1,360 @@
+/*
+ * SGF reader for the Python build
+ */
+
+#include "config.h"
+#include "sgfparse.h"
+
+#include <glib.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sgf.h"
+
+void (*SGFErrorHandler)(const char *szMessage, int fParseError) = NULL;
+
+/* Input set by SGFParseSetInput for the next SGFParse on this thread. */
+typedef struct {
+  const char *pch;
+  size_t cb;
+} sgfinput;
+
+static GPrivate privInput = G_PRIVATE_INIT(g_free);
+
+typedef struct {
+  const char *pch; /* next character */
+  const char *pchEnd;
+  const char *pchStart; /* for the line number of errors */
+  const char *szError;  /* first error, or NULL */
+  const char *pchError;
+} sgfparser;
+
+/*
+ * Everything in the collection is allocated with malloc, as sgf.c frees it
+ * with free().
+ */
+static void *Alloc(size_t cb) {
+  void *p = malloc(cb);
+
+  if (!p)
+    g_error("sgf: out of memory");
+
+  return p;
+}
+
+static listOLD *NewList(void) {
+  listOLD *pl = Alloc(sizeof(*pl));
+
+  ListCreate(pl);
+
+  return pl;
+}
+
+static void FreeValues(listOLD *pl) {
+  while (pl->plNext != pl) {
+    free(pl->plNext->p);
+    ListDelete(pl->plNext);
+  }
+  free(pl);
+}
+
+static void FreeNode(listOLD *pl) {
+  while (pl->plNext != pl) {
+    property *pp = pl->plNext->p;
+
+    FreeValues(pp->pl);
+    free(pp);
+    ListDelete(pl->plNext);
+  }
+  free(pl);
+}
+
+static void FreeSequence(listOLD *pl) {
+  while (pl->plNext != pl) {
+    FreeNode(pl->plNext->p);
+    ListDelete(pl->plNext);
+  }
+  free(pl);
+}
+
+static void FreeTree(listOLD *pl) {
+  if (pl->plNext != pl) {
+    FreeSequence(pl->plNext->p);
+    ListDelete(pl->plNext);
+  }
+  while (pl->plNext != pl) {
+    FreeTree(pl->plNext->p);
+    ListDelete(pl->plNext);
+  }
+  free(pl);
+}
+
+extern void SGFFreeCollection(listOLD *plCollection) {
+  while (plCollection->plNext != plCollection) {
+    FreeTree(plCollection->plNext->p);
+    ListDelete(plCollection->plNext);
+  }
+  free(plCollection);
+}
+
+static int Peek(const sgfparser *pp) {
+  return pp->pch < pp->pchEnd ? (unsigned char)*pp->pch : EOF;
+}
+
+static void SkipSpace(sgfparser *pp) {
+  while (pp->pch < pp->pchEnd && g_ascii_isspace(*pp->pch))
+    ++pp->pch;
+}
+
+static void *Fail(sgfparser *pp, const char *szError) {
+  if (!pp->szError) {
+    pp->szError = szError;
+    pp->pchError = pp->pch;
+  }
+
+  return NULL;
+}
+
+/*
+ * A value, from its '[' to its ']'. "\x" stands for x; a backslash before a
+ * line break (a soft line break) is dropped with the break.
+ */
+static char *ParseValue(sgfparser *pp) {
+  const char *pchOpen = ++pp->pch;
+  const char *pchClose = pchOpen;
+  char *sz, *pchOut;
+
+  while (pchClose < pp->pchEnd && *pchClose != ']')
+    pchClose += *pchClose == '\\' ? 2 : 1;
+
+  if (pchClose >= pp->pchEnd)
+    return Fail(pp, "unterminated property value");
+
+  sz = pchOut = Alloc(pchClose - pchOpen + 1);
+
+  for (; pp->pch < pchClose; ++pp->pch) {
+    if (*pp->pch == '\\') {
+      ++pp->pch;
+      if (*pp->pch == '\n' || *pp->pch == '\r') {
+        if (pp->pch + 1 < pchClose &&
+            (pp->pch[1] == '\n' || pp->pch[1] == '\r') &&
+            pp->pch[1] != pp->pch[0])
+          ++pp->pch;
+        continue;
+      }
+    }
+    *pchOut++ = *pp->pch;
+  }
+  *pchOut = 0;
+  ++pp->pch;
+
+  return sz;
+}
+
+/*
+ * A property with one or more values. Lower case letters in the identifier
+ * are ignored (the long FF[3] style, e.g. "AddBlack"); identifiers of more
+ * than two upper case letters mean nothing to sgf.c and are skipped, in
+ * which case NULL is returned without an error.
+ */
+static property *ParseProperty(sgfparser *pp) {
+  char ach[2] = {0, 0};
+  int cUpper = 0;
+  listOLD *plValues;
+  property *ppr;
+
+  while (g_ascii_isalpha(Peek(pp))) {
+    if (g_ascii_isupper(*pp->pch)) {
+      if (cUpper < 2)
+        ach[cUpper] = *pp->pch;
+      ++cUpper;
+    }
+    ++pp->pch;
+  }
+
+  SkipSpace(pp);
+  if (Peek(pp) != '[')
+    return Fail(pp, "property without a value");
+
+  plValues = NewList();
+  while (Peek(pp) == '[') {
+    char *sz = ParseValue(pp);
+
+    if (!sz) {
+      FreeValues(plValues);
+      return NULL;
+    }
+    ListInsert(plValues, sz);
+    SkipSpace(pp);
+  }
+
+  if (cUpper < 1 || cUpper > 2) {
+    FreeValues(plValues);
+    return NULL;
+  }
+
+  ppr = Alloc(sizeof(*ppr));
+  ppr->ach[0] = ach[0];
+  ppr->ach[1] = ach[1];
+  ppr->pl = plValues;
+
+  return ppr;
+}
+
+/* A node, from its ';'. */
+static listOLD *ParseNode(sgfparser *pp) {
+  listOLD *pl = NewList();
+
+  ++pp->pch;
+  for (;;) {
+    property *ppr;
+
+    SkipSpace(pp);
+    if (!g_ascii_isalpha(Peek(pp)))
+      return pl;
+
+    ppr = ParseProperty(pp);
+    if (pp->szError) {
+      FreeNode(pl);
+      return NULL;
+    }
+    if (ppr)
+      ListInsert(pl, ppr);
+  }
+}
+
+/* A game tree, from its '('. */
+static listOLD *ParseTree(sgfparser *pp, int nDepth) {
+  listOLD *plTree, *plSequence;
+
+  if (nDepth > SGF_MAX_DEPTH)
+    return Fail(pp, "variations nested too deeply");
+
+  ++pp->pch;
+  SkipSpace(pp);
+  if (Peek(pp) != ';')
+    return Fail(pp, "game tree without a node");
+
+  plSequence = NewList();
+  while (Peek(pp) == ';') {
+    listOLD *plNode = ParseNode(pp);
+
+    if (!plNode) {
+      FreeSequence(plSequence);
+      return NULL;
+    }
+    ListInsert(plSequence, plNode);
+  }
+
+  plTree = NewList();
+  ListInsert(plTree, plSequence);
+
+  for (;;) {
+    listOLD *plVariation;
+    int ch;
+
+    SkipSpace(pp);
+    ch = Peek(pp);
+    if (ch == ')') {
+      ++pp->pch;
+      return plTree;
+    }
+    if (ch != '(') {
+      FreeTree(plTree);
+      return Fail(pp, ch == EOF ? "unexpected end of input"
+                                : "unexpected character in game tree");
+    }
+
+    plVariation = ParseTree(pp, nDepth + 1);
+    if (!plVariation) {
+      FreeTree(plTree);
+      return NULL;
+    }
+    ListInsert(plTree, plVariation);
+  }
+}
+
+static void ReportError(const sgfparser *pp) {
+  const char *pch;
+  int nLine = 1;
+  char *sz;
+
+  for (pch = pp->pchStart; pch < pp->pchError; ++pch)
+    if (*pch == '\n')
+      ++nLine;
+
+  sz = g_strdup_printf("line %d: %s", nLine, pp->szError);
+  if (SGFErrorHandler)
+    SGFErrorHandler(sz, TRUE);
+  else
+    fprintf(stderr, "sgf: %s\n", sz);
+  g_free(sz);
+}
+
+extern listOLD *SGFParseBuffer(const char *pch, size_t cb) {
+  sgfparser sp = {pch, pch + cb, pch, NULL, NULL};
+  listOLD *plCollection = NewList();
+
+  /* Text outside game trees (a byte order mark, mail headers) is ignored. */
+  for (;;) {
+    listOLD *plTree;
+
+    while (sp.pch < sp.pchEnd && *sp.pch != '(')
+      ++sp.pch;
+    if (sp.pch == sp.pchEnd)
+      return plCollection;
+
+    plTree = ParseTree(&sp, 0);
+    if (!plTree) {
+      ReportError(&sp);
+      SGFFreeCollection(plCollection);
+      return NULL;
+    }
+    ListInsert(plCollection, plTree);
+  }
+}
+
+extern void SGFParseSetInput(const char *pch, size_t cb) {
+  sgfinput *psi = NULL;
+
+  if (pch) {
+    psi = g_new(sgfinput, 1);
+    psi->pch = pch;
+    psi->cb = cb;
+  }
+
+  g_private_replace(&privInput, psi);
+}
+
+extern listOLD *SGFParse(FILE *pf) {
+  sgfinput *psi = g_private_get(&privInput);
+  GString *gs;
+  char ach[65536];
+  size_t cb;
+  listOLD *pl;
+
+  if (psi) {
+    pl = SGFParseBuffer(psi->pch, psi->cb);
+    g_private_replace(&privInput, NULL);
+    return pl;
+  }
+
+  gs = g_string_sized_new(sizeof(ach));
+  while ((cb = fread(ach, 1, sizeof(ach), pf)) > 0)
+    g_string_append_len(gs, ach, cb);
+
+  if (ferror(pf)) {
+    if (SGFErrorHandler)
+      SGFErrorHandler("read error", FALSE);
+    else
+      fprintf(stderr, "sgf: read error\n");
+    g_string_free(gs, TRUE);
+    return NULL;
+  }
+
+  pl = SGFParseBuffer(gs->str, gs->len);
+  g_string_free(gs, TRUE);
+
+  return pl;
+}
@@ -0,0 +1,45 @@
+/*
+ * SGF reader for the Python build
+ *
+ * gnubg's own reader is generated by bison and flex, which the Python build
+ * does not run. This is a hand-written, reentrant replacement: it provides
+ * SGFParse and SGFErrorHandler as declared in sgf.h, so sgf.c loads matches
+ * unchanged, and builds the same collection (a list of game trees, each a
+ * list holding its sequence of nodes followed by its variations; a node is
+ * a list of properties) from a FILE or from memory.
+ */
+
+#ifndef SRC_GNUBGMODULE_SGFPARSE_H_
+#define SRC_GNUBGMODULE_SGFPARSE_H_
+
+#include <stddef.h>
+
+#include "list.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Deepest nesting of variations accepted. */
+#define SGF_MAX_DEPTH 1000
+
+/*
+ * Parse cb bytes at pch into a collection, or return NULL after reporting
+ * the error through SGFErrorHandler. The result is freed with
+ * SGFFreeCollection.
+ */
+extern listOLD *SGFParseBuffer(const char *pch, size_t cb);
+extern void SGFFreeCollection(listOLD *plCollection);
+
+/*
+ * Make the next SGFParse on this thread read cb bytes at pch instead of its
+ * FILE. The buffer must stay valid until then; SGFParseSetInput(NULL, 0)
+ * cancels.
+ */
+extern void SGFParseSetInput(const char *pch, size_t cb);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // SRC_GNUBGMODULE_SGFPARSE_H_
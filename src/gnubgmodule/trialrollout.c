@@ -0,0 +1,702 @@
+/*
+ * Rollouts as independent trials
+ */
+
+#include "config.h"
+#include "trialrollout.h"
+
+#include <math.h>
+#include <string.h>
+
+static const unsigned char achShardMagic[8] = {'G', 'N', 'U', 'B',
+                                               'G', 'T', 'R', 1};
+
+/* splitmix64 finaliser. */
+static guint64 Mix64(guint64 x) {
+  x ^= x >> 30;
+  x *= 0xbf58476d1ce4e5b9ULL;
+  x ^= x >> 27;
+  x *= 0x94d049bb133111ebULL;
+  return x ^ (x >> 31);
+}
+
+static guint64 TrialHash(guint64 nSeed, guint64 n, unsigned int iTurn,
+                         unsigned int iStream) {
+  guint64 h = Mix64(nSeed ^ 0x9e3779b97f4a7c15ULL);
+
+  h = Mix64(h + n);
+  return Mix64(h + (((guint64)iTurn << 32) | iStream));
+}
+
+/* Number of distinct rolls on turn iTurn (no doubles on an opening roll). */
+static unsigned int TurnRolls(unsigned int iTurn, int fInitial) {
+  return fInitial && iTurn == 0 ? 30 : 36;
+}
+
+/*
+ * With fRotate the first TRIAL_ROTATE_TURNS turns are stratified: every
+ * block of consecutive trials covering all combinations of their rolls
+ * contains each combination once, in an order shifted per block by the
+ * seed.
+ */
+extern void TrialDice(guint64 nSeed, unsigned int iTrial, unsigned int iTurn,
+                      int fRotate, int fInitial, unsigned int anDice[2]) {
+  unsigned int m = TurnRolls(iTurn, fInitial);
+  unsigned int c;
+
+  if (fRotate && iTurn < TRIAL_ROTATE_TURNS) {
+    guint64 p = 1;
+    unsigned int t;
+
+    for (t = 0; t < iTurn; ++t)
+      p *= TurnRolls(t, fInitial);
+    c = (unsigned int)((iTrial / p) % m +
+                       TrialHash(nSeed, iTrial / (p * m), iTurn, 1) % m) %
+        m;
+  } else
+    c = (unsigned int)(TrialHash(nSeed, iTrial, iTurn, 0) % m);
+
+  if (m == 30) {
+    anDice[0] = c / 5;
+    anDice[1] = c % 5;
+    if (anDice[1] >= anDice[0])
+      anDice[1]++;
+  } else {
+    anDice[0] = c / 6;
+    anDice[1] = c % 6;
+  }
+  anDice[0]++;
+  anDice[1]++;
+}
+
+/*
+ * Evaluation at the settings of pec; in a cubeful trial the cubeful equity
+ * for the player on roll is in ar[OUTPUT_CUBEFUL_EQUITY].
+ */
+static int EvaluateTrial(float ar[NUM_ROLLOUT_OUTPUTS], const TanBoard anBoard,
+                         const cubeinfo *pci, const evalcontext *pec,
+                         int fCubeful) {
+  evalcontext ec = *pec;
+
+  ec.fCubeful = fCubeful;
+  return GeneralEvaluationE(ar, anBoard, pci, &ec);
+}
+
+/* Index of a cube value in the rolloutstat histograms. */
+static int LogCube(int nCube) {
+  int i = 0;
+
+  while ((nCube >>= 1) && i < STAT_MAXCUBE - 1)
+    i++;
+  return i;
+}
+
+/*
+ * rEq is a cubeful equity for the player on roll in pciNow. Returns it for
+ * the player on roll in pciStart, at the cube of pciStart; fOther is set
+ * if they are not the same player. Match play goes through match winning
+ * chances, money play scales by the cube.
+ */
+static float StartEquity(float rEq, const cubeinfo *pciNow, int fOther,
+                         const cubeinfo *pciStart) {
+  if (pciNow->nMatchTo) {
+    float rMwc = eq2mwc(rEq, pciNow);
+
+    return mwc2eq(fOther ? 1.0f - rMwc : rMwc, pciStart);
+  }
+  rEq *= (float)pciNow->nCube / (float)pciStart->nCube;
+  return fOther ? -rEq : rEq;
+}
+
+/* aci[iPlayer] doubles and aci[!iPlayer] takes. */
+static void TakeCube(cubeinfo aci[2], int iPlayer) {
+  int i;
+
+  for (i = 0; i < 2; ++i)
+    SetCubeInfo(&aci[i], 2 * aci[i].nCube, aci[!iPlayer].fMove, aci[i].fMove,
+                aci[i].nMatchTo, aci[i].anScore, aci[i].fCrawford,
+                aci[i].fJacoby, aci[i].fBeavers, aci[i].bgv);
+}
+
+/*
+ * Move for the player on roll with variance reduction: the best move is
+ * found for all 21 rolls, and the luck of the actual roll (the evaluation
+ * after it minus the average over all rolls, one ply lower) is added to
+ * arLuck from player 0's side. In a cubeful trial prCubefulLuck gets the
+ * luck in cubeful equity, as StartEquity returns it for player 0 at the
+ * cube of pciStart; otherwise it is NULL. Leaves the position after the
+ * move, with the opponent on roll, in anBoard.
+ */
+static int VarRednMove(TanBoard anBoard, const unsigned int anDice[2],
+                       const cubeinfo aci[2], int iPlayer, evalcontext *pec,
+                       movefilter aamf[MAX_FILTER_PLIES][MAX_FILTER_PLIES],
+                       float arLuck[NUM_OUTPUTS], float *prCubefulLuck,
+                       const cubeinfo *pciStart) {
+  float arMean[NUM_OUTPUTS] = {0.0f, 0.0f, 0.0f, 0.0f, 0.0f};
+  float arActual[NUM_OUTPUTS];
+  float rCubefulMean = 0.0f, rCubefulActual = 0.0f;
+  TanBoard anActual;
+  evalcontext ecLuck = *pec;
+  int i, j, k;
+
+  if (ecLuck.nPlies > 0)
+    ecLuck.nPlies--;
+
+  for (i = 1; i <= 6; ++i)
+    for (j = 1; j <= i; ++j) {
+      float ar[NUM_ROLLOUT_OUTPUTS];
+      float rCubeful = 0.0f;
+      TanBoard an;
+      int anMove[8];
+
+      memcpy(an, anBoard, sizeof(TanBoard));
+      if (FindBestMove(anMove, i, j, an, &aci[iPlayer], pec, aamf) < 0)
+        return -1;
+      SwapSides(an);
+      if (EvaluateTrial(ar, (ConstTanBoard)an, &aci[!iPlayer], &ecLuck,
+                        prCubefulLuck != NULL) < 0)
+        return -1;
+      if (prCubefulLuck)
+        rCubeful = StartEquity(ar[OUTPUT_CUBEFUL_EQUITY], &aci[!iPlayer],
+                               !iPlayer, pciStart);
+      if (!iPlayer)
+        InvertEvaluation(ar);
+      for (k = 0; k < NUM_OUTPUTS; ++k)
+        arMean[k] += ar[k] * (i == j ? 1.0f : 2.0f) / 36.0f;
+      rCubefulMean += rCubeful * (i == j ? 1.0f : 2.0f) / 36.0f;
+      if ((unsigned int)i == MAX(anDice[0], anDice[1]) &&
+          (unsigned int)j == MIN(anDice[0], anDice[1])) {
+        memcpy(anActual, an, sizeof(TanBoard));
+        memcpy(arActual, ar, sizeof(arActual));
+        rCubefulActual = rCubeful;
+      }
+    }
+
+  for (k = 0; k < NUM_OUTPUTS; ++k)
+    arLuck[k] += arActual[k] - arMean[k];
+  if (prCubefulLuck)
+    *prCubefulLuck += rCubefulActual - rCubefulMean;
+  memcpy(anBoard, anActual, sizeof(TanBoard));
+  return 0;
+}
+
+/*
+ * Count the move from anBefore (player on roll is anBefore[1]) to anAfter
+ * (the opponent on roll) in prs: the first hit and the first closeout of
+ * the opponent in the game, and the moves and pips lost bearing off in a
+ * race.
+ */
+static void MoveStats(rolloutstat *prs, const TanBoard anBefore,
+                      const TanBoard anAfter, const unsigned int anDice[2],
+                      positionclass pc, int *pfHit, int *pfClosedOut) {
+  unsigned int anPipsBefore[2], anPipsAfter[2];
+  int i, nLost;
+
+  if (!*pfHit && anAfter[1][24] > anBefore[0][24]) {
+    prs->nOpponentHit++;
+    *pfHit = TRUE;
+  }
+  if (!*pfClosedOut && anAfter[1][24] > 0) {
+    for (i = 0; i < 6 && anAfter[0][i] >= 2; ++i)
+      ;
+    if (i == 6) {
+      prs->nOpponentClosedOut++;
+      *pfClosedOut = TRUE;
+    }
+  }
+
+  if (pc > CLASS_RACE)
+    return;
+  for (i = 6; i < 25; ++i)
+    if (anBefore[1][i])
+      return;
+  PipCount(anBefore, anPipsBefore);
+  PipCount(anAfter, anPipsAfter);
+  nLost = (int)((anDice[0] + anDice[1]) * (anDice[0] == anDice[1] ? 2 : 1)) -
+          (int)(anPipsBefore[1] - anPipsAfter[0]);
+  prs->nBearoffMoves++;
+  if (nLost > 0)
+    prs->nBearoffPipsLost += nLost;
+}
+
+/*
+ * Cube decision for aci[iPlayer], who is on roll in anBoard. Returns 1 if
+ * the cube was passed, with the cubeless outputs of the position for the
+ * doubler in arOutput, 0 otherwise (after a take the cube in aci is
+ * turned), or -1 if an evaluation failed. Optional doubles are not made
+ * and beavers are taken as plain takes, as in RolloutGeneral.
+ */
+static int TrialCubeDecision(const TanBoard anBoard, cubeinfo aci[2],
+                             int iPlayer, const evalcontext *pec,
+                             float arOutput[NUM_ROLLOUT_OUTPUTS],
+                             rolloutstat *prs) {
+  float aarOutput[2][NUM_ROLLOUT_OUTPUTS], arDouble[4];
+  evalcontext ec = *pec;
+
+  ec.fCubeful = TRUE;
+  if (GeneralCubeDecisionE(aarOutput, anBoard, &aci[iPlayer], &ec, NULL) < 0)
+    return -1;
+  switch (FindCubeDecision(arDouble, aarOutput, &aci[iPlayer])) {
+  case DOUBLE_TAKE:
+  case DOUBLE_BEAVER:
+  case REDOUBLE_TAKE:
+    prs->acDoubleTake[LogCube(aci[iPlayer].nCube)]++;
+    TakeCube(aci, iPlayer);
+    return 0;
+  case DOUBLE_PASS:
+  case REDOUBLE_PASS:
+    prs->acDoubleDrop[LogCube(aci[iPlayer].nCube)]++;
+    memcpy(arOutput, aarOutput[0], sizeof(aarOutput[0]));
+    return 1;
+  default:
+    return 0;
+  }
+}
+
+extern int TrialRollout(const trialjob *ptj, unsigned int iPosition,
+                        unsigned int iTrial,
+                        float arOutput[NUM_ROLLOUT_OUTPUTS],
+                        rolloutstat ars[2]) {
+  const rolloutcontext *prc = &ptj->rc;
+  const trialposition *ptp = &ptj->atp[iPosition];
+  const cubeinfo *pci = &ptp->ci;
+  const int fCubeful = prc->fCubeful;
+  float arLuck[NUM_OUTPUTS] = {0.0f, 0.0f, 0.0f, 0.0f, 0.0f};
+  float rCubeful = 0.0f, rCubefulLuck = 0.0f;
+  int fInitial = prc->fInitial && !ptp->fInvert;
+  TanBoard anBoard;
+  cubeinfo aciStart[2], aci[2];
+  unsigned int iTurn;
+  int iPlayer = 0, fOver = FALSE, k;
+  int afHit[2] = {FALSE, FALSE}, afClosedOut[2] = {FALSE, FALSE};
+
+  memcpy(anBoard, ptp->anBoard, sizeof(TanBoard));
+  aciStart[0] = *pci;
+  SetCubeInfo(&aciStart[1], pci->nCube, pci->fCubeOwner, !pci->fMove,
+              pci->nMatchTo, pci->anScore, pci->fCrawford, pci->fJacoby,
+              pci->fBeavers, pci->bgv);
+  memcpy(aci, aciStart, sizeof(aci));
+  memset(ars, 0, 2 * sizeof(rolloutstat));
+
+  for (iTurn = 0;; ++iTurn, iPlayer = !iPlayer) {
+    positionclass pc = ClassifyPosition((ConstTanBoard)anBoard, pci->bgv);
+    int fLate = prc->fLateEvals && iTurn >= prc->nLate;
+    evalcontext ec;
+    TanBoard anBefore;
+    unsigned int anDice[2];
+    int anMove[8];
+
+    if (pc == CLASS_OVER) {
+      fOver = TRUE;
+      if (EvaluateTrial(arOutput, (ConstTanBoard)anBoard, &aci[iPlayer],
+                        &ecBasic, FALSE) < 0)
+        return -1;
+      rCubeful = Utility(arOutput, &aci[iPlayer]);
+      break;
+    }
+    if (prc->fDoTruncate && iTurn >= prc->nTruncate) {
+      if (EvaluateTrial(arOutput, (ConstTanBoard)anBoard, &aci[iPlayer],
+                        &prc->aecChequerTrunc, fCubeful) < 0)
+        return -1;
+      rCubeful = arOutput[OUTPUT_CUBEFUL_EQUITY];
+      break;
+    }
+    if ((prc->fTruncBearoff2 && pc == CLASS_BEAROFF2) ||
+        (prc->fTruncBearoffOS && pc == CLASS_BEAROFF_OS)) {
+      if (EvaluateTrial(arOutput, (ConstTanBoard)anBoard, &aci[iPlayer],
+                        &ecBasic, fCubeful) < 0)
+        return -1;
+      rCubeful = arOutput[OUTPUT_CUBEFUL_EQUITY];
+      break;
+    }
+    /* As RolloutGeneral is called here, the first turn has no cube
+     * decision: the position is rolled out as a no double. */
+    if (fCubeful && iTurn > 0 && GetDPEq(NULL, NULL, &aci[iPlayer])) {
+      int n = TrialCubeDecision(
+          (ConstTanBoard)anBoard, aci, iPlayer,
+          fLate ? &prc->aecCubeLate[iPlayer] : &prc->aecCube[iPlayer],
+          arOutput, &ars[iPlayer]);
+
+      if (n < 0)
+        return -1;
+      if (n) {
+        rCubeful = 1.0f;
+        break;
+      }
+    }
+
+    TrialDice(ptj->nSeed, iTrial, iTurn, prc->fRotate, fInitial, anDice);
+    memcpy(anBefore, anBoard, sizeof(TanBoard));
+    ec = fLate ? prc->aecChequerLate[iPlayer] : prc->aecChequer[iPlayer];
+    if (!fCubeful)
+      ec.fCubeful = FALSE;
+    if (prc->fVarRedn) {
+      if (VarRednMove(anBoard, anDice, aci, iPlayer, &ec,
+                      (movefilter(*)[MAX_FILTER_PLIES])(
+                          fLate ? prc->aaamfLate[iPlayer]
+                                : prc->aaamfChequer[iPlayer]),
+                      arLuck, fCubeful ? &rCubefulLuck : NULL, pci) < 0)
+        return -1;
+    } else {
+      if (FindBestMove(anMove, (int)anDice[0], (int)anDice[1], anBoard,
+                       &aci[iPlayer], &ec,
+                       (movefilter(*)[MAX_FILTER_PLIES])(
+                           fLate ? prc->aaamfLate[iPlayer]
+                                 : prc->aaamfChequer[iPlayer])) < 0)
+        return -1;
+      SwapSides(anBoard);
+    }
+    MoveStats(&ars[iPlayer], (ConstTanBoard)anBefore, (ConstTanBoard)anBoard,
+              anDice, pc, &afHit[iPlayer], &afClosedOut[iPlayer]);
+  }
+
+  /* arOutput is for the player on roll; the other one won if it is over */
+  if (fOver) {
+    rolloutstat *prs = &ars[!iPlayer];
+    int i = LogCube(aci[0].nCube);
+
+    prs->acWin[i]++;
+    if (arOutput[OUTPUT_LOSEGAMMON] > 0.0f)
+      prs->acWinGammon[i]++;
+    if (arOutput[OUTPUT_LOSEBACKGAMMON] > 0.0f)
+      prs->acWinBackgammon[i]++;
+  }
+  if (iPlayer)
+    InvertEvaluation(arOutput);
+  for (k = 0; k < NUM_OUTPUTS; ++k)
+    arOutput[k] -= arLuck[k];
+  if (fCubeful)
+    rCubeful = StartEquity(rCubeful, &aci[iPlayer], iPlayer, pci) -
+               rCubefulLuck;
+  if (ptp->fInvert) {
+    rolloutstat rs = ars[0];
+
+    InvertEvaluation(arOutput);
+    ars[0] = ars[1];
+    ars[1] = rs;
+    if (fCubeful)
+      rCubeful = StartEquity(rCubeful, &aciStart[0], TRUE, &aciStart[1]);
+  }
+  arOutput[OUTPUT_EQUITY] = Utility(arOutput, &aciStart[ptp->fInvert]);
+  arOutput[OUTPUT_CUBEFUL_EQUITY] = fCubeful ? rCubeful : 0.0f;
+  return 0;
+}
+
+static void RolloutStatAdd(rolloutstat *prsTo, const rolloutstat *prsFrom) {
+  int i;
+
+  for (i = 0; i < STAT_MAXCUBE; ++i) {
+    prsTo->acWin[i] += prsFrom->acWin[i];
+    prsTo->acWinGammon[i] += prsFrom->acWinGammon[i];
+    prsTo->acWinBackgammon[i] += prsFrom->acWinBackgammon[i];
+    prsTo->acDoubleDrop[i] += prsFrom->acDoubleDrop[i];
+    prsTo->acDoubleTake[i] += prsFrom->acDoubleTake[i];
+  }
+  prsTo->nOpponentHit += prsFrom->nOpponentHit;
+  prsTo->nBearoffMoves += prsFrom->nBearoffMoves;
+  prsTo->nBearoffPipsLost += prsFrom->nBearoffPipsLost;
+  prsTo->nOpponentClosedOut += prsFrom->nOpponentClosedOut;
+}
+
+extern void TrialSumsAdd(trialsums *pts,
+                         const float arOutput[NUM_ROLLOUT_OUTPUTS],
+                         const rolloutstat ars[2]) {
+  int i;
+
+  for (i = 0; i < NUM_ROLLOUT_OUTPUTS; ++i) {
+    gint64 n = (gint64)floor(arOutput[i] * TRIAL_SCALE + 0.5);
+
+    pts->anSum[i] += n;
+    pts->anSumSq[i] += n * n;
+  }
+  pts->cTrials++;
+  RolloutStatAdd(&pts->ars[0], &ars[0]);
+  RolloutStatAdd(&pts->ars[1], &ars[1]);
+}
+
+extern void TrialSumsMerge(trialsums *ptsTo, const trialsums *ptsFrom) {
+  int i;
+
+  for (i = 0; i < NUM_ROLLOUT_OUTPUTS; ++i) {
+    ptsTo->anSum[i] += ptsFrom->anSum[i];
+    ptsTo->anSumSq[i] += ptsFrom->anSumSq[i];
+  }
+  ptsTo->cTrials += ptsFrom->cTrials;
+  RolloutStatAdd(&ptsTo->ars[0], &ptsFrom->ars[0]);
+  RolloutStatAdd(&ptsTo->ars[1], &ptsFrom->ars[1]);
+}
+
+extern void TrialSumsResult(const trialsums *pts,
+                            float arOutput[NUM_ROLLOUT_OUTPUTS],
+                            float arStdDev[NUM_ROLLOUT_OUTPUTS]) {
+  double n = pts->cTrials;
+  int i;
+
+  for (i = 0; i < NUM_ROLLOUT_OUTPUTS; ++i) {
+    double s = (double)pts->anSum[i], ss = (double)pts->anSumSq[i];
+    double rVar = n > 1 ? (ss - s * s / n) / (n - 1) : 0.0;
+
+    arOutput[i] = n > 0 ? (float)(s / n / TRIAL_SCALE) : 0.0f;
+    arStdDev[i] =
+        n > 0 ? (float)(sqrt(MAX(rVar, 0.0) / n) / TRIAL_SCALE) : 0.0f;
+  }
+}
+
+extern void TrialShardInit(trialshard *psh, guint64 nJob, guint32 fFlags,
+                           guint32 cPositions) {
+  psh->nJob = nJob;
+  psh->fFlags = fFlags;
+  psh->cPositions = cPositions;
+  psh->cRanges = 0;
+  psh->atr = NULL;
+  psh->ats = g_new0(trialsums, cPositions ? cPositions : 1);
+}
+
+extern void TrialShardFree(trialshard *psh) {
+  g_free(psh->atr);
+  g_free(psh->ats);
+  psh->atr = NULL;
+  psh->ats = NULL;
+  psh->cRanges = psh->cPositions = 0;
+}
+
+/* Union of the ranges of psh and atr (sorted, disjoint), coalescing
+ * adjacent ones. Returns -2 on overlap. */
+static int MergeRanges(trialshard *psh, const trialrange *atr,
+                       guint32 cRanges) {
+  trialrange *atrNew = g_new(trialrange, psh->cRanges + cRanges);
+  guint32 i = 0, j = 0, c = 0;
+
+  while (i < psh->cRanges || j < cRanges) {
+    trialrange tr;
+
+    if (j == cRanges ||
+        (i < psh->cRanges && psh->atr[i].iFirst < atr[j].iFirst))
+      tr = psh->atr[i++];
+    else
+      tr = atr[j++];
+    if (c && tr.iFirst < atrNew[c - 1].iLast) {
+      g_free(atrNew);
+      return -2;
+    }
+    if (c && tr.iFirst == atrNew[c - 1].iLast)
+      atrNew[c - 1].iLast = tr.iLast;
+    else
+      atrNew[c++] = tr;
+  }
+  g_free(psh->atr);
+  psh->atr = atrNew;
+  psh->cRanges = c;
+  return 0;
+}
+
+extern int TrialShardAddRange(trialshard *psh, guint32 iFirst, guint32 iLast) {
+  trialrange tr;
+
+  if (iFirst >= iLast)
+    return 0;
+  tr.iFirst = iFirst;
+  tr.iLast = iLast;
+  return MergeRanges(psh, &tr, 1);
+}
+
+extern guint32 TrialShardTrials(const trialshard *psh) {
+  guint32 i, c = 0;
+
+  for (i = 0; i < psh->cRanges; ++i)
+    c += psh->atr[i].iLast - psh->atr[i].iFirst;
+  return c;
+}
+
+extern int TrialShardMerge(trialshard *pshTo, const trialshard *pshFrom) {
+  guint32 i;
+
+  if (pshTo->nJob != pshFrom->nJob || pshTo->fFlags != pshFrom->fFlags ||
+      pshTo->cPositions != pshFrom->cPositions)
+    return -1;
+  if (MergeRanges(pshTo, pshFrom->atr, pshFrom->cRanges) < 0)
+    return -2;
+  for (i = 0; i < pshTo->cPositions; ++i)
+    TrialSumsMerge(&pshTo->ats[i], &pshFrom->ats[i]);
+  return 0;
+}
+
+/* Serialised layout, all little-endian:
+ *   magic[8] nJob:u64 fFlags:u32 cPositions:u32 cRanges:u32
+ *   cRanges * (iFirst:u32 iLast:u32)
+ *   cPositions * (cTrials:u32 anSum:i64[7] anSumSq:i64[7]
+ *                 2 * (5 * STAT_MAXCUBE + 4) * i32)
+ */
+#define SHARD_HEADER_SIZE (8 + 8 + 4 + 4 + 4)
+#define SHARD_STAT_INTS (5 * STAT_MAXCUBE + 4)
+#define SHARD_SUMS_SIZE                                                        \
+  (4 + 2 * 8 * NUM_ROLLOUT_OUTPUTS + 2 * 4 * SHARD_STAT_INTS)
+
+static unsigned char *Put32(unsigned char *pb, guint32 n) {
+  int i;
+
+  for (i = 0; i < 4; ++i)
+    *pb++ = (unsigned char)(n >> (8 * i));
+  return pb;
+}
+
+static unsigned char *Put64(unsigned char *pb, guint64 n) {
+  int i;
+
+  for (i = 0; i < 8; ++i)
+    *pb++ = (unsigned char)(n >> (8 * i));
+  return pb;
+}
+
+static guint32 Get32(const unsigned char **ppb) {
+  guint32 n = 0;
+  int i;
+
+  for (i = 0; i < 4; ++i)
+    n |= (guint32)(*ppb)[i] << (8 * i);
+  *ppb += 4;
+  return n;
+}
+
+static guint64 Get64(const unsigned char **ppb) {
+  guint64 n = 0;
+  int i;
+
+  for (i = 0; i < 8; ++i)
+    n |= (guint64)(*ppb)[i] << (8 * i);
+  *ppb += 8;
+  return n;
+}
+
+/* The integer fields of a rolloutstat, in serialised order. */
+static void StatInts(rolloutstat *prs, int *apn[SHARD_STAT_INTS]) {
+  int i, c = 0;
+
+  for (i = 0; i < STAT_MAXCUBE; ++i) {
+    apn[c++] = &prs->acWin[i];
+    apn[c++] = &prs->acWinGammon[i];
+    apn[c++] = &prs->acWinBackgammon[i];
+    apn[c++] = &prs->acDoubleDrop[i];
+    apn[c++] = &prs->acDoubleTake[i];
+  }
+  apn[c++] = &prs->nOpponentHit;
+  apn[c++] = &prs->nBearoffMoves;
+  apn[c++] = &prs->nBearoffPipsLost;
+  apn[c++] = &prs->nOpponentClosedOut;
+}
+
+extern size_t TrialShardSize(const trialshard *psh) {
+  return SHARD_HEADER_SIZE + (size_t)psh->cRanges * 8 +
+         (size_t)psh->cPositions * SHARD_SUMS_SIZE;
+}
+
+extern void TrialShardWrite(const trialshard *psh, unsigned char *pb) {
+  guint32 i;
+  int j, k;
+
+  memcpy(pb, achShardMagic, sizeof(achShardMagic));
+  pb = Put64(pb + sizeof(achShardMagic), psh->nJob);
+  pb = Put32(pb, psh->fFlags);
+  pb = Put32(pb, psh->cPositions);
+  pb = Put32(pb, psh->cRanges);
+  for (i = 0; i < psh->cRanges; ++i) {
+    pb = Put32(pb, psh->atr[i].iFirst);
+    pb = Put32(pb, psh->atr[i].iLast);
+  }
+  for (i = 0; i < psh->cPositions; ++i) {
+    trialsums *pts = &psh->ats[i];
+
+    pb = Put32(pb, pts->cTrials);
+    for (j = 0; j < NUM_ROLLOUT_OUTPUTS; ++j)
+      pb = Put64(pb, (guint64)pts->anSum[j]);
+    for (j = 0; j < NUM_ROLLOUT_OUTPUTS; ++j)
+      pb = Put64(pb, (guint64)pts->anSumSq[j]);
+    for (j = 0; j < 2; ++j) {
+      int *apn[SHARD_STAT_INTS];
+
+      StatInts(&pts->ars[j], apn);
+      for (k = 0; k < SHARD_STAT_INTS; ++k)
+        pb = Put32(pb, (guint32)*apn[k]);
+    }
+  }
+}
+
+extern int TrialShardRead(trialshard *psh, const unsigned char *pb,
+                          size_t cb) {
+  const unsigned char *pbEnd = pb + cb;
+  guint64 nJob;
+  guint32 fFlags, cPositions, cRanges, i;
+  int j, k;
+
+  if (cb < SHARD_HEADER_SIZE ||
+      memcmp(pb, achShardMagic, sizeof(achShardMagic)) != 0)
+    return -1;
+  pb += sizeof(achShardMagic);
+  nJob = Get64(&pb);
+  fFlags = Get32(&pb);
+  cPositions = Get32(&pb);
+  cRanges = Get32(&pb);
+  if ((size_t)(pbEnd - pb) !=
+      (size_t)cRanges * 8 + (size_t)cPositions * SHARD_SUMS_SIZE)
+    return -1;
+
+  TrialShardInit(psh, nJob, fFlags, cPositions);
+  psh->atr = g_new(trialrange, cRanges ? cRanges : 1);
+  psh->cRanges = cRanges;
+  for (i = 0; i < cRanges; ++i) {
+    psh->atr[i].iFirst = Get32(&pb);
+    psh->atr[i].iLast = Get32(&pb);
+    if (psh->atr[i].iFirst >= psh->atr[i].iLast ||
+        (i && psh->atr[i].iFirst <= psh->atr[i - 1].iLast)) {
+      TrialShardFree(psh);
+      return -1;
+    }
+  }
+  for (i = 0; i < cPositions; ++i) {
+    trialsums *pts = &psh->ats[i];
+
+    pts->cTrials = Get32(&pb);
+    for (j = 0; j < NUM_ROLLOUT_OUTPUTS; ++j)
+      pts->anSum[j] = (gint64)Get64(&pb);
+    for (j = 0; j < NUM_ROLLOUT_OUTPUTS; ++j)
+      pts->anSumSq[j] = (gint64)Get64(&pb);
+    for (j = 0; j < 2; ++j) {
+      int *apn[SHARD_STAT_INTS];
+
+      StatInts(&pts->ars[j], apn);
+      for (k = 0; k < SHARD_STAT_INTS; ++k)
+        *apn[k] = (int)Get32(&pb);
+    }
+  }
+  return 0;
+}
+
+extern int TrialShardSave(const trialshard *psh, const char *szFile,
+                          GError **ppError) {
+  size_t cb = TrialShardSize(psh);
+  unsigned char *pb = (unsigned char *)g_malloc(cb);
+  int ret;
+
+  TrialShardWrite(psh, pb);
+  ret = g_file_set_contents(szFile, (const gchar *)pb, (gssize)cb, ppError)
+            ? 0
+            : -1;
+  g_free(pb);
+  return ret;
+}
+
+extern int TrialShardLoad(trialshard *psh, const char *szFile,
+                          GError **ppError) {
+  gchar *pch;
+  gsize cb;
+  int ret;
+
+  if (!g_file_get_contents(szFile, &pch, &cb, ppError))
+    return -1;
+  ret = TrialShardRead(psh, (const unsigned char *)pch, cb);
+  g_free(pch);
+  if (ret < 0)
+    g_set_error(ppError, G_FILE_ERROR, G_FILE_ERROR_INVAL,
+                "%s is not a rollout checkpoint", szFile);
+  return ret;
+}
@@ -0,0 +1,140 @@
+/*
+ * Rollouts as independent trials
+ *
+ * Trial i of a rollout is a pure function of the position, the rollout
+ * settings, the seed and i: its dice come from a counter-based generator
+ * keyed by (seed, trial, turn), so trials can run in any order, on any
+ * thread or in another process. Results are accumulated in fixed point, so
+ * partial sums over disjoint trial ranges add up to exactly the sums of a
+ * single run over their union.
+ */
+
+#ifndef SRC_GNUBGMODULE_TRIALROLLOUT_H_
+#define SRC_GNUBGMODULE_TRIALROLLOUT_H_
+
+#include <glib.h>
+#include <stddef.h>
+
+#include "eval.h"
+#include "rollout.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Fixed-point scale of the per-trial outputs in trialsums. */
+#define TRIAL_SCALE 65536.0
+
+/* Turns whose dice are stratified over the trials when fRotate is set. */
+#define TRIAL_ROTATE_TURNS 2
+
+/* One position to roll out. */
+typedef struct {
+  TanBoard anBoard; /* player on roll is anBoard[1] */
+  cubeinfo ci;      /* for the player on roll */
+  int fInvert;      /* report results for the player not on roll */
+} trialposition;
+
+/* Everything a trial depends on. */
+typedef struct {
+  rolloutcontext rc; /* nTrials, nGamesDone and stopping rules are unused */
+  guint64 nSeed;
+  unsigned int cPositions;
+  const trialposition *atp;
+} trialjob;
+
+/* Exact partial sums over a set of trials of one position. */
+typedef struct {
+  guint32 cTrials;
+  gint64 anSum[NUM_ROLLOUT_OUTPUTS];   /* sum of outputs * TRIAL_SCALE */
+  gint64 anSumSq[NUM_ROLLOUT_OUTPUTS]; /* sum of squares of the above */
+  rolloutstat ars[2]; /* counts only; the float averages are not kept */
+} trialsums;
+
+/* A half-open range [iFirst, iLast) of trial indices. */
+typedef struct {
+  guint32 iFirst, iLast;
+} trialrange;
+
+/*
+ * Partial results of a rollout job: the trial ranges covered (sorted and
+ * disjoint) and one trialsums per position. nJob identifies the job, so
+ * that shards of different rollouts are never merged.
+ */
+typedef struct {
+  guint64 nJob;
+  guint32 fFlags; /* free for the caller; stored and compared on merge */
+  guint32 cPositions;
+  guint32 cRanges;
+  trialrange *atr;
+  trialsums *ats;
+} trialshard;
+
+/* The dice of turn iTurn in trial iTrial. */
+extern void TrialDice(guint64 nSeed, unsigned int iTrial, unsigned int iTurn,
+                      int fRotate, int fInitial, unsigned int anDice[2]);
+
+/*
+ * Play trial iTrial of position iPosition. arOutput gets the outputs for
+ * the reporting player. With ptj->rc.fCubeful the players double and take
+ * or pass from the second turn on, as RolloutGeneral plays them, and
+ * OUTPUT_CUBEFUL_EQUITY is the cubeful equity at the position's cube
+ * (normalised as GeneralEvaluationE gives it); otherwise it is 0. ars gets
+ * the game statistics (ars[0] for the reporting player): wins and gammons
+ * by final cube, doubles taken and passed, hits, closeouts and bearoff
+ * moves; the averages of the move numbers are not kept.
+ * Returns -1 if an evaluation failed.
+ */
+extern int TrialRollout(const trialjob *ptj, unsigned int iPosition,
+                        unsigned int iTrial,
+                        float arOutput[NUM_ROLLOUT_OUTPUTS],
+                        rolloutstat ars[2]);
+
+extern void TrialSumsAdd(trialsums *pts,
+                         const float arOutput[NUM_ROLLOUT_OUTPUTS],
+                         const rolloutstat ars[2]);
+extern void TrialSumsMerge(trialsums *ptsTo, const trialsums *ptsFrom);
+
+/* Means and standard errors of the means. */
+extern void TrialSumsResult(const trialsums *pts,
+                            float arOutput[NUM_ROLLOUT_OUTPUTS],
+                            float arStdDev[NUM_ROLLOUT_OUTPUTS]);
+
+/* A shard for cPositions positions with no trials yet. */
+extern void TrialShardInit(trialshard *psh, guint64 nJob, guint32 fFlags,
+                           guint32 cPositions);
+extern void TrialShardFree(trialshard *psh);
+
+/* Record that [iFirst, iLast) has been added to psh->ats. */
+extern int TrialShardAddRange(trialshard *psh, guint32 iFirst, guint32 iLast);
+
+/* Trials in psh, counted over its ranges. */
+extern guint32 TrialShardTrials(const trialshard *psh);
+
+/*
+ * Add pshFrom to pshTo. Returns -1 if they belong to different jobs and -2
+ * if their trial ranges overlap; pshTo is unchanged then.
+ */
+extern int TrialShardMerge(trialshard *pshTo, const trialshard *pshFrom);
+
+/* Portable little-endian serialisation. TrialShardRead returns -1 on
+ * malformed input. */
+extern size_t TrialShardSize(const trialshard *psh);
+extern void TrialShardWrite(const trialshard *psh, unsigned char *pb);
+extern int TrialShardRead(trialshard *psh, const unsigned char *pb, size_t cb);
+
+/*
+ * Save psh to szFile atomically (a crash leaves the old file or the new
+ * one), or load it back. TrialShardLoad fails with G_FILE_ERROR_INVAL if
+ * the file is not a shard.
+ */
+extern int TrialShardSave(const trialshard *psh, const char *szFile,
+                          GError **ppError);
+extern int TrialShardLoad(trialshard *psh, const char *szFile,
+                          GError **ppError);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // SRC_GNUBGMODULE_TRIALROLLOUT_H_
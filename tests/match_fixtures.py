@@ -0,0 +1,51 @@
+"""
+Match files shared by the tests of match import, analysis and export.
+"""
+import os
+import tempfile
+import unittest
+import gnubg
+
+ONE_GAME = """ 3 point match
+
+ Game 1
+ Alice : 0                          Bob : 0
+  1) 31: 8/5 6/5                    42: 8/4 6/4
+  2) 65: 24/13                      Doubles => 2
+  3)  Drops                         Wins 1 point
+"""
+
+TWO_GAMES = ONE_GAME + """
+ Game 2
+ Alice : 0                          Bob : 1
+  1) 52: 13/8 13/11                 61: 13/7 8/7
+  2) 43: 24/20 13/10                Doubles => 2
+  3)  Drops                         Wins 1 point
+"""
+
+
+class MatchFileTestCase(unittest.TestCase):
+    """Writes MATCH to self.path in a temporary directory."""
+
+    MATCH = ONE_GAME
+
+    def setUp(self):
+        self.tmpdir = tempfile.TemporaryDirectory()
+        self.path = self.write_match('match.mat')
+
+    def tearDown(self):
+        self.tmpdir.cleanup()
+
+    def write_match(self, name):
+        """Write MATCH to name in the temporary directory; return its path."""
+        path = os.path.join(self.tmpdir.name, name)
+        os.makedirs(os.path.dirname(path), exist_ok=True)
+        with open(path, 'w', encoding='ascii') as f:
+            f.write(self.MATCH)
+        return path
+
+    def import_match(self):
+        """Import self.path into a new engine, self.engine."""
+        self.engine = gnubg.Engine()
+        with self.engine:
+            gnubg.command('import auto "%s"' % self.path)
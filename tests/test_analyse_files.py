@@ -0,0 +1,64 @@
+"""
+Tests for analyse_files(): batch analysis of match files.
+"""
+import os
+import unittest
+import gnubg
+from match_fixtures import MatchFileTestCase
+
+
+class TestAnalyseFiles(MatchFileTestCase):
+    """Test importing and analysing files in sessions of their own."""
+
+    def setUp(self):
+        super().setUp()
+        self.settings = {'chequer': gnubg.evalcontext(0, 0, 1, 0, 0.0),
+                         'cube': gnubg.evalcontext(0, 0, 1, 0, 0.0)}
+
+    def test_analyse_files_results(self):
+        """Test each file yields its match, in order."""
+        results = list(gnubg.analyse_files([self.path, self.path],
+                                           self.settings))
+        self.assertEqual(len(results), 2)
+        for result in results:
+            self.assertEqual(result['path'], self.path)
+            self.assertEqual(result['match']['match-info']['match-length'], 3)
+            self.assertEqual(len(result['match']['games']), 1)
+
+    def test_analyse_files_error(self):
+        """Test a file that cannot be imported yields an error and the
+        batch goes on."""
+        missing = os.path.join(self.tmpdir.name, 'missing.mat')
+        results = list(gnubg.analyse_files([missing, self.path],
+                                           self.settings))
+        self.assertIn('error', results[0])
+        self.assertIn('match', results[1])
+
+    def test_analyse_files_isolated(self):
+        """Test the analysis leaves the current session alone."""
+        engine = gnubg.Engine()
+        with engine:
+            gnubg.command('new match 7')
+            for _ in gnubg.analyse_files([self.path], self.settings):
+                pass
+            self.assertEqual(gnubg.cubeinfo()['matchto'], 7)
+
+    def test_analyse_files_threads(self):
+        """Test threads caps the workers without resizing the pool."""
+        threads = gnubg.get_threads()
+        capped = list(gnubg.analyse_files([self.path], self.settings,
+                                          threads=1))
+        self.assertEqual(gnubg.get_threads(), threads)
+        self.assertEqual(capped,
+                         list(gnubg.analyse_files([self.path], self.settings)))
+        with self.assertRaises(ValueError):
+            gnubg.analyse_files([self.path], self.settings, threads=-1)
+
+    def test_analyse_files_bad_settings(self):
+        """Test unknown analysis settings raise ValueError."""
+        with self.assertRaises(ValueError):
+            gnubg.analyse_files([self.path], {'plies': 2})
+
+
+if __name__ == '__main__':
+    unittest.main()
@@ -0,0 +1,128 @@
+"""
+Tests for analyse_match(): match analysis reusing stored results.
+"""
+import unittest
+import gnubg
+from match_fixtures import ONE_GAME
+
+MATCH = ONE_GAME.encode('ascii')
+
+
+class TestAnalyseMatch(unittest.TestCase):
+    """Test the current match is analysed incrementally."""
+
+    def setUp(self):
+        self.engine = gnubg.Engine()
+        with self.engine:
+            gnubg.import_bytes(MATCH)
+
+    def analysis(self):
+        with self.engine:
+            m = gnubg.match()
+        return [r.get('analysis') for r in m['games'][0]['game']]
+
+    def test_analyse_match(self):
+        """Test analysing without a store analyses every record."""
+        with self.engine:
+            result = gnubg.analyse_match()
+            self.assertEqual(result['checksum'], gnubg.matchchecksum())
+        self.assertEqual(result['reused'], 0)
+        self.assertEqual(result['analysed'], result['records'])
+        moves = [a for a in self.analysis() if a and 'error' in a]
+        self.assertTrue(moves)
+
+    def test_analyse_match_store(self):
+        """Test a second run reuses everything the first one stored."""
+        store = {}
+        with self.engine:
+            first = gnubg.analyse_match(store)
+        self.assertTrue(store)
+        self.assertEqual(first['reused'], 0)
+        expected = self.analysis()
+
+        engine = gnubg.Engine()
+        with engine:
+            gnubg.import_bytes(MATCH)
+            second = gnubg.analyse_match(store=store)
+            m = gnubg.match()
+        self.assertEqual(second['records'], first['records'])
+        self.assertEqual(second['reused'], len(store))
+        self.assertEqual(second['checksum'], first['checksum'])
+        self.assertEqual([r.get('analysis') for r in m['games'][0]['game']],
+                         expected)
+
+    def test_analyse_match_luck_setting(self):
+        """Test a different luck analysis evalcontext reuses nothing."""
+        store = {}
+        with self.engine:
+            gnubg.analyse_match(store)
+            gnubg.command('set analysis luckanalysis plies 1')
+            result = gnubg.analyse_match(store)
+        self.assertEqual(result['reused'], 0)
+
+    def test_analyse_match_bad_blob(self):
+        """Test values that are not blobs are analysed again."""
+        store = {}
+        with self.engine:
+            gnubg.analyse_match(store)
+            for key in store:
+                store[key] = b'x'
+            result = gnubg.analyse_match(store)
+        self.assertEqual(result['reused'], 0)
+        self.assertTrue(all(len(v) > 1 for v in store.values()))
+
+    def test_analyse_match_callback_order(self):
+        """Test the callback sees every record once, in match order."""
+        seen = []
+        with self.engine:
+            result = gnubg.analyse_match(
+                callback=lambda game, record, analysis:
+                seen.append((game, record, analysis)))
+        self.assertEqual([(g, r) for g, r, _ in seen],
+                         [(0, i) for i in range(result['records'])])
+        self.assertEqual([a or None for _, _, a in seen], self.analysis())
+
+    def test_analyse_match_callback_error(self):
+        """Test an exception in the callback stops the analysis."""
+        def callback(game, record, analysis):
+            raise KeyError(record)
+        with self.engine:
+            with self.assertRaises(KeyError):
+                gnubg.analyse_match(callback=callback)
+
+    def test_analyse_match_callback_reentry(self):
+        """Test gnubg calls from the callback raise instead of deadlocking."""
+        def callback(game, record, analysis):
+            gnubg.command('new match 5')
+        with self.engine:
+            with self.assertRaises(RuntimeError):
+                gnubg.analyse_match(callback=callback)
+            self.assertEqual(gnubg.cubeinfo()['matchto'], 3)
+
+    def test_analyse_match_quick(self):
+        """Test quick analysis is stored apart from the full one."""
+        store = {}
+        with self.engine:
+            quick = gnubg.analyse_match(store, quick=True)
+            stored = len(store)
+            full = gnubg.analyse_match(store)
+            again = gnubg.analyse_match(store, quick=True)
+        self.assertEqual(quick['analysed'], quick['records'])
+        self.assertEqual(full['reused'], 0)
+        self.assertEqual(len(store), 2 * stored)
+        self.assertEqual(again['reused'], stored)
+
+    def test_analyse_match_errors(self):
+        """Test a missing match and a bad store are rejected."""
+        with gnubg.Engine():
+            with self.assertRaises(ValueError):
+                gnubg.analyse_match()
+        with self.engine:
+            with self.assertRaises(TypeError):
+                gnubg.analyse_match(store=42)
+            with self.assertRaises(TypeError):
+                gnubg.analyse_match(callback=42)
+
+
+if __name__ == '__main__':
+    unittest.main()
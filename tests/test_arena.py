@@ -0,0 +1,62 @@
+"""
+Tests for the per-thread search arena statistics.
+"""
+import unittest
+import gnubg
+
+
+class TestArenaStats(unittest.TestCase):
+    """Test arenastats() and that top-k searches use the arena."""
+
+    def setUp(self):
+        self.board = (
+            (0, 2, 0, 0, 0, 0, 5, 0, 3, 0, 0, 0, 5, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0),
+            (0, 2, 0, 0, 0, 0, 5, 0, 3, 0, 0, 0, 5, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0)
+        )
+        gnubg.setcachesize(0)
+
+    def tearDown(self):
+        gnubg.setcachesize(256)
+
+    def test_arenastats_keys(self):
+        """Test arenastats returns the expected counters."""
+        stats = gnubg.arenastats()
+        for key in ('arenas', 'chunks', 'reserved', 'peak', 'allocations',
+                    'allocated', 'resets', 'chunkallocations'):
+            self.assertIn(key, stats)
+            self.assertGreaterEqual(stats[key], 0)
+
+    def test_topk_uses_arena(self):
+        """Test a top-k search allocates from and resets an arena."""
+        before = gnubg.arenastats()
+        ec = gnubg.evalcontext(1, 1, 1, 0, 0.0)
+        for _ in range(3):
+            gnubg.hintmoves(self.board, (6, 6), None, ec, None, -1, 1)
+        after = gnubg.arenastats()
+        self.assertGreaterEqual(after['resets'], before['resets'] + 3)
+        self.assertGreater(after['allocations'], before['allocations'])
+        self.assertGreaterEqual(after['arenas'], 1)
+        self.assertGreater(after['reserved'], 0)
+
+    def test_topk_order_is_stable(self):
+        """Test repeated top-k searches return the same moves in order."""
+        ec = gnubg.evalcontext(0, 0, 0, 0, 0.0)
+        first = gnubg.hintmoves(self.board, (2, 1), None, ec, None, -1, 5)
+        second = gnubg.hintmoves(self.board, (2, 1), None, ec, None, -1, 5)
+        self.assertEqual([m['move'] for m in first],
+                         [m['move'] for m in second])
+
+    def test_findbestmoves_uses_arena(self):
+        """Test findbestmoves sorts its moves in arena scratch space."""
+        before = gnubg.arenastats()
+        ci = gnubg.cubeinfo(1, -1, 0, 0, (0, 0), 0)
+        ec = gnubg.evalcontext(0, 0, 0, 0, 0.0)
+        moves = gnubg.findbestmoves(self.board, ci, ec, (3, 1))
+        after = gnubg.arenastats()
+        self.assertGreater(after['allocations'], before['allocations'])
+        scores = [m['score'] for m in moves]
+        self.assertEqual(scores, sorted(scores, reverse=True))
+
+
+if __name__ == '__main__':
+    unittest.main()
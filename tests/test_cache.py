@@ -0,0 +1,101 @@
+"""
+Tests for the move list and evaluation result caches.
+"""
+import unittest
+import gnubg
+
+
+class TestResultCache(unittest.TestCase):
+    """Test cache control functions and cache hits."""
+
+    def setUp(self):
+        self.board = (
+            (0, 2, 0, 0, 0, 0, 5, 0, 3, 0, 0, 0, 5, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0),
+            (0, 2, 0, 0, 0, 0, 5, 0, 3, 0, 0, 0, 5, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0)
+        )
+        self.evalcontext = gnubg.evalcontext(1, 0, 1, 0, 0.0)
+        gnubg.setcachesize(256)
+        gnubg.clearcache()
+
+    def test_cache_functions_exist(self):
+        """Test that the cache control functions exist."""
+        self.assertTrue(callable(gnubg.setcachesize))
+        self.assertTrue(callable(gnubg.cachestats))
+        self.assertTrue(callable(gnubg.clearcache))
+
+    def test_cache_functions_take_no_arguments(self):
+        """Test cachestats and clearcache reject arguments."""
+        with self.assertRaises(TypeError):
+            gnubg.cachestats(1)
+        with self.assertRaises(TypeError):
+            gnubg.clearcache(1)
+
+    def test_cachestats_keys(self):
+        """Test cachestats reports both caches."""
+        stats = gnubg.cachestats()
+        for cache in ('moves', 'evaluations'):
+            self.assertIn(cache, stats)
+            for key in ('size', 'capacity', 'hits', 'misses', 'evictions'):
+                self.assertIn(key, stats[cache])
+        self.assertEqual(stats['moves']['capacity'], 256)
+
+    def test_hintmoves_hit(self):
+        """Test a repeated search is served from the cache."""
+        first = gnubg.hintmoves(self.board, (3, 1), None, self.evalcontext)
+        hits = gnubg.cachestats()['moves']['hits']
+        second = gnubg.hintmoves(self.board, (1, 3), None, self.evalcontext)
+        self.assertEqual(gnubg.cachestats()['moves']['hits'], hits + 1)
+        self.assertEqual(first, second)
+
+    def test_evaluate_hit(self):
+        """Test a repeated evaluation is served from the cache."""
+        ci = gnubg.cubeinfo(1, -1, 0, 0, (0, 0), 0)
+        first = gnubg.evaluate(self.board, ci, self.evalcontext)
+        stats = gnubg.cachestats()['evaluations']
+        second = gnubg.evaluate(self.board, ci, self.evalcontext)
+        self.assertEqual(gnubg.cachestats()['evaluations']['hits'],
+                         stats['hits'] + 1)
+        self.assertEqual(first, second)
+
+    def test_met_in_key(self):
+        """Test a match equity table change misses instead of hitting."""
+        ci = gnubg.cubeinfo(1, -1, 0, 5, (0, 2), 0)
+        gnubg.evaluate(self.board, ci, self.evalcontext)
+        stats = gnubg.cachestats()['evaluations']
+        gnubg.command('set invert matchequitytable on')
+        try:
+            gnubg.evaluate(self.board, ci, self.evalcontext)
+        finally:
+            gnubg.command('set invert matchequitytable off')
+        after = gnubg.cachestats()['evaluations']
+        self.assertEqual(after['hits'], stats['hits'])
+        self.assertEqual(after['misses'], stats['misses'] + 1)
+        gnubg.evaluate(self.board, ci, self.evalcontext)
+        self.assertEqual(gnubg.cachestats()['evaluations']['hits'],
+                         stats['hits'] + 1)
+
+    def test_eviction(self):
+        """Test the cache never grows beyond its capacity."""
+        gnubg.setcachesize(2)
+        for dice in ((1, 2), (3, 4), (5, 6), (6, 6)):
+            gnubg.hintmoves(self.board, dice, None, self.evalcontext)
+        stats = gnubg.cachestats()['moves']
+        self.assertEqual(stats['size'], 2)
+        self.assertGreaterEqual(stats['evictions'], 2)
+
+    def test_disabled(self):
+        """Test capacity 0 disables caching."""
+        gnubg.setcachesize(0)
+        gnubg.hintmoves(self.board, (3, 1), None, self.evalcontext)
+        gnubg.hintmoves(self.board, (3, 1), None, self.evalcontext)
+        stats = gnubg.cachestats()['moves']
+        self.assertEqual(stats['size'], 0)
+
+    def test_invalid_size(self):
+        """Test a negative size is rejected."""
+        with self.assertRaises(ValueError):
+            gnubg.setcachesize(-1)
+
+
+if __name__ == '__main__':
+    unittest.main()
@@ -0,0 +1,135 @@
+"""
+Tests for CancelToken: per-call cancellation and deadlines.
+"""
+import threading
+import time
+import unittest
+import gnubg
+
+
+def context(trials, seed=3):
+    """Cubeless rollout truncated after 4 plies."""
+    return gnubg.rolloutcontext(0, 0, 0, 1, 0, 1, 4, 1, 1, 0, trials, seed,
+                                trials, 0, 5, trials, 0.01, 2.33)
+
+
+class TestCancel(unittest.TestCase):
+    """Test that tokens stop the calls made under them, and only those."""
+
+    def setUp(self):
+        self.start_board = (
+            (0, 2, 0, 0, 0, 0, 5, 0, 3, 0, 0, 0, 5, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0),
+            (0, 2, 0, 0, 0, 0, 5, 0, 3, 0, 0, 0, 5, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0)
+        )
+        self.cubeinfo = gnubg.cubeinfo(1, -1, 0, 0, (0, 0), 0)
+
+    def test_token_state(self):
+        """Test cancel() and an expired deadline mark a token cancelled."""
+        token = gnubg.CancelToken()
+        self.assertFalse(token.cancelled())
+        token.cancel()
+        self.assertTrue(token.cancelled())
+        self.assertTrue(gnubg.CancelToken(timeout=0).cancelled())
+        self.assertFalse(gnubg.CancelToken(timeout=60).cancelled())
+        with self.assertRaises(ValueError):
+            gnubg.CancelToken(timeout=-1)
+
+    def test_cancelled_token_raises(self):
+        """Test a call under a cancelled token raises CancelledError."""
+        token = gnubg.CancelToken()
+        token.cancel()
+        with token:
+            with self.assertRaises(gnubg.CancelledError):
+                gnubg.cubedecisions([(self.start_board, self.cubeinfo)] * 4)
+        # Calls outside the block are not affected.
+        self.assertEqual(
+            len(gnubg.cubedecisions([(self.start_board, self.cubeinfo)])), 1)
+
+    def test_cancelled_token_stops_evaluate(self):
+        """Test evaluate honours a cancelled token."""
+        token = gnubg.CancelToken()
+        token.cancel()
+        with token:
+            with self.assertRaises(gnubg.CancelledError):
+                gnubg.evaluate(self.start_board, self.cubeinfo)
+        self.assertEqual(len(gnubg.evaluate(self.start_board, self.cubeinfo)),
+                         6)
+
+    def test_deadline_raises_timeout(self):
+        """Test a rollout past its deadline stops with TimeoutError."""
+        start = time.monotonic()
+        with gnubg.CancelToken(timeout=0.2):
+            with self.assertRaises(TimeoutError):
+                gnubg.rolloutshard(self.start_board, self.cubeinfo,
+                                   context(1000000), last=1000000)
+        self.assertLess(time.monotonic() - start, 30)
+
+    def test_cancel_from_other_thread(self):
+        """Test cancel() from another thread stops a running rollout."""
+        token = gnubg.CancelToken()
+        timer = threading.Timer(0.2, token.cancel)
+        timer.start()
+        try:
+            with token:
+                with self.assertRaises(gnubg.CancelledError):
+                    gnubg.rollout(self.start_board, self.cubeinfo,
+                                  context(1000000), deterministic=True)
+        finally:
+            timer.cancel()
+
+    def test_cancel_findbestmoves_from_other_thread(self):
+        """Test cancel() from another thread stops a deep move search."""
+        token = gnubg.CancelToken()
+        timer = threading.Timer(0.2, token.cancel)
+        start = time.monotonic()
+        timer.start()
+        try:
+            with token:
+                with self.assertRaises(gnubg.CancelledError):
+                    gnubg.findbestmoves(self.start_board, self.cubeinfo,
+                                        gnubg.evalcontext(0, 4, 0, 0, 0.0),
+                                        (3, 1))
+        finally:
+            timer.cancel()
+        self.assertLess(time.monotonic() - start, 30)
+
+    def test_cancel_leaves_other_threads_running(self):
+        """Test a cancelled call does not make other threads' calls fail."""
+        errors = []
+        done = threading.Event()
+        ec = gnubg.evalcontext(0, 1, 1, 0, 0.0)
+
+        def other():
+            try:
+                while not done.is_set():
+                    gnubg.hintmoves(self.start_board, (5, 2), None, ec)
+                    gnubg.cubedecisions([(self.start_board, self.cubeinfo)])
+            except Exception as e:  # pylint: disable=broad-except
+                errors.append(e)
+
+        thread = threading.Thread(target=other)
+        thread.start()
+        try:
+            for _ in range(5):
+                with gnubg.CancelToken(timeout=0.05):
+                    with self.assertRaises(TimeoutError):
+                        gnubg.findbestmoves(self.start_board, self.cubeinfo,
+                                            gnubg.evalcontext(0, 4, 0, 0, 0.0),
+                                            (3, 1))
+        finally:
+            done.set()
+            thread.join()
+        self.assertEqual(errors, [])
+
+    def test_tokens_independent(self):
+        """Test cancelling one token leaves calls under another running."""
+        first, second = gnubg.CancelToken(), gnubg.CancelToken()
+        first.cancel()
+        with second:
+            result = gnubg.rollout(self.start_board, self.cubeinfo,
+                                   context(72), deterministic=True)
+        self.assertEqual(result['trials'], 72)
+
+
+if __name__ == '__main__':
+    unittest.main()
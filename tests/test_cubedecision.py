@@ -0,0 +1,69 @@
+"""
+Tests for cubedecision() and the batched cubedecisions().
+"""
+import unittest
+import gnubg
+
+
+class TestCubeDecision(unittest.TestCase):
+    """Test cube analysis for single positions and batches."""
+
+    def setUp(self):
+        self.start_board = (
+            (0, 2, 0, 0, 0, 0, 5, 0, 3, 0, 0, 0, 5, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0),
+            (0, 2, 0, 0, 0, 0, 5, 0, 3, 0, 0, 0, 5, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0)
+        )
+        # Player on roll has two checkers left on the ace point, opponent
+        # has not started bearing off: a clear double and pass.
+        self.race_board = (
+            (0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 15, 0, 0, 0, 0, 0, 0),
+            (2, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0)
+        )
+        self.cubeinfo = gnubg.cubeinfo(1, -1, 0, 0, (0, 0), 0)
+        self.evalcontext = gnubg.evalcontext(1, 0, 1, 0, 0.0)
+
+    def test_cubedecision_exists(self):
+        """Test that cubedecision and cubedecisions exist."""
+        self.assertTrue(callable(gnubg.cubedecision))
+        self.assertTrue(callable(gnubg.cubedecisions))
+
+    def test_cubedecision_keys(self):
+        """Test cubedecision returns equities and the recommended action."""
+        cd = gnubg.cubedecision(self.start_board, self.cubeinfo, self.evalcontext)
+        self.assertIsInstance(cd, dict)
+        for key in ('nodouble', 'take', 'pass', 'optimal', 'decision',
+                    'recommendation', 'double', 'takes', 'probs'):
+            self.assertIn(key, cd)
+        self.assertIsInstance(cd['recommendation'], str)
+        self.assertEqual(len(cd['probs']), 5)
+        self.assertFalse(cd['double'])
+
+    def test_cubedecision_double_pass(self):
+        """Test a trivially won race is a double and pass."""
+        cd = gnubg.cubedecision(self.race_board, self.cubeinfo, self.evalcontext)
+        self.assertFalse(cd['takes'])
+        self.assertAlmostEqual(cd['pass'], 1.0, places=3)
+
+    def test_cubedecisions_matches_single(self):
+        """Test the batch variant returns the same results in order."""
+        positions = [(self.start_board, self.cubeinfo),
+                     (self.race_board, self.cubeinfo)] * 4
+        batch = gnubg.cubedecisions(positions, self.evalcontext)
+        self.assertEqual(len(batch), len(positions))
+        for (board, ci), cd in zip(positions, batch):
+            single = gnubg.cubedecision(board, ci, self.evalcontext)
+            self.assertEqual(cd['decision'], single['decision'])
+            self.assertAlmostEqual(cd['optimal'], single['optimal'], places=5)
+
+    def test_cubedecisions_empty(self):
+        """Test an empty batch returns an empty list."""
+        self.assertEqual(gnubg.cubedecisions([]), [])
+
+    def test_cubedecisions_invalid(self):
+        """Test a malformed batch entry raises TypeError."""
+        with self.assertRaises(TypeError):
+            gnubg.cubedecisions([self.start_board])
+
+
+if __name__ == '__main__':
+    unittest.main()
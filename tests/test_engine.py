@@ -0,0 +1,126 @@
+"""
+Tests for gnubg.Engine: sessions with their own match and settings.
+"""
+import threading
+import unittest
+import gnubg
+
+
+class TestEngine(unittest.TestCase):
+    """Test that engines keep their state apart."""
+
+    def test_engine_context(self):
+        """Test an engine is a context manager returning itself."""
+        engine = gnubg.Engine()
+        with engine as entered:
+            self.assertIs(entered, engine)
+
+    def test_engines_isolated(self):
+        """Test a match started in one engine is not seen by another."""
+        first, second = gnubg.Engine(), gnubg.Engine()
+        with first:
+            gnubg.command('new match 3')
+            self.assertEqual(gnubg.cubeinfo()['matchto'], 3)
+        with second:
+            self.assertEqual(gnubg.cubeinfo()['matchto'], 0)
+            gnubg.command('new match 7')
+        with first:
+            self.assertEqual(gnubg.cubeinfo()['matchto'], 3)
+        with second:
+            self.assertEqual(gnubg.cubeinfo()['matchto'], 7)
+
+    def test_engine_settings_isolated(self):
+        """Test settings changed in an engine stay in that engine."""
+        before = gnubg.show('jacoby')  # on by default
+        engine = gnubg.Engine()
+        with engine:
+            gnubg.command('set jacoby off')
+            changed = gnubg.show('jacoby')
+        self.assertNotEqual(changed, before)
+        self.assertEqual(gnubg.show('jacoby'), before)
+        with gnubg.Engine():
+            self.assertEqual(gnubg.show('jacoby'), before)
+        with engine:
+            self.assertEqual(gnubg.show('jacoby'), changed)
+
+    def test_engine_dice_isolated(self):
+        """Test an engine's seed does not move another engine's dice."""
+        first, second = gnubg.Engine(), gnubg.Engine()
+        with first:
+            gnubg.command('set seed 11')
+            expected = gnubg.dicerolls(10)
+            gnubg.command('set seed 11')
+        with second:
+            gnubg.command('set seed 12')
+            gnubg.dicerolls(10)
+        with first:
+            self.assertEqual(gnubg.dicerolls(10), expected)
+
+    def test_engine_nesting(self):
+        """Test nested engines restore the outer one on exit."""
+        outer, inner = gnubg.Engine(), gnubg.Engine()
+        with outer:
+            gnubg.command('new match 5')
+            with inner:
+                self.assertEqual(gnubg.cubeinfo()['matchto'], 0)
+            self.assertEqual(gnubg.cubeinfo()['matchto'], 5)
+
+    def test_engine_evalcontext_default(self):
+        """Test the engine's evalcontext is used when none is given."""
+        board = (
+            (0, 2, 0, 0, 0, 0, 5, 0, 3, 0, 0, 0, 5, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0),
+            (0, 2, 0, 0, 0, 0, 5, 0, 3, 0, 0, 0, 5, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0)
+        )
+        ci = gnubg.cubeinfo(1, -1, 0, 0, (0, 0), 0)
+        ec = gnubg.evalcontext(0, 1, 1, 0, 0.0)
+        with gnubg.Engine(evalcontext=ec):
+            implicit = gnubg.evaluate(board, ci)
+        self.assertEqual(implicit, gnubg.evaluate(board, ci, ec))
+
+    def test_engine_hintmoves_default(self):
+        """Test hintmoves takes the engine's evalcontext when none is given."""
+        board = (
+            (0, 2, 0, 0, 0, 0, 5, 0, 3, 0, 0, 0, 5, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0),
+            (0, 2, 0, 0, 0, 0, 5, 0, 3, 0, 0, 0, 5, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0)
+        )
+        ec = gnubg.evalcontext(0, 1, 1, 0, 0.0)
+        with gnubg.Engine(evalcontext=ec):
+            implicit = gnubg.hintmoves(board, (3, 1))
+        self.assertEqual(implicit, gnubg.hintmoves(board, (3, 1), None, ec))
+
+    def test_engines_in_threads(self):
+        """Test engines used from several threads keep their own matches."""
+        errors = []
+
+        def session(length):
+            engine = gnubg.Engine()
+            try:
+                for _ in range(5):
+                    with engine:
+                        gnubg.command('new match %d' % length)
+                        if gnubg.cubeinfo()['matchto'] != length:
+                            errors.append(length)
+            except Exception as exc:  # pylint: disable=broad-except
+                errors.append(exc)
+
+        threads = [threading.Thread(target=session, args=(n,))
+                   for n in (1, 3, 5, 7)]
+        for thread in threads:
+            thread.start()
+        for thread in threads:
+            thread.join()
+        self.assertEqual(errors, [])
+
+    def test_engine_exit_order(self):
+        """Test leaving an engine that is not innermost raises."""
+        outer, inner = gnubg.Engine(), gnubg.Engine()
+        outer.__enter__()
+        inner.__enter__()
+        with self.assertRaises(RuntimeError):
+            outer.__exit__(None, None, None)
+        inner.__exit__(None, None, None)
+        outer.__exit__(None, None, None)
+
+
+if __name__ == '__main__':
+    unittest.main()
@@ -0,0 +1,75 @@
+"""
+Tests for export_files(): batch export of match files.
+"""
+import os
+import unittest
+import gnubg
+from match_fixtures import MatchFileTestCase
+
+
+class TestExportFiles(MatchFileTestCase):
+    """Test each file is exported to the folder, in a session of its own."""
+
+    def setUp(self):
+        super().setUp()
+        self.paths = [self.write_match(os.path.join(name, 'match.mat'))
+                      for name in ('a', 'b')]
+        self.folder = os.path.join(self.tmpdir.name, 'out')
+
+    def test_formats(self):
+        """Test every format writes one file per match, named after it."""
+        for fmt, ext in (('html', 'html'), ('latex', 'tex'), ('text', 'txt')):
+            results = list(gnubg.export_files(self.paths, self.folder,
+                                              format=fmt))
+            self.assertEqual([r['path'] for r in results], self.paths)
+            outputs = [r['output'] for r in results]
+            self.assertEqual([os.path.basename(o) for o in outputs],
+                             ['match.' + ext, 'match-2.' + ext])
+            for output in outputs:
+                self.assertTrue(os.path.getsize(output) > 0, output)
+
+    def test_picture_url(self):
+        """Test HTML pages take their board images from picture_url."""
+        result = next(gnubg.export_files(self.paths[:1], self.folder,
+                                         picture_url='../boards/'))
+        with open(result['output'], encoding='utf-8',
+                  errors='replace') as f:
+            self.assertIn('../boards/', f.read())
+
+    def test_bad_file(self):
+        """Test a file that cannot be imported is reported, not raised."""
+        bad = os.path.join(self.tmpdir.name, 'bad.mat')
+        with open(bad, 'w', encoding='ascii') as f:
+            f.write('not a match\n')
+        results = list(gnubg.export_files([bad] + self.paths[:1],
+                                          self.folder))
+        self.assertIn('error', results[0])
+        self.assertIn('output', results[1])
+
+    def test_stale_output_replaced(self):
+        """Test a file left in the folder by an earlier run is replaced."""
+        os.makedirs(self.folder)
+        stale = os.path.join(self.folder, 'match.txt')
+        with open(stale, 'w', encoding='ascii') as f:
+            f.write('stale\n')
+        result = next(gnubg.export_files(self.paths[:1], self.folder,
+                                         format='text'))
+        self.assertEqual(result['output'], stale)
+        with open(stale, encoding='utf-8', errors='replace') as f:
+            self.assertNotEqual(f.read(), 'stale\n')
+
+    def test_current_match_kept(self):
+        """Test the current session's match is left alone."""
+        gnubg.command('new match 5')
+        before = gnubg.match(analysis=0)
+        list(gnubg.export_files(self.paths, self.folder))
+        self.assertEqual(gnubg.match(analysis=0), before)
+
+    def test_unknown_format(self):
+        """Test an unknown format is rejected."""
+        with self.assertRaises(ValueError):
+            gnubg.export_files(self.paths, self.folder, format='pdf')
+
+
+if __name__ == '__main__':
+    unittest.main()
@@ -0,0 +1,154 @@
+"""
+Tests for the stateless hintmoves() API.
+"""
+import random
+import threading
+import unittest
+import gnubg
+
+
+def selfplay_positions(n, seed=1):
+    """Return n (board, dice) pairs reached by 0-ply self-play."""
+    rng = random.Random(seed)
+    ec0 = gnubg.evalcontext(1, 0, 0, 0, 0.0)
+    out = []
+    while len(out) < n:
+        board = gnubg.positionfromid('4HPwATDgc/ABMA')
+        while board is not None and len(out) < n:
+            dice = (rng.randint(1, 6), rng.randint(1, 6))
+            moves = gnubg.hintmoves(board, dice, None, ec0, None, 1)
+            if not moves or not moves[0]['move']:
+                board = (board[1], board[0])
+                continue
+            out.append((board, dice))
+            me, opp = list(board[1]), list(board[0])
+            move = moves[0]['move']
+            for i in range(0, len(move), 2):
+                me[move[i] - 1] -= 1
+                if move[i + 1]:
+                    me[move[i + 1] - 1] += 1
+                    if opp[24 - move[i + 1]] == 1:
+                        opp[24 - move[i + 1]] = 0
+                        opp[24] += 1
+            board = (tuple(me), tuple(opp)) if sum(me) else None
+    return out
+
+
+class TestHintMoves(unittest.TestCase):
+    """Test chequer play hints for explicit positions."""
+
+    def setUp(self):
+        self.board = (
+            (0, 2, 0, 0, 0, 0, 5, 0, 3, 0, 0, 0, 5, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0),
+            (0, 2, 0, 0, 0, 0, 5, 0, 3, 0, 0, 0, 5, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0)
+        )
+        self.evalcontext = gnubg.evalcontext(1, 0, 0, 0, 0.0)
+
+    def test_hintmoves_exists(self):
+        """Test that hintmoves exists."""
+        self.assertTrue(callable(gnubg.hintmoves))
+
+    def test_hintmoves_result(self):
+        """Test hintmoves returns moves best first."""
+        moves = gnubg.hintmoves(self.board, (3, 1), None, self.evalcontext)
+        self.assertIsInstance(moves, list)
+        self.assertGreater(len(moves), 0)
+        for key in ('move', 'movestr', 'equity', 'eqdiff', 'probs', 'plies'):
+            self.assertIn(key, moves[0])
+        self.assertEqual(moves[0]['eqdiff'], 0.0)
+        for a, b in zip(moves, moves[1:]):
+            self.assertGreaterEqual(a['equity'], b['equity'])
+
+    def test_hintmoves_maxmoves(self):
+        """Test maxmoves limits the number of returned moves."""
+        moves = gnubg.hintmoves(self.board, (6, 5), None, self.evalcontext,
+                                None, 2)
+        self.assertLessEqual(len(moves), 2)
+
+    def test_hintmoves_matches_findbestmove(self):
+        """Test the best hint agrees with findbestmove."""
+        ci = gnubg.cubeinfo(1, -1, 0, 0, (0, 0), 0)
+        moves = gnubg.hintmoves(self.board, (4, 2), ci, self.evalcontext)
+        best = gnubg.findbestmove(self.board, ci, self.evalcontext, (4, 2))
+        self.assertEqual(moves[0]['move'], best)
+
+    def test_hintmoves_no_match_state(self):
+        """Test hintmoves works without a current match and leaves it alone."""
+        before = gnubg.board()
+        gnubg.hintmoves(self.board, (3, 1), None, self.evalcontext)
+        self.assertEqual(gnubg.board(), before)
+
+    def test_hintmoves_threads(self):
+        """Test concurrent calls return the same result."""
+        results = []
+
+        def worker():
+            results.append(gnubg.hintmoves(self.board, (5, 2), None,
+                                           self.evalcontext, None, 1))
+
+        threads = [threading.Thread(target=worker) for _ in range(4)]
+        for t in threads:
+            t.start()
+        for t in threads:
+            t.join()
+        self.assertEqual(len(results), 4)
+        for r in results:
+            self.assertEqual(r[0]['move'], results[0][0]['move'])
+
+    def test_hintmoves_topk(self):
+        """Test the top-k search returns at most k moves led by the best."""
+        ec = gnubg.evalcontext(1, 1, 1, 0, 0.0)
+        full = gnubg.hintmoves(self.board, (6, 4), None, ec)
+        for k in (1, 3):
+            top = gnubg.hintmoves(self.board, (6, 4), None, ec, None, -1, k)
+            self.assertLessEqual(len(top), k)
+            self.assertEqual(top[0]['move'], full[0]['move'])
+            self.assertAlmostEqual(top[0]['equity'], full[0]['equity'],
+                                   places=5)
+
+    def test_hintmoves_topk_corpus(self):
+        """Test the approximate top-k search mostly agrees with the full one.
+
+        Pruning assumes no move gains more than the filter threshold from
+        one ply to the next, so a few positions may pick another move, but
+        every move it returns is scored as the full search scores it.
+        """
+        ec = gnubg.evalcontext(1, 1, 0, 0, 0.0)
+        samples = selfplay_positions(40)
+        same = 0
+        for board, dice in samples:
+            full = gnubg.hintmoves(board, dice, None, ec)
+            top = gnubg.hintmoves(board, dice, None, ec, None, -1, 3)
+            self.assertLessEqual(len(top), 3)
+            equities = {tuple(m['move']): m['equity'] for m in full}
+            for m in top:
+                if tuple(m['move']) in equities:
+                    self.assertAlmostEqual(m['equity'],
+                                           equities[tuple(m['move'])],
+                                           places=5)
+            same += top[0]['move'] == full[0]['move']
+        self.assertGreaterEqual(same, 0.9 * len(samples))
+
+    def test_hintmoves_topk_invalid(self):
+        """Test a negative k is rejected."""
+        with self.assertRaises(ValueError):
+            gnubg.hintmoves(self.board, (6, 4), None, None, None, -1, -1)
+
+    def test_hintmoves_bearoff(self):
+        """Test bear-off moves keep their last step, reported as point 0."""
+        board = (
+            (0, 0, 0, 0, 0, 5, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0),
+            (1, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0)
+        )
+        moves = gnubg.hintmoves(board, (6, 5), None, self.evalcontext)
+        self.assertEqual(len(moves), 1)
+        self.assertEqual(sorted(moves[0]['move']), [0, 0, 1, 2])
+
+    def test_hintmoves_invalid_dice(self):
+        """Test invalid dice are rejected."""
+        with self.assertRaises(ValueError):
+            gnubg.hintmoves(self.board, (0, 7))
+
+
+if __name__ == '__main__':
+    unittest.main()
@@ -0,0 +1,55 @@
+"""
+Tests for import_bytes(): importing matches from memory.
+"""
+import unittest
+import gnubg
+from match_fixtures import ONE_GAME
+
+MATCH = ONE_GAME.encode('ascii')
+
+
+class TestImportBytes(unittest.TestCase):
+    """Test matches are read from bytes-like objects."""
+
+    def setUp(self):
+        self.engine = gnubg.Engine()
+
+    def test_import_bytes_mat(self):
+        """Test a .mat match is imported into the current session."""
+        with self.engine:
+            self.assertIsNone(gnubg.import_bytes(MATCH))
+            m = gnubg.match()
+        self.assertEqual(m['match-info']['match-length'], 3)
+        self.assertEqual(len(m['games']), 1)
+
+    def test_import_bytes_buffer_types(self):
+        """Test bytearray and memoryview are accepted."""
+        for data in (bytearray(MATCH), memoryview(MATCH)):
+            with gnubg.Engine():
+                gnubg.import_bytes(data, format='mat')
+                self.assertEqual(len(gnubg.match()['games']), 1)
+
+    def test_import_bytes_replaces_match(self):
+        """Test importing twice leaves only the second match."""
+        with self.engine:
+            gnubg.import_bytes(MATCH)
+            gnubg.import_bytes(MATCH.replace(b' 3 point', b' 5 point'))
+            m = gnubg.match()
+        self.assertEqual(m['match-info']['match-length'], 5)
+        self.assertEqual(len(m['games']), 1)
+
+    def test_import_bytes_errors(self):
+        """Test bad input raises ValueError."""
+        with self.engine:
+            with self.assertRaises(ValueError):
+                gnubg.import_bytes(MATCH, format='doc')
+            with self.assertRaises(ValueError):
+                gnubg.import_bytes(b'')
+            with self.assertRaises(ValueError):
+                gnubg.import_bytes(b'not a match file\n')
+        with self.assertRaises(TypeError):
+            gnubg.import_bytes(MATCH.decode('ascii'))
+
+
+if __name__ == '__main__':
+    unittest.main()
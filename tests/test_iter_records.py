@@ -0,0 +1,88 @@
+"""
+Tests for iter_records(): lazy iteration over the match records.
+"""
+import unittest
+import gnubg
+from match_fixtures import TWO_GAMES, MatchFileTestCase
+
+FIELDS = ('action', 'player', 'dice', 'move', 'board', 'comment', 'points',
+          'cube')
+
+
+class TestIterRecords(MatchFileTestCase):
+    """Test iter_records yields what match() reports, record by record."""
+
+    MATCH = TWO_GAMES
+
+    def setUp(self):
+        super().setUp()
+        self.import_match()
+
+    def test_iter_records_matches_match(self):
+        """Test each record agrees with the dict from match()."""
+        with self.engine:
+            games = gnubg.match(analysis=0, boards=1)['games']
+            records = list(gnubg.iter_records(boards=True))
+        self.assertEqual(len(records),
+                         sum(len(g['game']) for g in games))
+        for record in records:
+            expected = games[record.game]['game'][record.index]
+            for field in FIELDS:
+                self.assertEqual(getattr(record, field),
+                                 expected.get(field), field)
+
+    def test_iter_records_no_boards(self):
+        """Test moves carry no board unless asked for."""
+        with self.engine:
+            records = list(gnubg.iter_records())
+        self.assertTrue(all(r.board is None for r in records
+                            if r.action == 'move'))
+
+    def test_iter_records_bound_to_session(self):
+        """Test the iterator keeps reading the session it was made in."""
+        with self.engine:
+            it = gnubg.iter_records()
+        first = next(it)
+        self.assertEqual((first.game, first.index), (0, 0))
+        self.assertEqual(len(list(it)) + 1,
+                         sum(1 for _ in self.engine_records()))
+
+    def engine_records(self):
+        with self.engine:
+            return list(gnubg.iter_records())
+
+    def test_iter_records_match_changed(self):
+        """Test changing the match while iterating raises RuntimeError."""
+        with self.engine:
+            it = gnubg.iter_records()
+            next(it)
+            gnubg.command('new match 5')
+            with self.assertRaises(RuntimeError):
+                next(it)
+
+    def test_iter_records_reimported(self):
+        """Test a match imported again over the iterated one is noticed."""
+        with self.engine:
+            it = gnubg.iter_records()
+            next(it)
+            gnubg.import_bytes(TWO_GAMES.encode('ascii'))
+            with self.assertRaises(RuntimeError):
+                next(it)
+
+    def test_iter_records_other_engine(self):
+        """Test changing another engine's match does not end the iteration."""
+        with self.engine:
+            it = gnubg.iter_records()
+            next(it)
+        with gnubg.Engine():
+            gnubg.command('new match 5')
+        self.assertEqual(len(list(it)) + 1, len(self.engine_records()))
+
+    def test_iter_records_empty(self):
+        """Test a session with no match yields nothing."""
+        with gnubg.Engine():
+            self.assertEqual(list(gnubg.iter_records()), [])
+
+
+if __name__ == '__main__':
+    unittest.main()
@@ -0,0 +1,73 @@
+"""
+Tests for the analysis and statistics of match().
+"""
+import unittest
+import gnubg
+from match_fixtures import MatchFileTestCase
+
+
+class TestMatchAnalysis(MatchFileTestCase):
+    """Test match() reports the stored analysis and statistics."""
+
+    def setUp(self):
+        super().setUp()
+        self.import_match()
+
+    def analyse(self):
+        with self.engine:
+            gnubg.command('analyse match')
+
+    def test_match_no_analysis(self):
+        """Test records carry no analysis before the match is analysed."""
+        with self.engine:
+            m = gnubg.match(statistics=1)
+        for record in m['games'][0]['game']:
+            self.assertNotIn('analysis', record)
+
+    def test_match_move_analysis(self):
+        """Test analysed moves report their equity, error and luck."""
+        self.analyse()
+        with self.engine:
+            m = gnubg.match(verbose=1)
+        moves = [r for r in m['games'][0]['game'] if r['action'] == 'move']
+        self.assertTrue(moves)
+        for record in moves:
+            a = record['analysis']
+            self.assertGreaterEqual(a['error'], 0.0)
+            self.assertAlmostEqual(a['best-equity'] - a['equity'],
+                                   a['error'], places=5)
+            self.assertEqual(a['moves'][a['imove']]['move'], record['move'])
+            self.assertIn('luck', a)
+
+    def test_match_cube_analysis(self):
+        """Test the double and the drop report the cube analysis."""
+        self.analyse()
+        with self.engine:
+            m = gnubg.match()
+        cube = [r for r in m['games'][0]['game']
+                if r['action'] in ('double', 'drop')]
+        self.assertEqual(len(cube), 2)
+        for record in cube:
+            self.assertIn('recommendation', record['analysis']['cube'])
+
+    def test_match_statistics(self):
+        """Test game and match statistics add up."""
+        self.analyse()
+        with self.engine:
+            m = gnubg.match(statistics=1)
+        game = m['games'][0]['info']['stats']
+        stats = m['stats']
+        self.assertEqual(stats['games'], 1)
+        for side in ('X', 'O'):
+            self.assertEqual(stats['moves'][side]['unforced-moves'],
+                             game['moves'][side]['unforced-moves'])
+            self.assertEqual(stats['cube'][side]['total-cube'],
+                             game['cube'][side]['total-cube'])
+        self.assertEqual(sum(stats['cube'][side]['doubles']
+                             for side in ('X', 'O')), 1)
+        self.assertEqual(sum(stats['cube'][side]['drops']
+                             for side in ('X', 'O')), 1)
+
+
+if __name__ == '__main__':
+    unittest.main()
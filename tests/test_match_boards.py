@@ -0,0 +1,63 @@
+"""
+Tests for the board formats of match(boards=...).
+"""
+import unittest
+import gnubg
+from match_fixtures import MatchFileTestCase
+
+
+class TestMatchBoards(MatchFileTestCase):
+    """Test position IDs, keys and packed keys describe the same boards."""
+
+    def setUp(self):
+        super().setUp()
+        self.import_match()
+
+    def game(self, boards):
+        with self.engine:
+            return gnubg.match(analysis=0, boards=boards)['games'][0]
+
+    def test_key_matches_id(self):
+        """Test each key decodes to the board of the position ID."""
+        ids = self.game(1)['game']
+        keys = self.game('key')['game']
+        self.assertEqual(len(ids), len(keys))
+        for rid, rkey in zip(ids, keys):
+            self.assertEqual('board' in rid, 'board' in rkey)
+            if 'board' not in rid:
+                continue
+            self.assertIsInstance(rkey['board'], bytes)
+            self.assertEqual(len(rkey['board']), 10)
+            self.assertEqual(gnubg.positionfromkey(tuple(rkey['board'])),
+                             gnubg.positionfromid(rid['board']))
+
+    def test_packed(self):
+        """Test packed holds one key per record and no per-record board."""
+        game = self.game('packed')
+        packed = game['boards']
+        self.assertIsInstance(packed, bytes)
+        self.assertEqual(len(packed), 10 * len(game['game']))
+        self.assertTrue(all('board' not in r for r in game['game']))
+        ids = self.game(True)['game']
+        for i, record in enumerate(ids):
+            if 'board' in record:
+                self.assertEqual(
+                    gnubg.positionfromkey(tuple(packed[10 * i:10 * i + 10])),
+                    gnubg.positionfromid(record['board']))
+
+    def test_no_boards(self):
+        """Test moves carry no board when boards are off."""
+        for boards in (0, False, None):
+            game = self.game(boards)
+            self.assertNotIn('boards', game)
+            self.assertTrue(all('board' not in r for r in game['game']))
+
+    def test_invalid(self):
+        """Test an unknown format is rejected."""
+        with self.engine:
+            with self.assertRaises(ValueError):
+                gnubg.match(boards='array')
+
+
+if __name__ == '__main__':
+    unittest.main()
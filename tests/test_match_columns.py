@@ -0,0 +1,85 @@
+"""
+Tests for match_columns() and export_arrow(): columnar match records.
+"""
+import unittest
+import gnubg
+from match_fixtures import TWO_GAMES, MatchFileTestCase
+
+try:
+    import pyarrow
+except ImportError:
+    pyarrow = None
+
+
+class TestMatchColumns(MatchFileTestCase):
+    """Test the columns agree with the records of the match."""
+
+    MATCH = TWO_GAMES
+
+    def setUp(self):
+        super().setUp()
+        self.import_match()
+        with self.engine:
+            self.records = list(gnubg.iter_records())
+
+    def test_match_columns_rows(self):
+        """Test there is one row per record, in order."""
+        with self.engine:
+            columns = gnubg.match_columns()
+        self.assertEqual(len(columns['game']), len(self.records))
+        for i, record in enumerate(self.records):
+            self.assertEqual(columns['game'][i], record.game)
+            self.assertEqual(columns['record'][i], record.index)
+            self.assertEqual(columns['match'][i], 0)
+
+    def test_match_columns_moves(self):
+        """Test dice and moves match the records."""
+        with self.engine:
+            columns = gnubg.match_columns()
+        dice, move = columns['dice'].tolist(), columns['move'].tolist()
+        for i, record in enumerate(self.records):
+            if record.action != 'move':
+                continue
+            self.assertEqual(tuple(dice[i]), record.dice)
+            pairs = tuple(zip(move[i][::2], move[i][1::2]))
+            self.assertEqual(tuple(p for p in pairs if p[0] >= 0),
+                             record.move)
+
+    def test_match_columns_boards(self):
+        """Test the board columns have 50 values or 10 bytes per row."""
+        with self.engine:
+            array = gnubg.match_columns(boards='array')['board']
+            key = gnubg.match_columns(boards='key')['board']
+        self.assertEqual(array.shape, (len(self.records), 50))
+        self.assertEqual(key.shape, (len(self.records), 10))
+        self.assertEqual(sum(array.tolist()[0]), 30)
+        with self.assertRaises(ValueError):
+            gnubg.match_columns(boards='png')
+
+    def test_match_columns_paths(self):
+        """Test files are numbered by the match column."""
+        columns = gnubg.match_columns(paths=[self.path, self.path])
+        self.assertEqual(len(columns['match']), 2 * len(self.records))
+        self.assertEqual(sorted(set(columns['match'])), [0, 1])
+
+    def test_match_columns_unanalysed(self):
+        """Test equities are NaN without analysis."""
+        with self.engine:
+            equity = gnubg.match_columns()['equity']
+        self.assertTrue(all(e != e for e in equity))
+
+    @unittest.skipUnless(pyarrow, 'pyarrow not installed')
+    def test_export_arrow(self):
+        """Test the IPC stream reads back with the same rows."""
+        with self.engine:
+            data = gnubg.export_arrow(boards='array')
+        table = pyarrow.ipc.open_stream(data).read_all()
+        self.assertEqual(table.num_rows, len(self.records))
+        self.assertEqual(table.schema.field('move').type,
+                         pyarrow.list_(pyarrow.int8(), 8))
+        self.assertEqual(table.column('action').to_pylist(),
+                         [r.action for r in self.records])
+
+
+if __name__ == '__main__':
+    unittest.main()
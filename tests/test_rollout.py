@@ -0,0 +1,87 @@
+"""
+Tests for rollout() with progress callbacks.
+"""
+import unittest
+import gnubg
+
+
+class TestRollout(unittest.TestCase):
+    """Test rollouts of positions and candidate moves."""
+
+    def setUp(self):
+        self.start_board = (
+            (0, 2, 0, 0, 0, 0, 5, 0, 3, 0, 0, 0, 5, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0),
+            (0, 2, 0, 0, 0, 0, 5, 0, 3, 0, 0, 0, 5, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0)
+        )
+        self.cubeinfo = gnubg.cubeinfo(1, -1, 0, 0, (0, 0), 0)
+        # Cubeless, truncated after 5 plies, 36 trials, fixed seed.
+        self.rolloutcontext = gnubg.rolloutcontext(
+            0, 1, 0, 1, 0, 1, 5, 1, 1, 0, 36, 1, 36, 0, 5, 36, 0.01, 2.33)
+
+    def test_rollout_exists(self):
+        """Test that rollout exists."""
+        self.assertTrue(callable(gnubg.rollout))
+
+    def test_rollout_position(self):
+        """Test a rollout returns probabilities, deviations and stats."""
+        r = gnubg.rollout(self.start_board, self.cubeinfo, self.rolloutcontext)
+        for key in ('probs', 'std', 'stats', 'trials'):
+            self.assertIn(key, r)
+        self.assertEqual(len(r['probs']), 7)
+        self.assertEqual(len(r['std']), 7)
+        self.assertEqual(len(r['stats']), 2)
+        self.assertEqual(r['trials'], 36)
+        self.assertGreater(r['probs'][0], 0.0)
+        self.assertLess(r['probs'][0], 1.0)
+
+    def test_rollout_moves(self):
+        """Test rolling out candidate moves returns one result per move."""
+        moves = [(8, 5, 6, 5), (13, 10, 13, 8)]
+        r = gnubg.rollout(self.start_board, self.cubeinfo,
+                          self.rolloutcontext, moves)
+        self.assertEqual(len(r), 2)
+        self.assertEqual(r[0]['move'], (8, 5, 6, 5))
+        self.assertIsInstance(r[1]['movestr'], str)
+        self.assertEqual(r[1]['trials'], 36)
+
+    def test_rollout_progress(self):
+        """Test the progress callback is called with the running totals."""
+        calls = []
+        gnubg.rollout(self.start_board, self.cubeinfo, self.rolloutcontext,
+                      progress=calls.append)
+        self.assertTrue(calls)
+        self.assertEqual(calls[-1]['total'], 36)
+        self.assertIn('probs', calls[-1])
+
+    def test_rollout_progress_stop(self):
+        """Test returning False from the callback stops the rollout early."""
+        rc = dict(self.rolloutcontext, **{'trials': 1296, 'minimum-games': 1296})
+        r = gnubg.rollout(self.start_board, self.cubeinfo, rc,
+                          progress=lambda p: False)
+        self.assertLess(r['trials'], 1296)
+
+    def test_rollout_progress_exception(self):
+        """Test an exception raised by the callback propagates."""
+        def progress(_):
+            raise KeyError('stop')
+        with self.assertRaises(KeyError):
+            gnubg.rollout(self.start_board, self.cubeinfo,
+                          self.rolloutcontext, progress=progress)
+
+    def test_rollout_progress_reentry(self):
+        """Test gnubg calls from the callback raise instead of deadlocking."""
+        def progress(_):
+            gnubg.evaluate(self.start_board, self.cubeinfo)
+        with self.assertRaises(RuntimeError):
+            gnubg.rollout(self.start_board, self.cubeinfo,
+                          self.rolloutcontext, progress=progress)
+
+    def test_rollout_illegal_move(self):
+        """Test an illegal candidate move raises ValueError."""
+        with self.assertRaises(ValueError):
+            gnubg.rollout(self.start_board, self.cubeinfo,
+                          self.rolloutcontext, [(1, 25)])
+
+
+if __name__ == '__main__':
+    unittest.main()
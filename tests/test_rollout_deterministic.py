@@ -0,0 +1,85 @@
+"""
+Tests for deterministic rollouts: rollout(..., deterministic=True).
+"""
+import unittest
+import gnubg
+
+
+def context(seed):
+    """Cubeless rollout truncated after 4 plies, 72 trials."""
+    return gnubg.rolloutcontext(0, 0, 0, 1, 0, 1, 4, 1, 1, 0, 72, seed, 72,
+                                0, 5, 72, 0.01, 2.33)
+
+
+class TestRolloutDeterministic(unittest.TestCase):
+    """Test that deterministic rollouts are reproducible."""
+
+    def setUp(self):
+        self.start_board = (
+            (0, 2, 0, 0, 0, 0, 5, 0, 3, 0, 0, 0, 5, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0),
+            (0, 2, 0, 0, 0, 0, 5, 0, 3, 0, 0, 0, 5, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0)
+        )
+        self.cubeinfo = gnubg.cubeinfo(1, -1, 0, 0, (0, 0), 0)
+
+    def rollout(self, seed=7, **kwargs):
+        return gnubg.rollout(self.start_board, self.cubeinfo, context(seed),
+                             deterministic=True, **kwargs)
+
+    def test_deterministic_repeatable(self):
+        """Test two runs give identical results."""
+        first = self.rollout()
+        self.assertEqual(first, self.rollout())
+        self.assertEqual(first['trials'], 72)
+
+    def test_deterministic_matches_shards(self):
+        """Test the result equals merged shards of the same rollout."""
+        parts = [gnubg.rolloutshard(self.start_board, self.cubeinfo,
+                                    context(7), first=a, last=b)
+                 for a, b in ((0, 5), (5, 41), (41, 72))]
+        merged = gnubg.rolloutresult(gnubg.rolloutmerge(parts))
+        result = self.rollout()
+        self.assertEqual(result['probs'], merged['probs'])
+        self.assertEqual(result['std'], merged['std'])
+
+    def test_deterministic_job(self):
+        """Test the job id identifies the inputs."""
+        self.assertEqual(self.rollout()['job'], self.rollout()['job'])
+        self.assertNotEqual(self.rollout()['job'], self.rollout(seed=8)['job'])
+
+    def test_deterministic_moves(self):
+        """Test move rollouts return one result per move with a job id."""
+        results = self.rollout(moves=[(8, 5, 6, 5), (13, 10, 13, 8)])
+        self.assertEqual(len(results), 2)
+        self.assertIn('job', results[0])
+        self.assertIn('jsd', results[1])
+
+    def test_deterministic_progress_stop(self):
+        """Test returning False from progress stops after a round."""
+        calls = []
+
+        def progress(p):
+            calls.append(p)
+            return False
+        gnubg.rollout(self.start_board, self.cubeinfo,
+                      gnubg.rolloutcontext(0, 0, 0, 1, 0, 1, 4, 1, 1, 0, 1296,
+                                           7, 1296, 0, 5, 1296, 0.01, 2.33),
+                      progress=progress, deterministic=True)
+        self.assertEqual(len(calls), 1)
+        self.assertLess(calls[0]['trials'], calls[0]['total'])
+        self.assertEqual(set(calls[0]), {'trials', 'total'})
+
+    def test_deterministic_cubeful(self):
+        """Test a cubeful context is rolled out with the cube, repeatably."""
+        cubeful = gnubg.rolloutcontext(1, 0, 0, 1, 0, 1, 4, 1, 1, 0, 72, 7,
+                                       72, 0, 5, 72, 0.01, 2.33)
+        result = gnubg.rollout(self.start_board, self.cubeinfo, cubeful,
+                               deterministic=True)
+        self.assertEqual(result, gnubg.rollout(self.start_board,
+                                               self.cubeinfo, cubeful,
+                                               deterministic=True))
+        self.assertNotEqual(result['job'], self.rollout()['job'])
+        self.assertNotEqual(result['probs'][6], 0.0)
+
+
+if __name__ == '__main__':
+    unittest.main()
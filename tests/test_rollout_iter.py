@@ -0,0 +1,68 @@
+"""
+Tests for rollout_iter(), the streaming rollout.
+"""
+import unittest
+import gnubg
+
+
+class TestRolloutIter(unittest.TestCase):
+    """Test rollout snapshots and stopping early."""
+
+    def setUp(self):
+        self.start_board = (
+            (0, 2, 0, 0, 0, 0, 5, 0, 3, 0, 0, 0, 5, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0),
+            (0, 2, 0, 0, 0, 0, 5, 0, 3, 0, 0, 0, 5, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0)
+        )
+        self.cubeinfo = gnubg.cubeinfo(1, -1, 0, 0, (0, 0), 0)
+        # Cubeless, truncated after 4 plies, 72 trials, seed 7.
+        self.rolloutcontext = gnubg.rolloutcontext(
+            0, 0, 0, 1, 0, 1, 4, 1, 1, 0, 72, 7, 72, 0, 5, 72, 0.01, 2.33)
+
+    def test_rollout_iter_exists(self):
+        """Test that rollout_iter exists."""
+        self.assertTrue(callable(gnubg.rollout_iter))
+
+    def test_rollout_iter_snapshots(self):
+        """Test a snapshot is yielded every `every` trials."""
+        snaps = list(gnubg.rollout_iter(self.start_board, self.cubeinfo,
+                                        self.rolloutcontext, every=18))
+        self.assertEqual([s['trials'] for s in snaps], [18, 36, 54, 72])
+        self.assertEqual(snaps[-1]['total'], 72)
+        self.assertEqual(len(snaps[-1]['result']['probs']), 7)
+        self.assertEqual(len(snaps[-1]['result']['std']), 7)
+
+    def test_rollout_iter_matches_shard(self):
+        """Test the final snapshot equals the one-shot result."""
+        it = gnubg.rollout_iter(self.start_board, self.cubeinfo,
+                                self.rolloutcontext, every=20)
+        snaps = list(it)
+        shard = gnubg.rolloutshard(self.start_board, self.cubeinfo,
+                                   self.rolloutcontext)
+        self.assertEqual(snaps[-1]['result'], gnubg.rolloutresult(shard))
+        self.assertEqual(it.shard(), shard)
+
+    def test_rollout_iter_close(self):
+        """Test close() stops the rollout."""
+        it = gnubg.rollout_iter(self.start_board, self.cubeinfo,
+                                self.rolloutcontext, every=18)
+        first = next(it)
+        it.close()
+        self.assertEqual(list(it), [])
+        self.assertEqual(first['trials'], 18)
+        self.assertEqual(gnubg.rolloutresult(it.shard())['trials'], 18)
+
+    def test_rollout_iter_moves_jsd(self):
+        """Test move snapshots carry jsd, zero for the best move."""
+        moves = [(8, 5, 6, 5), (13, 10, 13, 8)]
+        snap = next(gnubg.rollout_iter(self.start_board, self.cubeinfo,
+                                       self.rolloutcontext, moves, every=36))
+        results = snap['result']
+        self.assertEqual(len(results), 2)
+        for r in results:
+            self.assertIn('jsd', r)
+            self.assertIn('movestr', r)
+        self.assertEqual(min(r['jsd'] for r in results), 0.0)
+
+
+if __name__ == '__main__':
+    unittest.main()
@@ -0,0 +1,86 @@
+"""
+Tests for checkpointed rollouts: rolloutshard() and
+rollout(deterministic=True) with a checkpoint file.
+"""
+import os
+import tempfile
+import unittest
+import gnubg
+
+
+class TestRolloutCheckpoint(unittest.TestCase):
+    """Test that resumed rollouts match uninterrupted ones."""
+
+    def setUp(self):
+        self.start_board = (
+            (0, 2, 0, 0, 0, 0, 5, 0, 3, 0, 0, 0, 5, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0),
+            (0, 2, 0, 0, 0, 0, 5, 0, 3, 0, 0, 0, 5, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0)
+        )
+        self.cubeinfo = gnubg.cubeinfo(1, -1, 0, 0, (0, 0), 0)
+        # Cubeless, truncated after 4 plies, 72 trials, seed 7.
+        self.rolloutcontext = gnubg.rolloutcontext(
+            0, 0, 0, 1, 0, 1, 4, 1, 1, 0, 72, 7, 72, 0, 5, 72, 0.01, 2.33)
+        fd, self.path = tempfile.mkstemp(suffix='.ckpt')
+        os.close(fd)
+        os.remove(self.path)
+
+    def tearDown(self):
+        if os.path.exists(self.path):
+            os.remove(self.path)
+
+    def shard(self, **kwargs):
+        return gnubg.rolloutshard(self.start_board, self.cubeinfo,
+                                  self.rolloutcontext, **kwargs)
+
+    def test_checkpoint_written(self):
+        """Test the checkpoint file holds the final shard."""
+        result = self.shard(checkpoint=self.path, interval=20)
+        with open(self.path, 'rb') as f:
+            self.assertEqual(f.read(), result)
+        self.assertEqual(result, self.shard())
+
+    def test_checkpoint_resume(self):
+        """Test a run resumed from a checkpoint equals an uninterrupted one."""
+        self.shard(last=30, checkpoint=self.path, interval=12)
+        resumed = self.shard(checkpoint=self.path, interval=12)
+        self.assertEqual(resumed, self.shard())
+        self.assertEqual(gnubg.rolloutresult(resumed)['trials'], 72)
+
+    def test_checkpoint_other_rollout(self):
+        """Test a checkpoint of another rollout is rejected."""
+        self.shard(last=12, checkpoint=self.path)
+        other = gnubg.rolloutcontext(
+            0, 0, 0, 1, 0, 1, 4, 1, 1, 0, 72, 8, 72, 0, 5, 72, 0.01, 2.33)
+        with self.assertRaises(ValueError):
+            gnubg.rolloutshard(self.start_board, self.cubeinfo, other,
+                               checkpoint=self.path)
+
+    def test_checkpoint_rollout_resume(self):
+        """Test rollout(deterministic=True) resumes from its checkpoint."""
+        context = gnubg.rolloutcontext(
+            0, 0, 0, 1, 0, 1, 4, 1, 1, 0, 720, 7, 720, 0, 5, 720, 0.01, 2.33)
+
+        def rollout(**kwargs):
+            return gnubg.rollout(self.start_board, self.cubeinfo, context,
+                                 deterministic=True, **kwargs)
+        rollout(checkpoint=self.path, progress=lambda p: False)
+        resumed = rollout(checkpoint=self.path)
+        self.assertEqual(resumed, rollout())
+        self.assertEqual(resumed['trials'], 720)
+
+    def test_checkpoint_rollout_needs_deterministic(self):
+        """Test rollout() refuses a checkpoint without deterministic=True."""
+        with self.assertRaises(ValueError):
+            gnubg.rollout(self.start_board, self.cubeinfo,
+                          self.rolloutcontext, checkpoint=self.path)
+
+    def test_checkpoint_invalid_file(self):
+        """Test a file that is not a checkpoint raises OSError."""
+        with open(self.path, 'wb') as f:
+            f.write(b'not a checkpoint')
+        with self.assertRaises(OSError):
+            self.shard(checkpoint=self.path)
+
+
+if __name__ == '__main__':
+    unittest.main()
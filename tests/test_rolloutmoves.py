@@ -0,0 +1,89 @@
+"""
+Tests for rolloutmoves(), the candidate move rollout scheduler.
+"""
+import unittest
+import gnubg
+
+
+def context(trials, min_jsd_games, jsd_limit, stop_on_jsd=1):
+    """Cubeless rollout truncated after 4 plies, seed 7."""
+    return gnubg.rolloutcontext(0, 0, 0, 1, 0, 1, 4, 1, 1, 0, trials, 7,
+                                trials, stop_on_jsd, 5, min_jsd_games, 0.01,
+                                jsd_limit)
+
+
+class TestRolloutMoves(unittest.TestCase):
+    """Test shared-dice candidate rollouts with early dropping."""
+
+    def setUp(self):
+        self.start_board = (
+            (0, 2, 0, 0, 0, 0, 5, 0, 3, 0, 0, 0, 5, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0),
+            (0, 2, 0, 0, 0, 0, 5, 0, 3, 0, 0, 0, 5, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0)
+        )
+        self.cubeinfo = gnubg.cubeinfo(1, -1, 0, 0, (0, 0), 0)
+        # 31 opening: making the 5 point against running a back checker.
+        self.moves = [(8, 5, 6, 5), (24, 21, 24, 23)]
+
+    def test_rolloutmoves_exists(self):
+        """Test that rolloutmoves exists."""
+        self.assertTrue(callable(gnubg.rolloutmoves))
+
+    def test_rolloutmoves_matches_shard(self):
+        """Test without dropping the results equal a shard of the same trials."""
+        rc = context(72, 72, 1000.0)
+        results = gnubg.rolloutmoves(self.start_board, self.moves,
+                                     self.cubeinfo, rc, every=36)
+        shard = gnubg.rolloutresult(gnubg.rolloutshard(
+            self.start_board, self.cubeinfo, rc, self.moves))
+        self.assertEqual(len(results), 2)
+        for r, s in zip(results, shard):
+            self.assertEqual(r['probs'], s['probs'])
+            self.assertEqual(r['trials'], 72)
+            self.assertFalse(r['dropped'])
+        self.assertEqual(results[0]['move'], (8, 5, 6, 5))
+
+    def test_rolloutmoves_drops_decided(self):
+        """Test a decided candidate is dropped and the rollout stops."""
+        results = gnubg.rolloutmoves(self.start_board, self.moves,
+                                     self.cubeinfo, context(720, 36, 0.01),
+                                     every=36)
+        self.assertEqual(sum(r['dropped'] for r in results), 1)
+        best = [r for r in results if not r['dropped']][0]
+        self.assertEqual(best['jsd'], 0.0)
+        self.assertLess(best['trials'], 720)
+
+    def test_rolloutmoves_threads(self):
+        """Test dropping gives the same result with one thread as with four."""
+        threads = gnubg.get_threads()
+        results = []
+        try:
+            for n in (1, 4):
+                gnubg.set_threads(n)
+                results.append(gnubg.rolloutmoves(
+                    self.start_board, self.moves, self.cubeinfo,
+                    context(720, 36, 0.01), every=36))
+        finally:
+            gnubg.set_threads(threads)
+        for a, b in zip(*results):
+            self.assertEqual(a['probs'], b['probs'])
+            self.assertEqual(a['trials'], b['trials'])
+            self.assertEqual(a['dropped'], b['dropped'])
+
+    def test_rolloutmoves_keeps_all_without_stop_on_jsd(self):
+        """Test no candidate is dropped when the context does not stop on jsd."""
+        results = gnubg.rolloutmoves(self.start_board, self.moves,
+                                     self.cubeinfo,
+                                     context(144, 36, 0.01, stop_on_jsd=0),
+                                     every=36)
+        for r in results:
+            self.assertFalse(r['dropped'])
+            self.assertEqual(r['trials'], 144)
+
+    def test_rolloutmoves_illegal_move(self):
+        """Test an illegal candidate raises ValueError."""
+        with self.assertRaises(ValueError):
+            gnubg.rolloutmoves(self.start_board, [(1, 25)])
+
+
+if __name__ == '__main__':
+    unittest.main()
@@ -0,0 +1,117 @@
+"""
+Tests for sharded rollouts: rolloutshard(), rolloutmerge() and rolloutresult().
+"""
+import unittest
+import gnubg
+
+
+class TestRolloutShard(unittest.TestCase):
+    """Test that shards of a rollout merge into the single-run result."""
+
+    def setUp(self):
+        self.start_board = (
+            (0, 2, 0, 0, 0, 0, 5, 0, 3, 0, 0, 0, 5, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0),
+            (0, 2, 0, 0, 0, 0, 5, 0, 3, 0, 0, 0, 5, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0)
+        )
+        self.cubeinfo = gnubg.cubeinfo(1, -1, 0, 0, (0, 0), 0)
+        # Cubeless, truncated after 4 plies, 72 trials, seed 7.
+        self.rolloutcontext = gnubg.rolloutcontext(
+            0, 0, 0, 1, 0, 1, 4, 1, 1, 0, 72, 7, 72, 0, 5, 72, 0.01, 2.33)
+
+    def shard(self, first, last, **kwargs):
+        return gnubg.rolloutshard(self.start_board, self.cubeinfo,
+                                  self.rolloutcontext, first=first, last=last,
+                                  **kwargs)
+
+    def test_rolloutshard_exists(self):
+        """Test that rolloutshard, rolloutmerge and rolloutresult exist."""
+        self.assertTrue(callable(gnubg.rolloutshard))
+        self.assertTrue(callable(gnubg.rolloutmerge))
+        self.assertTrue(callable(gnubg.rolloutresult))
+
+    def test_rolloutshard_result(self):
+        """Test a shard's result has the rollout() keys."""
+        r = gnubg.rolloutresult(self.shard(0, 36))
+        for key in ('probs', 'std', 'stats', 'trials'):
+            self.assertIn(key, r)
+        self.assertEqual(r['trials'], 36)
+        self.assertEqual(len(r['probs']), 7)
+
+    def test_rolloutmerge_exact(self):
+        """Test merged shards equal a single run, in any order."""
+        whole = self.shard(0, 72)
+        parts = [self.shard(0, 10), self.shard(10, 50), self.shard(50, 72)]
+        self.assertEqual(gnubg.rolloutmerge(parts), whole)
+        self.assertEqual(gnubg.rolloutmerge(parts[::-1]), whole)
+        self.assertEqual(gnubg.rolloutresult(gnubg.rolloutmerge(parts)),
+                         gnubg.rolloutresult(whole))
+
+    def test_rolloutmerge_overlap(self):
+        """Test overlapping shards are rejected."""
+        with self.assertRaises(ValueError):
+            gnubg.rolloutmerge([self.shard(0, 20), self.shard(10, 30)])
+
+    def test_rolloutmerge_other_rollout(self):
+        """Test shards of different rollouts are rejected."""
+        other = gnubg.rolloutshard(self.start_board, self.cubeinfo,
+                                   gnubg.rolloutcontext(
+                                       0, 0, 0, 1, 0, 1, 4, 1, 1, 0, 72, 8,
+                                       72, 0, 5, 72, 0.01, 2.33),
+                                   first=20, last=30)
+        with self.assertRaises(ValueError):
+            gnubg.rolloutmerge([self.shard(0, 20), other])
+
+    def test_rolloutshard_moves(self):
+        """Test shards of candidate moves give one result per move."""
+        moves = [(8, 5, 6, 5), (13, 10, 13, 8)]
+        parts = [self.shard(0, 18, moves=moves), self.shard(18, 36, moves=moves)]
+        r = gnubg.rolloutresult(gnubg.rolloutmerge(parts))
+        self.assertEqual(len(r), 2)
+        self.assertEqual(r[0]['trials'], 36)
+
+    def test_rolloutshard_cubeful(self):
+        """Test cubeful shards report a cubeful equity and merge exactly."""
+        cubeful = gnubg.rolloutcontext(
+            1, 0, 0, 1, 0, 1, 4, 1, 1, 0, 72, 7, 72, 0, 5, 72, 0.01, 2.33)
+
+        def shard(first, last):
+            return gnubg.rolloutshard(self.start_board, self.cubeinfo,
+                                      cubeful, first=first, last=last)
+
+        whole = shard(0, 36)
+        self.assertEqual(gnubg.rolloutmerge([shard(0, 12), shard(12, 36)]),
+                         whole)
+        r = gnubg.rolloutresult(whole)
+        self.assertNotEqual(r['probs'][6], 0.0)
+        with self.assertRaises(ValueError):
+            gnubg.rolloutmerge([self.shard(0, 12), shard(12, 36)])
+
+    def test_rolloutshard_cube_passed(self):
+        """Test a hopeless race ends with the opponent's double passed."""
+        board = (
+            (0, 0, 0, 0, 2, 2, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0),
+            (3, 3, 3, 3, 3, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0)
+        )
+        # Cubeful, no truncation, so the game reaches a cube decision.
+        cubeful = gnubg.rolloutcontext(
+            1, 0, 0, 1, 0, 0, 0, 0, 0, 0, 36, 7, 36, 0, 5, 36, 0.01, 2.33)
+        r = gnubg.rolloutresult(gnubg.rolloutshard(board, self.cubeinfo,
+                                                   cubeful))
+        self.assertGreater(r['stats'][1]['doubledrop'][0], 0)
+        self.assertLess(r['probs'][6], -0.9)
+
+    def test_rolloutshard_cubeless(self):
+        """Test no cubeful equity is reported and game statistics are kept."""
+        r = gnubg.rolloutresult(self.shard(0, 36))
+        self.assertEqual(r['probs'][6], 0.0)
+        self.assertEqual(r['std'][6], 0.0)
+        self.assertGreater(sum(s['opponenthit'] for s in r['stats']), 0)
+
+    def test_rolloutresult_invalid(self):
+        """Test bytes that are not a shard raise ValueError."""
+        with self.assertRaises(ValueError):
+            gnubg.rolloutresult(b'not a shard')
+
+
+if __name__ == '__main__':
+    unittest.main()
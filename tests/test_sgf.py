@@ -0,0 +1,58 @@
+"""
+Tests for loading SGF matches with the built-in reader.
+"""
+import os
+import unittest
+import gnubg
+from match_fixtures import MatchFileTestCase
+
+
+class TestSGF(MatchFileTestCase):
+    """Test matches saved as SGF load back with their analysis."""
+
+    def setUp(self):
+        super().setUp()
+        self.sgf = os.path.join(self.tmpdir.name, 'match.sgf')
+        self.import_match()
+        with self.engine:
+            gnubg.command('analyse match')
+            gnubg.command('save match "%s"' % self.sgf)
+            self.expected = gnubg.match()
+
+    def assertSameMatch(self, m):
+        self.assertEqual(m['match-info']['match-length'], 3)
+        self.assertEqual(len(m['games']), 1)
+        game, expected = m['games'][0]['game'], self.expected['games'][0]['game']
+        self.assertEqual([r['action'] for r in game],
+                         [r['action'] for r in expected])
+        for record, want in zip(game, expected):
+            self.assertEqual('analysis' in record, 'analysis' in want)
+            if record['action'] == 'move':
+                self.assertAlmostEqual(record['analysis']['error'],
+                                       want['analysis']['error'], places=4)
+
+    def test_load_match(self):
+        """Test "load match" reads an SGF file with its analysis."""
+        with gnubg.Engine():
+            gnubg.command('load match "%s"' % self.sgf)
+            self.assertSameMatch(gnubg.match())
+
+    def test_import_bytes_sgf(self):
+        """Test import_bytes reads SGF data from memory."""
+        with open(self.sgf, 'rb') as f:
+            data = f.read()
+        with gnubg.Engine():
+            gnubg.import_bytes(data, format='sgf')
+            self.assertSameMatch(gnubg.match())
+
+    def test_import_bytes_sgf_errors(self):
+        """Test malformed SGF raises ValueError."""
+        with gnubg.Engine():
+            with self.assertRaises(ValueError):
+                gnubg.import_bytes(b'(;FF[4]GM[6]C[unterminated', format='sgf')
+            with self.assertRaises(ValueError):
+                gnubg.import_bytes(b'(;FF[4]GM[1])', format='sgf')
+
+
+if __name__ == '__main__':
+    unittest.main()
@@ -0,0 +1,48 @@
+"""
+Tests for taskstats() and the work-stealing engine task scheduler.
+"""
+import unittest
+import gnubg
+
+
+class TestTaskStats(unittest.TestCase):
+    """Test the scheduler counters."""
+
+    def setUp(self):
+        self.start_board = (
+            (0, 2, 0, 0, 0, 0, 5, 0, 3, 0, 0, 0, 5, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0),
+            (0, 2, 0, 0, 0, 0, 5, 0, 3, 0, 0, 0, 5, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0)
+        )
+        self.cubeinfo = gnubg.cubeinfo(1, -1, 0, 0, (0, 0), 0)
+        self.evalcontext = gnubg.evalcontext(1, 0, 0, 0, 0.0)
+
+    def test_taskstats_keys(self):
+        """Test taskstats returns all counters."""
+        stats = gnubg.taskstats()
+        for key in ('batches', 'tasks', 'steals', 'steal_rate', 'queue_wait',
+                    'queue_wait_max'):
+            self.assertIn(key, stats)
+
+    def test_taskstats_counts_batch(self):
+        """Test a batch is counted and every task in it is run."""
+        gnubg.taskstats(reset=True)
+        positions = [(self.start_board, self.cubeinfo)] * 100
+        results = gnubg.cubedecisions(positions, self.evalcontext)
+        self.assertEqual(len(results), 100)
+        self.assertTrue(all('decision' in cd for cd in results))
+        stats = gnubg.taskstats()
+        self.assertEqual(stats['batches'], 1)
+        self.assertEqual(stats['tasks'], 100)
+        self.assertGreaterEqual(stats['steal_rate'], 0.0)
+        self.assertGreaterEqual(stats['queue_wait_max'], stats['queue_wait'])
+
+    def test_taskstats_reset(self):
+        """Test reset clears the counters after returning them."""
+        gnubg.cubedecisions([(self.start_board, self.cubeinfo)] * 4,
+                            self.evalcontext)
+        self.assertGreater(gnubg.taskstats(reset=True)['tasks'], 0)
+        self.assertEqual(gnubg.taskstats()['tasks'], 0)
+
+
+if __name__ == '__main__':
+    unittest.main()
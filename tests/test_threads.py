@@ -0,0 +1,67 @@
+"""
+Tests for set_threads() and get_threads().
+"""
+import os
+import sys
+import unittest
+import gnubg
+
+
+class TestThreads(unittest.TestCase):
+    """Test resizing the engine thread pool."""
+
+    def setUp(self):
+        self.threads = gnubg.get_threads()
+        self.start_board = (
+            (0, 2, 0, 0, 0, 0, 5, 0, 3, 0, 0, 0, 5, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0),
+            (0, 2, 0, 0, 0, 0, 5, 0, 3, 0, 0, 0, 5, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0)
+        )
+        self.cubeinfo = gnubg.cubeinfo(1, -1, 0, 0, (0, 0), 0)
+
+    def tearDown(self):
+        gnubg.set_threads(self.threads)
+
+    def test_get_threads(self):
+        """Test the default pool has at least one thread."""
+        self.assertIsInstance(self.threads, int)
+        self.assertGreaterEqual(self.threads, 1)
+
+    def test_set_threads(self):
+        """Test the pool can be shrunk and grown."""
+        gnubg.set_threads(1)
+        self.assertEqual(gnubg.get_threads(), 1)
+        gnubg.set_threads(64)
+        self.assertEqual(gnubg.get_threads(), 64)
+
+    def test_set_threads_invalid(self):
+        """Test a thread count below one raises ValueError."""
+        with self.assertRaises(ValueError):
+            gnubg.set_threads(0)
+        self.assertEqual(gnubg.get_threads(), self.threads)
+
+    def test_results_independent_of_threads(self):
+        """Test a deterministic rollout does not depend on the pool size."""
+        rc = gnubg.rolloutcontext(0, 0, 0, 1, 0, 1, 4, 1, 1, 0, 72, 7, 72,
+                                  0, 5, 72, 0.01, 2.33)
+        results = []
+        for n in (1, 3, 8):
+            gnubg.set_threads(n)
+            results.append(gnubg.rollout(self.start_board, self.cubeinfo, rc,
+                                         deterministic=True))
+        self.assertEqual(results[0], results[1])
+        self.assertEqual(results[0], results[2])
+
+    @unittest.skipUnless(sys.platform.startswith('linux'), 'Linux only')
+    def test_set_threads_pinned(self):
+        """Test workers can be pinned to the CPUs this process may use."""
+        cpus = sorted(os.sched_getaffinity(0))
+        gnubg.set_threads(2, cpus)
+        self.assertEqual(gnubg.get_threads(), 2)
+        with self.assertRaises(ValueError):
+            gnubg.set_threads(2, [])
+        with self.assertRaises(ValueError):
+            gnubg.set_threads(2, [-1])
+
+
+if __name__ == '__main__':
+    unittest.main()
@@ -0,0 +1,73 @@
+#!/usr/bin/env python3
+# Compare gnubg.hintmoves() with the plain movefilter search against the
+# top-k search (k=1 and k=3) on random positions from self-play.
+# Usage: python3 tools/bench_topk.py [positions] [plies]
+import random
+import sys
+import time
+
+import gnubg
+
+
+def positions(n, seed=1):
+    """Return n (board, dice) pairs reached by 0-ply self-play."""
+    rng = random.Random(seed)
+    ec0 = gnubg.evalcontext(1, 0, 1, 0, 0.0)
+    out = []
+    while len(out) < n:
+        board = gnubg.positionfromid('4HPwATDgc/ABMA')
+        while board is not None and len(out) < n:
+            dice = (rng.randint(1, 6), rng.randint(1, 6))
+            moves = gnubg.hintmoves(board, dice, None, ec0, None, 1)
+            if moves and moves[0]['move']:
+                out.append((board, dice))
+                board = apply_and_swap(board, moves[0]['move'])
+            else:
+                board = (board[1], board[0])
+    return out
+
+
+def apply_and_swap(board, move):
+    """Play move (1-based from/to pairs) for the player on roll, then swap."""
+    me = list(board[1])
+    opp = list(board[0])
+    for i in range(0, len(move), 2):
+        src, dst = move[i] - 1, move[i + 1] - 1
+        me[src] -= 1
+        if dst >= 0:  # 0 (-1 here) is off
+            me[dst] += 1
+            if opp[23 - dst] == 1:
+                opp[23 - dst] = 0
+                opp[24] += 1
+    if sum(me) == 0:
+        return None
+    return (tuple(me), tuple(opp))
+
+
+def run(samples, ec, k):
+    start = time.perf_counter()
+    best = []
+    for board, dice in samples:
+        moves = gnubg.hintmoves(board, dice, None, ec, None, -1, k)
+        best.append(moves[0]['move'] if moves else ())
+    return time.perf_counter() - start, best
+
+
+def main():
+    n = int(sys.argv[1]) if len(sys.argv) > 1 else 200
+    plies = int(sys.argv[2]) if len(sys.argv) > 2 else 2
+    samples = positions(n)
+    ec = gnubg.evalcontext(1, plies, 1, 1, 0.0)
+
+    base_time, base_best = run(samples, ec, 0)
+    print(f'{len(samples)} positions, {plies}-ply')
+    print(f'  movefilters   {base_time:8.3f}s')
+    for k in (1, 3):
+        t, best = run(samples, ec, k)
+        same = sum(a == b for a, b in zip(base_best, best))
+        print(f'  top-k k={k}     {t:8.3f}s  speedup {base_time / t:5.2f}x  '
+              f'same best move {same}/{len(samples)}')
+
+
+if __name__ == '__main__':
+    main()